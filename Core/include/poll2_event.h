@@ -0,0 +1,102 @@
+/** \file poll2_event.h
+  *
+  * \brief epoll based event loop used by programs which receive poll2 data
+  *
+  * \date Oct. 18th, 2026
+  *
+  * The EventLoop class watches any number of file descriptors (data, stats or
+  * control sockets, stream connections, signalfds, etc.) with a single epoll
+  * instance and calls a callback for each one which becomes ready. Periodic
+  * timers (timerfd) are handled the same way. Every call to RunOnce waits for
+  * one batch of up to EVENT_LOOP_BATCH ready descriptors and dispatches them
+  * all before waiting again, so callbacks should drain their socket (e.g. with
+  * recvmmsg) rather than read a single packet. Stop may be called from any
+  * thread and wakes the loop immediately through an eventfd.
+*/
+
+#ifndef POLL2_EVENT_H
+#define POLL2_EVENT_H
+
+#include <map>
+#include <memory>
+#include <functional>
+#include <atomic>
+
+#include <sys/epoll.h>
+
+#define POLL2_EVENT_VERSION "1.0.00"
+#define POLL2_EVENT_DATE "Oct. 18th, 2026"
+
+// Maximum number of ready file descriptors dispatched by a single call to RunOnce
+#define EVENT_LOOP_BATCH 64
+
+/// Called with the file descriptor and the epoll events (EPOLLIN, EPOLLERR, etc.) which woke the loop.
+typedef std::function<void(int, unsigned int)> EventCallback;
+
+/// Called every time a timer expires.
+typedef std::function<void()> TimerCallback;
+
+class EventLoop{
+  private:
+	int epoll_fd;
+	int wake_fd; /// eventfd used by Stop to wake the loop
+	bool init;
+	std::atomic<bool> stopped;
+
+	std::map<int, std::shared_ptr<EventCallback> > handlers; /// Callback for each watched file descriptor
+	std::map<int, bool> owned; /// File descriptors created (and closed) by the loop (timers)
+
+	unsigned long long num_wakeups; /// Number of times epoll_wait returned with events
+	unsigned long long num_events; /// Number of callbacks dispatched
+
+  public:
+	EventLoop();
+
+	~EventLoop();
+
+	/// Create the epoll instance and the wakeup eventfd. Returns false on failure.
+	bool Init();
+
+	/** Watch fd_ for events_ (EPOLLIN by default, level triggered) and call callback_ whenever
+	  * it is ready. A descriptor may only be added once. Returns false on failure. */
+	bool Add(int fd_, EventCallback callback_, unsigned int events_=EPOLLIN);
+
+	/// Change the events watched for fd_. Returns false if fd_ is not being watched.
+	bool Modify(int fd_, unsigned int events_);
+
+	/** Stop watching fd_. This is safe to call from inside a callback, including for the
+	  * descriptor being dispatched, and for descriptors which have already been closed. */
+	bool Remove(int fd_);
+
+	/** Call callback_ every interval_ms_ milliseconds, starting interval_ms_ from now.
+	  * Returns the timer's file descriptor, which may be passed to Remove, or -1 on failure. */
+	int AddTimer(int interval_ms_, TimerCallback callback_);
+
+	/** Wait up to timeout_ms_ milliseconds (-1 waits forever) for a batch of events and
+	  * dispatch them. Returns the number of callbacks called, or -1 if the loop was stopped. */
+	int RunOnce(int timeout_ms_=-1);
+
+	/// Dispatch events until Stop is called.
+	void Run();
+
+	/// Make Run (or the current RunOnce) return as soon as possible. Safe to call from any thread.
+	void Stop();
+
+	/// Allow Run to be called again after Stop.
+	void Reset(){ stopped = false; }
+
+	bool IsStopped(){ return stopped; }
+
+	bool IsInit(){ return init; }
+
+	unsigned int GetNumWatched(){ return handlers.size(); }
+
+	unsigned long long GetWakeups(){ return num_wakeups; }
+
+	unsigned long long GetEvents(){ return num_events; }
+
+	/// Close the epoll instance, the wakeup eventfd and any timers.
+	void Close();
+};
+
+#endif
@@ -0,0 +1,82 @@
+/** \file poll2_history.h
+  *
+  * \brief Fixed size history of rates for trends and percentiles
+  *
+  * \date Oct. 18th, 2026
+  *
+  * The run totals and the rates of the last stats interval hide how much a
+  * rate moves about. A RateHistory keeps the last N samples of a number of
+  * series (e.g. the rate of every channel) in a ring which is allocated once,
+  * so adding a sample costs one store per series and nothing is allocated
+  * during a run. The min, mean, max and 95th percentile of a series may be
+  * queried over any window of the most recent samples, and a window may be
+  * drawn as a sparkline for a terminal.
+*/
+
+#ifndef POLL2_HISTORY_H
+#define POLL2_HISTORY_H
+
+#include <vector>
+#include <string>
+#include <cstddef>
+
+#define POLL2_HISTORY_VERSION "1.1.00"
+#define POLL2_HISTORY_DATE "Oct. 18th, 2026"
+
+/// Summary of a window of samples of one series.
+struct HistorySummary{
+	size_t samples; /// Number of samples in the window
+	double min;
+	double mean;
+	double max;
+	double p95; /// 95th percentile (nearest rank)
+
+	HistorySummary() : samples(0), min(0.0), mean(0.0), max(0.0), p95(0.0) { }
+};
+
+class RateHistory{
+  private:
+	size_t num_series; /// Values in each sample
+	size_t length; /// Number of samples kept
+	size_t head; /// Slot of the next sample
+	size_t count; /// Number of samples held
+
+	std::vector<double> values; /// length samples of num_series values each
+
+  public:
+	RateHistory();
+
+	/// Keep length_ samples of nSeries_ values each, dropping any samples held.
+	void Init(size_t nSeries_, size_t length_);
+
+	/// Return the values of the next sample, to be filled in before calling Commit. Returns NULL if not initialized.
+	double *Next(){ return (length > 0 ? &values[head*num_series] : NULL); }
+
+	/// Add the sample filled in through Next, dropping the oldest sample if the history is full.
+	void Commit();
+
+	/// Drop every sample.
+	void Clear();
+
+	/** Fill values_ with the last window_ samples of series_ (or every sample if window_ is 0),
+	  * oldest first. Returns the number of samples. */
+	size_t GetValues(size_t series_, size_t window_, std::vector<double> &values_) const;
+
+	/// Summarize the last window_ samples of series_ (or every sample if window_ is 0). Returns false if there are none.
+	bool GetSummary(size_t series_, size_t window_, HistorySummary &summary_) const;
+
+	size_t GetNumSeries() const { return num_series; }
+
+	size_t GetLength() const { return length; }
+
+	size_t GetCount() const { return count; }
+
+	/// Summarize a list of values.
+	static HistorySummary Summarize(const std::vector<double> &values_);
+
+	/** Draw values_ as a line of block characters (UTF-8), or of ASCII characters if ascii_ is set for
+	  * terminals which cannot draw them, scaled from the smallest to the largest value. */
+	static std::string Sparkline(const std::vector<double> &values_, bool ascii_=false);
+};
+
+#endif
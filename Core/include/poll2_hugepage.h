@@ -0,0 +1,122 @@
+/** \file poll2_hugepage.h
+  *
+  * \brief Spill buffers backed by 2 MB huge pages
+  *
+  * \date Oct. 18th, 2026
+  *
+  * A spill of a full crate is several MB long, so scanning one with 4 kB
+  * pages walks through hundreds of TLB entries. The HugePageRegion class
+  * maps memory which is backed by huge pages where the system allows it,
+  * trying in turn:
+  *  hugetlb - MAP_HUGETLB pages from the pool reserved in
+  *            /proc/sys/vm/nr_hugepages (the only sure way to get them)
+  *  thp     - ordinary memory aligned to 2 MB and marked MADV_HUGEPAGE, which
+  *            the kernel backs with transparent huge pages unless they are
+  *            turned off in /sys/kernel/mm/transparent_hugepage/enabled
+  *  pages   - ordinary memory, if neither of the above is possible
+  * Every page is touched when the region is mapped, so no page faults are
+  * taken while the buffers are in use.
+  *
+  * The SpillBufferPool class carves a region into a number of equal blocks
+  * which are handed out and returned by the spill readers. Every block
+  * starts on a HUGE_BLOCK_ALIGN boundary, so SIMD decoders may use aligned
+  * loads at the start of any block.
+*/
+
+#ifndef POLL2_HUGEPAGE_H
+#define POLL2_HUGEPAGE_H
+
+#include <vector>
+#include <mutex>
+#include <cstddef>
+
+#define POLL2_HUGEPAGE_VERSION "1.0.00"
+#define POLL2_HUGEPAGE_DATE "Oct. 18th, 2026"
+
+// Size of a huge page (in bytes)
+#define HUGE_PAGE_SIZE 2097152
+
+// Alignment of every block of a SpillBufferPool (in bytes)
+#define HUGE_BLOCK_ALIGN 4096
+
+// What a HugePageRegion is backed by
+#define HUGE_BACKING_NONE 0 /// Nothing is mapped
+#define HUGE_BACKING_HUGETLB 1 /// Reserved huge pages (MAP_HUGETLB)
+#define HUGE_BACKING_THP 2 /// Transparent huge pages (MADV_HUGEPAGE)
+#define HUGE_BACKING_PAGES 3 /// Ordinary pages
+
+class HugePageRegion{
+  private:
+	void *base; /// Start of the usable memory
+	size_t size; /// Usable bytes
+	void *map_base; /// Start of the mapping, which may be larger than the usable memory
+	size_t map_size; /// Bytes mapped
+	int backing;
+
+  public:
+	HugePageRegion();
+
+	~HugePageRegion(){ Free(); }
+
+	/** Map at least bytes_ of memory, backed by huge pages if possible unless allowHuge_ is false.
+	  * Any memory already mapped is freed. Returns false if nothing could be mapped. */
+	bool Allocate(size_t bytes_, bool allowHuge_=true);
+
+	/// Unmap the memory.
+	void Free();
+
+	void *Get(){ return base; }
+
+	size_t GetSize(){ return size; }
+
+	int GetBacking(){ return backing; }
+
+	/// Return the alignment of the start of the region (in bytes).
+	size_t GetAlignment();
+
+	/// Return a short name for a backing (e.g. "hugetlb").
+	static const char *BackingName(int backing_);
+};
+
+class SpillBufferPool{
+  private:
+	HugePageRegion region;
+	size_t block_words; /// Usable words in each block
+	size_t stride; /// Distance between the starts of two blocks (in bytes)
+	size_t num_blocks;
+
+	std::vector<unsigned int*> free_blocks;
+	std::mutex pool_lock; /// Get and Put may be called from any thread
+
+  public:
+	SpillBufferPool();
+
+	/** Map nBlocks_ blocks of at least nWords_ words each, dropping any blocks mapped before (every
+	  * block must have been returned). Returns false if the memory could not be mapped. */
+	bool Init(size_t nBlocks_, size_t nWords_, bool allowHuge_=true);
+
+	/// Take a free block, or return NULL if every block is in use.
+	unsigned int *Get();
+
+	/// Return a block taken with Get.
+	void Put(unsigned int *block_);
+
+	/// Unmap every block.
+	void Free();
+
+	size_t GetBlockWords(){ return block_words; }
+
+	size_t GetNumBlocks(){ return num_blocks; }
+
+	size_t GetNumFree();
+
+	/// Return the total number of bytes mapped for the blocks.
+	size_t GetSize(){ return region.GetSize(); }
+
+	int GetBacking(){ return region.GetBacking(); }
+
+	/// Return the alignment every block is guaranteed to start on (in bytes).
+	size_t GetAlignment(){ return HUGE_BLOCK_ALIGN; }
+};
+
+#endif
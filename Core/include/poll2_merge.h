@@ -0,0 +1,210 @@
+/** \file poll2_merge.h
+  *
+  * \brief Merges the spills of several crates into one stream ordered by event time
+  *
+  * \date Oct. 18th, 2026
+  *
+  * Every crate runs its own poll2, so the events of an experiment with
+  * several crates arrive as several streams of spills. The TimeMerger class
+  * takes the spills of each crate (a "source"), adds the clock offset of the
+  * crate to the 48 bit timestamp of every event and merges the events of all
+  * of the sources by time.
+  *
+  * Events are held until no source can still send an earlier one. Each
+  * source is assumed to send its events in time order, give or take the hold
+  * time, so the watermark
+  *  min(latest event time of each live source) - hold
+  * only moves forward, and every event before it may be released. A source
+  * is not live once it has disconnected, or once it has sent no events for
+  * longer than the idle timeout, so a quiet or dead crate never stalls the
+  * others. If more than the buffer limit is held, the earliest events are
+  * released anyway until half of the limit is left. Events which arrive
+  * after the merged stream has passed their time are released with the next
+  * spill and counted as late.
+  *
+  * Released events are written as spills made of one [length, module,
+  * events...] record for every module of every crate, in module order, just
+  * like the spills of a single crate. The modules of each crate are numbered
+  * after those of the crates before it, and the events in each record and
+  * from one spill to the next are in time order. The timestamps written are
+  * the corrected ones.
+*/
+
+#ifndef POLL2_MERGE_H
+#define POLL2_MERGE_H
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <functional>
+
+#define POLL2_MERGE_VERSION "1.0.00"
+#define POLL2_MERGE_DATE "Oct. 18th, 2026"
+
+// Event timestamps are 48 bits long
+#define MERGE_TIME_MASK 0xFFFFFFFFFFFFULL
+
+// Module numbers at or above this are not module data (wall clock, end of spill, etc.)
+#define MERGE_FIRST_SPECIAL_VSN 1000
+
+// Default time events are held for stragglers from the same source (in clock ticks, 1 ms at 8 ns)
+#define MERGE_DEFAULT_HOLD 125000
+
+// Default time after which a source which has sent no events no longer holds the others back (in seconds)
+#define MERGE_DEFAULT_TIMEOUT 5.0
+
+// Default number of words which may be held before events are released early (64 MB)
+#define MERGE_DEFAULT_BUFFER 16777216
+
+// Largest merged spill (in words), longer releases are split
+#define MERGE_MAX_SPILL 1048576
+
+/// Called with every merged spill and its length (in words).
+typedef std::function<void(unsigned int *, size_t)> MergeCallback;
+
+/// An event held by the merger.
+struct MergeEvent{
+	unsigned long long time; /// Corrected event time (in clock ticks)
+	unsigned long long spill; /// Number of the spill holding the event, counted per source
+	unsigned int offset; /// Index of the first word of the event in its spill
+	unsigned int nWords; /// Length of the event (in words)
+	unsigned int module; /// Module number within the source
+
+	bool operator < (const MergeEvent &other_) const { return (time < other_.time); }
+};
+
+/// A spill held by the merger until all of its events have been released.
+struct MergeSpill{
+	std::vector<unsigned int> data;
+	size_t nWords;
+	size_t remaining; /// Events not yet released
+};
+
+/// Status of one source, for status displays.
+struct MergeSourceInfo{
+	std::string name;
+	long long offset; /// Clock offset added to every event (in clock ticks)
+	unsigned int first_module; /// Number of the first module of the source in the merged spills
+	unsigned int num_modules; /// Number of modules (0 until the first spill if not given)
+	bool connected;
+	bool idle; /// Set if the source has timed out
+	unsigned long long latest; /// Latest corrected event time seen
+	size_t events_held;
+	size_t words_held;
+	unsigned long long spills_in;
+	unsigned long long events_in;
+	unsigned long long events_late; /// Events which arrived after the merged stream had passed them
+	unsigned long long events_dropped; /// Events of modules beyond num_modules
+};
+
+class TimeMerger{
+  private:
+	/// One crate being merged.
+	struct MergeSource{
+		MergeSourceInfo info;
+		bool fixed_modules; /// Set if the number of modules was given rather than learned
+		bool have_base; /// Set once first_module has been given out
+		bool have_latest; /// Set once an event has been seen
+		double last_time; /// Time the last spill with events arrived, or the source connected (monotonic, in seconds, -1 if not yet known)
+
+		std::deque<MergeEvent> events; /// Events not yet released, in time order
+		std::deque<MergeSpill*> spills; /// Spills holding those events, oldest first
+		unsigned long long first_spill; /// Number of the spill at the front of spills
+	};
+
+	std::vector<MergeSource*> sources;
+	std::vector<MergeSpill*> spare; /// Spills with no events left, kept for reuse
+	std::vector<MergeEvent> incoming; /// Events of the spill being added
+
+	unsigned long long hold; /// Time held back from the watermark (in clock ticks)
+	double timeout; /// Idle timeout (in seconds)
+	size_t max_words; /// Words which may be held before events are released early
+	size_t words_held;
+
+	unsigned int num_modules; /// Modules in the merged spills
+
+	unsigned long long last_released; /// Time of the latest event released
+	bool have_released; /// Set once an event has been released
+
+	std::vector<std::vector<unsigned int> > blocks; /// Released events of every merged module
+	size_t block_words; /// Words of events in blocks
+	std::vector<unsigned int> output; /// The merged spill being built
+	MergeCallback callback;
+
+	unsigned long long num_spills_out;
+	unsigned long long num_events_out;
+	unsigned long long num_words_out;
+	unsigned long long num_forced; /// Releases forced by the buffer limit
+
+	/// Give module numbers to every source which does not have them yet.
+	void assign_modules();
+
+	/// Return the time before which every event may be released, or false if there is none.
+	bool get_watermark(unsigned long long &watermark_, double now_);
+
+	/** Release the events before until_, earliest first, stopping early once no more than target_ words
+	  * are held, and send the merged spill. */
+	void release(unsigned long long until_, size_t target_);
+
+	/// Move one event into the blocks, sending a spill first if it would not fit.
+	void take_event(MergeSource *source_, const MergeEvent &event_);
+
+	/// Drop the spills at the front of a source with no events left.
+	void trim_spills(MergeSource *source_);
+
+	/// Build a merged spill from the blocks and hand it to the callback.
+	void send_spill();
+
+  public:
+	TimeMerger();
+
+	~TimeMerger();
+
+	/** Add a source called name_ with a clock offset of offset_ ticks. If nModules_ is zero, the number
+	  * of modules is taken from its first spill. Returns the index of the source. */
+	size_t AddSource(const std::string &name_, long long offset_=0, unsigned int nModules_=0);
+
+	/// Set the function called with every merged spill.
+	void SetCallback(MergeCallback callback_){ callback = callback_; }
+
+	void SetHold(unsigned long long ticks_){ hold = ticks_; }
+
+	void SetTimeout(double seconds_){ timeout = seconds_; }
+
+	void SetBufferSize(size_t words_){ max_words = words_; }
+
+	/** Take the spill of nWords_ words in buffer_ from source source_, swapping buffer_ with an empty
+	  * buffer. now_ is the current time (monotonic, in seconds). Returns false if the spill is corrupt,
+	  * in which case the events read before the error are kept. */
+	bool AddSpill(size_t source_, std::vector<unsigned int> &buffer_, size_t nWords_, double now_);
+
+	/// Mark a source as connected or not. A disconnected source does not hold the others back.
+	void SetConnected(size_t source_, bool state_);
+
+	/// Release every event which may be released at time now_ (monotonic, in seconds).
+	void Service(double now_);
+
+	/// Release every event held, whatever the watermark.
+	void Flush();
+
+	/// Fill sources_ with the status of every source.
+	void GetSources(std::vector<MergeSourceInfo> &sources_);
+
+	size_t GetNumSources(){ return sources.size(); }
+
+	unsigned int GetNumModules(){ return num_modules; }
+
+	size_t GetWordsHeld(){ return words_held; }
+
+	unsigned long long GetLastReleased(){ return last_released; }
+
+	unsigned long long GetSpillsOut(){ return num_spills_out; }
+
+	unsigned long long GetEventsOut(){ return num_events_out; }
+
+	unsigned long long GetWordsOut(){ return num_words_out; }
+
+	unsigned long long GetForcedReleases(){ return num_forced; }
+};
+
+#endif
@@ -0,0 +1,148 @@
+/** \file poll2_metrics.h
+  *
+  * \brief Minimal HTTP server exporting poll2 metrics in the Prometheus text format
+  *
+  * \date Oct. 18th, 2026
+  *
+  * The MetricsServer class listens on a local TCP port or a Unix domain
+  * socket and answers "GET /metrics" with a page of metrics in the
+  * Prometheus text exposition format (version 0.0.4), so poll2 may be scraped
+  * by Prometheus or read with curl without any other service running.
+  *
+  * The server runs on a thread of its own and never touches the readout.
+  * The page is built by a callback, which must only read state that is safe
+  * to read from another thread. To keep a busy scraper from costing the
+  * readout anything, the page is built at most once every min_interval
+  * seconds and every request in between is served the same page. The number
+  * of connections, the size of a request and the time a client may take are
+  * all limited, and every socket is non-blocking.
+*/
+
+#ifndef POLL2_METRICS_H
+#define POLL2_METRICS_H
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <functional>
+
+#define POLL2_METRICS_VERSION "1.0.00"
+#define POLL2_METRICS_DATE "Oct. 18th, 2026"
+
+// Minimum time between two builds of the metrics page (in s)
+#define METRICS_MIN_INTERVAL 1.0
+
+// Maximum number of clients connected at once
+#define METRICS_MAX_CLIENTS 8
+
+// Maximum size of a request (in bytes)
+#define METRICS_MAX_REQUEST 4096
+
+// Time a client has to send its request and read the reply (in s)
+#define METRICS_CLIENT_TIMEOUT 5.0
+
+// Longest time the server thread waits between checks for Close (in ms)
+#define METRICS_POLL_INTERVAL 250
+
+/// Builds a page of metrics in the Prometheus text format.
+class MetricsPage{
+  private:
+	std::stringstream page;
+
+  public:
+	MetricsPage();
+
+	/// Start a family of metrics of type_ (counter, gauge, histogram), writing its HELP and TYPE lines.
+	void Family(const std::string &name_, const std::string &type_, const std::string &help_);
+
+	/// Write a sample of a family. labels_ is a list made with Label (empty for none).
+	void Sample(const std::string &name_, const std::string &labels_, double value_);
+
+	/// Return the page built so far.
+	std::string Get(){ return page.str(); }
+
+	/// Return a label name="value", escaping the value.
+	static std::string Label(const std::string &name_, const std::string &value_);
+
+	/// Return a label name="value" for a number.
+	static std::string Label(const std::string &name_, unsigned long long value_);
+};
+
+typedef std::function<void(MetricsPage &)> metrics_render_t;
+
+class MetricsServer{
+  private:
+	/// A connected client.
+	struct MetricsClient{
+		int fd;
+		std::string request; /// Bytes of the request received so far
+		std::string reply; /// Reply waiting to be sent (empty until the request is complete)
+		size_t sent; /// Bytes of the reply sent
+		double start; /// Time the client connected (in s)
+	};
+
+	int listen_fd; /// Listening socket (-1 if not in use)
+	int wake_fd; /// Event fd which wakes the server thread to exit
+	std::string unix_path; /// Path of the socket if it is a Unix domain socket
+	std::string address; /// The address given to Init
+	bool init;
+
+	double min_interval; /// Minimum time between two builds of the page (in s)
+	metrics_render_t render; /// Builds the page
+
+	std::thread thread;
+	std::vector<MetricsClient> clients;
+
+	std::string cached_page; /// The last page built
+	double last_render; /// Time the last page was built (in s)
+
+	std::atomic<unsigned long long> num_requests; /// Requests answered
+	std::atomic<unsigned long long> num_renders; /// Pages built
+	std::atomic<unsigned long long> num_rejected; /// Connections refused or dropped (too many, too large or too slow)
+
+	/// The server thread.
+	void Run();
+
+	/// Accept any new clients.
+	void Accept(double now_);
+
+	/// Read what a client has sent and build its reply once the request is complete. Returns false if the client has gone.
+	bool Read(MetricsClient &client_, double now_);
+
+	/// Send as much of a client's reply as the socket will take. Returns false once the reply is sent or the client has gone.
+	bool Write(MetricsClient &client_);
+
+	/// Return the reply to a request.
+	std::string Respond(const std::string &request_, double now_);
+
+  public:
+	MetricsServer();
+
+	~MetricsServer();
+
+	/** Serve the pages built by render_ on address_, which is a TCP port on the loopback interface,
+	  * host:port to listen on another interface (e.g. 0.0.0.0:9100), or the path of a Unix domain
+	  * socket. Returns false if the socket cannot be created or bound. */
+	bool Init(const std::string &address_, metrics_render_t render_);
+
+	/// Stop the server thread and close every socket.
+	void Close();
+
+	/// Set the minimum time between two builds of the page (in s). Must be called before Init.
+	void SetMinInterval(double interval_){ min_interval = interval_; }
+
+	bool IsInit(){ return init; }
+
+	std::string GetAddress(){ return address; }
+
+	unsigned long long GetRequests(){ return num_requests.load(); }
+
+	unsigned long long GetRenders(){ return num_renders.load(); }
+
+	unsigned long long GetRejected(){ return num_rejected.load(); }
+};
+
+#endif
@@ -0,0 +1,145 @@
+/** \file poll2_pac.h
+  *
+  * \brief Sends and reassembles spills in the classic pacman network format
+  *
+  * \date Oct. 18th, 2026
+  *
+  * In pacman mode, poll2 cuts every spill into shared memory buffers of at
+  * most PAC_BUFFER_WORDS words. Each buffer is sent as
+  *  [size in bytes, number of buffers, buffer index, data..., 0xFFFFFFFF]
+  * and a final buffer holding only the end of spill record [2, 9999] is sent
+  * after the data. Buffers larger than a datagram are split into several
+  * datagrams, each prefixed by a pac_header. The PacSender class builds and
+  * sends these datagrams, the PacReceiver class puts the spills back together
+  * (pacman itself does this in production, PacReceiver is used for testing).
+*/
+
+#ifndef POLL2_PAC_H
+#define POLL2_PAC_H
+
+#include <vector>
+#include <cstddef>
+
+#define POLL2_PAC_VERSION "1.0.00"
+#define POLL2_PAC_DATE "Oct. 18th, 2026"
+
+// Maximum number of pixie words in a single pacman shared memory buffer
+#define PAC_BUFFER_WORDS 4050
+
+// Maximum number of buffer bytes carried by a single datagram (1464 byte orph datagram less 8 bytes)
+#define PAC_PKT_DATA 1456
+
+// Module number (vsn) of the record which ends every pacman spill
+#define PAC_END_VSN 9999
+
+// Maximum number of datagrams read at once by the PacReceiver
+#define PAC_RECV_BATCH 64
+
+// Size of the PacReceiver's socket receive buffer (8 MB)
+#define PAC_RECV_BUFFER 8388608
+
+class Server;
+class Client;
+
+/// Header prepended to every datagram of a pacman style data_pack.
+struct pac_header{
+	int Sequence; /// Sequence number for reliable transport
+	int DataSize; /// Number of useable bytes following Sequence and DataSize
+	int TotalEvents; /// Index of the pacman buffer this datagram belongs to
+	unsigned short Events; /// Set to 1 on the last datagram of a buffer
+	unsigned short Cont; /// Continuation index for buffers spanning several datagrams
+};
+
+class PacSender{
+  private:
+	Client *client; /// The socket the datagrams are sent on
+	bool debug_mode;
+
+	unsigned int sequence; /// Sequence number of the next datagram
+	unsigned int total_buffers; /// Number of pacman buffers sent
+
+	std::vector<struct mmsghdr> msgs; /// Datagram descriptors for batched sends
+	std::vector<struct iovec> iov; /// Scatter list pointing into the spill being sent
+	std::vector<unsigned int> buffer_head; /// Pacman buffer headers referenced by iov
+	std::vector<pac_header> pkt_head; /// Datagram headers referenced by iov
+
+	unsigned long long num_spills; /// Spills sent
+	unsigned long long num_dgrams; /// Datagrams sent
+
+  public:
+	PacSender(Client *client_);
+
+	void SetDebugMode(bool state_=true){ debug_mode = state_; }
+
+	/// Send a spill of nWords_ words. Returns false if any of its datagrams could not be sent.
+	bool Send(const unsigned int *data_, unsigned int nWords_);
+
+	unsigned long long GetSpillsSent(){ return num_spills; }
+
+	unsigned long long GetDatagramsSent(){ return num_dgrams; }
+
+	unsigned int GetBuffersSent(){ return total_buffers; }
+};
+
+class PacReceiver{
+  private:
+	Server *server; /// The socket the datagrams arrive on
+
+	std::vector<unsigned int> spill; /// The spill being put back together
+	unsigned int spill_words; /// Number of words in the spill so far
+	std::vector<unsigned int> buffer; /// The pacman buffer being put back together
+	size_t buffer_bytes; /// Number of bytes in the buffer so far
+	bool in_buffer; /// Set while the datagrams of a buffer are arriving in order
+	bool in_spill; /// Set while the buffers of a spill are arriving in order
+	unsigned int next_buffer; /// Index of the next buffer expected
+	bool have_seq; /// Set once the first datagram has been received
+	unsigned int next_seq; /// Sequence number of the next datagram expected
+
+	std::vector<unsigned int> delivered; /// The last completed spill
+	unsigned int delivered_words;
+
+	std::vector<char> landing; /// Receive buffers for a batch of datagrams
+	std::vector<struct mmsghdr> msgs;
+	std::vector<struct iovec> iov;
+	unsigned int batch_count; /// Number of datagrams in the current batch
+	unsigned int batch_next; /// Index of the next datagram of the batch to handle
+
+	unsigned long long num_dgrams; /// Datagrams received
+	unsigned long long num_dgrams_lost; /// Gaps in the datagram sequence numbers
+	unsigned long long num_spills; /// Spills put back together
+	unsigned long long num_spills_dropped; /// Spills abandoned because of missing datagrams
+
+	/// Handle a single datagram. Returns true if it completed a spill.
+	bool Process(const char *dgram_, size_t nBytes_);
+
+	/// Handle a complete pacman buffer. Returns true if it completed a spill.
+	bool ProcessBuffer();
+
+	/// Abandon the spill being put back together.
+	void DropSpill();
+
+  public:
+	PacReceiver(Server *server_);
+
+	/** Read the datagrams waiting on the socket, up to PAC_RECV_BATCH at a time, until a spill
+	  * is completed or nothing is left. Returns true if a spill was completed, in which case it
+	  * may be retrieved with GetSpill until the next call to Receive. */
+	bool Receive();
+
+	/** Return a pointer to the last completed spill (without the end of spill record). The buffer
+	  * always has room for two extra words past the end of the spill. */
+	unsigned int *GetSpill(){ return (delivered_words > 0 ? &delivered[0] : NULL); }
+
+	/// Return the number of words in the last completed spill.
+	unsigned int GetSpillWords(){ return delivered_words; }
+
+	unsigned long long GetDatagramsReceived(){ return num_dgrams; }
+
+	unsigned long long GetDatagramsLost(){ return num_dgrams_lost; }
+
+	unsigned long long GetSpillsReceived(){ return num_spills; }
+
+	unsigned long long GetSpillsDropped(){ return num_spills_dropped; }
+};
+
+#endif
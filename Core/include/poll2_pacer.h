@@ -0,0 +1,78 @@
+/** \file poll2_pacer.h
+  *
+  * \brief Token bucket used to pace poll2 network broadcasts
+  *
+  * \date Oct. 18th, 2026
+  *
+  * Sending a whole spill in one burst overruns receiver socket buffers and
+  * switch queues at high rates. The TokenBucket class limits the average send
+  * rate to a number of bytes per second while allowing short bursts of up to
+  * the burst size. A Client with a pacer attached splits every batch of
+  * datagrams into groups of at most one burst and waits for the bucket before
+  * sending each group. Waits are timed with the monotonic clock; the bulk of
+  * a wait is slept and the final sub-millisecond part is spent spinning, since
+  * sleeps are only accurate to about the scheduler tick.
+*/
+
+#ifndef POLL2_PACER_H
+#define POLL2_PACER_H
+
+#include <cstddef>
+#include <mutex>
+
+#define POLL2_PACER_VERSION "1.0.00"
+#define POLL2_PACER_DATE "Oct. 18th, 2026"
+
+// Default burst size (in bytes), a little over one shm network chunk
+#define PACE_DEFAULT_BURST 65536
+
+// The last part of each wait is spent spinning instead of sleeping (in seconds)
+#define PACE_SPIN_TIME 0.001
+
+// Automatic pacing spreads each spill over this fraction of the time between spills
+#define PACE_AUTO_FILL 0.8
+
+class TokenBucket{
+  private:
+	double rate; /// Average rate limit in bytes per second (0 for no limit)
+	double burst; /// Maximum number of bytes which may be sent at once
+	double tokens; /// Bytes which may be sent now (negative while waiting)
+	double last_time; /// Time of the last refill (in seconds)
+	std::mutex lock; /// The rate may be changed from the command thread
+
+	unsigned long long num_bytes; /// Bytes passed through the bucket
+	unsigned long long num_waits; /// Number of times a sender had to wait
+	double wait_time; /// Total time spent waiting (in seconds)
+
+  public:
+	TokenBucket();
+
+	/** Limit the average rate to bytesPerSec_ bytes per second with bursts of up to burst_ bytes.
+	  * A rate of zero turns pacing off. Takes effect immediately, even while a spill is being sent. */
+	void SetRate(double bytesPerSec_, double burst_=PACE_DEFAULT_BURST);
+
+	double GetRate(){ return rate; }
+
+	double GetBurst(){ return burst; }
+
+	/// Return true if a rate limit is set.
+	bool IsActive(){ return (rate > 0.0); }
+
+	/** Wait until nBytes_ may be sent and take them from the bucket. Requests larger than the
+	  * burst size are allowed and simply wait longer. Returns the time spent waiting (in seconds). */
+	double Acquire(size_t nBytes_);
+
+	unsigned long long GetBytes(){ return num_bytes; }
+
+	unsigned long long GetWaits(){ return num_waits; }
+
+	double GetWaitTime(){ return wait_time; }
+
+	/// Return the current time of the monotonic clock (in seconds).
+	static double Now();
+
+	/// Wait until the monotonic clock reaches time_ (in seconds), spinning for the last PACE_SPIN_TIME.
+	static void WaitUntil(double time_);
+};
+
+#endif
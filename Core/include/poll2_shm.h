@@ -0,0 +1,217 @@
+/** \file poll2_shm.h
+  *
+  * \brief Shared memory ring buffer used to pass spills from poll2 to local programs
+  *
+  * \date Oct. 18th, 2026
+  *
+  * The ShmWriter class creates a POSIX shared memory segment (shm_open) which
+  * holds a single ring of variable length records. Any number of local
+  * programs (up to SHM_MAX_READERS) may attach to the ring with the ShmReader
+  * class. Each reader has its own read cursor stored in the segment, so a slow
+  * reader never holds up any other reader. Readers sleep on a futex in the
+  * segment and are woken up by the writer when a new record is published.
+  *
+  * When a reader falls more than one ring length behind the writer, the
+  * overrun policy of the ring decides what happens:
+  *  SHM_OVERRUN_LAP  - The writer never waits. The slow reader is lapped, loses
+  *                     everything it had not read and skips ahead to the newest
+  *                     data (the default, acquisition is never held up).
+  *  SHM_OVERRUN_DROP - The writer drops any new record which would overwrite
+  *                     data that a reader has not read yet.
+  * Either way, readers see a gap in the record sequence numbers and count the
+  * records they missed.
+  *
+  * The ring has a single writer process, but within it Publish may be called
+  * from several threads (poll2 sends spills from its sink thread and flags
+  * from its command thread), so Publish holds a mutex while it claims a slot
+  * and copies the record in.
+*/
+
+#ifndef POLL2_SHM_H
+#define POLL2_SHM_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+
+#define POLL2_SHM_VERSION "1.0.00"
+#define POLL2_SHM_DATE "Oct. 18th, 2026"
+
+// Name of the shared memory ring used for poll2 spills
+#define SHM_SPILL_RING "/poll2_spill"
+
+// Name of the shared memory ring used for poll2 stats packets
+#define SHM_STATS_RING "/poll2_stats"
+
+// Default size of the spill ring data area (in MB)
+#define SHM_SPILL_RING_SIZE 64
+
+// Size of the stats ring data area (in bytes)
+#define SHM_STATS_RING_SIZE 262144
+
+// Maximum number of readers attached to a single ring
+#define SHM_MAX_READERS 16
+
+// Overrun policies
+#define SHM_OVERRUN_LAP 0
+#define SHM_OVERRUN_DROP 1
+
+// Record types
+#define SHM_RECORD_PAD 0 /// Filler at the end of the ring, skipped by readers
+#define SHM_RECORD_SPILL 1 /// A complete poll2 spill
+#define SHM_RECORD_FLAG 2 /// A poll2 network flag ($OPEN_FILE, $CLOSE_FILE, $KILL_SOCKET)
+#define SHM_RECORD_STATS 3 /// A StatsHandler stats packet
+
+/// Per reader state stored in the shared memory segment. One cache line per reader.
+struct ShmReaderSlot{
+	int pid; /// Process ID of the reader which owns this slot (0 if the slot is free)
+	unsigned int unused;
+	unsigned long long cursor; /// Ring position of the next record this reader will read
+	unsigned long long overruns; /// Number of times this reader was lapped by the writer
+	unsigned long long padding[5];
+};
+
+/// Control block at the start of the shared memory segment.
+struct ShmRingHeader{
+	unsigned int magic; /// Always SHM_RING_MAGIC for a valid ring
+	unsigned int version; /// Layout version of the segment
+	unsigned long long capacity; /// Size of the data area following the header (in bytes)
+	unsigned int policy; /// The overrun policy of the ring
+	int writer_pid; /// Process ID of the writer (0 if the writer has closed)
+	unsigned int stale; /// Set when the segment has been replaced by a new one
+	unsigned int futex_word; /// Incremented for every record published, readers wait on it
+	unsigned int num_waiters; /// Number of readers currently sleeping on futex_word
+	unsigned int padding1[7];
+
+	unsigned long long reserve; /// The writer may be modifying data up to this position
+	unsigned long long head; /// All records before this position are complete
+	unsigned long long next_seq; /// Sequence number of the next record
+	unsigned long long dropped; /// Records dropped by the writer (SHM_OVERRUN_DROP only)
+	unsigned long long padding2[4];
+
+	ShmReaderSlot readers[SHM_MAX_READERS];
+};
+
+/// Header written in front of every record in the ring.
+struct ShmRecordHeader{
+	unsigned int size; /// Total size of the record in the ring, including this header
+	unsigned int type; /// The record type
+	unsigned int length; /// Number of payload bytes
+	unsigned int seq; /// Low 32 bits of the record sequence number
+};
+
+class ShmWriter{
+  private:
+	std::string name;
+	int fd;
+	size_t map_size;
+	ShmRingHeader *ring;
+	char *data;
+	bool init;
+	std::mutex publish_lock; /// Held by Publish, so threads never claim the same slot and sequence number
+
+	std::atomic<unsigned long long> num_published; /// Records published by this writer (read by other threads)
+	std::atomic<unsigned long long> num_dropped; /// Records dropped by this writer (read by other threads)
+
+	/// Return true if a record ending at ring position end_ will not overwrite unread data.
+	bool HasRoom(unsigned long long end_);
+
+  public:
+	ShmWriter();
+
+	~ShmWriter();
+
+	/** Create the shared memory ring name_ with a data area of capacity_ bytes. If a compatible
+	  * ring with the same name already exists, it is reused so that attached readers are kept.
+	  * Returns false if the segment cannot be created or mapped. */
+	bool Init(const char *name_, size_t capacity_, unsigned int policy_=SHM_OVERRUN_LAP);
+
+	/** Copy a record of nBytes_ into the ring and wake any waiting readers. May be called from
+	  * several threads at once. Returns false if the record is too large for the ring or was
+	  * dropped due to the overrun policy. */
+	bool Publish(unsigned int type_, const void *data_, size_t nBytes_);
+
+	/// Set the overrun policy of the ring.
+	void SetPolicy(unsigned int policy_);
+
+	/// Return the overrun policy of the ring.
+	unsigned int GetPolicy(){ return (init ? ring->policy : SHM_OVERRUN_LAP); }
+
+	/// Return the number of readers currently attached to the ring.
+	unsigned int GetNumReaders();
+
+	/// Return the size of the ring data area (in bytes).
+	size_t GetCapacity(){ return (init ? ring->capacity : 0); }
+
+	unsigned long long GetPublished(){ return num_published.load(std::memory_order_relaxed); }
+
+	unsigned long long GetDropped(){ return num_dropped.load(std::memory_order_relaxed); }
+
+	bool IsInit(){ return init; }
+
+	/// Unmap the ring. The segment itself is left in place for attached readers.
+	void Close();
+};
+
+class ShmReader{
+  private:
+	std::string name;
+	int fd;
+	size_t map_size;
+	ShmRingHeader *ring;
+	char *data;
+	int slot; /// Index of this reader's slot in the ring
+	bool init;
+
+	unsigned long long cursor; /// Ring position of the next record to read
+	unsigned int last_seq; /// Sequence number of the last record read
+	bool have_seq; /// Set once the first record has been read
+
+	unsigned long long num_records; /// Records read
+	unsigned long long num_bytes; /// Payload bytes read
+	unsigned long long num_missed; /// Records lost to overruns or writer drops
+	unsigned long long num_overruns; /// Number of times this reader was lapped
+
+	/// Skip ahead to the newest data after being lapped by the writer.
+	void Resync();
+
+  public:
+	ShmReader();
+
+	~ShmReader();
+
+	/** Attach to the shared memory ring name_. Reading starts with the next record published.
+	  * Returns false if the ring does not exist or all reader slots are in use. */
+	bool Init(const char *name_);
+
+	/** Copy the next record into buffer_, which is resized as needed and always has room for
+	  * two extra words past the end of the record. Returns false if no record is available.
+	  * Records lost to an overrun are skipped automatically. */
+	bool Read(std::vector<unsigned int> &buffer_, unsigned int &type_, size_t &nBytes_);
+
+	/** Sleep until a new record is available or until timeout_ms_ milliseconds have passed.
+	  * Returns true if a record is available. */
+	bool Wait(int timeout_ms_);
+
+	/// Return true if the writer has replaced the ring with a new one. The reader should re-attach.
+	bool IsStale(){ return (init && ring->stale != 0); }
+
+	/// Return true if the writer currently has the ring open.
+	bool WriterAlive(){ return (init && ring->writer_pid != 0); }
+
+	unsigned long long GetRecordsRead(){ return num_records; }
+
+	unsigned long long GetBytesRead(){ return num_bytes; }
+
+	unsigned long long GetRecordsMissed(){ return num_missed; }
+
+	unsigned long long GetOverruns(){ return num_overruns; }
+
+	bool IsInit(){ return init; }
+
+	/// Release the reader slot and unmap the ring.
+	void Close();
+};
+
+#endif
@@ -10,15 +10,37 @@
   * network. These packets are sent by poll using the Server class and may be
   * read by any program using the Client class or operating a socket on the
   * same port.
+  *
+  * A Client may also send to an IP multicast group (e.g. 239.255.0.1), in
+  * which case every Server which has joined the group with InitMulticast
+  * receives a copy of each datagram, however many there are.
+  *
+  * A TokenBucket may be attached to a Client with SetPacer to limit the rate
+  * at which datagrams are sent (see poll2_pacer.h).
 */
 
 #ifndef POLL2_SOCKET_H
 #define POLL2_SOCKET_H
 
+#include <cstddef>
+#include <string>
+
 #include <netinet/in.h>
+#include <sys/socket.h>
+
+#define POLL2_SOCKET_VERSION "1.3.00"
+#define POLL2_SOCKET_DATE "Oct. 18th, 2026"
+
+// Maximum number of datagrams handed to the kernel in a single sendmmsg call
+#define MAX_SEND_BATCH 1024
+
+// Default time-to-live of multicast datagrams (1 keeps them on the local subnet)
+#define MULTICAST_TTL 1
 
-#define POLL2_SOCKET_VERSION "1.1.01"
-#define POLL2_SOCKET_DATE "May 11th, 2015"
+class TokenBucket;
+
+/// Return true if str_ is a port number (nothing but digits) rather than a socket path or host name.
+bool is_port(const std::string &str_);
 
 class Server{
   private:
@@ -43,12 +65,24 @@ class Server{
 	  * socket fails to open or the socket fails to bind and returns true otherwise. */
 	bool Init(int port_, int sec_=10, int usec_=0);
 
+	/** Open a specified port and join the multicast group group_ on interface iface_, which may be
+	  * an interface name (eth0), the address of an interface or NULL to let the kernel choose.
+	  * Several Servers on the same host may join the same group and port. Returns false if the
+	  * socket fails to open or bind or if the group cannot be joined. */
+	bool InitMulticast(const char *group_, int port_, const char *iface_=NULL, int sec_=10, int usec_=0);
+
 	/** Receive a message from the socket. Returns the number of bytes received. Returns
 	  * -1 if the receive fails or if the object was not initialized. */
 	int RecvMessage(char *message_, size_t length_);
 
-	/** Send a message to the socket. Returns the number of bytes sent. Returns
-	  * -1 if the send fails or if the object was not initialized. */
+	/** Receive up to nMsgs_ datagrams which are already waiting on the socket using a single
+	  * call to recvmmsg. Each entry of msgs_ must have its msg_iov and msg_iovlen set by the
+	  * caller. The buffers are not zeroed. Returns the number of datagrams received. Returns
+	  * -1 if the receive fails or if the object was not initialized. */
+	int RecvMessages(struct mmsghdr *msgs_, unsigned int nMsgs_);
+
+	/** Send a message to the socket, waiting for the pacer first if one is set. Returns the
+	  * number of bytes sent. Returns -1 if the send fails or if the object was not initialized. */
 	int SendMessage(char *message_, size_t length_);
 
 	bool Select(int &retval);
@@ -65,8 +99,10 @@ class Client{
 	struct hostent *hp;
 	bool init;
 
+	TokenBucket *pacer; /// Rate limit for outgoing datagrams (not owned, may be NULL)
+
   public:
-	Client(){ init = false; }
+	Client(){ init = false; pacer = NULL; }
 	
 	~Client(){ Close(); }
   
@@ -76,13 +112,41 @@ class Client{
 	  * if the socket fails to open or the address is unresolved and returns true otherwise. */
 	bool Init(const char *address_, int port_);
 
+	/** Set the time-to-live and outgoing interface of multicast datagrams. iface_ may be an
+	  * interface name (eth0), the address of an interface or NULL to let the kernel choose.
+	  * If loop_ is set, programs on this host which have joined the group also receive the
+	  * datagrams. Returns false if the object was not initialized or an option was rejected. */
+	bool SetMulticast(int ttl_=MULTICAST_TTL, const char *iface_=NULL, bool loop_=true);
+
+	/** Pace every datagram sent by SendMessage and SendMessages with pacer_, or stop pacing if
+	  * pacer_ is NULL. The pacer is not owned by the client and may be shared between clients. */
+	void SetPacer(TokenBucket *pacer_){ pacer = pacer_; }
+
+	TokenBucket *GetPacer(){ return pacer; }
+
+	/// Return true if the client is sending to a multicast group.
+	bool IsMulticast(){ return (init && IN_MULTICAST(ntohl(serv.sin_addr.s_addr))); }
+
 	/** Receive a message from the socket. Returns the number of bytes received. Returns
 	  * -1 if the receive fails or if the object was not initialized. */
 	int RecvMessage(char *message_, size_t length_);
 
-	/** Send a message to the socket. Returns the number of bytes sent. Returns
-	  * -1 if the send fails or if the object was not initialized. */
+	/** Receive up to nMsgs_ datagrams which are already waiting on the socket (e.g. replies
+	  * from a Server) without blocking. Each entry of msgs_ must have its msg_iov and msg_iovlen
+	  * set by the caller. Returns the number of datagrams received. Returns -1 if nothing is
+	  * waiting, if the receive fails or if the object was not initialized. */
+	int RecvMessages(struct mmsghdr *msgs_, unsigned int nMsgs_);
+
+	/** Send a message to the socket, waiting for the pacer first if one is set. Returns the
+	  * number of bytes sent. Returns -1 if the send fails or if the object was not initialized. */
 	int SendMessage(char *message_, size_t length_);
+
+	/** Send a batch of datagrams to the socket using as few calls to sendmmsg as possible.
+	  * Each entry of msgs_ must have its msg_iov and msg_iovlen set by the caller, the
+	  * destination address is filled in here. If a pacer is set, the datagrams are sent in
+	  * groups of at most one burst. Returns the number of datagrams sent. Returns
+	  * -1 if the first send fails or if the object was not initialized. */
+	int SendMessages(struct mmsghdr *msgs_, unsigned int nMsgs_);
 	
 	/// Close the socket.
 	void Close();
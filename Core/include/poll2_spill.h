@@ -0,0 +1,298 @@
+/** \file poll2_spill.h
+  *
+  * \brief Sends and reassembles poll2 network spills
+  *
+  * \date Oct. 18th, 2026
+  *
+  * In shm mode, poll2 splits every spill into chunks of SHM_CHUNK_WORDS words
+  * and sends each chunk in its own datagram, prefixed by the chunk number
+  * (starting at 1) and the total number of chunks in the spill. The
+  * SpillReceiver class reads these datagrams in batches and places each one
+  * directly into its slot of a reusable spill buffer.
+  *
+  * In reliable mode, the SpillSender class also stamps every chunk with a 16
+  * bit spill ID and keeps a copy of the last few spills. The chunk header
+  * words are then laid out as
+  *  word 0 - bits 0-15 chunk number, bits 16-31 spill ID
+  *  word 1 - bits 0-15 total chunks, bit 30 SHM_CHUNK_RESENT, bit 31 SHM_CHUNK_RELIABLE
+  * A SpillReceiver which sees reliable chunks answers any gaps with a NACK
+  * datagram sent back to the sender
+  *  [SHM_NACK_MAGIC, spill ID, number of ranges, first chunk, last chunk, ...]
+  * and the sender resends only the chunks which were asked for.
+*/
+
+#ifndef POLL2_SPILL_H
+#define POLL2_SPILL_H
+
+#include <string>
+#include <vector>
+#include <deque>
+
+#include <sys/socket.h>
+
+#define POLL2_SPILL_VERSION "1.1.00"
+#define POLL2_SPILL_DATE "Oct. 18th, 2026"
+
+// Number of spill words carried by each shm network chunk (~40 kB)
+#define SHM_CHUNK_WORDS 10000
+
+// Length of the chunk header on each shm network chunk (in bytes)
+#define SHM_CHUNK_HEAD_LEN 8
+
+// Default number of datagrams read with each call to recvmmsg
+#define SHM_RECV_BATCH 32
+
+// Socket receive buffer size requested by the SpillReceiver (in bytes, capped by net.core.rmem_max)
+#define SHM_RECV_BUFFER 8388608
+
+// Reliable mode chunk header flags
+#define SHM_CHUNK_RELIABLE 0x80000000
+#define SHM_CHUNK_RESENT 0x40000000
+#define SHM_CHUNK_MASK 0x0000FFFF
+
+// First word of a NACK datagram ("NACK")
+#define SHM_NACK_MAGIC 0x4B43414E
+
+// Maximum number of missing chunk ranges in a single NACK
+#define SHM_NACK_MAX_RANGES 256
+
+// Default number of spills kept by the sender for retransmission
+#define SHM_SEND_WINDOW 8
+
+// Time to wait for missing chunks before asking for them (again) (in seconds)
+#define SHM_NACK_TIMEOUT 0.02
+
+// Number of NACKs sent for a spill before giving up on it
+#define SHM_NACK_RETRIES 10
+
+// Maximum number of incomplete spills waiting on retransmissions
+#define SHM_MAX_PENDING 4
+
+class Server;
+class Client;
+
+/// A spill being put back together by the SpillReceiver.
+struct SpillAssembly{
+	unsigned int id; /// Spill ID (reliable mode only)
+	unsigned int total_chunks; /// Number of chunks in the spill (0 if the assembly is not in use)
+	unsigned int chunks_recvd; /// Number of chunks received so far
+	unsigned int last_words; /// Number of words in the final chunk
+	unsigned int spill_words; /// Number of words in the spill, once complete
+	bool reliable; /// Chunks of this spill may be asked for again
+	bool recovered; /// Some chunks of this spill had to be retransmitted
+	unsigned int num_nacks; /// Number of NACKs sent for this spill
+	double last_time; /// Time of the last chunk or NACK for this spill
+
+	std::vector<unsigned int> data; /// Spill buffer. Only grows, never shrinks.
+	std::vector<char> recvd; /// Which chunks have arrived
+
+	SpillAssembly();
+
+	/// Make sure the spill buffer can hold nChunks_ chunks plus two words of padding.
+	void Reserve(unsigned int nChunks_);
+
+	/// Start a new spill with totalChunks_ chunks.
+	void Start(unsigned int id_, unsigned int totalChunks_, bool reliable_);
+};
+
+class SpillReceiver{
+  private:
+	Server *server; /// The socket the spill chunks arrive on
+	unsigned int batch_size; /// Maximum number of datagrams read at once
+	bool debug_mode;
+
+	SpillAssembly *current; /// The spill currently being received
+	SpillAssembly *landing_buf; /// The spill buffer datagrams in the current batch are received into
+	bool recycle_landing; /// Set if landing_buf was released during the current batch
+	SpillAssembly *delivered; /// The spill handed out by the last call to Receive
+	std::deque<SpillAssembly*> pending; /// Older spills waiting on retransmitted chunks
+	std::deque<SpillAssembly*> ready; /// Completed spills waiting to be handed out
+	std::vector<SpillAssembly*> spare; /// Assemblies available for reuse
+	std::vector<SpillAssembly*> assemblies; /// Every assembly ever allocated
+
+	std::vector<unsigned int> chunk_head; /// Chunk header of each datagram in the batch
+	std::vector<unsigned int> landing; /// The chunk slot each datagram in the batch is received into
+	std::vector<struct mmsghdr> msgs;
+	std::vector<struct iovec> iov;
+
+	std::vector<char> stash; /// Datagrams which arrived in the wrong slot
+	std::vector<SpillAssembly*> stash_target; /// The spill each stashed datagram belongs to
+	std::vector<std::pair<unsigned int, unsigned int> > stash_loc; /// Target chunk and stash offset
+
+	bool have_id; /// Set once a reliable chunk has been received
+	unsigned int last_id; /// ID of the newest reliable spill seen
+	std::deque<unsigned int> completed_ids; /// IDs of recently completed reliable spills
+
+	std::vector<unsigned int> nack; /// NACK message buffer
+	double nack_loss; /// Fraction of NACKs to throw away (for testing)
+	unsigned int loss_seed;
+
+	std::string last_flag; /// The last poll2 network flag received ($OPEN_FILE, etc.)
+
+	unsigned long long num_dgrams; /// Total datagrams received
+	unsigned long long num_dgrams_dropped; /// Datagrams which could not be used
+	unsigned long long num_dgrams_moved; /// Datagrams which arrived out of order and had to be copied
+	unsigned long long num_bytes; /// Total bytes received
+	unsigned long long num_spills; /// Spills reassembled
+	unsigned long long num_spills_dropped; /// Spills abandoned because of missing chunks
+	unsigned long long num_spills_recovered; /// Spills completed with retransmitted chunks
+	unsigned long long num_nacks; /// NACKs sent
+	unsigned long long num_flags; /// poll2 network flags received
+
+	/// Return an unused assembly.
+	SpillAssembly *GetSpare();
+
+	/// Return an assembly to the pool.
+	void Recycle(SpillAssembly *spill_);
+
+	/// Abandon an incomplete spill.
+	void DropSpill(SpillAssembly *spill_);
+
+	/// Find the assembly for a reliable chunk of spill id_, starting a new spill if needed.
+	SpillAssembly *FindSpill(unsigned int id_, unsigned int totalChunks_);
+
+	/// Replace the current spill (if any) with a new one and return it.
+	SpillAssembly *StartSpill(unsigned int id_, unsigned int totalChunks_, bool reliable_);
+
+	/// Move the current spill to the pending list and ask for its missing chunks.
+	void ParkCurrent(double now_);
+
+	/// Ask the sender for every chunk still missing from spill_.
+	void SendNack(SpillAssembly *spill_, double now_);
+
+	/// Re-send overdue NACKs and give up on spills which have used all of their retries.
+	void CheckRetransmits(double now_);
+
+	/// Mark a spill as complete and queue it to be handed out.
+	void Complete(SpillAssembly *spill_);
+
+  public:
+	SpillReceiver(Server *server_, unsigned int batch_=SHM_RECV_BATCH);
+
+	~SpillReceiver();
+
+	void SetDebugMode(bool state_=true){ debug_mode = state_; }
+
+	/// Throw away a fraction of the NACKs instead of sending them (for testing).
+	void SetNackLoss(double fraction_){ nack_loss = fraction_; }
+
+	/** Read all datagrams currently waiting on the socket (up to the batch size) and
+	  * send any NACKs which are due. Should be called regularly, even when Server::Select
+	  * reports no data, so that NACKs are repeated. Returns true if a spill was completed,
+	  * in which case it may be retrieved with GetSpill until the next call to Receive.
+	  * Spills recovered by retransmission may be handed out after newer spills. */
+	bool Receive();
+
+	/** Return a pointer to the last completed spill. The buffer always has room for two extra
+	  * words past the end of the spill so that an end of spill marker may be appended. */
+	unsigned int *GetSpill(){ return (delivered ? &delivered->data[0] : NULL); }
+
+	/// Return the number of words in the last completed spill.
+	unsigned int GetSpillWords(){ return (delivered ? delivered->spill_words : 0); }
+
+	/// Return true if the last completed spill needed retransmitted chunks.
+	bool GetSpillRecovered(){ return (delivered ? delivered->recovered : false); }
+
+	/// Return the last poll2 network flag received and clear it.
+	std::string GetLastFlag();
+
+	unsigned long long GetDatagramsReceived(){ return num_dgrams; }
+
+	unsigned long long GetDatagramsDropped(){ return num_dgrams_dropped; }
+
+	unsigned long long GetDatagramsMoved(){ return num_dgrams_moved; }
+
+	unsigned long long GetBytesReceived(){ return num_bytes; }
+
+	unsigned long long GetSpillsReassembled(){ return num_spills; }
+
+	unsigned long long GetSpillsDropped(){ return num_spills_dropped; }
+
+	unsigned long long GetSpillsRecovered(){ return num_spills_recovered; }
+
+	unsigned long long GetNacksSent(){ return num_nacks; }
+
+	unsigned long long GetFlagsReceived(){ return num_flags; }
+};
+
+class SpillSender{
+  private:
+	/// A spill kept for retransmission.
+	struct SentSpill{
+		unsigned int id;
+		unsigned int nWords;
+		std::vector<unsigned int> data;
+	};
+
+	Client *client; /// The socket the spill chunks are sent on
+	bool reliable;
+	bool debug_mode;
+	unsigned int window; /// Number of spills kept for retransmission
+	unsigned int next_id; /// ID of the next reliable spill
+
+	std::vector<SentSpill> history; /// The last few spills sent in reliable mode
+
+	std::vector<struct mmsghdr> msgs;
+	std::vector<struct iovec> iov;
+	std::vector<unsigned int> chunk_head;
+	std::vector<std::pair<SentSpill*, unsigned int> > resend; /// Spill and chunk index of each chunk to resend
+
+	std::vector<unsigned int> nack_buffer; /// Receive buffers for incoming NACKs
+	std::vector<struct mmsghdr> nack_msgs;
+	std::vector<struct iovec> nack_iov;
+
+	double loss_rate; /// Fraction of outgoing chunks to throw away (for testing)
+	unsigned int loss_seed;
+
+	unsigned long long num_spills; /// Spills sent
+	unsigned long long num_chunks; /// Chunks sent (including retransmissions)
+	unsigned long long num_resent; /// Chunks retransmitted
+	unsigned long long num_nacks; /// NACKs received
+	unsigned long long num_expired; /// Chunks asked for after leaving the window
+	unsigned long long num_lost; /// Chunks thrown away by the loss injection
+
+	/// Add one chunk to the outgoing batch.
+	void AddChunk(unsigned int index_, unsigned int id_, unsigned int chunk_, unsigned int total_, unsigned int *data_, unsigned int nWords_, bool resent_);
+
+	/// Send the outgoing batch. Returns false if the send failed.
+	bool Flush(unsigned int count_);
+
+  public:
+	SpillSender(Client *client_);
+
+	void SetDebugMode(bool state_=true){ debug_mode = state_; }
+
+	/** Turn reliable mode on or off. In reliable mode, the last window_ spills are kept so that
+	  * missing chunks may be sent again when a receiver asks for them. */
+	void SetReliable(bool state_=true, unsigned int window_=SHM_SEND_WINDOW);
+
+	/// Throw away a fraction of the outgoing chunks instead of sending them (for testing).
+	void SetLossRate(double fraction_){ loss_rate = fraction_; }
+
+	bool GetReliable(){ return reliable; }
+
+	unsigned int GetWindow(){ return window; }
+
+	/** Split a spill into chunks and send them. The spill is copied into the retransmit
+	  * window in reliable mode and sent directly from data_ otherwise. Returns false if
+	  * the send failed. */
+	bool Send(unsigned int *data_, unsigned int nWords_);
+
+	/** Read any NACKs waiting on the socket and resend the chunks they ask for. Does nothing
+	  * unless reliable mode is on. Returns the number of chunks resent. */
+	unsigned int ServiceNacks();
+
+	unsigned long long GetSpillsSent(){ return num_spills; }
+
+	unsigned long long GetChunksSent(){ return num_chunks; }
+
+	unsigned long long GetChunksResent(){ return num_resent; }
+
+	unsigned long long GetNacksReceived(){ return num_nacks; }
+
+	unsigned long long GetChunksExpired(){ return num_expired; }
+
+	unsigned long long GetChunksLost(){ return num_lost; }
+};
+
+#endif
@@ -0,0 +1,61 @@
+/** \file poll2_staging.h
+  *
+  * \brief Fixed size ring used to hold words between FIFO reads
+  *
+  * \date Oct. 18th, 2026
+  *
+  * Words left over from one FIFO read (the part of an event which was not
+  * read yet, or the rest of a minimum size read) have to be put in front of
+  * the words of the next read. The StagingRing class keeps them in a buffer
+  * which is allocated once, and moves them in and out with at most two
+  * memcpy calls (one if the words do not wrap around the end of the buffer),
+  * so nothing is allocated or copied word by word while the FIFOs are read.
+*/
+
+#ifndef POLL2_STAGING_H
+#define POLL2_STAGING_H
+
+#include <vector>
+#include <cstddef>
+
+#define POLL2_STAGING_VERSION "1.0.00"
+#define POLL2_STAGING_DATE "Oct. 18th, 2026"
+
+class StagingRing{
+  private:
+	std::vector<unsigned int> words; /// Storage for the ring, never resized after Init
+	size_t head; /// Index of the oldest word
+	size_t count; /// Number of words in the ring
+
+  public:
+	StagingRing();
+
+	/// Allocate room for capacity_ words.
+	StagingRing(size_t capacity_);
+
+	/// Allocate room for capacity_ words, dropping any words in the ring.
+	void Init(size_t capacity_);
+
+	/// Append nWords_ words to the ring. Returns false, and adds nothing, if they do not fit.
+	bool Push(const unsigned int *data_, size_t nWords_);
+
+	/// Move up to nWords_ of the oldest words to dest_. Returns the number of words moved.
+	size_t Pop(unsigned int *dest_, size_t nWords_);
+
+	/// Drop every word in the ring.
+	void Clear(){
+		head = 0;
+		count = 0;
+	}
+
+	size_t Size(){ return count; }
+
+	size_t Capacity(){ return words.size(); }
+
+	/// Return the number of words which may still be pushed.
+	size_t Free(){ return words.size() - count; }
+
+	bool Empty(){ return (count == 0); }
+};
+
+#endif
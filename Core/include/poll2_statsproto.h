@@ -0,0 +1,223 @@
+/** \file poll2_statsproto.h
+  *
+  * \brief Versioned, delta encoded and fragmented stats packets sent by poll2 to monitors
+  *
+  * \date Oct. 18th, 2026
+  *
+  * A StatsRecord holds the stats of one crate as a flat list of 64 bit
+  * fields: the STATS_RECORD_FIELDS fields of the crate, then the
+  * STATS_MODULE_FIELDS fields of each module, then the STATS_CHANNEL_FIELDS
+  * fields of each channel. Rates and times are doubles stored by their bit
+  * pattern, and counts are stored as integers. The number of modules and of
+  * channels per module travel with every packet, so nothing about the size of
+  * a crate is fixed.
+  *
+  * The StatsEncoder turns each record into one or more datagrams of at most
+  * STATS_PROTO_MAX_DATAGRAM bytes. Every datagram starts with a
+  * StatsPacketHeader and carries runs of fields
+  *  [first field (4 bytes), number of fields (4 bytes), fields (8 bytes each)]
+  * A key record carries every field. A delta record only carries the fields
+  * which changed since the record before it, and a key record is sent every
+  * STATS_PROTO_KEY_INTERVAL records so a monitor started in the middle of a
+  * run, or one which lost a datagram, catches up. Each fragment stands on its
+  * own, so a lost fragment only leaves its own fields out of date.
+  *
+  * The StatsDecoder reads the datagrams of any number of crates, told apart by
+  * the crate ID in the header, and keeps the last known record of each. It
+  * marks the fields which changed, so a display need only redraw those.
+*/
+
+#ifndef POLL2_STATSPROTO_H
+#define POLL2_STATSPROTO_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstddef>
+#include <stdint.h>
+
+#define POLL2_STATSPROTO_VERSION "1.0.00"
+#define POLL2_STATSPROTO_DATE "Oct. 18th, 2026"
+
+// First word of every stats packet ("PSTA")
+#define STATS_PROTO_MAGIC 0x41545350
+
+// Version of the stats protocol. Packets of any other version are ignored.
+#define STATS_PROTO_VERSION 2
+
+// Default UDP port the stats packets are sent to
+#define STATS_PROTO_PORT 5556
+
+// Largest stats datagram (in bytes, fits in an ethernet frame)
+#define STATS_PROTO_MAX_DATAGRAM 1400
+
+// Number of records between two key records
+#define STATS_PROTO_KEY_INTERVAL 4
+
+// Packet types
+#define STATS_PACKET_KEY 0 /// Carries every field of a record
+#define STATS_PACKET_DELTA 1 /// Carries the fields which changed since the last record
+#define STATS_PACKET_CLOSE 2 /// The sender has stopped (no fields)
+
+// Fields of the crate
+#define STATS_FIELD_TIME 0 /// Total run time (double, in s)
+#define STATS_FIELD_DATA_RATE 1 /// Total data rate (double, in B/s)
+#define STATS_FIELD_READOUT_MODE 2 /// FIFO readout mode (0 for a fixed threshold, 1 for adaptive)
+#define STATS_FIELD_MAX_LATENCY 3 /// Latency target of the adaptive readout (double, in s)
+#define STATS_FIELD_MARGIN 4 /// Fraction of the FIFO kept free by the adaptive readout (double)
+#define STATS_FIELD_LATENCY_MEAN 5 /// Mean time between FIFO reads (double, in s)
+#define STATS_FIELD_LATENCY_MAX 6 /// Longest time between FIFO reads (double, in s)
+#define STATS_FIELD_READS 7 /// Number of FIFO reads for each of the STATS_READ_TYPES reasons (threshold, safety, latency, forced)
+#define STATS_READ_TYPES 4
+#define STATS_RECORD_FIELDS (STATS_FIELD_READS + STATS_READ_TYPES)
+
+// Fields of each module
+#define STATS_MODULE_DATA_RATE 0 /// Data rate (double, in B/s)
+#define STATS_MODULE_DATA_TOTAL 1 /// Total data (in bytes)
+#define STATS_MODULE_FIFO_FILL 2 /// Estimated FIFO fill rate (double, in words/s)
+#define STATS_MODULE_FIFO_LEVEL 3 /// Number of FIFO words at which the module is read (double)
+#define STATS_MODULE_FIELDS 4
+
+// Fields of each channel
+#define STATS_CHANNEL_EVENT_RATE 0 /// Event rate (double, in Hz)
+#define STATS_CHANNEL_EVENTS_TOTAL 1 /// Total number of events
+#define STATS_CHANNEL_ICR 2 /// XIA input count rate (double, in Hz)
+#define STATS_CHANNEL_OCR 3 /// XIA output count rate (double, in Hz)
+#define STATS_CHANNEL_FIELDS 4
+
+/// Header at the start of every stats datagram.
+struct StatsPacketHeader{
+	uint32_t magic; /// STATS_PROTO_MAGIC
+	uint16_t version; /// STATS_PROTO_VERSION
+	uint16_t crate; /// ID of the crate which sent the packet
+	uint32_t sequence; /// Number of the record (counts up from 1)
+	uint16_t fragment; /// Number of this fragment of the record (from 0)
+	uint16_t num_fragments; /// Number of fragments of the record
+	uint8_t type; /// STATS_PACKET_*
+	uint8_t reserved;
+	uint16_t num_channels; /// Channels per module
+	uint32_t num_modules; /// Modules in the crate
+};
+
+/// The stats of one crate.
+class StatsRecord{
+  private:
+	unsigned int num_modules;
+	unsigned int num_channels; /// Channels per module
+	std::vector<uint64_t> fields;
+
+  public:
+	StatsRecord() : num_modules(0), num_channels(0) { }
+
+	/// Size the record for nModules_ modules of nChannels_ channels, zeroing every field.
+	void Init(unsigned int nModules_, unsigned int nChannels_);
+
+	unsigned int GetNumModules() const { return num_modules; }
+
+	unsigned int GetNumChannels() const { return num_channels; }
+
+	size_t GetNumFields() const { return fields.size(); }
+
+	/// Return the index of a field of the crate, a module or a channel.
+	static size_t ModuleField(unsigned int mod_, int field_){ return STATS_RECORD_FIELDS + mod_ * STATS_MODULE_FIELDS + field_; }
+
+	size_t ChannelField(unsigned int mod_, unsigned int ch_, int field_) const {
+		return STATS_RECORD_FIELDS + num_modules * STATS_MODULE_FIELDS + (mod_ * num_channels + ch_) * STATS_CHANNEL_FIELDS + field_;
+	}
+
+	uint64_t GetWord(size_t index_) const { return (index_ < fields.size() ? fields[index_] : 0); }
+
+	double GetDouble(size_t index_) const;
+
+	void SetWord(size_t index_, uint64_t value_){ if(index_ < fields.size()){ fields[index_] = value_; } }
+
+	void SetDouble(size_t index_, double value_);
+
+	const std::vector<uint64_t> &GetFields() const { return fields; }
+
+	std::vector<uint64_t> &GetFields(){ return fields; }
+};
+
+class StatsEncoder{
+  private:
+	unsigned short crate_id;
+	unsigned int sequence; /// Number of the last record encoded
+	unsigned int key_interval; /// Records between two key records
+	std::vector<uint64_t> last_fields; /// The fields of the last record, which deltas are taken against
+
+	unsigned long long bytes_key; /// Bytes of key records encoded
+	unsigned long long bytes_delta; /// Bytes of delta records encoded
+
+	/// Start a new datagram of a record.
+	void start_datagram(std::vector<std::string> &datagrams_, unsigned char type_, const StatsRecord &record_);
+
+  public:
+	StatsEncoder(unsigned short crateID_=0) : crate_id(crateID_), sequence(0), key_interval(STATS_PROTO_KEY_INTERVAL), bytes_key(0), bytes_delta(0) { }
+
+	void SetCrateID(unsigned short crateID_){ crate_id = crateID_; }
+
+	/// Send a key record every interval_ records (1 sends only key records).
+	void SetKeyInterval(unsigned int interval_){ key_interval = (interval_ > 0 ? interval_ : 1); }
+
+	unsigned short GetCrateID(){ return crate_id; }
+
+	unsigned long long GetKeyBytes(){ return bytes_key; }
+
+	unsigned long long GetDeltaBytes(){ return bytes_delta; }
+
+	/// Encode record_ into datagrams_, as a key record or as the fields which changed since the last record.
+	void Encode(const StatsRecord &record_, std::vector<std::string> &datagrams_);
+
+	/// Return the datagram telling monitors that the sender has stopped.
+	std::string EncodeClose();
+
+	/// Send a key record next.
+	void Reset(){ last_fields.clear(); }
+};
+
+/// What a StatsDecoder knows about one crate.
+struct StatsCrate{
+	unsigned short id;
+	StatsRecord record; /// The last known stats of the crate
+	std::vector<bool> changed; /// Fields which changed since ClearChanged was last called
+	bool layout_changed; /// Set when the number of modules or channels changed
+
+	unsigned int sequence; /// Number of the latest record seen
+	unsigned int fragments_seen; /// Fragments of the latest record seen
+	unsigned int num_fragments; /// Fragments in the latest record
+	bool synced; /// Set once a key record has been seen and no fragment has been lost since
+	bool closed; /// Set once the sender has stopped
+
+	unsigned long long records; /// Complete records received
+	unsigned long long lost; /// Records with a missing fragment, or skipped altogether
+
+	StatsCrate() : id(0), layout_changed(true), sequence(0), fragments_seen(0), num_fragments(0), synced(false), closed(false), records(0), lost(0) { }
+};
+
+class StatsDecoder{
+  private:
+	std::map<unsigned short, StatsCrate> crates;
+	unsigned long long rejected; /// Packets which were not stats packets, or of another version
+
+  public:
+	StatsDecoder() : rejected(0) { }
+
+	/** Decode a datagram. Returns true if it completed a record (or closed a crate), and sets
+	  * crate_ to the ID of the crate it came from. */
+	bool Decode(const char *buffer_, size_t length_, unsigned short &crate_);
+
+	/// Return a crate, or NULL if nothing has been received from it.
+	StatsCrate *GetCrate(unsigned short crate_);
+
+	std::map<unsigned short, StatsCrate> &GetCrates(){ return crates; }
+
+	/// Return true if every crate seen has stopped (false if none have been seen).
+	bool AllClosed();
+
+	/// Forget which fields of every crate changed.
+	void ClearChanged();
+
+	unsigned long long GetRejected(){ return rejected; }
+};
+
+#endif
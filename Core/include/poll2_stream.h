@@ -0,0 +1,268 @@
+/** \file poll2_stream.h
+  *
+  * \brief Stream socket (TCP or Unix domain) server used to pass spills to remote programs
+  *
+  * \date Oct. 18th, 2026
+  *
+  * The StreamServer class listens on a TCP port and/or a Unix domain socket and
+  * accepts any number of subscribers. Every record (spill, flag, etc.) is sent
+  * to each subscriber with a StreamRecordHeader in front of it. Records are
+  * queued for each subscriber and written with non-blocking sends, so a slow
+  * subscriber never holds up the acquisition. Once a subscriber's queue is
+  * full, the slow client policy decides what happens:
+  *  STREAM_SLOW_SAMPLE - New spills are skipped for that subscriber until its
+  *                       queue drains (it sees a downsampled stream, the default).
+  *  STREAM_SLOW_DROP   - The subscriber is disconnected.
+  * Flags are always queued. Subscribers can tell that spills were skipped from
+  * gaps in the record sequence numbers.
+  *
+  * A subscriber which only needs part of the system may send a
+  * StreamSubscription at any time with a mask of the modules and of the
+  * channels of each module it wants. It is then sent spills which only hold
+  * the matching data. Module records which do not match are kept as empty
+  * (two word) records so the module numbers stay in order for the Unpacker.
+  * Subscribers with the same subscription share a single filtered copy.
+  *
+  * The StreamReader class connects to a StreamServer and reads the records.
+*/
+
+#ifndef POLL2_STREAM_H
+#define POLL2_STREAM_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <atomic>
+
+#define POLL2_STREAM_VERSION "1.1.00"
+#define POLL2_STREAM_DATE "Oct. 18th, 2026"
+
+// First word of every stream record header ("STRM")
+#define STREAM_RECORD_MAGIC 0x4D525453
+
+// First word of a subscription request ("SUBS")
+#define STREAM_SUBSCRIBE_MAGIC 0x53425553
+
+// Number of modules and channels per module which may be selected by a subscription
+#define STREAM_MAX_MODULES 32
+#define STREAM_ALL_CHANNELS 0xFFFF
+
+// Default maximum number of bytes queued for a single subscriber (32 MB)
+#define STREAM_QUEUE_SIZE 33554432
+
+// Maximum number of subscribers connected at once
+#define STREAM_MAX_CLIENTS 32
+
+// Maximum number of queued records handed to the kernel in a single send
+#define STREAM_SEND_BATCH 64
+
+// Slow client policies
+#define STREAM_SLOW_SAMPLE 0
+#define STREAM_SLOW_DROP 1
+
+/// Header sent in front of every record on the stream.
+struct StreamRecordHeader{
+	unsigned int magic; /// Always STREAM_RECORD_MAGIC
+	unsigned int type; /// The record type (SHM_RECORD_SPILL, SHM_RECORD_FLAG, etc.)
+	unsigned int length; /// Number of payload bytes following the header
+	unsigned int seq; /// Record sequence number (counts every record published by the server)
+};
+
+/// Sent by a subscriber to choose which modules and channels it receives.
+struct StreamSubscription{
+	unsigned int magic; /// Always STREAM_SUBSCRIBE_MAGIC
+	unsigned int module_mask; /// Bit N is set to receive module N
+	unsigned short channel_mask[STREAM_MAX_MODULES]; /// Bit N is set to receive channel N of each module
+
+	/// Subscribe to the channels in channelMask_ of the modules in moduleMask_ (everything by default).
+	StreamSubscription(unsigned int moduleMask_=0xFFFFFFFF, unsigned short channelMask_=STREAM_ALL_CHANNELS);
+
+	/// Return true if every channel of every module is selected.
+	bool IsEverything() const;
+
+	bool operator == (const StreamSubscription &other_) const;
+};
+
+/** Parse a list of numbers and ranges (e.g. "0,2,5-7") smaller than max_ into a bit mask.
+  * Returns false if the list is empty or holds anything else. */
+bool parse_stream_mask(const std::string &list_, unsigned int &mask_, unsigned int max_=STREAM_MAX_MODULES);
+
+/// Summary of a subscriber's state, used for status displays.
+struct StreamClientInfo{
+	std::string address; /// Address of the subscriber
+	size_t queued_bytes; /// Bytes waiting to be sent (the subscriber's lag)
+	size_t queued_records; /// Records waiting to be sent
+	size_t max_queued_bytes; /// Largest lag seen for this subscriber
+	unsigned long long bytes_sent; /// Bytes sent to the subscriber
+	unsigned long long records_sent; /// Records completely sent to the subscriber
+	unsigned long long records_skipped; /// Spills skipped because the subscriber was too slow
+	bool filtered; /// Set if the subscriber only receives part of each spill
+	unsigned int module_mask; /// Modules received by the subscriber
+	unsigned long long bytes_filtered; /// Spill bytes not sent because of the subscription
+};
+
+class StreamServer{
+  private:
+	typedef std::shared_ptr<const std::vector<char> > record_t;
+
+	/// A single connected subscriber.
+	struct StreamClient{
+		int fd;
+		StreamClientInfo info;
+		std::deque<record_t> queue; /// Records waiting to be sent
+		size_t offset; /// Number of bytes of the front record already sent
+		StreamSubscription sub; /// The modules and channels the subscriber wants
+		StreamSubscription request; /// Subscription request being received
+		size_t request_recvd; /// Number of bytes of the request received
+	};
+
+	int tcp_fd; /// Listening TCP socket (-1 if not in use)
+	int unix_fd; /// Listening Unix domain socket (-1 if not in use)
+	std::string unix_path;
+	std::string address; /// The address given to Init
+	bool init;
+
+	size_t max_queue; /// Maximum number of bytes queued for each subscriber
+	unsigned int policy; /// The slow client policy
+	unsigned int next_seq; /// Sequence number of the next record
+
+	std::vector<StreamClient*> clients;
+	std::mutex client_lock; /// Protects the client list from status requests in other threads
+
+	// Counters read by other threads (e.g. the metrics server)
+	std::atomic<unsigned long long> num_published; /// Records published
+	std::atomic<unsigned long long> num_skipped; /// Spills skipped for slow subscribers
+	std::atomic<unsigned long long> num_accepted; /// Subscribers accepted
+	std::atomic<unsigned long long> num_dropped; /// Subscribers disconnected for being too slow
+
+	/// Accept any new subscribers waiting on listen_fd_.
+	void Accept(int listen_fd_, bool is_unix_);
+
+	/// Send as much of a subscriber's queue as the socket will take. Returns false if the subscriber has gone.
+	bool Flush(StreamClient *client_);
+
+	/// Disconnect the subscriber at index_ in the client list.
+	void Disconnect(size_t index_);
+
+	/// Read any subscription requests sent by a subscriber. Returns false if the subscriber has gone or sent garbage.
+	bool ReadRequests(StreamClient *client_);
+
+	/// Build a record from a header and nBytes_ of payload.
+	static record_t MakeRecord(const StreamRecordHeader &head_, const void *data_, size_t nBytes_);
+
+  public:
+	StreamServer();
+
+	~StreamServer();
+
+	/** Listen for subscribers on address_, which is either a TCP port number or the path of a
+	  * Unix domain socket. Returns false if the socket cannot be created or bound. */
+	bool Init(const std::string &address_);
+
+	/// Set the maximum number of bytes queued for each subscriber.
+	void SetQueueSize(size_t bytes_){ max_queue = bytes_; }
+
+	/// Set the slow client policy.
+	void SetPolicy(unsigned int policy_){ policy = policy_; }
+
+	/** Queue a record of nBytes_ for every subscriber and send as much as possible without
+	  * blocking. The record is copied once, no matter how many subscribers there are. Returns
+	  * false if the record was skipped or a subscriber was dropped. */
+	bool Publish(unsigned int type_, const void *data_, size_t nBytes_);
+
+	/** Accept new subscribers, notice ones which have disconnected and continue sending queued
+	  * records. Should be called regularly, even when nothing is being published. */
+	void Service();
+
+	/** Copy the parts of a spill of nWords_ words matching sub_ into dest_, which must have room
+	  * for nWords_ words. Returns the number of words written. Records which are not module data
+	  * (e.g. the wall clock) are always copied. */
+	static size_t FilterSpill(const unsigned int *data_, size_t nWords_, const StreamSubscription &sub_, unsigned int *dest_);
+
+	/// Fill clients_ with the state of every connected subscriber.
+	void GetClients(std::vector<StreamClientInfo> &clients_);
+
+	std::string GetAddress(){ return address; }
+
+	unsigned int GetPolicy(){ return policy; }
+
+	size_t GetQueueSize(){ return max_queue; }
+
+	unsigned int GetNumClients();
+
+	unsigned long long GetPublished(){ return num_published.load(std::memory_order_relaxed); }
+
+	unsigned long long GetSkipped(){ return num_skipped.load(std::memory_order_relaxed); }
+
+	unsigned long long GetAccepted(){ return num_accepted.load(std::memory_order_relaxed); }
+
+	unsigned long long GetDropped(){ return num_dropped.load(std::memory_order_relaxed); }
+
+	bool IsInit(){ return init; }
+
+	/// Disconnect all subscribers and close the listening sockets.
+	void Close();
+};
+
+class StreamReader{
+  private:
+	int fd;
+	bool init;
+
+	StreamSubscription sub; /// Subscription sent to the server on every connection
+	bool have_sub; /// Set if Subscribe has been called
+
+	StreamRecordHeader head; /// Header of the record being received
+	size_t head_recvd; /// Number of header bytes received
+	std::vector<unsigned int> payload; /// Payload of the record being received
+	size_t payload_recvd; /// Number of payload bytes received
+
+	unsigned int last_seq; /// Sequence number of the last record read
+	bool have_seq; /// Set once the first record has been read
+
+	unsigned long long num_records; /// Records read
+	unsigned long long num_bytes; /// Payload bytes read
+	unsigned long long num_missed; /// Records skipped by the server
+
+	/// Receive up to nBytes_ into dest_ without blocking. Returns false if the connection was lost.
+	bool Recv(char *dest_, size_t nBytes_, size_t &recvd_);
+
+  public:
+	StreamReader();
+
+	~StreamReader();
+
+	int Get(){ return fd; }
+
+	/** Connect to a StreamServer at address_, which is either host:port or the path of a Unix
+	  * domain socket. Returns false if the connection fails. */
+	bool Init(const std::string &address_);
+
+	/** Ask the server for only the modules and channels selected by sub_. The subscription is
+	  * kept and sent again every time Init connects. Returns false if the request could not be sent. */
+	bool Subscribe(const StreamSubscription &sub_);
+
+	/** Swap the next complete record into buffer_, which always has room for two extra words
+	  * past the end of the record. Returns false if no complete record has arrived yet. The
+	  * reader is closed if the server disconnects or sends a bad record header. */
+	bool Read(std::vector<unsigned int> &buffer_, unsigned int &type_, size_t &nBytes_);
+
+	/** Sleep until more data arrives or until timeout_ms_ milliseconds have passed. Returns
+	  * true if there is data to read. */
+	bool Wait(int timeout_ms_);
+
+	unsigned long long GetRecordsRead(){ return num_records; }
+
+	unsigned long long GetBytesRead(){ return num_bytes; }
+
+	unsigned long long GetRecordsMissed(){ return num_missed; }
+
+	bool IsInit(){ return init; }
+
+	/// Close the connection.
+	void Close();
+};
+
+#endif
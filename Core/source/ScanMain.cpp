@@ -9,10 +9,15 @@
 #include "Unpacker.hpp"
 #include "hribf_buffers.h"
 #include "poll2_socket.h"
+#include "poll2_spill.h"
+#include "poll2_shm.h"
+#include "poll2_stream.h"
+#include "poll2_event.h"
+#include "poll2_hugepage.h"
 #include "CTerminal.h"
 
-#define SCAN_VERSION "1.2.00"
-#define SCAN_DATE "Oct. 1st, 2015"
+#define SCAN_VERSION "1.4.00"
+#define SCAN_DATE "Oct. 18th, 2026"
 
 std::string prefix, extension;
 
@@ -25,12 +30,20 @@ bool debug_mode;
 bool dry_run_mode;
 bool force_overwrite;
 bool shm_mode;
+bool shm_udp_mode;
+bool stream_mode;
+
+std::string stream_address;
+StreamSubscription stream_sub;
+std::string mcast_group;
+std::string mcast_iface;
 
 bool kill_all = false;
 bool scan_running = false;
 bool run_ctrl_exit = false;
 
 Server poll_server;
+EventLoop event_loop;
 
 std::ifstream input_file;
 
@@ -60,88 +73,189 @@ void start_run_control(Unpacker *core_){
 	}
 
 	// Now we're ready to read the first data buffer
-	if(shm_mode){
+	if(stream_mode){
 		std::cout << std::endl;
-		unsigned int data[250000];
-		unsigned int shm_data[10002]; // Array to store the temporary shm data (~40 kB)
-		int dummy;
-		int previous_chunk;
-		int current_chunk;
-		int total_chunks;
-		int nBytes;
-		unsigned int nTotalBytes;
-	
-		while(true){
-			previous_chunk = 0;
-			current_chunk = 0;
-			total_chunks = -1;
-			nTotalBytes = 0;
-		
-			while(current_chunk != total_chunks){
-				if(kill_all == true){ 
-					run_ctrl_exit = true;
-					return;
+		StreamReader reader;
+		std::vector<unsigned int> buffer;
+		unsigned int type;
+		size_t nBytes;
+		int reader_fd = -1;
+
+		if(!stream_sub.IsEverything()){ reader.Subscribe(stream_sub); }
+
+		// Read every complete record which has arrived on the stream
+		EventCallback on_data = [&](int, unsigned int){
+			while(reader.Read(buffer, type, nBytes)){
+				if(type == SHM_RECORD_FLAG){
+					if(debug_mode){ std::cout << "debug: Received poll2 flag " << (char *)&buffer[0] << std::endl; }
+					continue;
 				}
+				else if(type != SHM_RECORD_SPILL){ continue; }
+
+				unsigned int *data = &buffer[0];
+				unsigned int nWords = nBytes / 4;
 
-				std::stringstream status;
-				if(!poll_server.Select(dummy)){
-					status << "\033[0;33m" << "[IDLE]" << "\033[0m" << " Waiting for a spill...";
+				if(debug_mode){ std::cout << "debug: Retrieved spill of " << nBytes << " bytes (" << nWords << " words)\n"; }
+				if(!dry_run_mode){ 
+					data[nWords] = 2;
+					data[nWords+1] = 9999;
+					core_->ReadSpill(data, nWords + 2, is_verbose); 
+				}
+				num_spills_recvd++;
+			}
+			if(!reader.IsInit()){ // poll2 went away
+				event_loop.Remove(reader_fd);
+				reader_fd = -1;
+			}
+		};
+
+		// Connect to poll2 (or reconnect if it went away) and update the status bar
+		unsigned long long last_records = 0;
+		TimerCallback on_status = [&](){
+			std::stringstream status;
+			if(!reader.IsInit()){
+				if(!reader.Init(stream_address)){
+					status << "\033[0;33m" << "[IDLE]" << "\033[0m" << " Waiting for poll2 stream server " << stream_address << "...";
 					term_->SetStatus(status.str());
-					continue; 
+					return;
 				}
+				reader_fd = reader.Get();
+				event_loop.Add(reader_fd, on_data);
+			}
+			if(reader.GetRecordsRead() == last_records){
+				status << "\033[0;33m" << "[IDLE]" << "\033[0m" << " Waiting for a spill...";
+			}
+			else{
+				status << "\033[0;32m" << "[RECV] " << "\033[0m" << reader.GetRecordsRead() << " records, ";
+				status << reader.GetBytesRead() << " bytes, " << reader.GetRecordsMissed() << " skipped by poll2";
+			}
+			last_records = reader.GetRecordsRead();
+			term_->SetStatus(status.str());
+		};
+
+		on_status();
+		event_loop.AddTimer(1000, on_status);
+		event_loop.Run();
+
+		run_ctrl_exit = true;
+		return;
+	}
+	else if(shm_mode && !shm_udp_mode){
+		std::cout << std::endl;
+		ShmReader reader;
+		std::vector<unsigned int> buffer;
+		unsigned int type;
+		size_t nBytes;
+	
+		while(true){
+			if(kill_all == true){ 
+				run_ctrl_exit = true;
+				return;
+			}
 
-				nBytes = poll_server.RecvMessage((char*)shm_data, 40008); // Read from the socket
-				if(strcmp((char*)shm_data, "$CLOSE_FILE") == 0 || strcmp((char*)shm_data, "$OPEN_FILE") == 0 || strcmp((char*)shm_data, "$KILL_SOCKET") == 0){ continue; } // Poll2 network flags
-				// Did not read enough bytes
-				else if(nBytes < 8){
+			std::stringstream status;
+			if(!reader.IsInit() || reader.IsStale()){ // Attach to the ring (or re-attach if poll2 replaced it)
+				reader.Close();
+				if(!reader.Init(SHM_SPILL_RING)){
+					status << "\033[0;33m" << "[IDLE]" << "\033[0m" << " Waiting for poll2 shm ring " << SHM_SPILL_RING << "...";
+					term_->SetStatus(status.str());
+					sleep(1);
 					continue;
 				}
-				status << "\033[0;32m" << "[RECV] " << "\033[0m" << nBytes;
-				term_->SetStatus(status.str());
+			}
 
-				if(debug_mode){ std::cout << "debug: Received " << nBytes << " bytes from the network\n"; }
-				memcpy((char *)&current_chunk, &shm_data[0], 4);
-				memcpy((char *)&total_chunks, &shm_data[4], 4);
+			// Sleep until poll2 publishes a spill
+			if(!reader.Wait(1000)){
+				status << "\033[0;33m" << "[IDLE]" << "\033[0m" << " Waiting for a spill...";
+				term_->SetStatus(status.str());
+				continue; 
+			}
 
-				if(previous_chunk == -1 && current_chunk != 1){ // Started reading in the middle of a spill, ignore the rest of it
-					if(debug_mode){ std::cout << "debug: Skipping chunk " << current_chunk << " of " << total_chunks << std::endl; }
+			while(reader.Read(buffer, type, nBytes)){
+				if(type == SHM_RECORD_FLAG){
+					if(debug_mode){ std::cout << "debug: Received poll2 flag " << (char *)&buffer[0] << std::endl; }
 					continue;
 				}
-				else if(previous_chunk != current_chunk - 1){ // We missed a spill chunk somewhere
-					if(debug_mode){ std::cout << "debug: Found chunk " << current_chunk << " but expected chunk " << previous_chunk+1 << std::endl; }
-					break;
-				}
+				else if(type != SHM_RECORD_SPILL){ continue; }
 
-				previous_chunk = current_chunk;
-		
-				// Copy the shm spill chunk into the data array
-				if(nTotalBytes + 2 + nBytes <= 1000000){ // This spill chunk will fit into the data buffer
-					memcpy(&data[nTotalBytes], &shm_data[8], nBytes - 8);
-					nTotalBytes += (nBytes - 8);				
+				unsigned int *data = &buffer[0];
+				unsigned int nWords = nBytes / 4;
+
+				if(debug_mode){ std::cout << "debug: Retrieved spill of " << nBytes << " bytes (" << nWords << " words)\n"; }
+				if(!dry_run_mode){ 
+					data[nWords] = 2;
+					data[nWords+1] = 9999;
+					core_->ReadSpill(data, nWords + 2, is_verbose); 
 				}
-				else{ 
-					if(debug_mode){ std::cout << "debug: Abnormally full spill buffer with " << nTotalBytes + 2 + nBytes << " bytes!\n"; }
-					break; 
+				num_spills_recvd++;
+			}
+			
+			status << "\033[0;32m" << "[RECV] " << "\033[0m" << reader.GetRecordsRead() << " records, ";
+			status << reader.GetBytesRead() << " bytes, " << reader.GetRecordsMissed() << " missed";
+			term_->SetStatus(status.str());
+		}
+	}
+	else if(shm_mode){
+		std::cout << std::endl;
+		SpillReceiver receiver(&poll_server);
+		if(debug_mode){ receiver.SetDebugMode(); }
+
+		// Hand every completed spill to the unpacker. Receive reads all chunks waiting on the socket
+		// straight into the spill buffer and also repeats any requests for missing chunks.
+		auto receive_spills = [&](){
+			while(receiver.Receive()){
+				unsigned int *data = receiver.GetSpill();
+				unsigned int nWords = receiver.GetSpillWords();
+			
+				if(debug_mode){ std::cout << "debug: Retrieved spill of " << 4*nWords << " bytes (" << nWords << " words)\n"; }
+				if(!dry_run_mode){ 
+					data[nWords] = 2;
+					data[nWords+1] = 9999;
+					core_->ReadSpill(data, nWords + 2, is_verbose); 
 				}
+				num_spills_recvd++;
 			}
-		
-			if(debug_mode){ std::cout << "debug: Retrieved spill of " << nTotalBytes << " bytes (" << nTotalBytes/4 << " words)\n"; }
-			if(!dry_run_mode){ 
-				int word1 = 2, word2 = 9999;
-				memcpy(&data[nTotalBytes], (char *)&word1, 4);
-				memcpy(&data[nTotalBytes+4], (char *)&word2, 4);
-				core_->ReadSpill(data, nTotalBytes/4 + 2, is_verbose); 
+		};
+
+		unsigned long long last_dgrams = 0;
+		TimerCallback on_status = [&](){
+			std::stringstream status;
+			if(receiver.GetDatagramsReceived() == last_dgrams){
+				status << "\033[0;33m" << "[IDLE]" << "\033[0m" << " Waiting for a spill...";
 			}
-			num_spills_recvd++;
-		}
+			else{
+				status << "\033[0;32m" << "[RECV] " << "\033[0m" << receiver.GetSpillsReassembled() << " spills, ";
+				status << receiver.GetBytesReceived() << " bytes, " << receiver.GetSpillsDropped() << " dropped";
+				if(receiver.GetNacksSent() > 0){ status << ", " << receiver.GetSpillsRecovered() << " recovered"; }
+			}
+			last_dgrams = receiver.GetDatagramsReceived();
+			term_->SetStatus(status.str());
+		};
+
+		event_loop.Add(poll_server.Get(), [&](int, unsigned int){ receive_spills(); });
+		event_loop.AddTimer((int)(SHM_NACK_TIMEOUT * 1000), receive_spills); // Keep repeating NACKs while no chunks arrive
+		event_loop.AddTimer(250, on_status);
+		on_status();
+		event_loop.Run();
+
+		run_ctrl_exit = true;
+		return;
 	}
 	else if(file_format == 0){
 		unsigned int *data = NULL;
 		bool full_spill;
 		bool bad_spill;
 		unsigned int nBytes;
+		HugePageRegion region; // Spills are scanned in place, so keep them on huge pages
 		
-		if(!dry_run_mode){ data = new unsigned int[250000]; }
+		if(!dry_run_mode){
+			if(!region.Allocate(250000*sizeof(unsigned int))){
+				std::cout << sys_message_head << "Failed to allocate memory for spill data!\n";
+				run_ctrl_exit = true;
+				return;
+			}
+			data = (unsigned int *)region.Get();
+		}
 		
 		while(databuff.Read(&input_file, (char*)data, nBytes, 1000000, full_spill, bad_spill, dry_run_mode)){ 
 			if(full_spill){ 
@@ -169,14 +283,20 @@ void start_run_control(Unpacker *core_){
 		else{
 			std::cout << sys_message_head << "Failed to find end of file buffer!\n";
 		}
-		
-		if(!dry_run_mode){ delete[] data; }
 	}
 	else if(file_format == 1){
 		unsigned int *data = NULL;
 		int nBytes;
+		HugePageRegion region;
 		
-		if(!dry_run_mode){ data = new unsigned int[max_spill_size+2]; }
+		if(!dry_run_mode){
+			if(!region.Allocate((max_spill_size+2)*sizeof(unsigned int))){
+				std::cout << sys_message_head << "Failed to allocate memory for spill data!\n";
+				run_ctrl_exit = true;
+				return;
+			}
+			data = (unsigned int *)region.Get();
+		}
 		
 		while(pldData.Read(&input_file, (char*)data, nBytes, 4*max_spill_size, dry_run_mode)){ 
 			if(debug_mode){ 
@@ -199,8 +319,6 @@ void start_run_control(Unpacker *core_){
 		else{
 			std::cout << sys_message_head << "Failed to find end of file buffer!\n";
 		}
-		
-		if(!dry_run_mode){ delete[] data; }
 	}
 	else if(file_format == 2){
 	}
@@ -224,6 +342,7 @@ void start_cmd_control(){
 				if(scan_running){ std::cout << sys_message_head << "Warning! Cannot quit while scan is running\n"; }
 				else{
 					kill_all = true;
+					event_loop.Stop();
 					while(!run_ctrl_exit){ sleep(1); }
 					break;
 				}
@@ -260,6 +379,12 @@ void help(char *name_, Unpacker *core_){
 	std::cout << "   --version  - Display version information\n";
 	std::cout << "   --debug    - Enable readout debug mode\n";
 	std::cout << "   --shm      - Enable shared memory readout\n";
+	std::cout << "   --shm-udp  - Enable shared memory readout over UDP port 5555 (old style)\n";
+	std::cout << "   --stream [host:port|path] - Enable shared memory readout from a poll2 stream server\n";
+	std::cout << "   --modules [list] - Only receive these modules from the stream server (e.g. 0,2-4)\n";
+	std::cout << "   --channels [list] - Only receive these channels of each module from the stream server (e.g. 0-7)\n";
+	std::cout << "   --mcast [group] - Enable shared memory readout from a poll2 multicast group on port 5555\n";
+	std::cout << "   --mcast-if [iface] - Join the multicast group on a given interface name or address\n";
 	std::cout << "   --ldf      - Force use of ldf readout\n";
 	std::cout << "   --pld      - Force use of pld readout\n";
 	std::cout << "   --root     - Force use of root readout\n";
@@ -281,12 +406,18 @@ int main(int argc, char *argv[]){
 		std::cout << " |hribf_buffers-v" << HRIBF_BUFFERS_VERSION << " (" << HRIBF_BUFFERS_DATE << ")\n";
 		std::cout << " |CTerminal-----v" << CTERMINAL_VERSION << " (" << CTERMINAL_DATE << ")\n";
 		std::cout << " |poll2_socket--v" << POLL2_SOCKET_VERSION << " (" << POLL2_SOCKET_DATE << ")\n";
+		std::cout << " |poll2_spill---v" << POLL2_SPILL_VERSION << " (" << POLL2_SPILL_DATE << ")\n";
+		std::cout << " |poll2_shm-----v" << POLL2_SHM_VERSION << " (" << POLL2_SHM_DATE << ")\n";
+		std::cout << " |poll2_stream--v" << POLL2_STREAM_VERSION << " (" << POLL2_STREAM_DATE << ")\n";
+		std::cout << " |poll2_event---v" << POLL2_EVENT_VERSION << " (" << POLL2_EVENT_DATE << ")\n";
 		return 0;
 	}
 	
 	debug_mode = false;
 	dry_run_mode = false;
 	shm_mode = false;
+	shm_udp_mode = false;
+	stream_mode = false;
 
 	num_spills_recvd = 0;
 
@@ -332,6 +463,61 @@ int main(int argc, char *argv[]){
 			shm_mode = true;
 			std::cout << " Using shm mode!\n";
 		}
+		else if(current_arg == "--shm-udp"){ 
+			file_format = 0;
+			shm_mode = true;
+			shm_udp_mode = true;
+			std::cout << " Using shm mode over UDP!\n";
+		}
+		else if(current_arg == "--mcast" || current_arg == "--mcast-if"){
+			if(scan_args.empty()){
+				std::cout << " Error: Missing required argument to option '" << current_arg << "'!\n";
+				help(argv[0], core);
+				return 1;
+			}
+			if(current_arg == "--mcast-if"){
+				mcast_iface = scan_args.front();
+				scan_args.pop_front();
+				continue;
+			}
+			mcast_group = scan_args.front();
+			scan_args.pop_front();
+			file_format = 0;
+			shm_mode = true;
+			shm_udp_mode = true;
+			std::cout << " Using shm mode over multicast!\n";
+		}
+		else if(current_arg == "--stream"){
+			if(scan_args.empty()){
+				std::cout << " Error: Missing required argument to option '--stream'!\n";
+				help(argv[0], core);
+				return 1;
+			}
+			stream_address = scan_args.front();
+			scan_args.pop_front();
+			file_format = 0;
+			shm_mode = true;
+			stream_mode = true;
+			std::cout << " Using shm mode over a stream socket!\n";
+		}
+		else if(current_arg == "--modules" || current_arg == "--channels"){
+			if(scan_args.empty()){
+				std::cout << " Error: Missing required argument to option '" << current_arg << "'!\n";
+				help(argv[0], core);
+				return 1;
+			}
+			unsigned int mask;
+			bool is_module = (current_arg == "--modules");
+			if(!parse_stream_mask(scan_args.front(), mask, (is_module ? STREAM_MAX_MODULES : 16))){
+				std::cout << " Error: Invalid " << (is_module ? "module" : "channel") << " list '" << scan_args.front() << "'!\n";
+				return 1;
+			}
+			scan_args.pop_front();
+			if(is_module){ stream_sub.module_mask = mask; }
+			else{
+				for(unsigned int i = 0; i < STREAM_MAX_MODULES; i++){ stream_sub.channel_mask[i] = mask; }
+			}
+		}
 		else if(current_arg == "--ldf"){ 
 			file_format = 0;
 		}
@@ -400,11 +586,22 @@ int main(int argc, char *argv[]){
 		}
 	}
 	else{
-		if(!poll_server.Init(5555, 1)){
+		if(!mcast_group.empty()){
+			if(!poll_server.InitMulticast(mcast_group.c_str(), 5555, (mcast_iface.empty() ? NULL : mcast_iface.c_str()), 0, 100000)){
+				std::cout << " ERROR: Failed to join multicast group " << mcast_group << " on port 5555!\n";
+				return 1;
+			}
+		}
+		else if(shm_udp_mode && !poll_server.Init(5555, 0, 100000)){
 			std::cout << " ERROR: Failed to open shm socket 5555!\n";
 			return 1;
 		}
 
+		if(!event_loop.Init()){
+			std::cout << " ERROR: Failed to create event loop!\n";
+			return 1;
+		}
+
 		std::string temp_name = std::string(PROG_NAME);
 		
 		// Only initialize the terminal if this is shared-memory mode
@@ -420,7 +617,10 @@ int main(int argc, char *argv[]){
 	if(dry_run_mode){ std::cout << sys_message_head << "Doing a dry run.\n"; }
 	if(shm_mode){ 
 		std::cout << sys_message_head << "Using shared-memory mode.\n"; 
-		std::cout << sys_message_head << "Listening on poll2 SHM port 5555\n";
+		if(stream_mode){ std::cout << sys_message_head << "Reading from poll2 stream server " << stream_address << "\n"; }
+		else if(!mcast_group.empty()){ std::cout << sys_message_head << "Listening on poll2 multicast group " << mcast_group << " port 5555\n"; }
+		else if(shm_udp_mode){ std::cout << sys_message_head << "Listening on poll2 SHM port 5555\n"; }
+		else{ std::cout << sys_message_head << "Reading from poll2 shm ring " << SHM_SPILL_RING << "\n"; }
 	}
 
 	if(!shm_mode){
@@ -488,6 +688,7 @@ int main(int argc, char *argv[]){
 	
 		// Close the socket and restore the terminal
 		terminal.Close();
+		event_loop.Close();
 		poll_server.Close();
 		
 		//Reprint the leader as the carriage was returned
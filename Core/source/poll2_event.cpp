@@ -0,0 +1,182 @@
+/** \file poll2_event.cpp
+  *
+  * \brief epoll based event loop used by programs which receive poll2 data
+  *
+  * \date Oct. 18th, 2026
+*/
+
+#include "poll2_event.h"
+
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+
+EventLoop::EventLoop(){
+	epoll_fd = -1;
+	wake_fd = -1;
+	init = false;
+	stopped = false;
+	num_wakeups = 0;
+	num_events = 0;
+}
+
+EventLoop::~EventLoop(){
+	Close();
+}
+
+bool EventLoop::Init(){
+	if(init){ return false; }
+
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if(epoll_fd < 0){ return false; }
+
+	wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if(wake_fd < 0){
+		close(epoll_fd);
+		return false;
+	}
+
+	struct epoll_event event;
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.fd = wake_fd;
+	if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &event) < 0){
+		close(wake_fd);
+		close(epoll_fd);
+		return false;
+	}
+
+	stopped = false;
+
+	return init = true;
+}
+
+bool EventLoop::Add(int fd_, EventCallback callback_, unsigned int events_/*=EPOLLIN*/){
+	if(!init || fd_ < 0 || handlers.find(fd_) != handlers.end()){ return false; }
+
+	struct epoll_event event;
+	memset(&event, 0, sizeof(event));
+	event.events = events_;
+	event.data.fd = fd_;
+	if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd_, &event) < 0){ return false; }
+
+	handlers[fd_] = std::make_shared<EventCallback>(callback_);
+
+	return true;
+}
+
+bool EventLoop::Modify(int fd_, unsigned int events_){
+	if(!init || handlers.find(fd_) == handlers.end()){ return false; }
+
+	struct epoll_event event;
+	memset(&event, 0, sizeof(event));
+	event.events = events_;
+	event.data.fd = fd_;
+
+	return (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd_, &event) == 0);
+}
+
+bool EventLoop::Remove(int fd_){
+	if(!init){ return false; }
+
+	std::map<int, std::shared_ptr<EventCallback> >::iterator iter = handlers.find(fd_);
+	if(iter == handlers.end()){ return false; }
+
+	// Closed descriptors have already left the epoll set, so errors are expected here
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd_, NULL);
+	handlers.erase(iter);
+
+	std::map<int, bool>::iterator owner = owned.find(fd_);
+	if(owner != owned.end()){
+		close(fd_);
+		owned.erase(owner);
+	}
+
+	return true;
+}
+
+int EventLoop::AddTimer(int interval_ms_, TimerCallback callback_){
+	if(!init || interval_ms_ <= 0){ return -1; }
+
+	int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if(fd < 0){ return -1; }
+
+	struct itimerspec spec;
+	spec.it_interval.tv_sec = interval_ms_ / 1000;
+	spec.it_interval.tv_nsec = (interval_ms_ % 1000) * 1000000L;
+	spec.it_value = spec.it_interval;
+
+	// Read the expiration count so the timer does not stay ready, then call the user's callback
+	EventCallback handler = [callback_](int fd_, unsigned int){
+		uint64_t expirations;
+		if(read(fd_, &expirations, sizeof(expirations)) == sizeof(expirations)){ callback_(); }
+	};
+
+	if(timerfd_settime(fd, 0, &spec, NULL) < 0 || !Add(fd, handler)){
+		close(fd);
+		return -1;
+	}
+	owned[fd] = true;
+
+	return fd;
+}
+
+int EventLoop::RunOnce(int timeout_ms_/*=-1*/){
+	if(!init || stopped){ return -1; }
+
+	struct epoll_event events[EVENT_LOOP_BATCH];
+	int count = epoll_wait(epoll_fd, events, EVENT_LOOP_BATCH, timeout_ms_);
+	if(count < 0){ return (errno == EINTR ? 0 : -1); }
+	if(count > 0){ num_wakeups++; }
+
+	int dispatched = 0;
+	for(int i = 0; i < count; i++){
+		int fd = events[i].data.fd;
+		if(fd == wake_fd){
+			uint64_t value;
+			if(read(wake_fd, &value, sizeof(value)) < 0){ /* Already drained */ }
+			continue;
+		}
+
+		// An earlier callback in this batch may have removed this descriptor
+		std::map<int, std::shared_ptr<EventCallback> >::iterator iter = handlers.find(fd);
+		if(iter == handlers.end()){ continue; }
+
+		std::shared_ptr<EventCallback> callback = iter->second; // Keep it alive if it removes itself
+		(*callback)(fd, events[i].events);
+		dispatched++;
+		num_events++;
+	}
+
+	return (stopped ? -1 : dispatched);
+}
+
+void EventLoop::Run(){
+	while(RunOnce(-1) >= 0){ }
+}
+
+void EventLoop::Stop(){
+	stopped = true;
+	if(wake_fd >= 0){
+		uint64_t value = 1;
+		if(write(wake_fd, &value, sizeof(value)) < 0){ /* Counter is already non-zero */ }
+	}
+}
+
+void EventLoop::Close(){
+	if(!init){ return; }
+
+	for(std::map<int, bool>::iterator iter = owned.begin(); iter != owned.end(); iter++){ close(iter->first); }
+	owned.clear();
+	handlers.clear();
+
+	close(wake_fd);
+	close(epoll_fd);
+	wake_fd = -1;
+	epoll_fd = -1;
+
+	init = false;
+}
@@ -0,0 +1,110 @@
+/** \file poll2_history.cpp
+  *
+  * \brief Fixed size history of rates for trends and percentiles
+  *
+  * \date Oct. 18th, 2026
+  *
+  * Queries copy the window and sort it to find the percentile, which is
+  * cheap for the few hundred samples a history holds.
+*/
+
+#include <algorithm>
+#include <cmath>
+
+#include "poll2_history.h"
+
+// Glyphs of a sparkline, from lowest to highest
+static const char *spark_blocks[] = {"▁", "▂", "▃", "▄", "▅", "▆", "▇", "█"};
+static const char *spark_ascii[] = {"_", ".", "-", ":", "=", "+", "*", "#"};
+static const int num_spark_glyphs = 8;
+
+RateHistory::RateHistory(){
+	num_series = 0;
+	length = 0;
+	head = 0;
+	count = 0;
+}
+
+void RateHistory::Init(size_t nSeries_, size_t length_){
+	num_series = nSeries_;
+	length = (nSeries_ > 0 ? length_ : 0);
+	values.assign(num_series * length, 0.0);
+	Clear();
+}
+
+void RateHistory::Commit(){
+	if(length == 0){ return; }
+	head = (head + 1) % length;
+	if(count < length){ count++; }
+}
+
+void RateHistory::Clear(){
+	head = 0;
+	count = 0;
+}
+
+size_t RateHistory::GetValues(size_t series_, size_t window_, std::vector<double> &values_) const {
+	values_.clear();
+	if(series_ >= num_series || count == 0){ return 0; }
+
+	size_t nSamples = (window_ == 0 || window_ > count ? count : window_);
+	values_.reserve(nSamples);
+	size_t slot = (head + length - nSamples) % length; // Oldest sample of the window
+	for(size_t i = 0; i < nSamples; i++){
+		values_.push_back(values[slot*num_series + series_]);
+		slot = (slot + 1) % length;
+	}
+
+	return nSamples;
+}
+
+bool RateHistory::GetSummary(size_t series_, size_t window_, HistorySummary &summary_) const {
+	std::vector<double> window;
+	if(GetValues(series_, window_, window) == 0){
+		summary_ = HistorySummary();
+		return false;
+	}
+	summary_ = Summarize(window);
+	return true;
+}
+
+HistorySummary RateHistory::Summarize(const std::vector<double> &values_){
+	HistorySummary summary;
+	if(values_.empty()){ return summary; }
+
+	summary.samples = values_.size();
+	summary.min = values_[0];
+	summary.max = values_[0];
+	double sum = 0.0;
+	for(std::vector<double>::const_iterator iter = values_.begin(); iter != values_.end(); iter++){
+		if(*iter < summary.min){ summary.min = *iter; }
+		if(*iter > summary.max){ summary.max = *iter; }
+		sum += *iter;
+	}
+	summary.mean = sum / values_.size();
+
+	std::vector<double> sorted(values_);
+	size_t rank = (size_t)std::ceil(0.95 * sorted.size());
+	if(rank > 0){ rank--; }
+	std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+	summary.p95 = sorted[rank];
+
+	return summary;
+}
+
+std::string RateHistory::Sparkline(const std::vector<double> &values_, bool ascii_/*=false*/){
+	const char **glyphs = (ascii_ ? spark_ascii : spark_blocks);
+
+	std::string line;
+	if(values_.empty()){ return line; }
+
+	double low = *std::min_element(values_.begin(), values_.end());
+	double high = *std::max_element(values_.begin(), values_.end());
+	for(std::vector<double>::const_iterator iter = values_.begin(); iter != values_.end(); iter++){
+		int glyph = 0;
+		if(high > low){ glyph = (int)((*iter - low) / (high - low) * (num_spark_glyphs - 1) + 0.5); }
+		line += glyphs[glyph];
+	}
+
+	return line;
+}
@@ -0,0 +1,147 @@
+/** \file poll2_hugepage.cpp
+  *
+  * \brief Spill buffers backed by 2 MB huge pages
+  *
+  * \date Oct. 18th, 2026
+  *
+  * Transparent huge pages are only used for memory aligned to a huge page,
+  * so the region is mapped a huge page larger than needed and the start is
+  * moved up to the next 2 MB boundary.
+*/
+
+#include <cstring>
+#include <cstdint>
+
+#include <sys/mman.h>
+
+#include "poll2_hugepage.h"
+
+/// Round bytes_ up to a multiple of align_.
+static size_t round_up(size_t bytes_, size_t align_){
+	return (bytes_ + align_ - 1) / align_ * align_;
+}
+
+HugePageRegion::HugePageRegion(){
+	base = NULL;
+	size = 0;
+	map_base = NULL;
+	map_size = 0;
+	backing = HUGE_BACKING_NONE;
+}
+
+bool HugePageRegion::Allocate(size_t bytes_, bool allowHuge_/*=true*/){
+	Free();
+	if(bytes_ == 0){ return false; }
+
+	size_t hugeBytes = round_up(bytes_, HUGE_PAGE_SIZE);
+#ifdef MAP_HUGETLB
+	if(allowHuge_){
+		void *mem = mmap(NULL, hugeBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+		if(mem != MAP_FAILED){
+			base = map_base = mem;
+			size = map_size = hugeBytes;
+			backing = HUGE_BACKING_HUGETLB;
+			return true;
+		}
+	}
+#endif
+
+	// Map an extra huge page so the start can be moved to a 2 MB boundary
+	size_t mapBytes = (allowHuge_ ? hugeBytes + HUGE_PAGE_SIZE : bytes_);
+	void *mem = mmap(NULL, mapBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(mem == MAP_FAILED){ return false; }
+
+	map_base = mem;
+	map_size = mapBytes;
+	base = mem;
+	size = bytes_;
+	backing = HUGE_BACKING_PAGES;
+
+#ifdef MADV_HUGEPAGE
+	if(allowHuge_){
+		base = (void *)round_up((uintptr_t)mem, HUGE_PAGE_SIZE);
+		size = hugeBytes;
+		if(madvise(base, size, MADV_HUGEPAGE) == 0){ backing = HUGE_BACKING_THP; }
+	}
+#endif
+
+	// Fault every page in now rather than during a run
+	memset(base, 0, size);
+
+	return true;
+}
+
+void HugePageRegion::Free(){
+	if(map_base){ munmap(map_base, map_size); }
+	base = NULL;
+	size = 0;
+	map_base = NULL;
+	map_size = 0;
+	backing = HUGE_BACKING_NONE;
+}
+
+size_t HugePageRegion::GetAlignment(){
+	if(!base){ return 0; }
+	uintptr_t address = (uintptr_t)base;
+	return (size_t)(address & (~address + 1)); // The lowest set bit
+}
+
+const char *HugePageRegion::BackingName(int backing_){
+	switch(backing_){
+		case HUGE_BACKING_HUGETLB: return "hugetlb";
+		case HUGE_BACKING_THP: return "thp";
+		case HUGE_BACKING_PAGES: return "pages";
+		default: return "none";
+	}
+}
+
+SpillBufferPool::SpillBufferPool(){
+	block_words = 0;
+	stride = 0;
+	num_blocks = 0;
+}
+
+bool SpillBufferPool::Init(size_t nBlocks_, size_t nWords_, bool allowHuge_/*=true*/){
+	std::lock_guard<std::mutex> guard(pool_lock);
+	free_blocks.clear();
+	block_words = 0;
+	num_blocks = 0;
+	if(nBlocks_ == 0 || nWords_ == 0){ return false; }
+
+	stride = round_up(nWords_ * sizeof(unsigned int), HUGE_BLOCK_ALIGN);
+	if(!region.Allocate(stride * nBlocks_, allowHuge_)){ return false; }
+
+	block_words = stride / sizeof(unsigned int);
+	num_blocks = nBlocks_;
+	char *start = (char *)region.Get();
+	for(size_t i = nBlocks_; i > 0; i--){ free_blocks.push_back((unsigned int *)(start + (i - 1) * stride)); } // Hand out the first block first
+
+	return true;
+}
+
+unsigned int *SpillBufferPool::Get(){
+	std::lock_guard<std::mutex> guard(pool_lock);
+	if(free_blocks.empty()){ return NULL; }
+	unsigned int *block = free_blocks.back();
+	free_blocks.pop_back();
+	return block;
+}
+
+void SpillBufferPool::Put(unsigned int *block_){
+	if(!block_){ return; }
+	std::lock_guard<std::mutex> guard(pool_lock);
+	free_blocks.push_back(block_);
+}
+
+void SpillBufferPool::Free(){
+	std::lock_guard<std::mutex> guard(pool_lock);
+	free_blocks.clear();
+	region.Free();
+	block_words = 0;
+	num_blocks = 0;
+}
+
+size_t SpillBufferPool::GetNumFree(){
+	std::lock_guard<std::mutex> guard(pool_lock);
+	return free_blocks.size();
+}
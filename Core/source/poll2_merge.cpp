@@ -0,0 +1,304 @@
+/** \file poll2_merge.cpp
+  *
+  * \brief Merges the spills of several crates into one stream ordered by event time
+  *
+  * \date Oct. 18th, 2026
+  *
+  * Spills are kept whole while any of their events are held, so an event is
+  * only copied once, when it is released into the merged spill. The events
+  * of each source are sorted on arrival, and a heap of the earliest event of
+  * every source picks the next event to release.
+*/
+
+#include <algorithm>
+#include <queue>
+#include <functional>
+
+#include "poll2_merge.h"
+
+TimeMerger::TimeMerger(){
+	hold = MERGE_DEFAULT_HOLD;
+	timeout = MERGE_DEFAULT_TIMEOUT;
+	max_words = MERGE_DEFAULT_BUFFER;
+	words_held = 0;
+	num_modules = 0;
+	last_released = 0;
+	have_released = false;
+	block_words = 0;
+	num_spills_out = 0;
+	num_events_out = 0;
+	num_words_out = 0;
+	num_forced = 0;
+}
+
+TimeMerger::~TimeMerger(){
+	for(std::vector<MergeSource*>::iterator iter = sources.begin(); iter != sources.end(); iter++){
+		for(std::deque<MergeSpill*>::iterator spill = (*iter)->spills.begin(); spill != (*iter)->spills.end(); spill++){ delete *spill; }
+		delete *iter;
+	}
+	for(std::vector<MergeSpill*>::iterator iter = spare.begin(); iter != spare.end(); iter++){ delete *iter; }
+}
+
+size_t TimeMerger::AddSource(const std::string &name_, long long offset_/*=0*/, unsigned int nModules_/*=0*/){
+	MergeSource *source = new MergeSource();
+	source->info.name = name_;
+	source->info.offset = offset_;
+	source->info.first_module = 0;
+	source->info.num_modules = nModules_;
+	source->info.connected = false;
+	source->info.idle = false;
+	source->info.latest = 0;
+	source->info.events_held = 0;
+	source->info.words_held = 0;
+	source->info.spills_in = 0;
+	source->info.events_in = 0;
+	source->info.events_late = 0;
+	source->info.events_dropped = 0;
+	source->fixed_modules = (nModules_ > 0);
+	source->have_base = false;
+	source->have_latest = false;
+	source->last_time = -1.0;
+	source->first_spill = 0;
+
+	sources.push_back(source);
+	return sources.size() - 1;
+}
+
+bool TimeMerger::AddSpill(size_t source_, std::vector<unsigned int> &buffer_, size_t nWords_, double now_){
+	if(source_ >= sources.size()){ return false; }
+	MergeSource *source = sources[source_];
+	source->info.spills_in++;
+
+	// Find every event in the spill, correcting its timestamp as we go
+	bool good = true;
+	incoming.clear();
+	size_t block = 0;
+	unsigned long long spillNum = source->first_spill + source->spills.size();
+	unsigned int *data = (buffer_.empty() ? NULL : &buffer_[0]);
+	while(block + 2 <= nWords_){
+		size_t blockWords = data[block];
+		unsigned int vsn = data[block+1];
+		if(blockWords < 2 || block + blockWords > nWords_){
+			good = false;
+			break;
+		}
+
+		if(vsn < MERGE_FIRST_SPECIAL_VSN){
+			// The number of modules may grow until the modules of the source are numbered
+			if(vsn >= source->info.num_modules && !source->fixed_modules && !source->have_base){ source->info.num_modules = vsn + 1; }
+
+			size_t event = block + 2;
+			size_t blockEnd = block + blockWords;
+			while(event < blockEnd){
+				size_t eventWords = (data[event] & 0x1FFE0000) >> 17;
+				if(eventWords < 4 || event + eventWords > blockEnd){
+					good = false;
+					break;
+				}
+
+				if(vsn >= source->info.num_modules){ source->info.events_dropped++; }
+				else{
+					unsigned long long time = data[event+1] | ((unsigned long long)(data[event+2] & 0xFFFF) << 32);
+					time = (unsigned long long)((long long)time + source->info.offset) & MERGE_TIME_MASK;
+					data[event+1] = time & 0xFFFFFFFF;
+					data[event+2] = (data[event+2] & 0xFFFF0000) | (unsigned int)(time >> 32);
+
+					MergeEvent current;
+					current.time = time;
+					current.spill = spillNum;
+					current.offset = event;
+					current.nWords = eventWords;
+					current.module = vsn;
+					incoming.push_back(current);
+				}
+				event += eventWords;
+			}
+			if(!good){ break; }
+		}
+		block += blockWords;
+	}
+
+	if(incoming.empty()){ return good; }
+
+	// Keep the spill, handing its old buffer back to the caller
+	MergeSpill *spill;
+	if(!spare.empty()){
+		spill = spare.back();
+		spare.pop_back();
+	}
+	else{ spill = new MergeSpill(); }
+	spill->data.swap(buffer_);
+	spill->nWords = nWords_;
+	spill->remaining = incoming.size();
+	source->spills.push_back(spill);
+
+	// Events from different modules of a spill may be out of order
+	std::stable_sort(incoming.begin(), incoming.end());
+	for(std::vector<MergeEvent>::iterator iter = incoming.begin(); iter != incoming.end(); iter++){
+		if(have_released && iter->time < last_released){ source->info.events_late++; }
+		words_held += iter->nWords;
+		source->info.words_held += iter->nWords;
+	}
+
+	bool inOrder = (source->events.empty() || source->events.back().time <= incoming.front().time);
+	size_t oldSize = source->events.size();
+	source->events.insert(source->events.end(), incoming.begin(), incoming.end());
+	if(!inOrder){ std::inplace_merge(source->events.begin(), source->events.begin() + oldSize, source->events.end()); }
+
+	source->info.events_in += incoming.size();
+	source->info.events_held = source->events.size();
+	if(!source->have_latest || incoming.back().time > source->info.latest){ source->info.latest = incoming.back().time; }
+	source->have_latest = true;
+	source->last_time = now_;
+
+	return good;
+}
+
+void TimeMerger::SetConnected(size_t source_, bool state_){
+	if(source_ >= sources.size()){ return; }
+	sources[source_]->info.connected = state_;
+
+	// Start the idle timeout over
+	if(state_){ sources[source_]->last_time = -1.0; }
+}
+
+void TimeMerger::assign_modules(){
+	for(std::vector<MergeSource*>::iterator iter = sources.begin(); iter != sources.end(); iter++){
+		if((*iter)->have_base || (*iter)->info.num_modules == 0){ continue; }
+		(*iter)->info.first_module = num_modules;
+		(*iter)->have_base = true;
+		num_modules += (*iter)->info.num_modules;
+	}
+	if(blocks.size() < num_modules){ blocks.resize(num_modules); }
+}
+
+bool TimeMerger::get_watermark(unsigned long long &watermark_, double now_){
+	bool limited = false;
+	unsigned long long earliest = 0;
+	for(std::vector<MergeSource*>::iterator iter = sources.begin(); iter != sources.end(); iter++){
+		MergeSource *source = *iter;
+		if(!source->info.connected){ continue; }
+
+		if(source->last_time < 0.0){ source->last_time = now_; }
+		source->info.idle = (now_ - source->last_time > timeout);
+		if(source->info.idle){ continue; }
+
+		// A live source which has sent no events yet may still send anything
+		if(!source->have_latest){ return false; }
+
+		if(!limited || source->info.latest < earliest){ earliest = source->info.latest; }
+		limited = true;
+	}
+
+	// Nothing holds the events back
+	if(!limited){
+		watermark_ = MERGE_TIME_MASK + 1;
+		return true;
+	}
+
+	if(earliest <= hold){ return false; }
+	watermark_ = earliest - hold;
+	return true;
+}
+
+void TimeMerger::Service(double now_){
+	if(words_held > max_words){
+		num_forced++;
+		release(MERGE_TIME_MASK + 1, max_words / 2);
+	}
+
+	unsigned long long watermark;
+	if(!get_watermark(watermark, now_)){
+		// Late events have nothing to wait for
+		if(have_released){ release(last_released + 1, 0); }
+		return;
+	}
+
+	if(have_released && watermark <= last_released){ watermark = last_released + 1; }
+	release(watermark, 0);
+}
+
+void TimeMerger::Flush(){
+	release(MERGE_TIME_MASK + 1, 0);
+}
+
+void TimeMerger::release(unsigned long long until_, size_t target_){
+	if(words_held == 0){ return; }
+	assign_modules();
+
+	// Heap of the earliest event of every source
+	typedef std::pair<unsigned long long, size_t> head_t;
+	std::priority_queue<head_t, std::vector<head_t>, std::greater<head_t> > heads;
+	for(size_t index = 0; index < sources.size(); index++){
+		if(!sources[index]->events.empty()){ heads.push(head_t(sources[index]->events.front().time, index)); }
+	}
+
+	while(!heads.empty() && words_held > target_){
+		head_t next = heads.top();
+		if(next.first >= until_){ break; }
+		heads.pop();
+
+		MergeSource *source = sources[next.second];
+		take_event(source, source->events.front());
+		source->events.pop_front();
+		if(!source->events.empty()){ heads.push(head_t(source->events.front().time, next.second)); }
+	}
+
+	for(std::vector<MergeSource*>::iterator iter = sources.begin(); iter != sources.end(); iter++){
+		(*iter)->info.events_held = (*iter)->events.size();
+		trim_spills(*iter);
+	}
+
+	if(block_words > 0){ send_spill(); }
+}
+
+void TimeMerger::take_event(MergeSource *source_, const MergeEvent &event_){
+	MergeSpill *spill = source_->spills.at(event_.spill - source_->first_spill);
+	spill->remaining--;
+	words_held -= event_.nWords;
+	source_->info.words_held -= event_.nWords;
+
+	// Every module of the merged spill has a two word record header
+	if(block_words > 0 && block_words + event_.nWords + 2 * num_modules > MERGE_MAX_SPILL){ send_spill(); }
+
+	unsigned int *data = &spill->data[event_.offset];
+	std::vector<unsigned int> &dest = blocks[source_->info.first_module + event_.module];
+	dest.insert(dest.end(), data, data + event_.nWords);
+	block_words += event_.nWords;
+
+	if(!have_released || event_.time > last_released){ last_released = event_.time; }
+	have_released = true;
+	num_events_out++;
+}
+
+void TimeMerger::trim_spills(MergeSource *source_){
+	while(!source_->spills.empty() && source_->spills.front()->remaining == 0){
+		spare.push_back(source_->spills.front());
+		source_->spills.pop_front();
+		source_->first_spill++;
+	}
+}
+
+void TimeMerger::send_spill(){
+	output.clear();
+	for(unsigned int mod = 0; mod < num_modules; mod++){
+		output.push_back(blocks[mod].size() + 2);
+		output.push_back(mod);
+		output.insert(output.end(), blocks[mod].begin(), blocks[mod].end());
+		blocks[mod].clear();
+	}
+	block_words = 0;
+
+	// Leave room for an end of spill record after the spill
+	size_t nWords = output.size();
+	output.resize(nWords + 2);
+
+	num_spills_out++;
+	num_words_out += nWords;
+	if(callback){ callback(&output[0], nWords); }
+}
+
+void TimeMerger::GetSources(std::vector<MergeSourceInfo> &sources_){
+	sources_.clear();
+	for(std::vector<MergeSource*>::iterator iter = sources.begin(); iter != sources.end(); iter++){ sources_.push_back((*iter)->info); }
+}
@@ -0,0 +1,301 @@
+/** \file poll2_metrics.cpp
+  *
+  * \brief Minimal HTTP server exporting poll2 metrics in the Prometheus text format
+  *
+  * \date Oct. 18th, 2026
+  *
+  * Only as much HTTP as a scraper needs is spoken: the request line is read
+  * up to the blank line ending the headers, the headers themselves are
+  * ignored, and every reply is HTTP/1.0 with the connection closed after it.
+*/
+
+#include "poll2_metrics.h"
+#include "poll2_socket.h"
+
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+static double get_time(){
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// Build a complete HTTP reply.
+static std::string http_reply(const std::string &status_, const std::string &type_, const std::string &body_, bool sendBody_=true){
+	std::stringstream reply;
+	reply << "HTTP/1.0 " << status_ << "\r\n";
+	reply << "Content-Type: " << type_ << "\r\n";
+	reply << "Content-Length: " << body_.size() << "\r\n";
+	reply << "Connection: close\r\n\r\n";
+	if(sendBody_){ reply << body_; }
+	return reply.str();
+}
+
+/////////////////////////////////////////////////////////////////////
+// class MetricsPage
+/////////////////////////////////////////////////////////////////////
+
+MetricsPage::MetricsPage(){
+	page << std::setprecision(12);
+}
+
+void MetricsPage::Family(const std::string &name_, const std::string &type_, const std::string &help_){
+	page << "# HELP " << name_ << " " << help_ << "\n";
+	page << "# TYPE " << name_ << " " << type_ << "\n";
+}
+
+void MetricsPage::Sample(const std::string &name_, const std::string &labels_, double value_){
+	page << name_;
+	if(!labels_.empty()){ page << "{" << labels_ << "}"; }
+	page << " ";
+	if(std::isnan(value_)){ page << "NaN"; }
+	else if(std::isinf(value_)){ page << (value_ > 0 ? "+Inf" : "-Inf"); }
+	else{ page << value_; }
+	page << "\n";
+}
+
+std::string MetricsPage::Label(const std::string &name_, const std::string &value_){
+	std::string label = name_ + "=\"";
+	for(size_t i = 0; i < value_.size(); i++){
+		if(value_[i] == '\\' || value_[i] == '"'){ label += '\\'; }
+		if(value_[i] == '\n'){ label += "\\n"; }
+		else{ label += value_[i]; }
+	}
+	return label + "\"";
+}
+
+std::string MetricsPage::Label(const std::string &name_, unsigned long long value_){
+	std::stringstream stream;
+	stream << value_;
+	return Label(name_, stream.str());
+}
+
+/////////////////////////////////////////////////////////////////////
+// class MetricsServer
+/////////////////////////////////////////////////////////////////////
+
+MetricsServer::MetricsServer(){
+	listen_fd = -1;
+	wake_fd = -1;
+	init = false;
+	min_interval = METRICS_MIN_INTERVAL;
+	last_render = 0.0;
+	num_requests = 0;
+	num_renders = 0;
+	num_rejected = 0;
+}
+
+MetricsServer::~MetricsServer(){
+	Close();
+}
+
+bool MetricsServer::Init(const std::string &address_, metrics_render_t render_){
+	if(init || !render_){ return false; }
+
+	size_t colon = address_.find_last_of(':');
+	if(is_port(address_) || (colon != std::string::npos && address_.find('/') == std::string::npos && is_port(address_.substr(colon+1)))){
+		std::string host = (is_port(address_) ? "127.0.0.1" : address_.substr(0, colon));
+		std::string port = (is_port(address_) ? address_ : address_.substr(colon+1));
+
+		struct sockaddr_in serv;
+		memset(&serv, 0, sizeof(serv));
+		serv.sin_family = AF_INET;
+		serv.sin_port = htons(atoi(port.c_str()));
+		if(inet_pton(AF_INET, host.c_str(), &serv.sin_addr) != 1){ return false; }
+
+		listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if(listen_fd < 0){ return false; }
+
+		int on = 1;
+		setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+		if(bind(listen_fd, (struct sockaddr *)&serv, sizeof(serv)) < 0 || listen(listen_fd, METRICS_MAX_CLIENTS) < 0){
+			close(listen_fd);
+			listen_fd = -1;
+			return false;
+		}
+	}
+	else{
+		struct sockaddr_un serv;
+		if(address_.empty() || address_.size() >= sizeof(serv.sun_path)){ return false; }
+
+		listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if(listen_fd < 0){ return false; }
+
+		memset(&serv, 0, sizeof(serv));
+		serv.sun_family = AF_UNIX;
+		strcpy(serv.sun_path, address_.c_str());
+		unlink(address_.c_str()); // Remove a socket left behind by a previous poll2
+
+		if(bind(listen_fd, (struct sockaddr *)&serv, sizeof(serv)) < 0 || listen(listen_fd, METRICS_MAX_CLIENTS) < 0){
+			close(listen_fd);
+			listen_fd = -1;
+			return false;
+		}
+		unix_path = address_;
+	}
+
+	wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if(wake_fd < 0){
+		close(listen_fd);
+		listen_fd = -1;
+		if(!unix_path.empty()){ unlink(unix_path.c_str()); }
+		return false;
+	}
+
+	address = address_;
+	render = render_;
+	thread = std::thread(&MetricsServer::Run, this);
+
+	return init = true;
+}
+
+void MetricsServer::Close(){
+	if(!init){ return; }
+
+	// Wake the server thread and wait for it to exit
+	unsigned long long one = 1;
+	if(write(wake_fd, &one, sizeof(one)) != sizeof(one)){ std::cout << " Warning: Failed to wake the metrics server\n"; }
+	thread.join();
+
+	for(std::vector<MetricsClient>::iterator iter = clients.begin(); iter != clients.end(); iter++){ close(iter->fd); }
+	clients.clear();
+
+	close(listen_fd);
+	listen_fd = -1;
+	if(!unix_path.empty()){
+		unlink(unix_path.c_str());
+		unix_path = "";
+	}
+	close(wake_fd);
+	wake_fd = -1;
+
+	init = false;
+}
+
+void MetricsServer::Run(){
+	std::vector<struct pollfd> fds;
+	while(true){
+		fds.resize(clients.size() + 2);
+		fds[0].fd = wake_fd;
+		fds[0].events = POLLIN;
+		fds[1].fd = listen_fd;
+		fds[1].events = POLLIN;
+		for(size_t i = 0; i < clients.size(); i++){
+			fds[i+2].fd = clients[i].fd;
+			fds[i+2].events = (clients[i].reply.empty() ? POLLIN : POLLOUT);
+		}
+		for(size_t i = 0; i < fds.size(); i++){ fds[i].revents = 0; }
+
+		if(poll(&fds[0], fds.size(), METRICS_POLL_INTERVAL) < 0 && errno != EINTR){ return; }
+		if(fds[0].revents & POLLIN){ return; } // Close was called
+
+		// Service the clients (backwards, so they may be removed as we go)
+		double now = get_time();
+		for(size_t i = clients.size(); i > 0; i--){
+			MetricsClient &client = clients[i-1];
+			bool keep = true;
+			if(fds[i+1].revents & POLLIN){ keep = Read(client, now); }
+			else if(fds[i+1].revents & POLLOUT){ keep = Write(client); }
+			else if(fds[i+1].revents & (POLLERR | POLLHUP | POLLNVAL)){ keep = false; }
+
+			if(keep && now - client.start > METRICS_CLIENT_TIMEOUT){ // Too slow
+				num_rejected++;
+				keep = false;
+			}
+			if(!keep){
+				close(client.fd);
+				clients.erase(clients.begin() + (i-1));
+			}
+		}
+
+		if(fds[1].revents & POLLIN){ Accept(now); }
+	}
+}
+
+void MetricsServer::Accept(double now_){
+	while(true){
+		int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if(fd < 0){ return; }
+
+		if(clients.size() >= METRICS_MAX_CLIENTS){
+			close(fd);
+			num_rejected++;
+			continue;
+		}
+
+		MetricsClient client;
+		client.fd = fd;
+		client.sent = 0;
+		client.start = now_;
+		clients.push_back(client);
+	}
+}
+
+bool MetricsServer::Read(MetricsClient &client_, double now_){
+	char buffer[1024];
+	while(true){
+		ssize_t count = recv(client_.fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+		if(count == 0){ return false; } // The client closed the connection
+		else if(count < 0){ return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR); }
+
+		client_.request.append(buffer, count);
+		if(client_.request.size() > METRICS_MAX_REQUEST){
+			num_rejected++;
+			client_.reply = http_reply("413 Payload Too Large", "text/plain", "Request too large\n");
+			return Write(client_);
+		}
+
+		// Reply once the headers are complete
+		if(client_.request.find("\r\n\r\n") != std::string::npos || client_.request.find("\n\n") != std::string::npos){
+			client_.reply = Respond(client_.request, now_);
+			return Write(client_);
+		}
+	}
+}
+
+bool MetricsServer::Write(MetricsClient &client_){
+	while(client_.sent < client_.reply.size()){
+		ssize_t count = send(client_.fd, client_.reply.data() + client_.sent, client_.reply.size() - client_.sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+		if(count < 0){ return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR); }
+		client_.sent += count;
+	}
+	return false; // Everything was sent
+}
+
+std::string MetricsServer::Respond(const std::string &request_, double now_){
+	std::stringstream line(request_.substr(0, request_.find_first_of("\r\n")));
+	std::string method, path;
+	line >> method >> path;
+	path = path.substr(0, path.find('?'));
+
+	if(method != "GET" && method != "HEAD"){ return http_reply("405 Method Not Allowed", "text/plain", "Only GET is supported\n"); }
+	bool sendBody = (method == "GET");
+
+	if(path == "/"){ return http_reply("200 OK", "text/plain", "poll2 metrics are served at /metrics\n", sendBody); }
+	if(path != "/metrics"){ return http_reply("404 Not Found", "text/plain", "Not found\n", sendBody); }
+
+	// Serve the cached page unless it is old enough to be built again
+	if(cached_page.empty() || now_ - last_render >= min_interval){
+		MetricsPage page;
+		render(page);
+		cached_page = page.Get();
+		last_render = now_;
+		num_renders++;
+	}
+	num_requests++;
+
+	return http_reply("200 OK", "text/plain; version=0.0.4; charset=utf-8", cached_page, sendBody);
+}
@@ -0,0 +1,288 @@
+/** \file poll2_pac.cpp
+  *
+  * \brief Sends and reassembles spills in the classic pacman network format
+  *
+  * \date Oct. 18th, 2026
+  *
+  * The sender never copies the spill, every datagram is a scatter list of its
+  * header and the pieces of the spill it carries. The receiver drops the whole
+  * spill if a single datagram is missing, since pacman has no retransmission.
+*/
+
+#include "poll2_pac.h"
+#include "poll2_socket.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Every pacman buffer ends with this flag
+static const unsigned int pac_buffer_end = 0xFFFFFFFF;
+
+// Pacman looks for the following data in the final buffer
+static const unsigned int pac_spill_end[2] = {0x2, PAC_END_VSN};
+
+/////////////////////////////////////////////////////////////////////
+// class PacSender
+/////////////////////////////////////////////////////////////////////
+
+PacSender::PacSender(Client *client_){
+	client = client_;
+	debug_mode = false;
+	sequence = 0;
+	total_buffers = 0;
+	num_spills = 0;
+	num_dgrams = 0;
+}
+
+bool PacSender::Send(const unsigned int *data_, unsigned int nWords_){
+	unsigned int nBufs = nWords_ / PAC_BUFFER_WORDS;
+	unsigned int wordsLeft = nWords_ % PAC_BUFFER_WORDS;
+
+	unsigned int totalBufs = nBufs + 1 + ((wordsLeft != 0) ? 1 : 0);
+
+	// Count the datagrams first so that the scatter lists are not reallocated while they are being filled.
+	// Each pacman buffer is a 3 word header, the data, and the end of buffer flag.
+	unsigned int totalPkts = 0;
+	for(unsigned int buf = 0; buf < totalBufs; buf++){
+		unsigned int bufWords = (buf < nBufs ? PAC_BUFFER_WORDS : (buf == nBufs && wordsLeft != 0 ? wordsLeft : 2));
+		totalPkts += ((bufWords + 4) * sizeof(unsigned int) + PAC_PKT_DATA - 1) / PAC_PKT_DATA;
+	}
+
+	buffer_head.resize(3*totalBufs);
+	pkt_head.resize(totalPkts);
+	iov.resize(4*totalPkts);
+	msgs.resize(totalPkts);
+	memset(&msgs[0], 0, totalPkts*sizeof(struct mmsghdr));
+
+	unsigned int pkt = 0;
+	for(unsigned int buf = 0; buf < totalBufs; buf++){
+		const unsigned int *bufData;
+		unsigned int bufWords;
+		if(buf < nBufs){ // A full buffer
+			bufData = &data_[buf * PAC_BUFFER_WORDS];
+			bufWords = PAC_BUFFER_WORDS;
+		}
+		else if(buf == nBufs && wordsLeft != 0){ // The last fragment
+			bufData = &data_[nBufs * PAC_BUFFER_WORDS];
+			bufWords = wordsLeft;
+		}
+		else{ // A buffer to say that we are done
+			bufData = pac_spill_end;
+			bufWords = 2;
+		}
+
+		// Put a header on each shared memory buffer
+		unsigned int *bufHead = &buffer_head[3*buf];
+		bufHead[0] = (bufWords + 3) * sizeof(unsigned int); // size
+		bufHead[1] = totalBufs; // number of buffers we expect
+		bufHead[2] = buf;
+
+		struct iovec segs[3];
+		segs[0].iov_base = bufHead;
+		segs[0].iov_len = 3 * sizeof(unsigned int);
+		segs[1].iov_base = (void *)bufData;
+		segs[1].iov_len = bufWords * sizeof(unsigned int);
+		segs[2].iov_base = (void *)&pac_buffer_end;
+		segs[2].iov_len = sizeof(unsigned int);
+
+		size_t size = (bufWords + 4) * sizeof(unsigned int);
+		unsigned int bufPkts = (size + PAC_PKT_DATA - 1) / PAC_PKT_DATA;
+
+		// Chop the buffer into datagrams. Large buffers are flagged as continuation packets.
+		total_buffers++;
+		unsigned int seg = 0;
+		size_t segOffset = 0;
+		for(unsigned int cont_pkt = 1; cont_pkt <= bufPkts; cont_pkt++, pkt++){
+			size_t bytes = (size > PAC_PKT_DATA ? PAC_PKT_DATA : size);
+
+			pac_header *pktHead = &pkt_head[pkt];
+			pktHead->Sequence = sequence++;
+			pktHead->DataSize = bytes + 8;
+			pktHead->TotalEvents = total_buffers;
+			pktHead->Events = (cont_pkt == bufPkts ? 1 : 0);
+			pktHead->Cont = (bufPkts == 1 ? 0 : cont_pkt);
+
+			struct iovec *pktIov = &iov[4*pkt];
+			pktIov[0].iov_base = pktHead;
+			pktIov[0].iov_len = sizeof(pac_header);
+
+			// Point the rest of the datagram at the next bytes of the buffer
+			size_t iovlen = 1;
+			size_t needed = bytes;
+			while(needed > 0){
+				size_t take = segs[seg].iov_len - segOffset;
+				if(take > needed){ take = needed; }
+				pktIov[iovlen].iov_base = (char *)segs[seg].iov_base + segOffset;
+				pktIov[iovlen++].iov_len = take;
+				needed -= take;
+				segOffset += take;
+				if(segOffset == segs[seg].iov_len){
+					seg++;
+					segOffset = 0;
+				}
+			}
+
+			msgs[pkt].msg_hdr.msg_iov = pktIov;
+			msgs[pkt].msg_hdr.msg_iovlen = iovlen;
+			size -= bytes;
+		}
+	}
+
+	num_spills++;
+
+	int status = client->SendMessages(&msgs[0], totalPkts);
+	if(status > 0){ num_dgrams += status; }
+	if(status < (int)totalPkts){
+		if(debug_mode){ perror(" debug: PacSender - error at SendMessages"); }
+		return false;
+	}
+
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////
+// class PacReceiver
+/////////////////////////////////////////////////////////////////////
+
+PacReceiver::PacReceiver(Server *server_){
+	server = server_;
+
+	spill_words = 0;
+	buffer_bytes = 0;
+	in_buffer = false;
+	in_spill = false;
+	next_buffer = 0;
+	have_seq = false;
+	next_seq = 0;
+	delivered_words = 0;
+
+	buffer.resize((sizeof(pac_header) + PAC_BUFFER_WORDS*sizeof(unsigned int) + PAC_PKT_DATA) / sizeof(unsigned int));
+
+	landing.resize(PAC_RECV_BATCH * (sizeof(pac_header) + PAC_PKT_DATA));
+	msgs.resize(PAC_RECV_BATCH);
+	iov.resize(PAC_RECV_BATCH);
+	memset(&msgs[0], 0, msgs.size()*sizeof(struct mmsghdr));
+	for(unsigned int i = 0; i < PAC_RECV_BATCH; i++){
+		iov[i].iov_base = &landing[i * (sizeof(pac_header) + PAC_PKT_DATA)];
+		iov[i].iov_len = sizeof(pac_header) + PAC_PKT_DATA;
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	batch_count = 0;
+	batch_next = 0;
+
+	// A whole spill arrives in one burst, which easily overflows the default receive buffer
+	int bufsize = PAC_RECV_BUFFER;
+	setsockopt(server->Get(), SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+
+	num_dgrams = 0;
+	num_dgrams_lost = 0;
+	num_spills = 0;
+	num_spills_dropped = 0;
+}
+
+void PacReceiver::DropSpill(){
+	if(in_spill){ num_spills_dropped++; }
+	in_spill = false;
+	spill_words = 0;
+}
+
+bool PacReceiver::ProcessBuffer(){
+	unsigned int nWords = buffer_bytes / sizeof(unsigned int);
+
+	// [size, number of buffers, index, data..., end flag]
+	if(nWords < 4 || buffer[0] + sizeof(unsigned int) != buffer_bytes || buffer[nWords-1] != pac_buffer_end){
+		DropSpill();
+		return false;
+	}
+
+	unsigned int totalBufs = buffer[1];
+	unsigned int index = buffer[2];
+	unsigned int bufWords = nWords - 4;
+
+	if(index == 0){ // The start of a new spill
+		DropSpill();
+		in_spill = true;
+		next_buffer = 0;
+	}
+	if(!in_spill || index != next_buffer || index >= totalBufs){
+		DropSpill();
+		return false;
+	}
+	next_buffer++;
+
+	if(index == totalBufs - 1){ // The end of spill buffer
+		in_spill = false;
+		if(spill.size() < spill_words + 2){ spill.resize(spill_words + 2); }
+		spill.swap(delivered);
+		delivered_words = spill_words;
+		spill_words = 0;
+		num_spills++;
+		return true;
+	}
+
+	if(spill.size() < spill_words + bufWords + 2){ spill.resize(2*(spill_words + bufWords + 2)); }
+	memcpy(&spill[spill_words], &buffer[3], bufWords*sizeof(unsigned int));
+	spill_words += bufWords;
+
+	return false;
+}
+
+bool PacReceiver::Process(const char *dgram_, size_t nBytes_){
+	if(nBytes_ < sizeof(pac_header)){ return false; }
+
+	pac_header head;
+	memcpy(&head, dgram_, sizeof(pac_header));
+
+	// Any missing datagram ruins the buffer and the spill it belongs to
+	if(have_seq && (unsigned int)head.Sequence != next_seq){
+		num_dgrams_lost += (unsigned int)head.Sequence - next_seq;
+		in_buffer = false;
+		DropSpill();
+	}
+	have_seq = true;
+	next_seq = head.Sequence + 1;
+
+	size_t bytes = head.DataSize - 8;
+	if(head.DataSize < 8 || bytes > nBytes_ - sizeof(pac_header)){
+		in_buffer = false;
+		DropSpill();
+		return false;
+	}
+
+	if(head.Cont <= 1){ // The first datagram of a buffer
+		in_buffer = true;
+		buffer_bytes = 0;
+	}
+	if(!in_buffer){ return false; }
+
+	if(buffer_bytes + bytes > buffer.size()*sizeof(unsigned int)){
+		in_buffer = false;
+		DropSpill();
+		return false;
+	}
+	memcpy((char *)&buffer[0] + buffer_bytes, dgram_ + sizeof(pac_header), bytes);
+	buffer_bytes += bytes;
+
+	if(head.Events != 1){ return false; }
+
+	in_buffer = false;
+	return ProcessBuffer();
+}
+
+bool PacReceiver::Receive(){
+	while(true){
+		// Finish the current batch before reading more
+		while(batch_next < batch_count){
+			unsigned int i = batch_next++;
+			if(Process((char *)iov[i].iov_base, msgs[i].msg_len)){ return true; }
+		}
+
+		int count = server->RecvMessages(&msgs[0], PAC_RECV_BATCH);
+		if(count <= 0){ return false; }
+
+		num_dgrams += count;
+		batch_count = count;
+		batch_next = 0;
+	}
+}
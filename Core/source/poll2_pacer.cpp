@@ -0,0 +1,83 @@
+/** \file poll2_pacer.cpp
+  *
+  * \brief Token bucket used to pace poll2 network broadcasts
+  *
+  * \date Oct. 18th, 2026
+  *
+  * Tokens are taken before waiting, so the bucket may go into debt. The next
+  * caller then waits for the debt to be paid off as well, which keeps the
+  * average rate correct no matter how the sends are split up.
+*/
+
+#include "poll2_pacer.h"
+
+#include <time.h>
+#include <errno.h>
+
+TokenBucket::TokenBucket(){
+	rate = 0.0;
+	burst = PACE_DEFAULT_BURST;
+	tokens = burst;
+	last_time = Now();
+	num_bytes = 0;
+	num_waits = 0;
+	wait_time = 0.0;
+}
+
+void TokenBucket::SetRate(double bytesPerSec_, double burst_/*=PACE_DEFAULT_BURST*/){
+	std::lock_guard<std::mutex> guard(lock);
+	rate = (bytesPerSec_ > 0.0 ? bytesPerSec_ : 0.0);
+	burst = (burst_ > 0.0 ? burst_ : PACE_DEFAULT_BURST);
+	if(tokens > burst){ tokens = burst; }
+	last_time = Now();
+}
+
+double TokenBucket::Acquire(size_t nBytes_){
+	double target;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		num_bytes += nBytes_;
+		if(rate <= 0.0){ return 0.0; }
+
+		// Refill for the time since the last call, up to one burst
+		double now = Now();
+		tokens += (now - last_time) * rate;
+		if(tokens > burst){ tokens = burst; }
+		last_time = now;
+
+		tokens -= nBytes_;
+		if(tokens >= 0.0){ return 0.0; }
+
+		target = now - tokens / rate;
+		num_waits++;
+	}
+
+	double start = Now();
+	WaitUntil(target);
+	double waited = Now() - start;
+
+	std::lock_guard<std::mutex> guard(lock);
+	wait_time += waited;
+
+	return waited;
+}
+
+double TokenBucket::Now(){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1E-9;
+}
+
+void TokenBucket::WaitUntil(double time_){
+	// Sleep through most of the wait
+	double sleep_until = time_ - PACE_SPIN_TIME;
+	if(Now() < sleep_until){
+		struct timespec wake;
+		wake.tv_sec = (time_t)sleep_until;
+		wake.tv_nsec = (long)((sleep_until - wake.tv_sec) * 1E9);
+		while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL) == EINTR){ }
+	}
+
+	// Spin for the rest, a sleep would overshoot
+	while(Now() < time_){ }
+}
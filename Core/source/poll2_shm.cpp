@@ -0,0 +1,426 @@
+/** \file poll2_shm.cpp
+  *
+  * \brief Shared memory ring buffer used to pass spills from poll2 to local programs
+  *
+  * \date Oct. 18th, 2026
+  *
+  * Ring positions are 64-bit byte counters which only ever increase, the
+  * location of a position in the data area is the position modulo the ring
+  * capacity. The writer advances the reserve position before it touches the
+  * data area and the head position once the record is complete. A reader
+  * copies a record out of the ring and then checks that the reserve position
+  * has not moved more than one ring length past the start of the record. If
+  * it has, the copy may be torn and the reader was lapped (a seqlock scheme).
+*/
+
+#include "poll2_shm.h"
+
+#include <iostream>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+
+#define SHM_RING_MAGIC 0x504C4C32 // "PLL2"
+#define SHM_RING_LAYOUT 1
+
+// Records are aligned so that the space left at the end of the ring always fits a header
+#define SHM_RECORD_ALIGN 16
+
+static unsigned long long align_record(unsigned long long nBytes_){
+	return (nBytes_ + SHM_RECORD_ALIGN - 1) & ~((unsigned long long)SHM_RECORD_ALIGN - 1);
+}
+
+/// Return true if the process with the given pid no longer exists.
+static bool process_gone(int pid_){
+	return (kill(pid_, 0) != 0 && errno == ESRCH);
+}
+
+static void futex_wake_all(unsigned int *addr_){
+	syscall(SYS_futex, addr_, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+/////////////////////////////////////////////////////////////////////
+// class ShmWriter
+/////////////////////////////////////////////////////////////////////
+
+ShmWriter::ShmWriter(){
+	fd = -1;
+	map_size = 0;
+	ring = NULL;
+	data = NULL;
+	init = false;
+	num_published = 0;
+	num_dropped = 0;
+}
+
+ShmWriter::~ShmWriter(){
+	Close();
+}
+
+bool ShmWriter::Init(const char *name_, size_t capacity_, unsigned int policy_/*=SHM_OVERRUN_LAP*/){
+	if(init){ return false; }
+
+	// Round the data area up to a whole number of pages
+	long page_size = sysconf(_SC_PAGESIZE);
+	if(capacity_ < 65536){ capacity_ = 65536; }
+	capacity_ = ((capacity_ + page_size - 1) / page_size) * page_size;
+
+	name = std::string(name_);
+	map_size = sizeof(ShmRingHeader) + capacity_;
+
+	fd = shm_open(name_, O_RDWR | O_CREAT, 0666);
+	if(fd < 0){ return false; }
+	fchmod(fd, 0666); // Allow readers run by other users to attach
+
+	struct stat st;
+	if(fstat(fd, &st) != 0){
+		close(fd);
+		return false;
+	}
+
+	// Check for a ring left behind by a previous writer
+	if((size_t)st.st_size >= sizeof(ShmRingHeader)){
+		void *old_map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if(old_map != MAP_FAILED){
+			ShmRingHeader *old_ring = (ShmRingHeader *)old_map;
+			if(old_ring->magic == SHM_RING_MAGIC && old_ring->version == SHM_RING_LAYOUT &&
+			  old_ring->capacity == capacity_ && (size_t)st.st_size == map_size){ // Compatible, keep using it
+				ring = old_ring;
+			}
+			else{ // Tell any attached readers that this ring is going away
+				if(old_ring->magic == SHM_RING_MAGIC){
+					__atomic_store_n(&old_ring->stale, 1, __ATOMIC_RELEASE);
+					__atomic_add_fetch(&old_ring->futex_word, 1, __ATOMIC_SEQ_CST);
+					futex_wake_all(&old_ring->futex_word);
+				}
+				munmap(old_map, st.st_size);
+			}
+		}
+	}
+
+	if(!ring){ // Create a new ring. Readers still mapping the old one keep a valid (stale) mapping.
+		if(st.st_size != 0){
+			close(fd);
+			shm_unlink(name_);
+			fd = shm_open(name_, O_RDWR | O_CREAT | O_EXCL, 0666);
+			if(fd < 0){ return false; }
+			fchmod(fd, 0666);
+		}
+		if(ftruncate(fd, map_size) != 0){
+			close(fd);
+			return false;
+		}
+
+		void *new_map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if(new_map == MAP_FAILED){
+			close(fd);
+			return false;
+		}
+		ring = (ShmRingHeader *)new_map;
+		memset(ring, 0, sizeof(ShmRingHeader));
+		ring->capacity = capacity_;
+		ring->version = SHM_RING_LAYOUT;
+		__atomic_store_n(&ring->magic, SHM_RING_MAGIC, __ATOMIC_RELEASE);
+	}
+	else{
+		// A previous writer may have died in the middle of a record
+		__atomic_store_n(&ring->reserve, ring->head, __ATOMIC_RELEASE);
+
+		// Release the slots of readers which have exited without detaching
+		for(unsigned int i = 0; i < SHM_MAX_READERS; i++){
+			int pid = __atomic_load_n(&ring->readers[i].pid, __ATOMIC_ACQUIRE);
+			if(pid != 0 && process_gone(pid)){ __atomic_compare_exchange_n(&ring->readers[i].pid, &pid, 0, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE); }
+		}
+	}
+
+	data = (char *)ring + sizeof(ShmRingHeader);
+	ring->policy = policy_;
+	__atomic_store_n(&ring->writer_pid, (int)getpid(), __ATOMIC_RELEASE);
+
+	return init = true;
+}
+
+bool ShmWriter::HasRoom(unsigned long long end_){
+	for(unsigned int i = 0; i < SHM_MAX_READERS; i++){
+		ShmReaderSlot *reader = &ring->readers[i];
+		int pid = __atomic_load_n(&reader->pid, __ATOMIC_ACQUIRE);
+		if(pid == 0){ continue; }
+
+		unsigned long long cursor = __atomic_load_n(&reader->cursor, __ATOMIC_ACQUIRE);
+		if((long long)(end_ - cursor) <= (long long)ring->capacity){ continue; }
+
+		// This reader has not read far enough. Make sure it is still running.
+		if(process_gone(pid)){
+			__atomic_compare_exchange_n(&reader->pid, &pid, 0, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+			continue;
+		}
+
+		return false;
+	}
+	return true;
+}
+
+bool ShmWriter::Publish(unsigned int type_, const void *data_, size_t nBytes_){
+	std::lock_guard<std::mutex> lock(publish_lock);
+	if(!init){ return false; }
+
+	unsigned long long capacity = ring->capacity;
+	unsigned long long size = align_record(sizeof(ShmRecordHeader) + nBytes_);
+	if(size > capacity / 2){ // Too large for the ring
+		num_dropped.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	unsigned long long pos = ring->head;
+	unsigned long long offset = pos % capacity;
+	unsigned long long pad = (offset + size > capacity ? capacity - offset : 0); // Records never wrap
+	unsigned long long end = pos + pad + size;
+	unsigned long long seq = ring->next_seq;
+	__atomic_store_n(&ring->next_seq, seq + 1, __ATOMIC_RELEASE);
+
+	if(ring->policy == SHM_OVERRUN_DROP && !HasRoom(end)){
+		__atomic_add_fetch(&ring->dropped, 1, __ATOMIC_RELEASE);
+		num_dropped.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	// Tell readers this region is being overwritten before touching it
+	__atomic_store_n(&ring->reserve, end, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	ShmRecordHeader head;
+	if(pad != 0){
+		head.size = pad;
+		head.type = SHM_RECORD_PAD;
+		head.length = 0;
+		head.seq = 0;
+		memcpy(&data[offset], &head, sizeof(ShmRecordHeader));
+		offset = 0;
+	}
+
+	head.size = size;
+	head.type = type_;
+	head.length = nBytes_;
+	head.seq = (unsigned int)seq;
+	memcpy(&data[offset], &head, sizeof(ShmRecordHeader));
+	memcpy(&data[offset + sizeof(ShmRecordHeader)], data_, nBytes_);
+
+	// Publish the record and wake up any sleeping readers
+	__atomic_store_n(&ring->head, end, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&ring->futex_word, 1, __ATOMIC_SEQ_CST);
+	if(__atomic_load_n(&ring->num_waiters, __ATOMIC_SEQ_CST) != 0){ futex_wake_all(&ring->futex_word); }
+
+	num_published.fetch_add(1, std::memory_order_relaxed);
+
+	return true;
+}
+
+void ShmWriter::SetPolicy(unsigned int policy_){
+	if(init){ ring->policy = policy_; }
+}
+
+unsigned int ShmWriter::GetNumReaders(){
+	if(!init){ return 0; }
+	unsigned int count = 0;
+	for(unsigned int i = 0; i < SHM_MAX_READERS; i++){
+		if(__atomic_load_n(&ring->readers[i].pid, __ATOMIC_ACQUIRE) != 0){ count++; }
+	}
+	return count;
+}
+
+void ShmWriter::Close(){
+	if(!init){ return; }
+
+	// Wake up the readers so they notice the writer is gone
+	__atomic_store_n(&ring->writer_pid, 0, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&ring->futex_word, 1, __ATOMIC_SEQ_CST);
+	futex_wake_all(&ring->futex_word);
+
+	munmap(ring, map_size);
+	close(fd);
+	ring = NULL;
+	data = NULL;
+	init = false;
+}
+
+/////////////////////////////////////////////////////////////////////
+// class ShmReader
+/////////////////////////////////////////////////////////////////////
+
+ShmReader::ShmReader(){
+	fd = -1;
+	map_size = 0;
+	ring = NULL;
+	data = NULL;
+	slot = -1;
+	init = false;
+	cursor = 0;
+	last_seq = 0;
+	have_seq = false;
+	num_records = 0;
+	num_bytes = 0;
+	num_missed = 0;
+	num_overruns = 0;
+}
+
+ShmReader::~ShmReader(){
+	Close();
+}
+
+bool ShmReader::Init(const char *name_){
+	if(init){ return false; }
+
+	name = std::string(name_);
+
+	fd = shm_open(name_, O_RDWR, 0);
+	if(fd < 0){ return false; } // The writer has not created the ring yet
+
+	struct stat st;
+	if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ShmRingHeader)){
+		close(fd);
+		return false;
+	}
+
+	map_size = st.st_size;
+	void *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if(map == MAP_FAILED){
+		close(fd);
+		return false;
+	}
+	ring = (ShmRingHeader *)map;
+
+	if(__atomic_load_n(&ring->magic, __ATOMIC_ACQUIRE) != SHM_RING_MAGIC || ring->version != SHM_RING_LAYOUT ||
+	  map_size != sizeof(ShmRingHeader) + ring->capacity){
+		munmap(map, map_size);
+		close(fd);
+		return false;
+	}
+
+	// Claim a free reader slot, or the slot of a reader which has exited without detaching
+	int my_pid = getpid();
+	for(unsigned int i = 0; i < SHM_MAX_READERS && slot < 0; i++){
+		int pid = 0;
+		if(__atomic_compare_exchange_n(&ring->readers[i].pid, &pid, my_pid, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)){ slot = i; }
+		else if(process_gone(pid) && __atomic_compare_exchange_n(&ring->readers[i].pid, &pid, my_pid, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)){ slot = i; }
+	}
+
+	if(slot < 0){ // No free slots
+		munmap(map, map_size);
+		close(fd);
+		return false;
+	}
+
+	data = (char *)ring + sizeof(ShmRingHeader);
+
+	// Start reading with the next record published
+	cursor = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	ring->readers[slot].overruns = 0;
+	__atomic_store_n(&ring->readers[slot].cursor, cursor, __ATOMIC_RELEASE);
+	have_seq = false;
+
+	return init = true;
+}
+
+void ShmReader::Resync(){
+	cursor = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	__atomic_store_n(&ring->readers[slot].cursor, cursor, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&ring->readers[slot].overruns, 1, __ATOMIC_RELAXED);
+	num_overruns++;
+}
+
+bool ShmReader::Read(std::vector<unsigned int> &buffer_, unsigned int &type_, size_t &nBytes_){
+	if(!init){ return false; }
+
+	unsigned long long capacity = ring->capacity;
+	ShmRecordHeader head;
+
+	while(true){
+		unsigned long long head_pos = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		if(head_pos == cursor){ return false; } // Nothing new
+
+		if(head_pos - cursor > capacity){ // Lapped by the writer
+			Resync();
+			continue;
+		}
+
+		unsigned long long offset = cursor % capacity;
+		memcpy(&head, &data[offset], sizeof(ShmRecordHeader));
+
+		bool valid = (head.size >= sizeof(ShmRecordHeader) && head.size % SHM_RECORD_ALIGN == 0 &&
+		              offset + head.size <= capacity && head.length <= head.size - sizeof(ShmRecordHeader));
+
+		if(valid && head.type != SHM_RECORD_PAD){
+			size_t nWords = (head.length + sizeof(unsigned int) - 1) / sizeof(unsigned int);
+			if(buffer_.size() < nWords + 2){ buffer_.resize(nWords + 2); }
+			memcpy(&buffer_[0], &data[offset + sizeof(ShmRecordHeader)], head.length);
+		}
+
+		// Make sure the writer did not overwrite the record while it was being copied
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		unsigned long long reserve = __atomic_load_n(&ring->reserve, __ATOMIC_RELAXED);
+		if(!valid || reserve - cursor > capacity){
+			Resync();
+			continue;
+		}
+
+		cursor += head.size;
+		__atomic_store_n(&ring->readers[slot].cursor, cursor, __ATOMIC_RELEASE);
+
+		if(head.type == SHM_RECORD_PAD){ continue; }
+
+		// Count any records lost to overruns or dropped by the writer
+		if(have_seq){ num_missed += (unsigned int)(head.seq - last_seq - 1); }
+		last_seq = head.seq;
+		have_seq = true;
+
+		num_records++;
+		num_bytes += head.length;
+		type_ = head.type;
+		nBytes_ = head.length;
+
+		return true;
+	}
+
+	return false;
+}
+
+bool ShmReader::Wait(int timeout_ms_){
+	if(!init){ return false; }
+
+	unsigned int word = __atomic_load_n(&ring->futex_word, __ATOMIC_SEQ_CST);
+	if(__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) != cursor){ return true; }
+	if(__atomic_load_n(&ring->stale, __ATOMIC_ACQUIRE) != 0){ return false; }
+
+	struct timespec timeout;
+	timeout.tv_sec = timeout_ms_ / 1000;
+	timeout.tv_nsec = (timeout_ms_ % 1000) * 1000000L;
+
+	// The writer wakes us if futex_word has changed since it was read above
+	__atomic_add_fetch(&ring->num_waiters, 1, __ATOMIC_SEQ_CST);
+	syscall(SYS_futex, &ring->futex_word, FUTEX_WAIT, word, &timeout, NULL, 0);
+	__atomic_sub_fetch(&ring->num_waiters, 1, __ATOMIC_SEQ_CST);
+
+	return (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) != cursor);
+}
+
+void ShmReader::Close(){
+	if(!init){ return; }
+
+	__atomic_store_n(&ring->readers[slot].pid, 0, __ATOMIC_RELEASE);
+
+	munmap(ring, map_size);
+	close(fd);
+	ring = NULL;
+	data = NULL;
+	slot = -1;
+	init = false;
+}
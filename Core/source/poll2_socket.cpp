@@ -13,6 +13,7 @@
 */
 
 #include "poll2_socket.h"
+#include "poll2_pacer.h"
 
 #include <iostream>
 #include <string>
@@ -21,12 +22,34 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
+#include <net/if.h>
 #include <netdb.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <strings.h>
 #include <string.h>
+#include <errno.h>
+
+/// Fill the interface fields of req_ from an interface name or address. Returns false if the interface does not exist.
+static bool get_interface(const char *iface_, struct ip_mreqn &req_){
+	req_.imr_address.s_addr = htonl(INADDR_ANY);
+	req_.imr_ifindex = 0;
+
+	if(!iface_ || iface_[0] == '\0'){ return true; }
+	if(inet_aton(iface_, &req_.imr_address) != 0){ return true; }
+
+	req_.imr_ifindex = if_nametoindex(iface_);
+	return (req_.imr_ifindex != 0);
+}
+
+bool is_port(const std::string &str_){
+	if(str_.empty()){ return false; }
+	for(size_t i = 0; i < str_.size(); i++){
+		if(str_[i] < '0' || str_[i] > '9'){ return false; }
+	}
+	return true;
+}
 
 /////////////////////////////////////////////////////////////////////
 // class Server
@@ -55,6 +78,49 @@ bool Server::Init(int port_, int sec_, int usec_){
 	return init = true;
 }
 
+bool Server::InitMulticast(const char *group_, int port_, const char *iface_/*=NULL*/, int sec_/*=10*/, int usec_/*=0*/){
+	if(init){ return false; }
+
+	struct ip_mreqn req;
+	if(inet_aton(group_, &req.imr_multiaddr) == 0 || !IN_MULTICAST(ntohl(req.imr_multiaddr.s_addr))){ return false; } // not a multicast group
+	if(!get_interface(iface_, req)){ return false; } // no such interface
+
+	sock = socket(AF_INET, SOCK_DGRAM, 0);
+	if(sock < 0){ return false; } // failed to open socket
+
+	// Allow other receivers on this host to join the same group and port
+	int on = 1;
+	if(setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0){ // failed to share the port
+		close(sock);
+		return false;
+	}
+
+	length = sizeof(serv);
+	bzero(&serv, length);
+
+	// Bind to the group address so that unicast datagrams sent to the same port are not received
+	serv.sin_family = AF_INET;
+	serv.sin_addr = req.imr_multiaddr;
+	serv.sin_port = htons(port_);
+
+	if(bind(sock, (struct sockaddr *)&serv, length) < 0){ // failed to bind to port
+		close(sock);
+		return false;
+	}
+
+	if(setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &req, sizeof(req)) < 0){ // failed to join the group
+		close(sock);
+		return false;
+	}
+
+	fromlen = sizeof(struct sockaddr_in);
+
+	to_sec = sec_;
+	to_usec = usec_;
+
+	return init = true;
+}
+
 int Server::RecvMessage(char *message_, size_t length_){
 	if(!init){ return -1; }
 
@@ -65,6 +131,18 @@ int Server::RecvMessage(char *message_, size_t length_){
 	return nbytes;
 }
 
+int Server::RecvMessages(struct mmsghdr *msgs_, unsigned int nMsgs_){
+	if(!init){ return -1; }
+
+	// Remember the address of the sender so that SendMessage may reply to it
+	for(unsigned int i = 0; i < nMsgs_; i++){
+		msgs_[i].msg_hdr.msg_name = (void *)&from;
+		msgs_[i].msg_hdr.msg_namelen = fromlen;
+	}
+
+	return recvmmsg(sock, msgs_, nMsgs_, MSG_DONTWAIT, NULL);
+}
+
 int Server::SendMessage(char *message_, size_t length_){
 	if(!init){ return -1; }
 
@@ -103,7 +181,10 @@ bool Client::Init(const char *address_, int port_){
 
 	serv.sin_family = AF_INET;
 	hp = gethostbyname(address_);
-	if(!hp){ return false; } // failed to resolve hostname
+	if(!hp){ // failed to resolve hostname
+		close(sock);
+		return false;
+	}
 
 	bcopy((char *)hp->h_addr, (char *)&serv.sin_addr, hp->h_length);
 	serv.sin_port = htons(port_);
@@ -112,6 +193,22 @@ bool Client::Init(const char *address_, int port_){
 	return init = true;
 }
 
+bool Client::SetMulticast(int ttl_/*=MULTICAST_TTL*/, const char *iface_/*=NULL*/, bool loop_/*=true*/){
+	if(!init){ return false; }
+
+	struct ip_mreqn req;
+	if(!get_interface(iface_, req)){ return false; } // no such interface
+
+	unsigned char ttl = (ttl_ < 0 ? 0 : (ttl_ > 255 ? 255 : ttl_));
+	unsigned char loop = (loop_ ? 1 : 0);
+
+	if(setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) < 0){ return false; }
+	if(setsockopt(sock, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) < 0){ return false; }
+	if(setsockopt(sock, IPPROTO_IP, IP_MULTICAST_IF, &req, sizeof(req)) < 0){ return false; }
+
+	return true;
+}
+
 int Client::RecvMessage(char *message_, size_t length_){
 	if(!init){ return -1; }
 
@@ -121,14 +218,68 @@ int Client::RecvMessage(char *message_, size_t length_){
 	return (int)recvfrom(sock, message_, length_, 0, (struct sockaddr *)&from, &length);
 }
 
+int Client::RecvMessages(struct mmsghdr *msgs_, unsigned int nMsgs_){
+	if(!init){ return -1; }
+
+	return recvmmsg(sock, msgs_, nMsgs_, MSG_DONTWAIT, NULL);
+}
+
 int Client::SendMessage(char *message_, size_t length_){
 	if(!init){ return -1; }
 
+	if(pacer && pacer->IsActive()){ pacer->Acquire(length_); }
+
 	return (int)sendto(sock, message_, length_, 0, (const struct sockaddr *)&serv, length);
 }
 
+int Client::SendMessages(struct mmsghdr *msgs_, unsigned int nMsgs_){
+	if(!init){ return -1; }
+
+	for(unsigned int i = 0; i < nMsgs_; i++){
+		msgs_[i].msg_hdr.msg_name = (void *)&serv;
+		msgs_[i].msg_hdr.msg_namelen = length;
+	}
+
+	// sendmmsg may return early, so keep going until every datagram is sent
+	unsigned int nSent = 0;
+	unsigned int nPaid = 0; // Datagrams already taken from the pacer
+	while(nSent < nMsgs_){
+		unsigned int batch = nMsgs_ - nSent;
+		if(batch > MAX_SEND_BATCH){ batch = MAX_SEND_BATCH; }
+
+		if(pacer && pacer->IsActive()){
+			// Limit the batch to one burst (but always at least one datagram)
+			size_t burst = (size_t)pacer->GetBurst();
+			size_t nBytes = 0, batchBytes = 0;
+			unsigned int count = 0;
+			for(; count < batch; count++){
+				size_t msgBytes = 0;
+				for(size_t j = 0; j < msgs_[nSent+count].msg_hdr.msg_iovlen; j++){ msgBytes += msgs_[nSent+count].msg_hdr.msg_iov[j].iov_len; }
+				if(count > 0 && batchBytes + msgBytes > burst){ break; }
+				batchBytes += msgBytes;
+				if(nSent + count >= nPaid){ nBytes += msgBytes; }
+			}
+			batch = count;
+			if(nSent + batch > nPaid){
+				pacer->Acquire(nBytes);
+				nPaid = nSent + batch;
+			}
+		}
+
+		int retval = sendmmsg(sock, &msgs_[nSent], batch, 0);
+		if(retval < 0){
+			if(errno == EINTR){ continue; }
+			return (nSent > 0 ? (int)nSent : -1);
+		}
+		nSent += retval;
+	}
+
+	return (int)nSent;
+}
+
 void Client::Close(){
 	if(!init){ return; }
 
 	close(sock);
+	init = false;
 }
@@ -0,0 +1,622 @@
+/** \file poll2_spill.cpp
+  *
+  * \brief Sends and reassembles poll2 network spills
+  *
+  * \date Oct. 18th, 2026
+  *
+  * In shm mode, poll2 splits every spill into chunks of SHM_CHUNK_WORDS words
+  * and sends each chunk in its own datagram, prefixed by the chunk number
+  * (starting at 1) and the total number of chunks in the spill. The
+  * SpillReceiver class reads these datagrams in batches and places each one
+  * directly into its slot of a reusable spill buffer. In reliable mode, the
+  * receiver asks the SpillSender for any chunks it is missing.
+*/
+
+#include <iostream>
+#include <algorithm>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "poll2_spill.h"
+#include "poll2_socket.h"
+
+// Sanity limit on the number of chunks in a spill (~1 GB)
+#define MAX_SPILL_CHUNKS 25000
+
+// Number of completed spill IDs remembered in order to recognise late duplicates
+#define COMPLETED_ID_HISTORY 64
+
+// Number of NACK datagrams read at once by the sender
+#define NACK_RECV_BATCH 16
+
+// Maximum length of a NACK datagram (in words)
+#define NACK_WORDS (3 + 2*SHM_NACK_MAX_RANGES)
+
+static double get_time(){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec*1E-9;
+}
+
+/// Return true if the 16 bit spill ID a_ is newer than b_.
+static bool id_newer(unsigned int a_, unsigned int b_){
+	return (short)((a_ - b_) & SHM_CHUNK_MASK) > 0;
+}
+
+/// Return true with a probability of fraction_.
+static bool roll_loss(double fraction_, unsigned int &seed_){
+	return (fraction_ > 0.0 && rand_r(&seed_) < fraction_ * RAND_MAX);
+}
+
+/////////////////////////////////////////////////////////////////////
+// struct SpillAssembly
+/////////////////////////////////////////////////////////////////////
+
+SpillAssembly::SpillAssembly(){
+	id = 0;
+	total_chunks = 0;
+	chunks_recvd = 0;
+	last_words = 0;
+	spill_words = 0;
+	reliable = false;
+	recovered = false;
+	num_nacks = 0;
+	last_time = 0.0;
+	Reserve(1);
+}
+
+void SpillAssembly::Reserve(unsigned int nChunks_){
+	size_t needed = (size_t)nChunks_ * SHM_CHUNK_WORDS + 2;
+	if(data.size() < needed){ data.resize(needed); }
+	if(recvd.size() < nChunks_){ recvd.resize(nChunks_, 0); }
+}
+
+void SpillAssembly::Start(unsigned int id_, unsigned int totalChunks_, bool reliable_){
+	id = id_;
+	total_chunks = totalChunks_;
+	chunks_recvd = 0;
+	last_words = 0;
+	spill_words = 0;
+	reliable = reliable_;
+	recovered = false;
+	num_nacks = 0;
+	last_time = 0.0;
+
+	Reserve(total_chunks);
+	memset(&recvd[0], 0, total_chunks);
+}
+
+/////////////////////////////////////////////////////////////////////
+// class SpillReceiver
+/////////////////////////////////////////////////////////////////////
+
+SpillReceiver::SpillReceiver(Server *server_, unsigned int batch_/*=SHM_RECV_BATCH*/){
+	server = server_;
+	batch_size = (batch_ > 0 ? batch_ : 1);
+	debug_mode = false;
+
+	chunk_head.resize(2*batch_size);
+	landing.resize(batch_size);
+	msgs.resize(batch_size);
+	iov.resize(2*batch_size);
+	nack.resize(NACK_WORDS);
+
+	// A whole spill arrives in one burst, which easily overflows the default receive buffer
+	int bufsize = SHM_RECV_BUFFER;
+	setsockopt(server->Get(), SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+
+	landing_buf = NULL;
+	recycle_landing = false;
+	delivered = NULL;
+	current = GetSpare();
+
+	have_id = false;
+	last_id = 0;
+	nack_loss = 0.0;
+	loss_seed = 1;
+
+	num_dgrams = 0;
+	num_dgrams_dropped = 0;
+	num_dgrams_moved = 0;
+	num_bytes = 0;
+	num_spills = 0;
+	num_spills_dropped = 0;
+	num_spills_recovered = 0;
+	num_nacks = 0;
+	num_flags = 0;
+}
+
+SpillReceiver::~SpillReceiver(){
+	for(size_t i = 0; i < assemblies.size(); i++){ delete assemblies[i]; }
+}
+
+SpillAssembly *SpillReceiver::GetSpare(){
+	SpillAssembly *output;
+	if(!spare.empty()){
+		output = spare.back();
+		spare.pop_back();
+	}
+	else{
+		output = new SpillAssembly();
+		assemblies.push_back(output);
+	}
+	output->total_chunks = 0;
+	return output;
+}
+
+void SpillReceiver::Recycle(SpillAssembly *spill_){
+	spill_->total_chunks = 0;
+
+	// Forget any stashed chunks which have not been copied into this spill yet
+	for(size_t i = 0; i < stash_target.size(); i++){
+		if(stash_target[i] == spill_){ stash_target[i] = NULL; }
+	}
+
+	// Datagrams are still landing in this buffer, it may not be reused until the batch is done
+	if(spill_ == landing_buf){ recycle_landing = true; }
+	else{ spare.push_back(spill_); }
+}
+
+void SpillReceiver::DropSpill(SpillAssembly *spill_){
+	if(debug_mode){ std::cout << "debug: Dropping spill with " << spill_->chunks_recvd << " of " << spill_->total_chunks << " chunks\n"; }
+	num_spills_dropped++;
+	Recycle(spill_);
+}
+
+void SpillReceiver::Complete(SpillAssembly *spill_){
+	spill_->spill_words = (spill_->total_chunks - 1) * SHM_CHUNK_WORDS + spill_->last_words;
+
+	if(spill_->reliable){
+		completed_ids.push_back(spill_->id);
+		if(completed_ids.size() > COMPLETED_ID_HISTORY){ completed_ids.pop_front(); }
+	}
+	if(spill_->recovered){ num_spills_recovered++; }
+	num_spills++;
+
+	ready.push_back(spill_);
+}
+
+SpillAssembly *SpillReceiver::FindSpill(unsigned int id_, unsigned int totalChunks_){
+	if(current->total_chunks != 0 && current->reliable && current->id == id_){ return current; }
+
+	for(size_t i = 0; i < pending.size(); i++){
+		if(pending[i]->id == id_){ return pending[i]; }
+	}
+
+	// A late duplicate of a completed spill, or a spill which was already given up on
+	if(std::find(completed_ids.begin(), completed_ids.end(), id_) != completed_ids.end()){ return NULL; }
+	if(have_id && !id_newer(id_, last_id)){ return NULL; }
+
+	have_id = true;
+	last_id = id_;
+
+	return StartSpill(id_, totalChunks_, true);
+}
+
+SpillAssembly *SpillReceiver::StartSpill(unsigned int id_, unsigned int totalChunks_, bool reliable_){
+	if(current->total_chunks != 0){ // The current spill is still missing chunks
+		if(current->reliable){ ParkCurrent(get_time()); }
+		else{
+			DropSpill(current);
+			current = GetSpare();
+		}
+	}
+
+	// Datagrams are landing in this buffer, so it may not be resized
+	if(current == landing_buf && current->data.size() < (size_t)totalChunks_ * SHM_CHUNK_WORDS + 2){
+		SpillAssembly *next = GetSpare();
+		Recycle(current);
+		current = next;
+	}
+
+	current->Start(id_, totalChunks_, reliable_);
+
+	return current;
+}
+
+void SpillReceiver::ParkCurrent(double now_){
+	if(pending.size() >= SHM_MAX_PENDING){ // Give up on the oldest spill
+		DropSpill(pending.front());
+		pending.pop_front();
+	}
+
+	pending.push_back(current);
+	SendNack(current, now_);
+	current = GetSpare();
+}
+
+void SpillReceiver::SendNack(SpillAssembly *spill_, double now_){
+	unsigned int nRanges = 0;
+	unsigned int chunk = 0;
+	while(chunk < spill_->total_chunks && nRanges < SHM_NACK_MAX_RANGES){
+		if(spill_->recvd[chunk]){
+			chunk++;
+			continue;
+		}
+		unsigned int first = chunk;
+		while(chunk < spill_->total_chunks && !spill_->recvd[chunk]){ chunk++; }
+		nack[3+2*nRanges] = first + 1; // Chunk numbers start at 1
+		nack[4+2*nRanges] = chunk;
+		nRanges++;
+	}
+
+	nack[0] = SHM_NACK_MAGIC;
+	nack[1] = spill_->id;
+	nack[2] = nRanges;
+
+	spill_->num_nacks++;
+	spill_->last_time = now_;
+	spill_->recovered = true;
+	num_nacks++;
+
+	if(debug_mode){ std::cout << "debug: Sending NACK for " << spill_->total_chunks - spill_->chunks_recvd << " chunks of spill " << spill_->id << " in " << nRanges << " ranges\n"; }
+
+	if(roll_loss(nack_loss, loss_seed)){ return; } // Testing only
+	server->SendMessage((char *)&nack[0], (3 + 2*nRanges)*sizeof(unsigned int));
+}
+
+void SpillReceiver::CheckRetransmits(double now_){
+	// No chunks have arrived for the current spill in a while, its last chunks must have been lost
+	if(current->total_chunks != 0 && current->reliable && now_ - current->last_time > SHM_NACK_TIMEOUT){ ParkCurrent(now_); }
+
+	for(std::deque<SpillAssembly*>::iterator iter = pending.begin(); iter != pending.end();){
+		if(now_ - (*iter)->last_time < SHM_NACK_TIMEOUT){
+			iter++;
+			continue;
+		}
+		if((*iter)->num_nacks >= SHM_NACK_RETRIES){
+			DropSpill(*iter);
+			iter = pending.erase(iter);
+		}
+		else{
+			SendNack(*iter, now_);
+			iter++;
+		}
+	}
+}
+
+std::string SpillReceiver::GetLastFlag(){
+	std::string output = last_flag;
+	last_flag = "";
+	return output;
+}
+
+bool SpillReceiver::Receive(){
+	// The caller is done with the last spill handed out
+	if(delivered){
+		Recycle(delivered);
+		delivered = NULL;
+	}
+
+	if(!ready.empty()){
+		delivered = ready.front();
+		ready.pop_front();
+		return true;
+	}
+
+	// Receive each datagram straight into the slot of the next missing chunk. When the
+	// chunks arrive in order, which is almost always, no copying is needed at all.
+	// Never ask for more datagrams than the current spill is missing, so that a
+	// completed spill is always the last thing in the batch.
+	unsigned int batch = 1;
+	if(current->total_chunks != 0){
+		batch = current->total_chunks - current->chunks_recvd;
+		if(batch > batch_size){ batch = batch_size; }
+
+		unsigned int slot = 0;
+		for(unsigned int i = 0; i < batch; i++){
+			while(current->recvd[slot]){ slot++; }
+			landing[i] = slot++;
+		}
+	}
+	else{ landing[0] = 0; } // Expecting the first chunk of a new spill
+
+	// This buffer must not be resized or reused until every datagram in the batch is handled
+	landing_buf = current;
+	recycle_landing = false;
+
+	memset(&msgs[0], 0, batch*sizeof(struct mmsghdr));
+	for(unsigned int i = 0; i < batch; i++){
+		iov[2*i].iov_base = &chunk_head[2*i];
+		iov[2*i].iov_len = SHM_CHUNK_HEAD_LEN;
+		iov[2*i+1].iov_base = &landing_buf->data[landing[i]*SHM_CHUNK_WORDS];
+		iov[2*i+1].iov_len = SHM_CHUNK_WORDS*sizeof(unsigned int);
+		msgs[i].msg_hdr.msg_iov = &iov[2*i];
+		msgs[i].msg_hdr.msg_iovlen = 2;
+	}
+
+	int nMsgs = server->RecvMessages(&msgs[0], batch);
+	double now = get_time();
+
+	for(int i = 0; i < nMsgs; i++){
+		unsigned int nBytes = msgs[i].msg_len;
+		char *head = (char *)&chunk_head[2*i];
+		char *payload = (char *)&landing_buf->data[landing[i]*SHM_CHUNK_WORDS];
+
+		num_dgrams++;
+		num_bytes += nBytes;
+
+		// Poll2 network flags ($OPEN_FILE, $CLOSE_FILE, $KILL_SOCKET)
+		if(nBytes >= 2 && head[0] == '$' && head[1] >= 'A' && head[1] <= 'Z'){
+			last_flag = std::string(head, (nBytes < SHM_CHUNK_HEAD_LEN ? nBytes : SHM_CHUNK_HEAD_LEN));
+			if(nBytes > SHM_CHUNK_HEAD_LEN){ last_flag += std::string(payload, nBytes - SHM_CHUNK_HEAD_LEN); }
+			last_flag = last_flag.c_str(); // Strip the trailing null
+			num_flags++;
+			continue;
+		}
+
+		// Did not read enough bytes, or the chunk is too large for its slot
+		if(nBytes < SHM_CHUNK_HEAD_LEN || (msgs[i].msg_hdr.msg_flags & MSG_TRUNC)){
+			num_dgrams_dropped++;
+			continue;
+		}
+
+		bool reliable = ((chunk_head[2*i+1] & SHM_CHUNK_RELIABLE) != 0);
+		unsigned int current_chunk = (reliable ? chunk_head[2*i] & SHM_CHUNK_MASK : chunk_head[2*i]);
+		unsigned int chunk_total = (reliable ? chunk_head[2*i+1] & SHM_CHUNK_MASK : chunk_head[2*i+1]);
+		unsigned int chunk_words = (nBytes - SHM_CHUNK_HEAD_LEN) / sizeof(unsigned int);
+
+		if(chunk_total == 0 || chunk_total > MAX_SPILL_CHUNKS || current_chunk == 0 || current_chunk > chunk_total ||
+		  (current_chunk != chunk_total && chunk_words != SHM_CHUNK_WORDS)){ // Corrupt chunk header
+			if(debug_mode){ std::cout << "debug: Invalid chunk " << current_chunk << " of " << chunk_total << " (" << nBytes << " bytes)\n"; }
+			num_dgrams_dropped++;
+			continue;
+		}
+
+		SpillAssembly *target = NULL;
+		if(reliable){ // Any chunk of a reliable spill may start it, the rest can be asked for
+			target = FindSpill(chunk_head[2*i] >> 16, chunk_total);
+			if(!target || target->total_chunks != chunk_total){
+				num_dgrams_dropped++;
+				continue;
+			}
+		}
+		else if(current_chunk == 1 && (current->total_chunks == 0 || current->reliable || chunk_total != current->total_chunks || current->recvd[0])){ // The start of a new spill
+			target = StartSpill(0, chunk_total, false);
+		}
+		else if(current->total_chunks == 0 || current->reliable || chunk_total != current->total_chunks){ // Started reading in the middle of a spill, ignore the rest of it
+			if(debug_mode){ std::cout << "debug: Skipping chunk " << current_chunk << " of " << chunk_total << std::endl; }
+			num_dgrams_dropped++;
+			continue;
+		}
+		else{ target = current; }
+
+		if(target->recvd[current_chunk-1]){ // Duplicate chunk
+			num_dgrams_dropped++;
+			continue;
+		}
+
+		target->recvd[current_chunk-1] = 1;
+		target->chunks_recvd++;
+		target->last_time = now;
+		if(current_chunk == chunk_total){ target->last_words = chunk_words; }
+
+		if(target != landing_buf || current_chunk-1 != landing[i]){ // This chunk was received into the wrong slot
+			if(debug_mode){ std::cout << "debug: Found chunk " << current_chunk << " but expected chunk " << landing[i]+1 << std::endl; }
+			stash_target.push_back(target);
+			stash_loc.push_back(std::make_pair(current_chunk-1, (unsigned int)stash.size()));
+			stash.insert(stash.end(), payload, payload + chunk_words*sizeof(unsigned int));
+			num_dgrams_moved++;
+		}
+
+		if(target->chunks_recvd == target->total_chunks){ // The spill is complete
+			if(target == current){ current = GetSpare(); }
+			else{ pending.erase(std::find(pending.begin(), pending.end(), target)); }
+			Complete(target);
+		}
+	}
+
+	// Move any out of order chunks into place now that nothing else will land on top of them
+	for(size_t i = 0; i < stash_loc.size(); i++){
+		if(!stash_target[i]){ continue; } // The spill was dropped
+		size_t stash_end = (i+1 < stash_loc.size() ? stash_loc[i+1].second : stash.size());
+		memcpy(&stash_target[i]->data[stash_loc[i].first*SHM_CHUNK_WORDS], &stash[stash_loc[i].second], stash_end - stash_loc[i].second);
+	}
+	stash.clear();
+	stash_target.clear();
+	stash_loc.clear();
+
+	if(recycle_landing){ spare.push_back(landing_buf); }
+	landing_buf = NULL;
+
+	// Ask for any chunks which are still missing
+	CheckRetransmits(now);
+
+	if(ready.empty()){ return false; }
+
+	delivered = ready.front();
+	ready.pop_front();
+
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////
+// class SpillSender
+/////////////////////////////////////////////////////////////////////
+
+SpillSender::SpillSender(Client *client_){
+	client = client_;
+	reliable = false;
+	debug_mode = false;
+	window = SHM_SEND_WINDOW;
+	next_id = 0;
+
+	nack_buffer.resize(NACK_RECV_BATCH*NACK_WORDS);
+	nack_msgs.resize(NACK_RECV_BATCH);
+	nack_iov.resize(NACK_RECV_BATCH);
+
+	loss_rate = 0.0;
+	loss_seed = 1;
+
+	num_spills = 0;
+	num_chunks = 0;
+	num_resent = 0;
+	num_nacks = 0;
+	num_expired = 0;
+	num_lost = 0;
+}
+
+void SpillSender::SetReliable(bool state_/*=true*/, unsigned int window_/*=SHM_SEND_WINDOW*/){
+	reliable = state_;
+	window = (window_ > 0 ? window_ : 1);
+
+	history.clear();
+	if(reliable){
+		history.resize(window);
+		for(unsigned int i = 0; i < window; i++){
+			history[i].id = (unsigned int)-1; // Matches no spill ID
+			history[i].nWords = 0;
+		}
+	}
+}
+
+void SpillSender::AddChunk(unsigned int index_, unsigned int id_, unsigned int chunk_, unsigned int total_, unsigned int *data_, unsigned int nWords_, bool resent_){
+	unsigned int *head = &chunk_head[2*index_];
+	if(reliable){
+		head[0] = chunk_ | ((id_ & SHM_CHUNK_MASK) << 16);
+		head[1] = total_ | SHM_CHUNK_RELIABLE | (resent_ ? SHM_CHUNK_RESENT : 0);
+	}
+	else{
+		head[0] = chunk_;
+		head[1] = total_;
+	}
+
+	iov[2*index_].iov_base = head;
+	iov[2*index_].iov_len = SHM_CHUNK_HEAD_LEN;
+	iov[2*index_+1].iov_base = data_;
+	iov[2*index_+1].iov_len = nWords_*sizeof(unsigned int);
+
+	memset(&msgs[index_], 0, sizeof(struct mmsghdr));
+	msgs[index_].msg_hdr.msg_iov = &iov[2*index_];
+	msgs[index_].msg_hdr.msg_iovlen = 2;
+}
+
+bool SpillSender::Flush(unsigned int count_){
+	if(count_ == 0){ return true; }
+
+	int status = client->SendMessages(&msgs[0], count_);
+	if(status > 0){ num_chunks += status; }
+	if(status < (int)count_ && debug_mode){ perror(" debug: SpillSender::Flush - error at SendMessages"); }
+
+	return (status == (int)count_);
+}
+
+bool SpillSender::Send(unsigned int *data_, unsigned int nWords_){
+	unsigned int nChunks = nWords_ / SHM_CHUNK_WORDS;
+	if(nWords_ % SHM_CHUNK_WORDS != 0){ nChunks++; }
+
+	if(debug_mode){ std::cout << " debug: Splitting " << nWords_ << " words into network spill of " << nChunks << " chunks (fragment = " << nWords_ % SHM_CHUNK_WORDS << " words)\n"; }
+	if(nChunks == 0){ return true; }
+
+	unsigned int id = 0;
+	unsigned int *source = data_;
+	if(reliable){ // Keep a copy of the spill in case any chunks need to be sent again
+		if(nChunks > SHM_CHUNK_MASK){ return false; }
+		id = (next_id++) & SHM_CHUNK_MASK;
+		SentSpill *spill = &history[id % window];
+		spill->id = id;
+		spill->nWords = nWords_;
+		if(spill->data.size() < nWords_){ spill->data.resize(nWords_); }
+		memcpy(&spill->data[0], data_, nWords_*sizeof(unsigned int));
+		source = &spill->data[0];
+	}
+
+	if(msgs.size() < nChunks){
+		chunk_head.resize(2*nChunks);
+		iov.resize(2*nChunks);
+		msgs.resize(nChunks);
+	}
+
+	// Each 40 kB chunk is an 8 byte header followed by a slice of the spill
+	unsigned int count = 0;
+	for(unsigned int chunk = 0; chunk < nChunks; chunk++){
+		unsigned int chunk_words = nWords_ - chunk*SHM_CHUNK_WORDS;
+		if(chunk_words > SHM_CHUNK_WORDS){ chunk_words = SHM_CHUNK_WORDS; }
+
+		if(roll_loss(loss_rate, loss_seed)){ // Testing only
+			num_lost++;
+			continue;
+		}
+		AddChunk(count++, id, chunk + 1, nChunks, &source[chunk*SHM_CHUNK_WORDS], chunk_words, false); // Chunk numbers start at 1
+	}
+
+	num_spills++;
+
+	return Flush(count);
+}
+
+unsigned int SpillSender::ServiceNacks(){
+	if(!reliable){ return 0; }
+
+	unsigned int nResent = 0;
+	while(true){
+		memset(&nack_msgs[0], 0, NACK_RECV_BATCH*sizeof(struct mmsghdr));
+		for(unsigned int i = 0; i < NACK_RECV_BATCH; i++){
+			nack_iov[i].iov_base = &nack_buffer[i*NACK_WORDS];
+			nack_iov[i].iov_len = NACK_WORDS*sizeof(unsigned int);
+			nack_msgs[i].msg_hdr.msg_iov = &nack_iov[i];
+			nack_msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		int nMsgs = client->RecvMessages(&nack_msgs[0], NACK_RECV_BATCH);
+		if(nMsgs <= 0){ break; }
+
+		// Collect every chunk which was asked for
+		resend.clear();
+		for(int i = 0; i < nMsgs; i++){
+			unsigned int *words = &nack_buffer[i*NACK_WORDS];
+			unsigned int nWords = nack_msgs[i].msg_len / sizeof(unsigned int);
+			if(nWords < 3 || words[0] != SHM_NACK_MAGIC){ continue; }
+
+			num_nacks++;
+
+			unsigned int id = words[1] & SHM_CHUNK_MASK;
+			unsigned int nRanges = std::min(words[2], (nWords - 3) / 2);
+			SentSpill *spill = &history[id % window];
+			if(spill->id != id){ // This spill is no longer in the window
+				for(unsigned int j = 0; j < nRanges; j++){ num_expired += words[4+2*j] - words[3+2*j] + 1; }
+				if(debug_mode){ std::cout << " debug: Received NACK for spill " << id << " which has left the window\n"; }
+				continue;
+			}
+
+			unsigned int nChunks = (spill->nWords + SHM_CHUNK_WORDS - 1) / SHM_CHUNK_WORDS;
+			for(unsigned int j = 0; j < nRanges; j++){
+				unsigned int first = std::max(words[3+2*j], 1u);
+				unsigned int last = std::min(words[4+2*j], nChunks);
+				for(unsigned int chunk = first; chunk <= last; chunk++){ resend.push_back(std::make_pair(spill, chunk - 1)); }
+			}
+		}
+
+		if(msgs.size() < resend.size()){
+			chunk_head.resize(2*resend.size());
+			iov.resize(2*resend.size());
+			msgs.resize(resend.size());
+		}
+
+		unsigned int count = 0;
+		for(size_t i = 0; i < resend.size(); i++){
+			SentSpill *spill = resend[i].first;
+			unsigned int chunk = resend[i].second;
+			unsigned int nChunks = (spill->nWords + SHM_CHUNK_WORDS - 1) / SHM_CHUNK_WORDS;
+			unsigned int chunk_words = spill->nWords - chunk*SHM_CHUNK_WORDS;
+			if(chunk_words > SHM_CHUNK_WORDS){ chunk_words = SHM_CHUNK_WORDS; }
+
+			if(roll_loss(loss_rate, loss_seed)){ // Testing only
+				num_lost++;
+				continue;
+			}
+			AddChunk(count++, spill->id, chunk + 1, nChunks, &spill->data[chunk*SHM_CHUNK_WORDS], chunk_words, true);
+		}
+
+		Flush(count);
+		num_resent += count;
+		nResent += count;
+
+		if(nMsgs < NACK_RECV_BATCH){ break; }
+	}
+
+	return nResent;
+}
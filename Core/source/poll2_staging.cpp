@@ -0,0 +1,56 @@
+/** \file poll2_staging.cpp
+  *
+  * \brief Fixed size ring used to hold words between FIFO reads
+  *
+  * \date Oct. 18th, 2026
+  *
+  * The ring is emptied from the head and filled after the tail, so a push or
+  * a pop is split in two only when it runs over the end of the storage.
+*/
+
+#include <cstring>
+
+#include "poll2_staging.h"
+
+StagingRing::StagingRing() : head(0), count(0) { }
+
+StagingRing::StagingRing(size_t capacity_) : head(0), count(0) {
+	Init(capacity_);
+}
+
+void StagingRing::Init(size_t capacity_){
+	words.assign(capacity_, 0);
+	Clear();
+}
+
+bool StagingRing::Push(const unsigned int *data_, size_t nWords_){
+	if(nWords_ > Free()){ return false; }
+	if(nWords_ == 0){ return true; }
+
+	size_t tail = (head + count) % words.size();
+	size_t first = words.size() - tail;
+	if(first > nWords_){ first = nWords_; }
+
+	memcpy(&words[tail], data_, first * sizeof(unsigned int));
+	if(first < nWords_){ memcpy(&words[0], data_ + first, (nWords_ - first) * sizeof(unsigned int)); }
+
+	count += nWords_;
+	return true;
+}
+
+size_t StagingRing::Pop(unsigned int *dest_, size_t nWords_){
+	if(nWords_ > count){ nWords_ = count; }
+	if(nWords_ == 0){ return 0; }
+
+	size_t first = words.size() - head;
+	if(first > nWords_){ first = nWords_; }
+
+	memcpy(dest_, &words[head], first * sizeof(unsigned int));
+	if(first < nWords_){ memcpy(dest_ + first, &words[0], (nWords_ - first) * sizeof(unsigned int)); }
+
+	head = (head + nWords_) % words.size();
+	count -= nWords_;
+	if(count == 0){ head = 0; } // Keep the next push in one piece
+
+	return nWords_;
+}
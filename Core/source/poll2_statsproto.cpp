@@ -0,0 +1,230 @@
+/** \file poll2_statsproto.cpp
+  *
+  * \brief Versioned, delta encoded and fragmented stats packets sent by poll2 to monitors
+  *
+  * \date Oct. 18th, 2026
+  *
+  * Runs of changed fields are merged across a single unchanged field, as a
+  * new run header costs as much as the field it would skip.
+*/
+
+#include <string.h>
+
+#include "poll2_statsproto.h"
+
+// Length of the header of a run of fields (in bytes)
+#define STATS_RUN_HEAD_LEN 8
+
+/////////////////////////////////////////////////////////////////////
+// class StatsRecord
+/////////////////////////////////////////////////////////////////////
+
+void StatsRecord::Init(unsigned int nModules_, unsigned int nChannels_){
+	num_modules = nModules_;
+	num_channels = nChannels_;
+	fields.assign(STATS_RECORD_FIELDS + num_modules * (STATS_MODULE_FIELDS + num_channels * STATS_CHANNEL_FIELDS), 0);
+}
+
+double StatsRecord::GetDouble(size_t index_) const {
+	uint64_t word = GetWord(index_);
+	double value;
+	memcpy(&value, &word, sizeof(value));
+	return value;
+}
+
+void StatsRecord::SetDouble(size_t index_, double value_){
+	uint64_t word;
+	memcpy(&word, &value_, sizeof(word));
+	SetWord(index_, word);
+}
+
+/////////////////////////////////////////////////////////////////////
+// class StatsEncoder
+/////////////////////////////////////////////////////////////////////
+
+void StatsEncoder::start_datagram(std::vector<std::string> &datagrams_, unsigned char type_, const StatsRecord &record_){
+	StatsPacketHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = STATS_PROTO_MAGIC;
+	header.version = STATS_PROTO_VERSION;
+	header.crate = crate_id;
+	header.sequence = sequence;
+	header.fragment = datagrams_.size();
+	header.type = type_;
+	header.num_channels = record_.GetNumChannels();
+	header.num_modules = record_.GetNumModules();
+
+	datagrams_.push_back(std::string((const char *)&header, sizeof(header)));
+	datagrams_.back().reserve(STATS_PROTO_MAX_DATAGRAM);
+}
+
+void StatsEncoder::Encode(const StatsRecord &record_, std::vector<std::string> &datagrams_){
+	const std::vector<uint64_t> &fields = record_.GetFields();
+	const size_t capacity = STATS_PROTO_MAX_DATAGRAM;
+
+	sequence++;
+	bool key = (last_fields.size() != fields.size() || (sequence - 1) % key_interval == 0);
+	unsigned char type = (key ? STATS_PACKET_KEY : STATS_PACKET_DELTA);
+
+	datagrams_.clear();
+	start_datagram(datagrams_, type, record_);
+
+	size_t index = 0;
+	while(index < fields.size()){
+		// Find the next run of changed fields
+		if(!key){
+			while(index < fields.size() && fields[index] == last_fields[index]){ index++; }
+			if(index >= fields.size()){ break; }
+		}
+		size_t end = index + 1;
+		if(key){ end = fields.size(); }
+		else{
+			while(end < fields.size()){
+				if(fields[end] != last_fields[end]){ end++; }
+				else if(end + 1 < fields.size() && fields[end+1] != last_fields[end+1]){ end += 2; }
+				else{ break; }
+			}
+		}
+
+		// Write the run, splitting it across datagrams as needed
+		while(index < end){
+			if(datagrams_.back().size() + STATS_RUN_HEAD_LEN + sizeof(uint64_t) > capacity){ start_datagram(datagrams_, type, record_); }
+			uint32_t count = (capacity - datagrams_.back().size() - STATS_RUN_HEAD_LEN) / sizeof(uint64_t);
+			if(count > end - index){ count = end - index; }
+			uint32_t first = index;
+			datagrams_.back().append((const char *)&first, sizeof(first));
+			datagrams_.back().append((const char *)&count, sizeof(count));
+			datagrams_.back().append((const char *)&fields[index], count * sizeof(uint64_t));
+			index += count;
+		}
+	}
+
+	// Now that the number of fragments is known, put it in every header
+	uint16_t nFragments = datagrams_.size();
+	for(std::vector<std::string>::iterator iter = datagrams_.begin(); iter != datagrams_.end(); iter++){
+		memcpy(&(*iter)[offsetof(StatsPacketHeader, num_fragments)], &nFragments, sizeof(nFragments));
+		if(key){ bytes_key += iter->size(); }
+		else{ bytes_delta += iter->size(); }
+	}
+
+	last_fields = fields;
+}
+
+std::string StatsEncoder::EncodeClose(){
+	StatsPacketHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = STATS_PROTO_MAGIC;
+	header.version = STATS_PROTO_VERSION;
+	header.crate = crate_id;
+	header.sequence = sequence;
+	header.num_fragments = 1;
+	header.type = STATS_PACKET_CLOSE;
+	return std::string((const char *)&header, sizeof(header));
+}
+
+/////////////////////////////////////////////////////////////////////
+// class StatsDecoder
+/////////////////////////////////////////////////////////////////////
+
+bool StatsDecoder::Decode(const char *buffer_, size_t length_, unsigned short &crate_){
+	StatsPacketHeader header;
+	if(length_ < sizeof(header)){
+		rejected++;
+		return false;
+	}
+	memcpy(&header, buffer_, sizeof(header));
+	if(header.magic != STATS_PROTO_MAGIC || header.version != STATS_PROTO_VERSION || header.type > STATS_PACKET_CLOSE){
+		rejected++;
+		return false;
+	}
+
+	crate_ = header.crate;
+	StatsCrate &crate = crates[header.crate];
+	crate.id = header.crate;
+
+	if(header.type == STATS_PACKET_CLOSE){
+		crate.closed = true;
+		return true;
+	}
+	if(header.num_fragments == 0 || header.fragment >= header.num_fragments){
+		rejected++;
+		return false;
+	}
+	crate.closed = false;
+
+	// A crate which changed size starts over
+	if(header.num_modules != crate.record.GetNumModules() || header.num_channels != crate.record.GetNumChannels()){
+		crate.record.Init(header.num_modules, header.num_channels);
+		crate.changed.assign(crate.record.GetNumFields(), true);
+		crate.layout_changed = true;
+		crate.synced = false;
+	}
+
+	if(header.sequence != crate.sequence){
+		if(crate.sequence != 0){
+			if(crate.fragments_seen < crate.num_fragments){ // The last record is missing a fragment
+				crate.lost++;
+				crate.synced = false;
+			}
+			if(header.sequence > crate.sequence + 1){ // Whole records were missed
+				crate.lost += header.sequence - crate.sequence - 1;
+				crate.synced = false;
+			}
+			else if(header.sequence < crate.sequence){ crate.synced = false; } // The sender was restarted
+		}
+		crate.sequence = header.sequence;
+		crate.fragments_seen = 0;
+		crate.num_fragments = header.num_fragments;
+	}
+	crate.fragments_seen++;
+
+	// Apply the runs of fields
+	std::vector<uint64_t> &fields = crate.record.GetFields();
+	size_t pos = sizeof(header);
+	while(pos + STATS_RUN_HEAD_LEN <= length_){
+		uint32_t first, count;
+		memcpy(&first, buffer_ + pos, sizeof(first));
+		memcpy(&count, buffer_ + pos + sizeof(first), sizeof(count));
+		pos += STATS_RUN_HEAD_LEN;
+		if((size_t)first + count > fields.size() || pos + (size_t)count * sizeof(uint64_t) > length_){ // Malformed
+			rejected++;
+			break;
+		}
+		for(uint32_t i = 0; i < count; i++){
+			uint64_t value;
+			memcpy(&value, buffer_ + pos, sizeof(value));
+			pos += sizeof(value);
+			if(fields[first + i] != value){
+				fields[first + i] = value;
+				crate.changed[first + i] = true;
+			}
+		}
+	}
+
+	if(crate.fragments_seen < crate.num_fragments){ return false; }
+
+	if(header.type == STATS_PACKET_KEY){ crate.synced = true; }
+	crate.records++;
+
+	return true;
+}
+
+StatsCrate *StatsDecoder::GetCrate(unsigned short crate_){
+	std::map<unsigned short, StatsCrate>::iterator iter = crates.find(crate_);
+	return (iter != crates.end() ? &iter->second : NULL);
+}
+
+bool StatsDecoder::AllClosed(){
+	if(crates.empty()){ return false; }
+	for(std::map<unsigned short, StatsCrate>::iterator iter = crates.begin(); iter != crates.end(); iter++){
+		if(!iter->second.closed){ return false; }
+	}
+	return true;
+}
+
+void StatsDecoder::ClearChanged(){
+	for(std::map<unsigned short, StatsCrate>::iterator iter = crates.begin(); iter != crates.end(); iter++){
+		iter->second.changed.assign(iter->second.changed.size(), false);
+		iter->second.layout_changed = false;
+	}
+}
@@ -0,0 +1,593 @@
+/** \file poll2_stream.cpp
+  *
+  * \brief Stream socket (TCP or Unix domain) server used to pass spills to remote programs
+  *
+  * \date Oct. 18th, 2026
+  *
+  * Each published record is built once (header and payload) in a reference
+  * counted buffer, and every subscriber's queue holds a pointer to it. The
+  * buffer is freed once the last subscriber has sent it. Filtered spills are
+  * built once for each distinct subscription in the same way. Sends never
+  * block, whatever a socket will not take now is sent on the next Publish or
+  * Service.
+*/
+
+#include "poll2_stream.h"
+#include "poll2_shm.h"
+#include "poll2_socket.h"
+
+#include <iostream>
+#include <sstream>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+bool parse_stream_mask(const std::string &list_, unsigned int &mask_, unsigned int max_/*=STREAM_MAX_MODULES*/){
+	if(list_.empty()){ return false; }
+
+	mask_ = 0;
+	std::stringstream stream(list_);
+	std::string item;
+	while(std::getline(stream, item, ',')){
+		if(item.empty()){ return false; }
+
+		size_t dash = item.find('-');
+		std::string first = item.substr(0, dash);
+		std::string last = (dash == std::string::npos ? first : item.substr(dash+1));
+		if(!is_port(first) || !is_port(last)){ return false; }
+
+		unsigned int low = atoi(first.c_str());
+		unsigned int high = atoi(last.c_str());
+		if(low > high || high >= max_){ return false; }
+		for(unsigned int i = low; i <= high; i++){ mask_ |= (1U << i); }
+	}
+
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////
+// struct StreamSubscription
+/////////////////////////////////////////////////////////////////////
+
+StreamSubscription::StreamSubscription(unsigned int moduleMask_/*=0xFFFFFFFF*/, unsigned short channelMask_/*=STREAM_ALL_CHANNELS*/){
+	magic = STREAM_SUBSCRIBE_MAGIC;
+	module_mask = moduleMask_;
+	for(unsigned int i = 0; i < STREAM_MAX_MODULES; i++){ channel_mask[i] = channelMask_; }
+}
+
+bool StreamSubscription::IsEverything() const {
+	if(module_mask != 0xFFFFFFFF){ return false; }
+	for(unsigned int i = 0; i < STREAM_MAX_MODULES; i++){
+		if(channel_mask[i] != STREAM_ALL_CHANNELS){ return false; }
+	}
+	return true;
+}
+
+bool StreamSubscription::operator == (const StreamSubscription &other_) const {
+	return (module_mask == other_.module_mask && memcmp(channel_mask, other_.channel_mask, sizeof(channel_mask)) == 0);
+}
+
+/////////////////////////////////////////////////////////////////////
+// class StreamServer
+/////////////////////////////////////////////////////////////////////
+
+StreamServer::StreamServer(){
+	tcp_fd = -1;
+	unix_fd = -1;
+	init = false;
+	max_queue = STREAM_QUEUE_SIZE;
+	policy = STREAM_SLOW_SAMPLE;
+	next_seq = 0;
+	num_published = 0;
+	num_skipped = 0;
+	num_accepted = 0;
+	num_dropped = 0;
+}
+
+StreamServer::~StreamServer(){
+	Close();
+}
+
+bool StreamServer::Init(const std::string &address_){
+	if(init){ return false; }
+
+	if(is_port(address_)){
+		tcp_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if(tcp_fd < 0){ return false; }
+
+		int on = 1;
+		setsockopt(tcp_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+		struct sockaddr_in serv;
+		memset(&serv, 0, sizeof(serv));
+		serv.sin_family = AF_INET;
+		serv.sin_addr.s_addr = INADDR_ANY;
+		serv.sin_port = htons(atoi(address_.c_str()));
+
+		if(bind(tcp_fd, (struct sockaddr *)&serv, sizeof(serv)) < 0 || listen(tcp_fd, 8) < 0){
+			close(tcp_fd);
+			tcp_fd = -1;
+			return false;
+		}
+	}
+	else{
+		struct sockaddr_un serv;
+		if(address_.empty() || address_.size() >= sizeof(serv.sun_path)){ return false; }
+
+		unix_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if(unix_fd < 0){ return false; }
+
+		memset(&serv, 0, sizeof(serv));
+		serv.sun_family = AF_UNIX;
+		strcpy(serv.sun_path, address_.c_str());
+		unlink(address_.c_str()); // Remove a socket left behind by a previous poll2
+
+		if(bind(unix_fd, (struct sockaddr *)&serv, sizeof(serv)) < 0 || listen(unix_fd, 8) < 0){
+			close(unix_fd);
+			unix_fd = -1;
+			return false;
+		}
+		unix_path = address_;
+	}
+
+	address = address_;
+
+	return init = true;
+}
+
+void StreamServer::Accept(int listen_fd_, bool is_unix_){
+	while(true){
+		struct sockaddr_in from;
+		socklen_t fromlen = sizeof(from);
+		int fd = accept4(listen_fd_, (struct sockaddr *)&from, &fromlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if(fd < 0){ return; }
+
+		if(clients.size() >= STREAM_MAX_CLIENTS){
+			close(fd);
+			continue;
+		}
+
+		StreamClient *client = new StreamClient();
+		client->fd = fd;
+		client->offset = 0;
+		client->info.queued_bytes = 0;
+		client->info.queued_records = 0;
+		client->info.max_queued_bytes = 0;
+		client->info.bytes_sent = 0;
+		client->info.records_sent = 0;
+		client->info.records_skipped = 0;
+		client->info.filtered = false;
+		client->info.module_mask = client->sub.module_mask;
+		client->info.bytes_filtered = 0;
+		client->request_recvd = 0;
+
+		if(is_unix_){ client->info.address = unix_path; }
+		else{
+			int on = 1;
+			setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)); // Flags should not wait on the next spill
+
+			std::stringstream stream;
+			stream << inet_ntoa(from.sin_addr) << ":" << ntohs(from.sin_port);
+			client->info.address = stream.str();
+		}
+
+		clients.push_back(client);
+		num_accepted.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+bool StreamServer::Flush(StreamClient *client_){
+	struct iovec iov[STREAM_SEND_BATCH];
+
+	while(!client_->queue.empty()){
+		unsigned int count = 0;
+		for(std::deque<record_t>::iterator iter = client_->queue.begin(); iter != client_->queue.end() && count < STREAM_SEND_BATCH; iter++){
+			iov[count].iov_base = (void *)&(**iter)[0];
+			iov[count].iov_len = (*iter)->size();
+			count++;
+		}
+		iov[0].iov_base = (char *)iov[0].iov_base + client_->offset;
+		iov[0].iov_len -= client_->offset;
+
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = iov;
+		msg.msg_iovlen = count;
+
+		ssize_t sent = sendmsg(client_->fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+		if(sent < 0){ return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR); }
+
+		client_->info.bytes_sent += sent;
+		client_->info.queued_bytes -= sent;
+
+		// Remove every record which was sent completely
+		size_t remaining = sent + client_->offset;
+		while(!client_->queue.empty() && remaining >= client_->queue.front()->size()){
+			remaining -= client_->queue.front()->size();
+			client_->queue.pop_front();
+			client_->info.queued_records--;
+			client_->info.records_sent++;
+		}
+		client_->offset = remaining;
+
+		if(client_->offset != 0){ return true; } // The socket buffer is full
+	}
+
+	return true;
+}
+
+void StreamServer::Disconnect(size_t index_){
+	close(clients[index_]->fd);
+	delete clients[index_];
+	clients.erase(clients.begin() + index_);
+}
+
+bool StreamServer::ReadRequests(StreamClient *client_){
+	while(true){
+		ssize_t count = recv(client_->fd, (char *)&client_->request + client_->request_recvd, sizeof(StreamSubscription) - client_->request_recvd, MSG_DONTWAIT);
+		if(count == 0){ return false; } // The subscriber closed the connection
+		else if(count < 0){ return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR); }
+
+		client_->request_recvd += count;
+		if(client_->request_recvd < sizeof(StreamSubscription)){ continue; }
+		client_->request_recvd = 0;
+
+		if(client_->request.magic != STREAM_SUBSCRIBE_MAGIC){
+			std::cout << " StreamServer: Received bad subscription request from " << client_->info.address << std::endl;
+			return false;
+		}
+
+		client_->sub = client_->request;
+		client_->info.filtered = !client_->sub.IsEverything();
+		client_->info.module_mask = client_->sub.module_mask;
+	}
+}
+
+StreamServer::record_t StreamServer::MakeRecord(const StreamRecordHeader &head_, const void *data_, size_t nBytes_){
+	std::vector<char> *buffer = new std::vector<char>(sizeof(StreamRecordHeader) + nBytes_);
+	memcpy(&(*buffer)[0], &head_, sizeof(StreamRecordHeader));
+	if(nBytes_ > 0){ memcpy(&(*buffer)[sizeof(StreamRecordHeader)], data_, nBytes_); }
+	return record_t(buffer);
+}
+
+size_t StreamServer::FilterSpill(const unsigned int *data_, size_t nWords_, const StreamSubscription &sub_, unsigned int *dest_){
+	size_t nOut = 0;
+	size_t index = 0;
+	while(index + 2 <= nWords_){
+		unsigned int lenRec = data_[index];
+		unsigned int mod = data_[index+1];
+
+		if(lenRec < 2 || index + lenRec > nWords_){ break; } // Bad record length, keep nothing past here
+
+		if(mod >= STREAM_MAX_MODULES || (sub_.module_mask & (1U << mod) && sub_.channel_mask[mod] == STREAM_ALL_CHANNELS)){
+			memcpy(&dest_[nOut], &data_[index], lenRec*sizeof(unsigned int));
+			nOut += lenRec;
+		}
+		else if(!(sub_.module_mask & (1U << mod))){ // Keep an empty record for the module
+			dest_[nOut++] = 2;
+			dest_[nOut++] = mod;
+		}
+		else{ // Only keep the events from the selected channels
+			size_t start = nOut;
+			nOut += 2;
+			size_t event = index + 2;
+			while(event < index + lenRec){
+				unsigned int eventLength = (data_[event] & 0x1FFE0000) >> 17;
+				if(eventLength == 0 || event + eventLength > index + lenRec){ break; }
+				if(sub_.channel_mask[mod] & (1U << (data_[event] & 0xF))){
+					memcpy(&dest_[nOut], &data_[event], eventLength*sizeof(unsigned int));
+					nOut += eventLength;
+				}
+				event += eventLength;
+			}
+			dest_[start] = nOut - start;
+			dest_[start+1] = mod;
+		}
+
+		index += lenRec;
+	}
+
+	return nOut;
+}
+
+bool StreamServer::Publish(unsigned int type_, const void *data_, size_t nBytes_){
+	if(!init){ return false; }
+
+	std::lock_guard<std::mutex> lock(client_lock);
+
+	unsigned int seq = next_seq++;
+	num_published.fetch_add(1, std::memory_order_relaxed);
+
+	if(clients.empty()){ return true; }
+
+	StreamRecordHeader head;
+	head.magic = STREAM_RECORD_MAGIC;
+	head.type = type_;
+	head.length = nBytes_;
+	head.seq = seq;
+
+	record_t everything; // Built the first time a subscriber wants the whole record
+	std::vector<std::pair<StreamSubscription, record_t> > filtered; // Spills already built for other subscriptions
+
+	bool retval = true;
+	for(size_t i = 0; i < clients.size(); i++){
+		StreamClient *client = clients[i];
+
+		record_t record;
+		if(type_ != SHM_RECORD_SPILL || !client->info.filtered){
+			if(!everything){ everything = MakeRecord(head, data_, nBytes_); }
+			record = everything;
+		}
+		else{
+			for(size_t j = 0; j < filtered.size(); j++){
+				if(filtered[j].first == client->sub){ 
+					record = filtered[j].second;
+					break;
+				}
+			}
+			if(!record){
+				std::vector<char> *buffer = new std::vector<char>(sizeof(StreamRecordHeader) + nBytes_);
+				size_t nWords = FilterSpill((const unsigned int *)data_, nBytes_/sizeof(unsigned int), client->sub, (unsigned int *)&(*buffer)[sizeof(StreamRecordHeader)]);
+				StreamRecordHeader filtered_head = head;
+				filtered_head.length = nWords*sizeof(unsigned int);
+				memcpy(&(*buffer)[0], &filtered_head, sizeof(StreamRecordHeader));
+				buffer->resize(sizeof(StreamRecordHeader) + filtered_head.length);
+				record = record_t(buffer);
+				filtered.push_back(std::make_pair(client->sub, record));
+			}
+		}
+
+		// Only spills are ever held back from a slow subscriber
+		if(type_ == SHM_RECORD_SPILL && client->info.queued_bytes + record->size() > max_queue){
+			retval = false;
+			if(policy == STREAM_SLOW_DROP){
+				std::cout << " StreamServer: Dropping slow subscriber " << client->info.address << " (" << client->info.queued_bytes << " bytes behind)\n";
+				Disconnect(i--);
+				num_dropped.fetch_add(1, std::memory_order_relaxed);
+			}
+			else{
+				client->info.records_skipped++;
+				num_skipped.fetch_add(1, std::memory_order_relaxed);
+			}
+			continue;
+		}
+
+		client->queue.push_back(record);
+		client->info.queued_bytes += record->size();
+		client->info.bytes_filtered += sizeof(StreamRecordHeader) + nBytes_ - record->size();
+		client->info.queued_records++;
+		if(client->info.queued_bytes > client->info.max_queued_bytes){ client->info.max_queued_bytes = client->info.queued_bytes; }
+
+		if(!Flush(client)){ Disconnect(i--); }
+	}
+
+	return retval;
+}
+
+void StreamServer::Service(){
+	if(!init){ return; }
+
+	std::lock_guard<std::mutex> lock(client_lock);
+
+	if(tcp_fd >= 0){ Accept(tcp_fd, false); }
+	if(unix_fd >= 0){ Accept(unix_fd, true); }
+
+	for(size_t i = 0; i < clients.size(); i++){
+		// Subscribers only ever send subscription requests, or close the connection
+		if(!ReadRequests(clients[i]) || !Flush(clients[i])){ Disconnect(i--); }
+	}
+}
+
+void StreamServer::GetClients(std::vector<StreamClientInfo> &clients_){
+	std::lock_guard<std::mutex> lock(client_lock);
+	clients_.clear();
+	for(std::vector<StreamClient*>::iterator iter = clients.begin(); iter != clients.end(); iter++){
+		clients_.push_back((*iter)->info);
+	}
+}
+
+unsigned int StreamServer::GetNumClients(){
+	std::lock_guard<std::mutex> lock(client_lock);
+	return clients.size();
+}
+
+void StreamServer::Close(){
+	if(!init){ return; }
+
+	std::lock_guard<std::mutex> lock(client_lock);
+
+	while(!clients.empty()){ Disconnect(clients.size() - 1); }
+
+	if(tcp_fd >= 0){
+		close(tcp_fd);
+		tcp_fd = -1;
+	}
+	if(unix_fd >= 0){
+		close(unix_fd);
+		unlink(unix_path.c_str());
+		unix_fd = -1;
+	}
+
+	init = false;
+}
+
+/////////////////////////////////////////////////////////////////////
+// class StreamReader
+/////////////////////////////////////////////////////////////////////
+
+StreamReader::StreamReader(){
+	fd = -1;
+	init = false;
+	have_sub = false;
+	head_recvd = 0;
+	payload_recvd = 0;
+	last_seq = 0;
+	have_seq = false;
+	num_records = 0;
+	num_bytes = 0;
+	num_missed = 0;
+}
+
+StreamReader::~StreamReader(){
+	Close();
+}
+
+bool StreamReader::Init(const std::string &address_){
+	if(init){ return false; }
+
+	size_t colon = address_.find_last_of(':');
+	if(colon != std::string::npos && address_.find('/') == std::string::npos){ // host:port
+		struct addrinfo hints, *result;
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+
+		if(getaddrinfo(address_.substr(0, colon).c_str(), address_.substr(colon+1).c_str(), &hints, &result) != 0){ return false; }
+
+		for(struct addrinfo *addr = result; addr != NULL; addr = addr->ai_next){
+			fd = socket(addr->ai_family, addr->ai_socktype | SOCK_CLOEXEC, addr->ai_protocol);
+			if(fd < 0){ continue; }
+			if(connect(fd, addr->ai_addr, addr->ai_addrlen) == 0){ break; }
+			close(fd);
+			fd = -1;
+		}
+		freeaddrinfo(result);
+	}
+	else{ // Unix domain socket path
+		struct sockaddr_un serv;
+		if(address_.empty() || address_.size() >= sizeof(serv.sun_path)){ return false; }
+
+		memset(&serv, 0, sizeof(serv));
+		serv.sun_family = AF_UNIX;
+		strcpy(serv.sun_path, address_.c_str());
+
+		fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if(fd >= 0 && connect(fd, (struct sockaddr *)&serv, sizeof(serv)) != 0){
+			close(fd);
+			fd = -1;
+		}
+	}
+
+	if(fd < 0){ return false; }
+
+	// Make the socket buffer large enough to hold a good fraction of a spill
+	int bufsize = 4194304;
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+
+	head_recvd = 0;
+	payload_recvd = 0;
+	have_seq = false;
+
+	init = true;
+
+	if(have_sub && !Subscribe(sub)){
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+bool StreamReader::Subscribe(const StreamSubscription &sub_){
+	sub = sub_;
+	sub.magic = STREAM_SUBSCRIBE_MAGIC;
+	have_sub = true;
+
+	if(!init){ return true; } // Sent once connected
+
+	size_t sent = 0;
+	while(sent < sizeof(StreamSubscription)){
+		ssize_t count = send(fd, (char *)&sub + sent, sizeof(StreamSubscription) - sent, MSG_NOSIGNAL);
+		if(count < 0){
+			if(errno == EINTR){ continue; }
+			return false;
+		}
+		sent += count;
+	}
+
+	return true;
+}
+
+bool StreamReader::Recv(char *dest_, size_t nBytes_, size_t &recvd_){
+	while(recvd_ < nBytes_){
+		ssize_t count = recv(fd, dest_ + recvd_, nBytes_ - recvd_, MSG_DONTWAIT);
+		if(count > 0){ recvd_ += count; }
+		else if(count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){ return true; }
+		else if(count < 0 && errno == EINTR){ continue; }
+		else{ return false; } // The server closed the connection
+	}
+	return true;
+}
+
+bool StreamReader::Read(std::vector<unsigned int> &buffer_, unsigned int &type_, size_t &nBytes_){
+	if(!init){ return false; }
+
+	if(head_recvd < sizeof(StreamRecordHeader)){
+		if(!Recv((char *)&head, sizeof(StreamRecordHeader), head_recvd)){
+			Close();
+			return false;
+		}
+		if(head_recvd < sizeof(StreamRecordHeader)){ return false; }
+
+		if(head.magic != STREAM_RECORD_MAGIC){
+			std::cout << " StreamReader: Received bad record header, closing connection\n";
+			Close();
+			return false;
+		}
+
+		size_t nWords = (head.length + sizeof(unsigned int) - 1) / sizeof(unsigned int);
+		if(payload.size() < nWords + 2){ payload.resize(nWords + 2); }
+		payload_recvd = 0;
+	}
+
+	if(!Recv((char *)&payload[0], head.length, payload_recvd)){
+		Close();
+		return false;
+	}
+	if(payload_recvd < head.length){ return false; }
+
+	// Count any records the server skipped
+	if(have_seq){ num_missed += (unsigned int)(head.seq - last_seq - 1); }
+	last_seq = head.seq;
+	have_seq = true;
+
+	num_records++;
+	num_bytes += head.length;
+	type_ = head.type;
+	nBytes_ = head.length;
+
+	// Hand the payload buffer to the caller and receive the next record into the old one
+	payload.swap(buffer_);
+	head_recvd = 0;
+	payload_recvd = 0;
+
+	return true;
+}
+
+bool StreamReader::Wait(int timeout_ms_){
+	if(!init){ return false; }
+
+	struct pollfd pfd;
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+
+	return (poll(&pfd, 1, timeout_ms_) > 0);
+}
+
+void StreamReader::Close(){
+	if(!init){ return; }
+	close(fd);
+	fd = -1;
+	init = false;
+}
@@ -36,13 +36,13 @@
 
 #include <fstream>
 #include <map>
-#include <queue>
 #include <string>
 #include <set>
 
 #include <stdint.h>
 
 #include "Lock.h"
+#include "poll2_staging.h"
 
 #ifdef PIF_CATCHER
 const int CCSRA_PILEUP  = 15;
@@ -194,7 +194,8 @@ class PixieInterface
   int retval; // return value from pixie functions
   Lock lock;  // class to prevent simultaneous access to pixies
 
-  std::queue<word_t> extraWords[MAX_MODULES];
+  // words read ahead of the caller to satisfy MIN_FIFO_READ, never more than 2*MIN_FIFO_READ
+  StagingRing extraWords[MAX_MODULES];
 
   // temporary variables which hold the parameter which is being modified
   //   to deal with the const-incorrectness of the Pixie-16 API
@@ -0,0 +1,167 @@
+/** \file PixieSim.h
+  *
+  * \brief Software model of a Pixie16 crate used by PixieInterfaceSim
+  *
+  * \date Oct. 18th, 2026
+  *
+  * PixieInterfaceSim is PixieInterface linked against PixieSim.cpp instead of
+  * the XIA libraries. PixieSim.cpp implements the Pixie16* calls made by
+  * PixieInterface with a SimCrate, so poll2, MCA and the setup tools can be
+  * run and profiled without a crate.
+  *
+  * Every enabled channel produces events at random times with a fixed average
+  * rate. While a run is in progress, every call which touches a module first
+  * moves the module on to the current time: its events are added to the
+  * statistics and histograms and, in a list mode run, written to its FIFO as
+  * Rev. F list mode events with a four word header and an optional trace.
+  * Once a FIFO is full the module loses events, and the time until it is read
+  * again is counted as dead time.
+  *
+  * The crate is described by the file named by the PIXIE_SIM_CONFIG
+  * environment variable. Each line holds
+  *   module channel rate [traceLength [energy [sigma]]]
+  * with the rate in Hz and the trace length in ADC samples. Half of the
+  * events form a peak at energy with width sigma, the rest have an
+  * exponential spectrum. The module or channel may be * to set all of them,
+  * and later lines override earlier ones. Lines starting with # are ignored.
+  * Channels which are not listed produce SIM_DEFAULT_RATE events per second
+  * without traces.
+*/
+
+#ifndef PIXIE_SIM_H
+#define PIXIE_SIM_H
+
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "pixie16app_defs.h"
+
+#include "poll2_staging.h"
+
+#define PIXIE_SIM_VERSION "1.0.00"
+#define PIXIE_SIM_DATE "Oct. 18th, 2026"
+
+// Environment variable naming the crate description
+#define SIM_CONFIG_ENV "PIXIE_SIM_CONFIG"
+
+// Defaults for channels not in the crate description
+#define SIM_DEFAULT_RATE 1000.0 /// Events per second
+#define SIM_DEFAULT_ENERGY 1000.0
+#define SIM_DEFAULT_SIGMA 20.0
+#define SIM_DEFAULT_TAU 1.0 /// Pulse decay time (in us)
+
+#define SIM_CLOCK_TICK 8E-9 /// Length of a timestamp tick (in seconds)
+#define SIM_ADC_PERIOD 4E-9 /// Time between trace samples (in seconds)
+#define SIM_RISE_SAMPLES 5.0 /// Rise time of a pulse (in samples)
+#define SIM_BASELINE 400.0 /// Trace baseline (in ADC units)
+#define SIM_NOISE 4.0 /// Rms trace noise (in ADC units)
+#define SIM_NOISE_SAMPLES 4096 /// Number of precomputed noise samples
+#define SIM_ADC_MAX 16383 /// Largest ADC value
+
+#define SIM_HEADER_WORDS 4 /// Length of a list mode event header
+#define SIM_MAX_TRACE 8000 /// Longest trace (in samples), keeps events below the largest poll2 accepts
+
+/// A simulated channel.
+struct SimChannel{
+	double rate; /// Average event rate (in Hz)
+	double energy; /// Energy of the peak
+	double sigma; /// Width of the peak
+	unsigned int trace_length; /// Length of the trace written with each event (in samples)
+	bool good; /// Set if the channel takes data (CCSRA_GOOD)
+	bool traces; /// Set if traces are written (CCSRA_TRACEENA)
+
+	std::map<std::string, double> params; /// Channel parameters written by the user
+	std::vector<float> pulse; /// Trace of a unit pulse without baseline or noise
+	std::vector<unsigned int> histogram; /// MCA histogram
+
+	double next_time; /// Time of the next event (in seconds since the start of the run)
+	unsigned long long fast_peaks; /// Events seen by the channel
+	unsigned long long events; /// Events handled by the channel (stored in the FIFO in list mode)
+	unsigned long long lost; /// Events lost while the FIFO was full
+
+	SimChannel();
+};
+
+/// A simulated module.
+struct SimModule{
+	unsigned short slot;
+	std::vector<SimChannel> channels;
+	std::map<std::string, unsigned int> params; /// Module parameters written by the user
+	std::vector< std::vector<unsigned short> > adc_traces; /// Traces taken by the last Pixie16AcquireADCTrace
+
+	StagingRing fifo; /// The external FIFO
+	std::vector<unsigned int> event; /// The event being built
+
+	bool running;
+	bool list_mode; /// Set for a list mode run, otherwise a histogram run
+	double start_time; /// Time the run was started (in seconds of the monotonic clock)
+	double run_time; /// Time the module has been moved on to (in seconds since the start of the run)
+	double dead_time; /// Time the FIFO was full (in seconds)
+	double full_since; /// Run time at which the FIFO filled up, or negative if it is not full
+
+	SimModule();
+};
+
+class SimCrate{
+  private:
+	std::vector<SimModule> modules;
+	std::mt19937 rng;
+	std::vector<float> noise; /// Precomputed trace noise
+
+	/// Return a random time until the next event of a channel.
+	double NextInterval(const SimChannel &channel_);
+
+	/// Return a random energy for an event of channel_.
+	unsigned int Energy(const SimChannel &channel_);
+
+	/// Rebuild the unit pulse of channel_ after its trace length or decay time changed.
+	void BuildPulse(SimChannel &channel_);
+
+	/// Update the state of channel_ after a parameter changed.
+	void ApplyParams(SimChannel &channel_);
+
+	/// Handle the next event of channel chan_ of module_.
+	void Emit(SimModule &module_, unsigned short chan_);
+
+	/// Apply the crate description in fname_. Returns false if it cannot be read.
+	bool LoadConfig(const std::string &fname_);
+
+  public:
+	std::mutex lock; /// Taken by every Pixie16 call, the crate may be used from several threads
+
+	SimCrate();
+
+	/// Build nMods_ modules in the slots slots_ and apply the crate description.
+	void Init(unsigned short nMods_, const unsigned short *slots_);
+
+	size_t GetNumModules(){ return modules.size(); }
+
+	/// Return module mod_, or NULL if there is no such module.
+	SimModule *GetModule(unsigned short mod_){ return (mod_ < modules.size() ? &modules[mod_] : NULL); }
+
+	/// Start a run in module_. A new run clears the FIFO, statistics and histograms.
+	void StartRun(SimModule &module_, bool listMode_, bool newRun_);
+
+	/// Move module_ on to the current time.
+	void Advance(SimModule &module_);
+
+	/// Move nWords_ words out of the FIFO of module_. Returns false if it holds fewer words.
+	bool ReadFIFO(SimModule &module_, unsigned int *buf_, size_t nWords_);
+
+	/// Store the parameter name_ of channel chan_ of module_ and apply it to the channel.
+	void SetChanParam(SimModule &module_, unsigned short chan_, const std::string &name_, double value_);
+
+	/// Take an ADC trace of every channel of module_.
+	void AcquireTraces(SimModule &module_);
+
+	/// Return the live time of channel chan_ of module_ (in seconds).
+	double GetLiveTime(SimModule &module_, unsigned short chan_);
+
+	/// Return the current time of the monotonic clock (in seconds).
+	static double Now();
+};
+
+#endif
@@ -0,0 +1,41 @@
+/** \file pixie16app_defs.h
+  *
+  * \brief Stand-in for the XIA Pixie16 definitions used by PixieInterfaceSim
+  *
+  * \date Oct. 18th, 2026
+  *
+  * Only used when the suite is built with BUILD_SIM and the XIA software is
+  * not installed. Defines the subset of the XIA constants used by the suite,
+  * with the values of a Rev. F module.
+*/
+
+#ifndef PIXIE16APP_DEFS_H
+#define PIXIE16APP_DEFS_H
+
+// Module revisions
+#define PIXIE16_REVA 0
+#define PIXIE16_REVD_GENERAL 5
+#define PIXIE16_REVF 15
+#define PIXIE16_REVISION PIXIE16_REVF
+
+// Size of the DSP parameter memory and the start of the output parameters (in words)
+#define N_DSP_PAR 1280
+#define DSP_IO_BORDER 832
+
+#define NUMBER_OF_CHANNELS 16
+#define MAX_HISTOGRAM_LENGTH 32768 /// Bins in each channel's MCA histogram
+#define EXTERNAL_FIFO_LENGTH 131072 /// Size of each module's external FIFO (in words)
+#define RANDOMINDICES_LENGTH 8192 /// Length of an ADC trace (in samples)
+
+// Run types and modes
+#define LIST_MODE_RUN0 0x100
+#define NEW_RUN 1
+#define RESUME_RUN 0
+
+// Bits of CHANNEL_CSRA
+#define CCSRA_GOOD 2
+#define CCSRA_POLARITY 5
+#define CCSRA_TRACEENA 8
+#define CCSRA_ENARELAY 14
+
+#endif
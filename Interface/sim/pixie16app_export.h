@@ -0,0 +1,61 @@
+/** \file pixie16app_export.h
+  *
+  * \brief Stand-in for the XIA Pixie16 API used by PixieInterfaceSim
+  *
+  * \date Oct. 18th, 2026
+  *
+  * Only used when the suite is built with BUILD_SIM and the XIA software is
+  * not installed. Declares the XIA calls made by PixieInterface, which are
+  * implemented by the simulated crate in PixieSim.cpp.
+*/
+
+#ifndef PIXIE16APP_EXPORT_H
+#define PIXIE16APP_EXPORT_H
+
+#include "pixie16app_defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int Pixie16InitSystem(unsigned short NumModules, unsigned short *PXISlotMap, unsigned short OfflineMode);
+int Pixie16ExitSystem(unsigned short ModNum);
+int Pixie16BootModule(char *ComFPGAConfigFile, char *SPFPGAConfigFile, char *TrigFPGAConfigFile, char *DSPCodeFile,
+                      char *DSPParFile, char *DSPVarFile, unsigned short ModNum, unsigned short BootPattern);
+
+int Pixie16WriteSglModPar(char *ModParName, unsigned int ModParData, unsigned short ModNum);
+int Pixie16ReadSglModPar(char *ModParName, unsigned int *ModParData, unsigned short ModNum);
+int Pixie16WriteSglChanPar(char *ChanParName, double ChanParData, unsigned short ModNum, unsigned short ChanNum);
+int Pixie16ReadSglChanPar(char *ChanParName, double *ChanParData, unsigned short ModNum, unsigned short ChanNum);
+int Pixie16SaveDSPParametersToFile(char *FileName);
+int Pixie16CopyDSPParameters(unsigned short BitMask, unsigned short SourceModule, unsigned short SourceChannel, unsigned short *DestinationMask);
+
+int Pixie16AcquireADCTrace(unsigned short ModNum);
+int Pixie16ReadSglChanADCTrace(unsigned short *Trace_Buffer, unsigned int Trace_Length, unsigned short ModNum, unsigned short ChanNum);
+int Pixie16AdjustOffsets(unsigned short ModNum);
+int Pixie16TauFinder(unsigned short ModNum, double *Tau);
+
+int Pixie16ReadStatisticsFromModule(unsigned int *Statistics, unsigned short ModNum);
+double Pixie16ComputeInputCountRate(unsigned int *Statistics, unsigned short ModNum, unsigned short ChanNum);
+double Pixie16ComputeOutputCountRate(unsigned int *Statistics, unsigned short ModNum, unsigned short ChanNum);
+double Pixie16ComputeLiveTime(unsigned int *Statistics, unsigned short ModNum, unsigned short ChanNum);
+double Pixie16ComputeRealTime(unsigned int *Statistics, unsigned short ModNum);
+double Pixie16ComputeProcessedEvents(unsigned int *Statistics, unsigned short ModNum);
+
+int Pixie16StartHistogramRun(unsigned short ModNum, unsigned short mode);
+int Pixie16StartListModeRun(unsigned short ModNum, unsigned short RunType, unsigned short mode);
+int Pixie16CheckRunStatus(unsigned short ModNum);
+int Pixie16EndRun(unsigned short ModNum);
+int Pixie16CheckExternalFIFOStatus(unsigned int *nFIFOWords, unsigned short ModNum);
+int Pixie16ReadDataFromExternalFIFO(unsigned int *ExtFIFO_Data, unsigned int nFIFOWords, unsigned short ModNum);
+int Pixie16ReadHistogramFromModule(unsigned int *Histogram, unsigned int NumWords, unsigned short ModNum, unsigned short ChanNum);
+
+unsigned int Decimal2IEEEFloating(double DecimalNumber);
+unsigned int APP32_SetBit(unsigned short bit, unsigned int value);
+unsigned int APP32_ClrBit(unsigned short bit, unsigned int value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -95,6 +95,8 @@ bool PixieInterface::Histogram::Write(ofstream &out)
 PixieInterface::PixieInterface(const char *fn) : hasAlternativeConfig(false), lock("PixieInterface")
 {
   SetColorTerm();
+  for (size_t mod = 0; mod < MAX_MODULES; mod++)
+    extraWords[mod].Init(2 * MIN_FIFO_READ);
   // Set-up valid configuration keys if they don't exist yet
   if (validConfigKeys.empty()) { 
     //? perhaps these should allow more than just one alternate firmware configuration 
@@ -557,7 +559,7 @@ unsigned long PixieInterface::CheckFIFOWords(unsigned short mod)
     return 0;
   }
  
-	return nWords + extraWords[mod].size();
+	return nWords + extraWords[mod].Size();
 }
 
 bool PixieInterface::ReadFIFOWords(word_t *buf, unsigned long nWords,
@@ -567,10 +569,10 @@ bool PixieInterface::ReadFIFOWords(word_t *buf, unsigned long nWords,
 
 	if (verbose) {
 		std::cout << "mod " << mod << " nWords " << nWords;
-		std::cout << " extraWords[mod].size " << extraWords[mod].size();
+		std::cout << " extraWords[mod].size " << extraWords[mod].Size();
 	}
-	if (nWords < MIN_FIFO_READ + extraWords[mod].size()) {
-		if (nWords > extraWords[mod].size()) {
+	if (nWords < MIN_FIFO_READ + extraWords[mod].Size()) {
+		if (nWords > extraWords[mod].Size()) {
 			word_t minibuf[MIN_FIFO_READ];
 
 			if (availWords < MIN_FIFO_READ) {
@@ -583,17 +585,15 @@ bool PixieInterface::ReadFIFOWords(word_t *buf, unsigned long nWords,
 				cout << WarningStr("Error reading words from FIFO in module ") << mod << " retVal " << retval << endl;
 				return false;
 			}
-			for (int i=0;i<MIN_FIFO_READ;i++) extraWords[mod].push(minibuf[i]);
+			// fewer than MIN_FIFO_READ words are held here, so these always fit
+			extraWords[mod].Push(minibuf, MIN_FIFO_READ);
 		}
 	}
-	if (verbose) std::cout << " " << extraWords[mod].size();
+	if (verbose) std::cout << " " << extraWords[mod].Size();
 
-	size_t wordsAdded;
-	for (wordsAdded = 0;wordsAdded<nWords && !extraWords[mod].empty();++wordsAdded) {
-		*buf++ = extraWords[mod].front();
-		extraWords[mod].pop();
-	}
-	if (verbose) std::cout << " " << extraWords[mod].size();
+	size_t wordsAdded = extraWords[mod].Pop(buf, nWords);
+	buf += wordsAdded;
+	if (verbose) std::cout << " " << extraWords[mod].Size();
 
 	if (nWords <= wordsAdded) {
 		std::cout <<std::endl;
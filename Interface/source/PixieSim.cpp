@@ -0,0 +1,609 @@
+/** \file PixieSim.cpp
+  *
+  * \brief Software model of a Pixie16 crate used by PixieInterfaceSim
+  *
+  * \date Oct. 18th, 2026
+  *
+  * The Pixie16* calls below replace the XIA libraries. Each one takes the
+  * crate lock and works on the SimCrate. ModNum may be the number of modules
+  * to act on every module, as with the XIA calls. The statistics block filled
+  * by Pixie16ReadStatisticsFromModule only has to be understood by the
+  * Pixie16Compute* calls below, so it uses its own layout: the real time,
+  * then the live time, fast peaks and events of every channel, each as a
+  * 64 bit count of timestamp ticks or events.
+*/
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include <time.h>
+
+#include "pixie16app_export.h"
+
+#include "PixieSim.h"
+
+// Layout of the statistics block
+#define SIM_STAT_REAL 0
+#define SIM_STAT_CHAN 2
+#define SIM_STAT_LIVE 0
+#define SIM_STAT_PEAKS 2
+#define SIM_STAT_EVENTS 4
+#define SIM_STAT_CHAN_WORDS 6
+
+static SimCrate crate;
+
+SimChannel::SimChannel(){
+	rate = SIM_DEFAULT_RATE;
+	energy = SIM_DEFAULT_ENERGY;
+	sigma = SIM_DEFAULT_SIGMA;
+	trace_length = 0;
+	good = true;
+	traces = false;
+	histogram.assign(MAX_HISTOGRAM_LENGTH, 0);
+	next_time = 0.0;
+	fast_peaks = 0;
+	events = 0;
+	lost = 0;
+}
+
+SimModule::SimModule(){
+	slot = 0;
+	channels.assign(NUMBER_OF_CHANNELS, SimChannel());
+	adc_traces.assign(NUMBER_OF_CHANNELS, std::vector<unsigned short>(RANDOMINDICES_LENGTH, (unsigned short)SIM_BASELINE));
+	fifo.Init(EXTERNAL_FIFO_LENGTH);
+	event.assign(SIM_HEADER_WORDS + SIM_MAX_TRACE / 2, 0);
+	running = false;
+	list_mode = false;
+	start_time = 0.0;
+	run_time = 0.0;
+	dead_time = 0.0;
+	full_since = -1.0;
+}
+
+SimCrate::SimCrate() : rng(12345) {
+	std::normal_distribution<float> gauss(0.0, SIM_NOISE);
+	noise.resize(SIM_NOISE_SAMPLES);
+	for(size_t i = 0; i < noise.size(); i++){ noise[i] = gauss(rng); }
+}
+
+void SimCrate::Init(unsigned short nMods_, const unsigned short *slots_){
+	modules.assign(nMods_, SimModule());
+
+	for(unsigned short mod = 0; mod < nMods_; mod++){
+		modules[mod].slot = slots_[mod];
+		modules[mod].params["SlotID"] = slots_[mod];
+	}
+
+	const char *fname = getenv(SIM_CONFIG_ENV);
+	if(fname && !LoadConfig(fname)){ std::cout << " Warning! Failed to read the simulated crate description " << fname << " "; }
+
+	// Publish the description as channel parameters so they can be read and changed as usual
+	for(unsigned short mod = 0; mod < nMods_; mod++){
+		for(unsigned short chan = 0; chan < NUMBER_OF_CHANNELS; chan++){
+			SimChannel &channel = modules[mod].channels[chan];
+			unsigned int csra = (1 << CCSRA_GOOD);
+			if(channel.trace_length > 0){ csra |= (1 << CCSRA_TRACEENA); }
+			channel.params["CHANNEL_CSRA"] = csra;
+			channel.params["TRACE_LENGTH"] = channel.trace_length * SIM_ADC_PERIOD * 1E6;
+			channel.params["TAU"] = SIM_DEFAULT_TAU;
+			ApplyParams(channel);
+		}
+	}
+}
+
+bool SimCrate::LoadConfig(const std::string &fname_){
+	std::ifstream in(fname_.c_str());
+	if(!in){ return false; }
+
+	std::string line;
+	while(std::getline(in, line)){
+		std::istringstream lineStream(line);
+		if(lineStream.peek() == '#'){ continue; }
+
+		std::string modStr, chanStr;
+		double rate;
+		if(!(lineStream >> modStr >> chanStr >> rate)){ continue; }
+
+		double traceLength = -1.0, energy = -1.0, sigma = -1.0;
+		lineStream >> traceLength >> energy >> sigma;
+
+		for(size_t mod = 0; mod < modules.size(); mod++){
+			if(modStr != "*" && atoi(modStr.c_str()) != (int)mod){ continue; }
+			for(size_t chan = 0; chan < NUMBER_OF_CHANNELS; chan++){
+				if(chanStr != "*" && atoi(chanStr.c_str()) != (int)chan){ continue; }
+				SimChannel &channel = modules[mod].channels[chan];
+				channel.rate = (rate > 0.0 ? rate : 0.0);
+				if(traceLength >= 0.0){ channel.trace_length = (unsigned int)traceLength; }
+				if(energy >= 0.0){ channel.energy = energy; }
+				if(sigma >= 0.0){ channel.sigma = sigma; }
+			}
+		}
+	}
+
+	return true;
+}
+
+void SimCrate::SetChanParam(SimModule &module_, unsigned short chan_, const std::string &name_, double value_){
+	Advance(module_);
+
+	SimChannel &channel = module_.channels[chan_];
+	channel.params[name_] = value_;
+	ApplyParams(channel);
+
+	// A channel switched on during a run starts counting from now
+	if(module_.running && channel.rate > 0.0 && channel.next_time < module_.run_time){
+		channel.next_time = module_.run_time + NextInterval(channel);
+	}
+}
+
+void SimCrate::ApplyParams(SimChannel &channel_){
+	unsigned int csra = (unsigned int)channel_.params["CHANNEL_CSRA"];
+	channel_.good = ((csra & (1 << CCSRA_GOOD)) != 0);
+	channel_.traces = ((csra & (1 << CCSRA_TRACEENA)) != 0);
+
+	// Traces are packed two samples to a word
+	unsigned int length = (unsigned int)(channel_.params["TRACE_LENGTH"] * 1E-6 / SIM_ADC_PERIOD + 0.5);
+	if(length > SIM_MAX_TRACE){ length = SIM_MAX_TRACE; }
+	channel_.trace_length = length & ~1U;
+
+	BuildPulse(channel_);
+}
+
+void SimCrate::BuildPulse(SimChannel &channel_){
+	channel_.pulse.assign(channel_.trace_length, 0.0);
+	if(channel_.trace_length == 0){ return; }
+
+	double decay = channel_.params["TAU"] * 1E-6 / SIM_ADC_PERIOD;
+	if(decay <= 0.0){ decay = SIM_DEFAULT_TAU * 1E-6 / SIM_ADC_PERIOD; }
+
+	// The pulse starts a quarter of the way into the trace
+	size_t start = channel_.trace_length / 4;
+	double peak = 0.0;
+	for(size_t i = start; i < channel_.pulse.size(); i++){
+		double t = i - start;
+		channel_.pulse[i] = (1.0 - exp(-t / SIM_RISE_SAMPLES)) * exp(-t / decay);
+		if(channel_.pulse[i] > peak){ peak = channel_.pulse[i]; }
+	}
+	if(peak <= 0.0){ return; }
+	for(size_t i = start; i < channel_.pulse.size(); i++){ channel_.pulse[i] /= peak; }
+}
+
+double SimCrate::NextInterval(const SimChannel &channel_){
+	std::exponential_distribution<double> interval(channel_.rate);
+	return interval(rng);
+}
+
+unsigned int SimCrate::Energy(const SimChannel &channel_){
+	if(channel_.energy <= 0.0){ return 0; }
+
+	double energy;
+	if(std::uniform_int_distribution<int>(0, 1)(rng) == 0){ energy = std::normal_distribution<double>(channel_.energy, channel_.sigma)(rng); }
+	else{ energy = std::exponential_distribution<double>(2.0 / channel_.energy)(rng); }
+
+	if(energy < 0.0){ return 0; }
+	if(energy > 65535.0){ return 65535; }
+	return (unsigned int)energy;
+}
+
+void SimCrate::StartRun(SimModule &module_, bool listMode_, bool newRun_){
+	double now = Now();
+
+	if(newRun_){
+		module_.fifo.Clear();
+		module_.run_time = 0.0;
+		module_.dead_time = 0.0;
+		module_.full_since = -1.0;
+		for(size_t chan = 0; chan < module_.channels.size(); chan++){
+			SimChannel &channel = module_.channels[chan];
+			channel.fast_peaks = 0;
+			channel.events = 0;
+			channel.lost = 0;
+			channel.histogram.assign(MAX_HISTOGRAM_LENGTH, 0);
+		}
+	}
+
+	// A resumed run carries on from the time it was stopped
+	module_.start_time = now - module_.run_time;
+	for(size_t chan = 0; chan < module_.channels.size(); chan++){
+		SimChannel &channel = module_.channels[chan];
+		if(channel.rate > 0.0){ channel.next_time = module_.run_time + NextInterval(channel); }
+	}
+
+	module_.list_mode = listMode_;
+	module_.running = true;
+}
+
+void SimCrate::Advance(SimModule &module_){
+	if(!module_.running){ return; }
+
+	double now = Now() - module_.start_time;
+	if(now <= module_.run_time){ return; }
+	module_.run_time = now;
+
+	while(true){
+		// Events from all channels are handled in time order
+		int next = -1;
+		for(size_t chan = 0; chan < module_.channels.size(); chan++){
+			SimChannel &channel = module_.channels[chan];
+			if(!channel.good || channel.rate <= 0.0){ continue; }
+			if(next < 0 || channel.next_time < module_.channels[next].next_time){ next = chan; }
+		}
+		if(next < 0 || module_.channels[next].next_time > now){ break; }
+
+		if(module_.full_since >= 0.0){
+			// The module is dead until the FIFO is read, so only count the events it missed
+			for(size_t chan = 0; chan < module_.channels.size(); chan++){
+				SimChannel &channel = module_.channels[chan];
+				if(!channel.good || channel.rate <= 0.0 || channel.next_time > now){ continue; }
+				unsigned long long missed = (unsigned long long)((now - channel.next_time) * channel.rate) + 1;
+				channel.fast_peaks += missed;
+				channel.lost += missed;
+				channel.next_time = now + NextInterval(channel);
+			}
+			break;
+		}
+
+		Emit(module_, next);
+		module_.channels[next].next_time += NextInterval(module_.channels[next]);
+	}
+}
+
+void SimCrate::Emit(SimModule &module_, unsigned short chan_){
+	SimChannel &channel = module_.channels[chan_];
+	unsigned int energy = Energy(channel);
+	channel.fast_peaks++;
+
+	if(module_.list_mode){
+		unsigned int traceLength = (channel.traces ? channel.trace_length : 0);
+		unsigned int eventLength = SIM_HEADER_WORDS + traceLength / 2;
+		unsigned long long ticks = (unsigned long long)(channel.next_time / SIM_CLOCK_TICK);
+
+		unsigned int *event = &module_.event[0];
+		event[0] = chan_ | ((module_.slot & 0xF) << 4) | (SIM_HEADER_WORDS << 12) | (eventLength << 17);
+		event[1] = (unsigned int)(ticks & 0xFFFFFFFF);
+		event[2] = (unsigned int)((ticks >> 32) & 0xFFFF);
+		event[3] = energy | (traceLength << 16);
+
+		if(traceLength > 0){
+			double amplitude = energy;
+			if(amplitude > SIM_ADC_MAX - SIM_BASELINE){ amplitude = SIM_ADC_MAX - SIM_BASELINE; }
+			size_t offset = std::uniform_int_distribution<size_t>(0, noise.size() - 1)(rng);
+			for(unsigned int i = 0; i < traceLength; i += 2){
+				unsigned int first = (unsigned int)(SIM_BASELINE + amplitude * channel.pulse[i] + noise[(offset + i) % noise.size()]);
+				unsigned int second = (unsigned int)(SIM_BASELINE + amplitude * channel.pulse[i + 1] + noise[(offset + i + 1) % noise.size()]);
+				event[SIM_HEADER_WORDS + i / 2] = (first & 0xFFFF) | (second << 16);
+			}
+		}
+
+		if(!module_.fifo.Push(event, eventLength)){
+			module_.full_since = channel.next_time;
+			channel.lost++;
+			return;
+		}
+	}
+
+	channel.events++;
+	channel.histogram[energy * MAX_HISTOGRAM_LENGTH / 65536]++;
+}
+
+bool SimCrate::ReadFIFO(SimModule &module_, unsigned int *buf_, size_t nWords_){
+	Advance(module_);
+	if(nWords_ > module_.fifo.Size()){ return false; }
+	module_.fifo.Pop(buf_, nWords_);
+
+	if(module_.full_since >= 0.0){
+		module_.dead_time += module_.run_time - module_.full_since;
+		module_.full_since = -1.0;
+	}
+	return true;
+}
+
+void SimCrate::AcquireTraces(SimModule &module_){
+	for(size_t chan = 0; chan < module_.channels.size(); chan++){
+		SimChannel &channel = module_.channels[chan];
+		std::vector<unsigned short> &trace = module_.adc_traces[chan];
+
+		std::vector<double> samples(trace.size(), SIM_BASELINE);
+		size_t offset = std::uniform_int_distribution<size_t>(0, noise.size() - 1)(rng);
+		for(size_t i = 0; i < samples.size(); i++){ samples[i] += noise[(offset + i) % noise.size()]; }
+
+		// Add the pulses of the events falling within the trace
+		if(channel.good && channel.rate > 0.0){
+			double decay = channel.params["TAU"] * 1E-6 / SIM_ADC_PERIOD;
+			if(decay <= 0.0){ decay = SIM_DEFAULT_TAU * 1E-6 / SIM_ADC_PERIOD; }
+			double time = NextInterval(channel) / SIM_ADC_PERIOD;
+			while(time < samples.size()){
+				double amplitude = Energy(channel);
+				for(size_t i = (size_t)time; i < samples.size() && i < time + 10 * decay; i++){
+					double t = i - time;
+					samples[i] += amplitude * (1.0 - exp(-t / SIM_RISE_SAMPLES)) * exp(-t / decay);
+				}
+				time += NextInterval(channel) / SIM_ADC_PERIOD;
+			}
+		}
+
+		for(size_t i = 0; i < trace.size(); i++){
+			trace[i] = (unsigned short)(samples[i] < 0.0 ? 0 : (samples[i] > SIM_ADC_MAX ? SIM_ADC_MAX : samples[i]));
+		}
+	}
+}
+
+double SimCrate::GetLiveTime(SimModule &module_, unsigned short chan_){
+	double dead = module_.dead_time;
+	if(module_.full_since >= 0.0){ dead += module_.run_time - module_.full_since; }
+	return module_.run_time - dead;
+}
+
+double SimCrate::Now(){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1E-9;
+}
+
+/// Store a 64 bit count in two words of a statistics block.
+static void SetStat(unsigned int *stats_, size_t index_, unsigned long long value_){
+	stats_[index_] = (unsigned int)(value_ >> 32);
+	stats_[index_ + 1] = (unsigned int)(value_ & 0xFFFFFFFF);
+}
+
+/// Return a 64 bit count from two words of a statistics block.
+static double GetStat(const unsigned int *stats_, size_t index_){
+	return (double)(((unsigned long long)stats_[index_] << 32) | stats_[index_ + 1]);
+}
+
+/// Return the index of a channel count in a statistics block.
+static size_t ChanStat(unsigned short chan_, size_t offset_){
+	return SIM_STAT_CHAN + chan_ * SIM_STAT_CHAN_WORDS + offset_;
+}
+
+/// Call func_ for module mod_, or for every module if mod_ is the number of modules. Returns -1 for an unknown module.
+template<typename T>
+static int ForModules(unsigned short mod_, T func_){
+	if(mod_ == crate.GetNumModules()){
+		for(unsigned short mod = 0; mod < crate.GetNumModules(); mod++){ func_(*crate.GetModule(mod)); }
+		return 0;
+	}
+	SimModule *module = crate.GetModule(mod_);
+	if(!module){ return -1; }
+	func_(*module);
+	return 0;
+}
+
+extern "C" {
+
+int Pixie16InitSystem(unsigned short NumModules, unsigned short *PXISlotMap, unsigned short OfflineMode){
+	std::lock_guard<std::mutex> guard(crate.lock);
+	crate.Init(NumModules, PXISlotMap);
+	return 0;
+}
+
+int Pixie16ExitSystem(unsigned short ModNum){
+	return 0;
+}
+
+int Pixie16BootModule(char *ComFPGAConfigFile, char *SPFPGAConfigFile, char *TrigFPGAConfigFile, char *DSPCodeFile,
+                      char *DSPParFile, char *DSPVarFile, unsigned short ModNum, unsigned short BootPattern){
+	std::lock_guard<std::mutex> guard(crate.lock);
+	return ForModules(ModNum, [](SimModule &module){ module.running = false; });
+}
+
+int Pixie16WriteSglModPar(char *ModParName, unsigned int ModParData, unsigned short ModNum){
+	std::lock_guard<std::mutex> guard(crate.lock);
+	SimModule *module = crate.GetModule(ModNum);
+	if(!module){ return -1; }
+	module->params[ModParName] = ModParData;
+	if(strcmp(ModParName, "SlotID") == 0){ module->slot = ModParData; }
+	return 0;
+}
+
+int Pixie16ReadSglModPar(char *ModParName, unsigned int *ModParData, unsigned short ModNum){
+	std::lock_guard<std::mutex> guard(crate.lock);
+	SimModule *module = crate.GetModule(ModNum);
+	if(!module){ return -1; }
+	*ModParData = module->params[ModParName];
+	return 0;
+}
+
+int Pixie16WriteSglChanPar(char *ChanParName, double ChanParData, unsigned short ModNum, unsigned short ChanNum){
+	std::lock_guard<std::mutex> guard(crate.lock);
+	SimModule *module = crate.GetModule(ModNum);
+	if(!module || ChanNum >= NUMBER_OF_CHANNELS){ return -1; }
+	crate.SetChanParam(*module, ChanNum, ChanParName, ChanParData);
+	return 0;
+}
+
+int Pixie16ReadSglChanPar(char *ChanParName, double *ChanParData, unsigned short ModNum, unsigned short ChanNum){
+	std::lock_guard<std::mutex> guard(crate.lock);
+	SimModule *module = crate.GetModule(ModNum);
+	if(!module || ChanNum >= NUMBER_OF_CHANNELS){ return -1; }
+	*ChanParData = module->channels[ChanNum].params[ChanParName];
+	return 0;
+}
+
+int Pixie16SaveDSPParametersToFile(char *FileName){
+	std::lock_guard<std::mutex> guard(crate.lock);
+	std::ofstream out(FileName);
+	if(!out){ return -1; }
+
+	// Written as text, the simulated crate has no DSP memory to dump
+	for(unsigned short mod = 0; mod < crate.GetNumModules(); mod++){
+		SimModule *module = crate.GetModule(mod);
+		for(std::map<std::string, unsigned int>::iterator iter = module->params.begin(); iter != module->params.end(); iter++){
+			out << mod << "\t-\t" << iter->first << "\t" << iter->second << "\n";
+		}
+		for(unsigned short chan = 0; chan < NUMBER_OF_CHANNELS; chan++){
+			std::map<std::string, double> &params = module->channels[chan].params;
+			for(std::map<std::string, double>::iterator iter = params.begin(); iter != params.end(); iter++){
+				out << mod << "\t" << chan << "\t" << iter->first << "\t" << iter->second << "\n";
+			}
+		}
+	}
+
+	return 0;
+}
+
+int Pixie16CopyDSPParameters(unsigned short BitMask, unsigned short SourceModule, unsigned short SourceChannel, unsigned short *DestinationMask){
+	std::lock_guard<std::mutex> guard(crate.lock);
+	SimModule *source = crate.GetModule(SourceModule);
+	if(!source || SourceChannel >= NUMBER_OF_CHANNELS){ return -1; }
+
+	// Every parameter is copied, whatever the groups in BitMask
+	std::map<std::string, double> params = source->channels[SourceChannel].params;
+	for(unsigned short mod = 0; mod < crate.GetNumModules(); mod++){
+		for(unsigned short chan = 0; chan < NUMBER_OF_CHANNELS; chan++){
+			if(!DestinationMask[mod * NUMBER_OF_CHANNELS + chan]){ continue; }
+			SimModule *module = crate.GetModule(mod);
+			module->channels[chan].params = params;
+			crate.SetChanParam(*module, chan, "CHANNEL_CSRA", params["CHANNEL_CSRA"]);
+		}
+	}
+
+	return 0;
+}
+
+int Pixie16AcquireADCTrace(unsigned short ModNum){
+	std::lock_guard<std::mutex> guard(crate.lock);
+	return ForModules(ModNum, [](SimModule &module){ crate.AcquireTraces(module); });
+}
+
+int Pixie16ReadSglChanADCTrace(unsigned short *Trace_Buffer, unsigned int Trace_Length, unsigned short ModNum, unsigned short ChanNum){
+	std::lock_guard<std::mutex> guard(crate.lock);
+	SimModule *module = crate.GetModule(ModNum);
+	if(!module || ChanNum >= NUMBER_OF_CHANNELS || Trace_Length > RANDOMINDICES_LENGTH){ return -1; }
+	memcpy(Trace_Buffer, &module->adc_traces[ChanNum][0], Trace_Length * sizeof(unsigned short));
+	return 0;
+}
+
+int Pixie16AdjustOffsets(unsigned short ModNum){
+	std::lock_guard<std::mutex> guard(crate.lock);
+	// The simulated baselines are always where they should be
+	return ForModules(ModNum, [](SimModule &module){ });
+}
+
+int Pixie16TauFinder(unsigned short ModNum, double *Tau){
+	std::lock_guard<std::mutex> guard(crate.lock);
+	SimModule *module = crate.GetModule(ModNum);
+	if(!module){ return -1; }
+	for(unsigned short chan = 0; chan < NUMBER_OF_CHANNELS; chan++){
+		SimChannel &channel = module->channels[chan];
+		Tau[chan] = (channel.good && channel.rate > 0.0 ? channel.params["TAU"] : -1.0);
+	}
+	return 0;
+}
+
+int Pixie16ReadStatisticsFromModule(unsigned int *Statistics, unsigned short ModNum){
+	std::lock_guard<std::mutex> guard(crate.lock);
+	SimModule *module = crate.GetModule(ModNum);
+	if(!module){ return -1; }
+	crate.Advance(*module);
+
+	memset(Statistics, 0, (N_DSP_PAR - DSP_IO_BORDER) * sizeof(unsigned int));
+	SetStat(Statistics, SIM_STAT_REAL, (unsigned long long)(module->run_time / SIM_CLOCK_TICK));
+	for(unsigned short chan = 0; chan < NUMBER_OF_CHANNELS; chan++){
+		SimChannel &channel = module->channels[chan];
+		SetStat(Statistics, ChanStat(chan, SIM_STAT_LIVE), (unsigned long long)(crate.GetLiveTime(*module, chan) / SIM_CLOCK_TICK));
+		SetStat(Statistics, ChanStat(chan, SIM_STAT_PEAKS), channel.fast_peaks);
+		SetStat(Statistics, ChanStat(chan, SIM_STAT_EVENTS), channel.events);
+	}
+	return 0;
+}
+
+double Pixie16ComputeInputCountRate(unsigned int *Statistics, unsigned short ModNum, unsigned short ChanNum){
+	if(ChanNum >= NUMBER_OF_CHANNELS){ return 0.0; }
+	double live = GetStat(Statistics, ChanStat(ChanNum, SIM_STAT_LIVE)) * SIM_CLOCK_TICK;
+	return (live > 0.0 ? GetStat(Statistics, ChanStat(ChanNum, SIM_STAT_PEAKS)) / live : 0.0);
+}
+
+double Pixie16ComputeOutputCountRate(unsigned int *Statistics, unsigned short ModNum, unsigned short ChanNum){
+	if(ChanNum >= NUMBER_OF_CHANNELS){ return 0.0; }
+	double real = GetStat(Statistics, SIM_STAT_REAL) * SIM_CLOCK_TICK;
+	return (real > 0.0 ? GetStat(Statistics, ChanStat(ChanNum, SIM_STAT_EVENTS)) / real : 0.0);
+}
+
+double Pixie16ComputeLiveTime(unsigned int *Statistics, unsigned short ModNum, unsigned short ChanNum){
+	if(ChanNum >= NUMBER_OF_CHANNELS){ return 0.0; }
+	return GetStat(Statistics, ChanStat(ChanNum, SIM_STAT_LIVE)) * SIM_CLOCK_TICK;
+}
+
+double Pixie16ComputeRealTime(unsigned int *Statistics, unsigned short ModNum){
+	return GetStat(Statistics, SIM_STAT_REAL) * SIM_CLOCK_TICK;
+}
+
+double Pixie16ComputeProcessedEvents(unsigned int *Statistics, unsigned short ModNum){
+	double events = 0.0;
+	for(unsigned short chan = 0; chan < NUMBER_OF_CHANNELS; chan++){ events += GetStat(Statistics, ChanStat(chan, SIM_STAT_EVENTS)); }
+	return events;
+}
+
+int Pixie16StartHistogramRun(unsigned short ModNum, unsigned short mode){
+	std::lock_guard<std::mutex> guard(crate.lock);
+	return ForModules(ModNum, [mode](SimModule &module){ crate.StartRun(module, false, mode == NEW_RUN); });
+}
+
+int Pixie16StartListModeRun(unsigned short ModNum, unsigned short RunType, unsigned short mode){
+	std::lock_guard<std::mutex> guard(crate.lock);
+	return ForModules(ModNum, [mode](SimModule &module){ crate.StartRun(module, true, mode == NEW_RUN); });
+}
+
+int Pixie16CheckRunStatus(unsigned short ModNum){
+	std::lock_guard<std::mutex> guard(crate.lock);
+	SimModule *module = crate.GetModule(ModNum);
+	if(!module){ return -1; }
+	crate.Advance(*module);
+	return (module->running ? 1 : 0);
+}
+
+int Pixie16EndRun(unsigned short ModNum){
+	std::lock_guard<std::mutex> guard(crate.lock);
+	return ForModules(ModNum, [](SimModule &module){
+		crate.Advance(module);
+		module.running = false;
+	});
+}
+
+int Pixie16CheckExternalFIFOStatus(unsigned int *nFIFOWords, unsigned short ModNum){
+	std::lock_guard<std::mutex> guard(crate.lock);
+	SimModule *module = crate.GetModule(ModNum);
+	if(!module){ return -1; }
+	crate.Advance(*module);
+	*nFIFOWords = module->fifo.Size();
+	return 0;
+}
+
+int Pixie16ReadDataFromExternalFIFO(unsigned int *ExtFIFO_Data, unsigned int nFIFOWords, unsigned short ModNum){
+	std::lock_guard<std::mutex> guard(crate.lock);
+	SimModule *module = crate.GetModule(ModNum);
+	if(!module){ return -1; }
+	return (crate.ReadFIFO(*module, ExtFIFO_Data, nFIFOWords) ? 0 : -2);
+}
+
+int Pixie16ReadHistogramFromModule(unsigned int *Histogram, unsigned int NumWords, unsigned short ModNum, unsigned short ChanNum){
+	std::lock_guard<std::mutex> guard(crate.lock);
+	SimModule *module = crate.GetModule(ModNum);
+	if(!module || ChanNum >= NUMBER_OF_CHANNELS || NumWords > MAX_HISTOGRAM_LENGTH){ return -1; }
+	crate.Advance(*module);
+	memcpy(Histogram, &module->channels[ChanNum].histogram[0], NumWords * sizeof(unsigned int));
+	return 0;
+}
+
+unsigned int Decimal2IEEEFloating(double DecimalNumber){
+	float value = (float)DecimalNumber;
+	unsigned int word;
+	memcpy(&word, &value, sizeof(word));
+	return word;
+}
+
+unsigned int APP32_SetBit(unsigned short bit, unsigned int value){
+	return value | (1U << bit);
+}
+
+unsigned int APP32_ClrBit(unsigned short bit, unsigned int value){
+	return value & ~(1U << bit);
+}
+
+}
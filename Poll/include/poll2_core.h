@@ -10,22 +10,27 @@
   *
   * \author Cory R. Thornsberry
   * 
-  * \date Oct. 2nd, 2015
+  * \date Oct. 18th, 2026
   * 
-  * \version 1.3.08
+  * \version 1.4.00
 */
 
 #ifndef POLL2_CORE_H
 #define POLL2_CORE_H
 
 #include <vector>
+#include <string>
+#include <atomic>
+#include <mutex>
+
+#include <sys/socket.h>
 
 #include "PixieInterface.h"
 #include "hribf_buffers.h"
 #define maxEventSize 4095 // (0x1FFE0000 >> 17)
 
-#define POLL2_CORE_VERSION "1.3.08"
-#define POLL2_CORE_DATE "Oct. 2nd, 2015"
+#define POLL2_CORE_VERSION "1.4.00"
+#define POLL2_CORE_DATE "Oct. 18th, 2026"
 
 // Maximum length of UDP data packet (in bytes)
 #define MAX_ORPH_DATA 1464
@@ -98,24 +103,57 @@ struct data_pack{
 class StatsHandler;
 class Client;
 class Server;
+class ShmWriter;
+class SpillSender;
+class PacSender;
+class StreamServer;
+class TokenBucket;
+class SpillPipeline;
+class SpillBufferPool;
+class StagingRing;
+class FifoController;
+class PollBackoff;
+class SpillReplay;
+class SpillTracer;
+class TraceReducer;
+class RealtimeConfig;
+class MetricsServer;
+class MetricsPage;
+struct SpillBuffer;
 class Terminal;
 
 class Poll{
   private:
 	Terminal *poll_term_;
-	///A vector to store the partial events
-	std::vector<word_t> *partialEvent;
+	///A ring per module to hold the words of a partial event until the next spill
+	StagingRing *partialEvent;
 	
 	double startTime; ///Time when the acquistion was started.
 	double lastSpillTime; ///Time when the last spill finished.
 
-	unsigned int udp_sequence; /// ???
-	unsigned int total_spill_chunks; /// Total number of poll data spill chunks sent over the network
-
   	struct tm *time_info;
 
 	Client *client; /// UDP client for network access
 	Server *server; /// UDP server to listen for pacman commands
+	ShmWriter *shm_ring; /// Shared memory ring for local shm readers
+	SpillSender *spill_sender; /// Splits shm spills into network chunks
+	PacSender *pac_sender; /// Splits spills into classic pacman datagrams
+	StreamServer *stream_server; /// TCP or Unix domain socket server for remote subscribers
+	MetricsServer *metrics_server; /// HTTP server of Prometheus metrics
+	TokenBucket *pacer; /// Limits the rate of spills sent over UDP
+	SpillPipeline *pipeline; /// Passes spills from the FIFO reader to the validator and sink threads
+	SpillBuffer *raw_buffer; /// Raw FIFO words, when the stages all run on the RunControl thread
+	SpillBuffer *spill_buffer; /// The spill built from raw_buffer
+	SpillBufferPool *buffer_pool; /// The memory of raw_buffer and spill_buffer
+	size_t buffer_words; /// Size of every raw and spill buffer (in words)
+	size_t raw_stride; /// Words between the data of two modules in a raw buffer
+	FifoController *fifo_ctrl; /// Decides when the FIFOs are read
+	PollBackoff *backoff; /// Spins, yields or sleeps between FIFO checks
+	SpillReplay *replay; /// Source of spills in replay mode
+	SpillTracer *tracer; /// Time spent by every spill in each stage of the readout
+	TraceReducer *reducer; /// Shrinks the traces of validated spills before they reach the sink
+	RealtimeConfig *rt_config; /// Scheduling and memory locking of the readout threads
+	std::string replay_file; /// File replayed instead of reading the crate (empty if not in use)
 
 	PixieInterface *pif; /// The main pixie interface pointer 
   
@@ -125,14 +163,14 @@ class Poll{
 	std::string sys_message_head; /// Command line message header
 	bool kill_all; /// Set to true when the program is exiting
 	bool do_start_acq; /// Set to true when the command is given to start a run
-	bool do_stop_acq; /// Set to true when the command is given to stop a run
+	std::atomic<bool> do_stop_acq; /// Set to true when the command is given to stop a run
 	bool record_data; /// Set to true if data is to be recorded to disk
 	bool do_reboot; /// Set to true when the user tells POLL to reboot PIXIE
 	bool force_spill; /// Force poll2 to dump the current data spill
 	bool acq_running; /// Set to true when run_command is recieving data from PIXIE
 	bool run_ctrl_exit; /// Set to true when run_command exits
-	bool had_error;
-	bool file_open;
+	std::atomic<bool> had_error; /// Set to true when the readout hits an error (also set by the validator thread)
+	std::atomic<bool> file_open; /// Set to true while an output file is open
 	time_t raw_time;
 
 	// System MCA flags
@@ -148,7 +186,29 @@ class Poll{
 	bool zero_clocks; //
 	bool debug_mode; //
 	bool shm_mode; /// New style shared-memory mode.
+	bool shm_udp_mode; /// Send shm spills over UDP instead of the shared memory ring.
+	size_t shm_ring_size; /// Size of the shared memory ring (in MB).
+	unsigned int shm_overrun; /// Overrun policy of the shared memory ring.
+	std::string stream_address; /// TCP port or Unix socket path of the stream server (empty if not in use).
+	unsigned int stream_policy; /// What the stream server does with slow subscribers.
+	std::string metrics_address; /// TCP port, host:port or Unix socket path of the metrics server (empty if not in use).
+	unsigned short stats_crate; /// Crate ID sent with the stats packets.
+	std::string stats_destination; /// Host (and port) the stats packets are sent to (empty for the local host).
+	std::string mcast_group; /// Multicast group shm spills are sent to (empty if not in use).
+	std::string mcast_iface; /// Interface multicast datagrams are sent on (empty to let the kernel choose).
+	int mcast_ttl; /// Time-to-live of multicast datagrams.
+	bool pace_auto; /// Set the pacing rate from the size of and time between spills.
+	double last_bcast_time; /// Time when the last spill was broadcast over UDP (monotonic, in seconds).
 	bool pac_mode; /// Pacman shared-memory mode.
+	std::atomic<bool> use_pipeline; /// Run the validator and sink stages of the readout on their own threads.
+	std::atomic<bool> scalers_due; /// Set by the sink when the FIFO reader should read the scalers.
+	std::atomic<unsigned long long> bytes_written; /// Spill data written to disk (in bytes).
+	std::atomic<unsigned long long> spills_written; /// Spills written to disk.
+	std::atomic<unsigned long long> file_rollovers; /// Output files continued in a new file for being too large.
+	std::atomic<unsigned long long> file_size; /// Size of the current output file (in bytes), published for the status bar.
+	std::mutex file_info_lock; /// Guards file_name and file_run.
+	std::string file_name; /// Name of the current output file, published for the status bar.
+	int file_run; /// Run number of the current output file, published for the status bar.
 	bool init; //
 
 	// Options relating to output data file
@@ -176,9 +236,6 @@ class Poll{
 	const static std::vector<std::string> pollStatusCommands_; 
 	std::vector<std::string> commands_;
 
-	
-	data_pack AcqBuf; /// Data packet for class shared-memory broadcast
-	
 	/// Print help dialogue for POLL options.
 	void help();
 
@@ -210,12 +267,45 @@ class Poll{
 
 	///Routine to read Pixie FIFOs
 	bool ReadFIFO();
-	///Routine to read Pixie scalers.
-	void ReadScalers();
+	///Routine to read Pixie scalers into rates (input and output count rate of each channel).
+	void ReadScalers(std::vector<double> &rates);
+
+	/// Reader stage. Read nWords words from the FIFO of each module into raw.
+	bool read_modules(SpillBuffer *raw, const std::vector<word_t> &nWords);
+
+	/// Reader stage in replay mode. Wait for the next spill of the replay file to be due and pass it on like a FIFO read.
+	bool read_replay();
+
+	/// Print the number of spills replayed and the rate they were handled at.
+	void show_replay();
+
+	/// Print the median, 99th percentile and longest time spent by spills in each stage of the readout.
+	void show_trace();
+
+	/// Print how the traces of each channel are reduced and the number of bytes saved.
+	void show_reduce();
+
+	/// Print the spread of a rate (STATS_HISTORY_*) over the last window stats intervals, for the channels of mod or for every module.
+	void show_history(int type, int mod, size_t window);
+
+	/// Fill page with the metrics served by the metrics server. Called on the metrics server thread.
+	void write_metrics(MetricsPage &page);
+
+	/// Validator stage. Stitch partial events, check the data and build the spill from raw.
+	bool validate_spill(SpillBuffer *raw, SpillBuffer *spill);
+
+	/// Sink stage. Update the stats and write and broadcast the spill.
+	void sink_spill(SpillBuffer *spill);
+
+	/// Service the network while the sink has nothing to do.
+	void sink_idle();
 
 	/// Set IN_SYNCH and SYNCH_WAIT parameters on all modules.
 	bool synch_mods();
 
+	/// Allocate raw_buffer and spill_buffer, used when every stage of the readout runs on the RunControl thread.
+	bool alloc_serial_buffers();
+
 	/// Return the current output filename.
 	std::string get_filename();
 	
@@ -224,6 +314,9 @@ class Poll{
 	
 	/// Opens a new file if no file is currently open.
 	bool open_output_file(bool continueRun = false);
+
+	/// Copy the name, run number and size of the output file to where the status bar reads them.
+	void publish_file_info();
 	
 	/// Write a data spill to disk.
 	int write_data(word_t *data, unsigned int nWords);
@@ -231,8 +324,11 @@ class Poll{
 	/// Broadcast a data spill onto the network.
 	void broadcast_data(word_t *data, unsigned int nWords);
 
-	/// Broadcast a data spill onto the network in the classic pacman format.
-	void broadcast_pac_data();
+	/// Set the pacing rate so that a spill of nBytes is spread over the time since the last one.
+	void auto_pace(size_t nBytes);
+
+	/// Send a network flag ($OPEN_FILE, etc.) to shm readers.
+	void broadcast_flag(const char *flag);
 
   public:
   	/// Default constructor.
@@ -263,9 +359,64 @@ class Poll{
 	
 	void SetPacmanMode(bool input_=true){ pac_mode = input_; }
 	
+	void SetShmUdpMode(bool input_=true){ shm_udp_mode = input_; }
+	
+	void SetShmRingSize(const size_t &size_){ shm_ring_size = size_; }
+	
+	void SetShmOverrun(unsigned int policy_){ shm_overrun = policy_; }
+	
+	void SetStreamAddress(const std::string &address_){ stream_address = address_; }
+	
+	void SetStreamPolicy(unsigned int policy_){ stream_policy = policy_; }
+	
+	void SetMetricsAddress(const std::string &address_){ metrics_address = address_; }
+	
+	void SetStatsCrate(unsigned short crate_){ stats_crate = crate_; }
+	
+	void SetStatsDestination(const std::string &address_){ stats_destination = address_; }
+	
+	void SetMulticastGroup(const std::string &group_){ mcast_group = group_; }
+	
+	void SetMulticastIface(const std::string &iface_){ mcast_iface = iface_; }
+	
+	void SetMulticastTTL(int ttl_){ mcast_ttl = ttl_; }
+
+	/** Limit the rate of spills sent over UDP. rate_ is in MB/s, "auto" to spread each spill over
+	  * the time between spills or "off". burst_ is in kB. Returns false if either value is invalid. */
+	bool SetPacing(const std::string &rate_, const std::string &burst_="");
+
+	/** Set how the FIFOs are polled, as a comma separated list of the number of checks made spinning, the
+	  * number made yielding and the longest sleep between checks (in us). Returns false if it is invalid. */
+	bool SetBackoff(const std::string &config_);
+
+	/** Run the validator and sink stages of the readout on their own threads. cpus_ is an optional
+	  * comma separated list of the cpus of the reader, validator and sink. Returns false if it is invalid. */
+	bool SetPipeline(const std::string &cpus_="");
+
+	/** Pin the readout thread (and the validator and sink threads of the pipeline) to cpus. cpus_ is a
+	  * comma separated list of the cpus of the reader, validator and sink. Returns false if it is invalid. */
+	bool SetAffinity(const std::string &cpus_);
+
+	/// Run the readout threads under SCHED_FIFO at priority_, or "" for the default. Returns false if it is invalid.
+	bool SetRealtimePriority(const std::string &priority_);
+
+	/// Lock the memory of poll2 once the spill buffers are allocated.
+	void SetLockMemory(bool state_=true);
+
+	/// Replay the spills of the .ldf or .pld file fname_ instead of reading the crate.
+	void SetReplayFile(const std::string &fname_){ replay_file = fname_; }
+
+	/// Set the replay speed to a multiple of the original cadence, or "max". Returns false if it is invalid.
+	bool SetReplaySpeed(const std::string &speed_);
+	
 	void SetNcards(const size_t &n_cards_){ n_cards = n_cards_; }
 	
-	void SetThreshWords(const size_t &thresh_){ threshWords = thresh_; }
+	void SetThreshWords(const size_t &thresh_);
+
+	/** Switch between the fixed FIFO threshold and the adaptive threshold, which reads the FIFOs at
+	  * least every maxLatency_ seconds and before any of them is more than 1-margin_ full. Negative
+	  * values keep the current latency target and margin. */
+	void SetAdaptiveThresh(bool state_, double maxLatency_=-1.0, double margin_=-1.0);
 
 	///Set the terminal pointer.
 	void SetTerminal(Terminal *term){ poll_term_ = term; };
@@ -289,6 +440,30 @@ class Poll{
 	
 	bool GetPacmanMode(){ return pac_mode; }
 	
+	bool GetPipeline(){ return use_pipeline; }
+	
+	bool GetShmUdpMode(){ return shm_udp_mode; }
+	
+	size_t GetShmRingSize(){ return shm_ring_size; }
+	
+	unsigned int GetShmOverrun(){ return shm_overrun; }
+	
+	std::string GetStreamAddress(){ return stream_address; }
+	
+	unsigned int GetStreamPolicy(){ return stream_policy; }
+	
+	std::string GetMetricsAddress(){ return metrics_address; }
+	
+	unsigned short GetStatsCrate(){ return stats_crate; }
+	
+	std::string GetStatsDestination(){ return stats_destination; }
+	
+	std::string GetMulticastGroup(){ return mcast_group; }
+	
+	std::string GetMulticastIface(){ return mcast_iface; }
+	
+	int GetMulticastTTL(){ return mcast_ttl; }
+	
 	size_t GetNcards(){ return n_cards; }
 	
 	size_t GetThreshWords(){ return threshWords; }
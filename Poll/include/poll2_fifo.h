@@ -0,0 +1,227 @@
+/** \file poll2_fifo.h
+  *
+  * \brief Decides when poll2 reads out the module FIFOs
+  *
+  * \date Oct. 18th, 2026
+  *
+  * By default the FIFOs are read once any module holds more than a fixed
+  * number of words. At low rates this leaves data sitting in the modules for
+  * a long time, and at high rates the margin before a full FIFO is thin.
+  *
+  * In adaptive mode the FifoController estimates the fill rate of every
+  * module from successive FIFO size samples and reads the FIFOs when either
+  *  - a module is predicted to come within the safety margin of a full FIFO
+  *    before the FIFOs could next be read (the time between samples plus
+  *    the time the last read took), or
+  *  - data has waited in the FIFOs for longer than the latency target.
+  * The reason for every read is counted so it can be published with the stats.
+  * The settings may be changed from any thread at any time. They are staged
+  * and only take effect at the next Check, so the thread reading the FIFOs
+  * never sees half of a change.
+  *
+  * Between FIFO checks the PollBackoff class first spins (checks again
+  * straight away), then yields the cpu, then sleeps for exponentially longer
+  * times up to a limit. It starts spinning again as soon as data is read, so
+  * the FIFOs are checked quickly while data is flowing and rarely when it is
+  * not. The time spent in each phase is counted.
+*/
+
+#ifndef POLL2_FIFO_H
+#define POLL2_FIFO_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <atomic>
+#include <mutex>
+
+#define POLL2_FIFO_VERSION "1.1.01"
+#define POLL2_FIFO_DATE "Oct. 18th, 2026"
+
+// Reasons for reading the FIFOs
+#define FIFO_READ_NONE 0 /// The FIFOs do not need reading yet
+#define FIFO_READ_THRESH 1 /// A module passed the fixed threshold
+#define FIFO_READ_SAFETY 2 /// A module is about to come within the safety margin of a full FIFO
+#define FIFO_READ_LATENCY 3 /// Data has waited in the FIFOs for longer than the latency target
+#define FIFO_READ_FORCED 4 /// The read was forced (e.g. at the end of a run)
+#define FIFO_READ_TYPES 5
+
+// Default latency target in adaptive mode (in seconds)
+#define FIFO_DEFAULT_LATENCY 1.0
+
+// Default safety margin in adaptive mode (fraction of the FIFO kept free)
+#define FIFO_DEFAULT_MARGIN 0.25
+
+// Fill rates are measured over windows of at least this long (in seconds)
+#define FIFO_RATE_WINDOW 0.01
+
+// Weight given to the newest measurement in the fill rate averages
+#define FIFO_RATE_WEIGHT 0.25
+
+// Polling phases
+#define BACKOFF_SPIN 0 /// Check again straight away
+#define BACKOFF_YIELD 1 /// Let other threads run before checking again
+#define BACKOFF_SLEEP 2 /// Sleep before checking again
+#define BACKOFF_PHASES 3
+
+// Default number of checks made in the spin and yield phases
+#define BACKOFF_DEFAULT_SPINS 100
+#define BACKOFF_DEFAULT_YIELDS 100
+
+// Default first and longest sleep (in seconds)
+#define BACKOFF_MIN_SLEEP 0.00001
+#define BACKOFF_MAX_SLEEP 0.01
+
+/// The settings which decide when the FIFOs are read.
+struct FifoSettings{
+	bool adaptive;
+	size_t thresh; /// Fixed threshold (in words)
+	double max_latency; /// Latency target (in seconds)
+	double margin; /// Safety margin (fraction of the FIFO)
+};
+
+class FifoController{
+  private:
+	size_t num_mods;
+	size_t fifo_length; /// Size of each module's FIFO (in words)
+	size_t min_read; /// Smallest number of words which may be read from a FIFO
+
+	FifoSettings active; /// Settings used by Check (only changed by the thread calling Check)
+	FifoSettings requested; /// Settings most recently set, applied at the next Check
+	std::mutex settings_lock; /// Guards requested, and active while it is changed
+	std::atomic<bool> settings_changed; /// Set when requested has not been applied yet
+
+	std::atomic<unsigned int> *words; /// Words in each FIFO at the last sample (read by the metrics server thread)
+	std::vector<double> rate; /// Estimated fill rate of each FIFO (in words per second)
+	std::vector<unsigned int> window_words; /// Words in each FIFO at the start of the rate window
+	std::vector<double> window_time; /// Start of each rate window (in seconds)
+	double sample_time; /// Time of the last sample (in seconds)
+
+	double last_check; /// Time of the last call to Check (in seconds)
+	double check_interval; /// Average time between calls to Check (in seconds)
+	double read_time; /// Time the last read took (in seconds)
+	double last_read; /// Time of the last read (in seconds)
+
+	std::atomic<unsigned long long> num_reads[FIFO_READ_TYPES]; /// Reads for each reason since the last Reset (read by the metrics server thread)
+	double last_latency; /// Time between the last two reads (in seconds)
+
+  public:
+	FifoController();
+
+	~FifoController();
+
+	/// Set up nMods_ modules, each with a FIFO of fifoLength_ words from which at least minRead_ words must be read.
+	void Init(size_t nMods_, size_t fifoLength_, size_t minRead_);
+
+	/// Read the FIFOs once any module holds more than words_ words.
+	void SetThreshold(size_t words_);
+
+	/** Switch between the fixed threshold and adaptive mode. In adaptive mode the FIFOs are read
+	  * at least every maxLatency_ seconds and before any of them is more than 1-margin_ full. */
+	void SetAdaptive(bool state_, double maxLatency_=FIFO_DEFAULT_LATENCY, double margin_=FIFO_DEFAULT_MARGIN);
+
+	/// Forget the fill rates and counters at the start of a run (time_ in seconds).
+	void Reset(double time_);
+
+	/// Record the number of words in the FIFO of mod_ at time_ (in seconds).
+	void Sample(size_t mod_, unsigned int words_, double time_);
+
+	/// Decide whether the FIFOs should be read after the last samples. Returns one of the FIFO_READ_* reasons.
+	int Check(double time_);
+
+	/** Record a read of the nWords_ words sampled in each FIFO for reason_, which started at start_
+	  * and finished at stop_ (in seconds). Returns the time since the previous read. */
+	double Read(int reason_, const std::vector<unsigned int> &nWords_, double start_, double stop_);
+
+	/// Return the settings most recently set (which may not have been applied yet).
+	FifoSettings GetSettings();
+
+	bool IsAdaptive(){ return GetSettings().adaptive; }
+
+	size_t GetThreshold(){ return GetSettings().thresh; }
+
+	double GetMaxLatency(){ return GetSettings().max_latency; }
+
+	double GetMargin(){ return GetSettings().margin; }
+
+	/// Return the number of words in the FIFO of mod_ at the last sample. May be called from any thread.
+	unsigned int GetWords(size_t mod_){ return (mod_ < num_mods ? words[mod_].load(std::memory_order_relaxed) : 0); }
+
+	/// Return the estimated fill rate of the FIFO of mod_ (in words per second).
+	double GetFillRate(size_t mod_){ return (mod_ < num_mods ? rate[mod_] : 0.0); }
+
+	/// Return the number of words in the FIFO of mod_ at which a read will be triggered at its current fill rate.
+	double GetReadLevel(size_t mod_);
+
+	/// Return the number of reads made for reason_ since the last Reset. May be called from any thread.
+	unsigned long long GetReads(int reason_){ return (reason_ >= 0 && reason_ < FIFO_READ_TYPES ? num_reads[reason_].load(std::memory_order_relaxed) : 0); }
+
+	double GetLastLatency(){ return last_latency; }
+
+	double GetCheckInterval(){ return check_interval; }
+
+	double GetReadTime(){ return read_time; }
+
+	/// Return the name of a FIFO_READ_* reason.
+	static const char *ReasonName(int reason_);
+};
+
+class PollBackoff{
+  private:
+	unsigned int max_spins; /// Number of checks made before yielding
+	unsigned int max_yields; /// Number of checks made with a yield before sleeping
+	double min_sleep; /// First sleep (in seconds)
+	double max_sleep; /// Longest sleep (in seconds)
+
+	int phase; /// The current BACKOFF_* phase
+	unsigned int count; /// Number of waits in the current phase
+	double sleep_time; /// Length of the next sleep (in seconds)
+	double last_time; /// Time of the last call to Wait or Reset (in seconds)
+
+	double phase_time[BACKOFF_PHASES]; /// Time spent in each phase (in seconds)
+	unsigned long long phase_waits[BACKOFF_PHASES]; /// Number of waits in each phase
+
+	/// Add the time since the last call to the current phase and return the current time.
+	double Account();
+
+  public:
+	PollBackoff();
+
+	/** Spin for spins_ checks, then yield for yields_ checks, then sleep starting at minSleep_ and
+	  * doubling up to maxSleep_ (in seconds). Returns false if the sleeps are not valid. */
+	bool Configure(unsigned int spins_, unsigned int yields_, double minSleep_, double maxSleep_);
+
+	/** Parse a comma separated list of spins, yields and the longest sleep (in us) and configure.
+	  * Missing values are left as they are. Returns false if the list is invalid. */
+	bool Configure(const std::string &list_);
+
+	/// Data was seen, go back to spinning.
+	void Reset();
+
+	/** Wait before the next check, according to the current phase. If maxSleep_ is positive, sleeps
+	  * grow up to maxSleep_ (in seconds) instead of the longest sleep. Returns true if the wait was a sleep. */
+	bool Wait(double maxSleep_=-1.0);
+
+	/// Forget the time spent in each phase.
+	void ClearTimes();
+
+	int GetPhase(){ return phase; }
+
+	unsigned int GetSpins(){ return max_spins; }
+
+	unsigned int GetYields(){ return max_yields; }
+
+	double GetMaxSleep(){ return max_sleep; }
+
+	double GetPhaseTime(int phase_){ return (phase_ >= 0 && phase_ < BACKOFF_PHASES ? phase_time[phase_] : 0.0); }
+
+	unsigned long long GetPhaseWaits(int phase_){ return (phase_ >= 0 && phase_ < BACKOFF_PHASES ? phase_waits[phase_] : 0); }
+
+	/// Return the name of a BACKOFF_* phase.
+	static const char *PhaseName(int phase_);
+
+	/// Return the current time of the monotonic clock (in seconds).
+	static double Now();
+};
+
+#endif
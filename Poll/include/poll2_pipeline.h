@@ -0,0 +1,212 @@
+/** \file poll2_pipeline.h
+  *
+  * \brief Three stage readout pipeline used by poll2
+  *
+  * \date Oct. 18th, 2026
+  *
+  * The SpillPipeline class splits the readout of a spill into three stages:
+  *  reader    - Polls the module FIFOs and reads their words into a raw buffer
+  *              (the RunControl thread).
+  *  validator - Stitches partial events back together, checks the data and
+  *              builds the spill with its [length, module] headers.
+  *  sink      - Hands the spill to the stats handler, the output file and
+  *              the network.
+  * The validator and sink each run on their own thread. The stages pass
+  * preallocated SpillBuffers along single-producer/single-consumer rings, so
+  * no buffer is ever allocated or locked during a run. The reader only ever
+  * takes a buffer from its free ring if one is there; if every buffer is still
+  * downstream it counts a stall and goes back to polling the FIFOs, which
+  * leaves the data in the modules until a buffer comes back.
+  *
+  * The threads may be pinned to cpus so the reader does not share a core
+  * with the slower sinks.
+*/
+
+#ifndef POLL2_PIPELINE_H
+#define POLL2_PIPELINE_H
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <functional>
+
+#include "poll2_trace.h"
+#include "poll2_hugepage.h"
+
+#define POLL2_PIPELINE_VERSION "1.0.00"
+#define POLL2_PIPELINE_DATE "Oct. 18th, 2026"
+
+// Default number of raw buffers (and of spill buffers) in the pipeline
+#define PIPELINE_DEFAULT_BUFFERS 4
+
+// Time an idle validator or sink thread sleeps before looking again (in us)
+#define PIPELINE_IDLE_SLEEP 100
+
+// Size of a cache line, used to keep the two ends of a ring apart (in bytes)
+#define PIPELINE_CACHE_LINE 64
+
+/// A preallocated buffer passed between the stages of a SpillPipeline.
+struct SpillBuffer{
+	unsigned int *data; /// The words of the buffer, a block of a SpillBufferPool
+	size_t capacity; /// Number of words in data
+	size_t nWords; /// Number of words in use
+	std::vector<unsigned int> modWords; /// Number of words read from each module (raw buffers only)
+	double time; /// Time at which the FIFOs were read (in us since the start of the run)
+
+	int trigger; /// Why the FIFOs were read (one of the FIFO_READ_* reasons)
+	double latency; /// Time since the previous read (in seconds)
+	double stamps[TRACE_STAMPS]; /// Time the buffer passed each point of the readout (monotonic, in seconds)
+	std::vector<double> fillRates; /// Estimated fill rate of each module's FIFO (in words per second)
+	std::vector<double> readLevels; /// Number of FIFO words at which each module triggers a read
+
+	bool has_scalers; /// Set if scalers holds the module rates read with this buffer
+	std::vector<double> scalers; /// Input and output count rate of every channel
+
+	std::vector<unsigned int> chanEvents; /// Number of events found in each channel
+	std::vector<size_t> chanBytes; /// Number of event bytes found in each channel
+
+	/// Set up a buffer of words_ words at data_ for nMods_ modules with nChan_ channels each.
+	SpillBuffer(unsigned int *data_, size_t words_, size_t nMods_, size_t nChan_);
+
+	/// Clear everything but the data, ready for the buffer to be filled again.
+	void Reset();
+};
+
+/// Wait-free ring of SpillBuffer pointers with a single producer and a single consumer.
+class SpillQueue{
+  private:
+	std::vector<SpillBuffer*> slots;
+
+	std::atomic<size_t> head; /// Next slot to read (only moved by the consumer)
+	char pad[PIPELINE_CACHE_LINE]; /// Keeps head and tail on different cache lines
+	std::atomic<size_t> tail; /// Next slot to write (only moved by the producer)
+
+  public:
+	SpillQueue();
+
+	/// Make room for capacity_ buffers. Must not be called while the ring is in use.
+	void Init(size_t capacity_);
+
+	/// Producer only. Add a buffer to the ring. Returns false if the ring is full.
+	bool Push(SpillBuffer *buffer_);
+
+	/// Consumer only. Return the oldest buffer without removing it, or NULL if the ring is empty.
+	SpillBuffer *Front();
+
+	/// Consumer only. Remove the oldest buffer.
+	void Pop();
+
+	/// Return the number of buffers in the ring.
+	size_t Size();
+};
+
+class SpillPipeline{
+  public:
+	/// Validator stage. Builds a spill from a raw buffer, returns false if nothing should be passed on.
+	typedef std::function<bool(SpillBuffer*, SpillBuffer*)> validate_t;
+
+	/// Sink stage. Writes or sends a spill.
+	typedef std::function<void(SpillBuffer*)> sink_t;
+
+	/// Called regularly by the sink thread while it has nothing to do.
+	typedef std::function<void()> idle_t;
+
+	/// Called by each stage's thread as it starts with the stage (0 reader, 1 validator, 2 sink) and its cpu.
+	typedef std::function<void(size_t, int)> thread_init_t;
+
+  private:
+	std::vector<SpillBuffer*> buffers; /// Every buffer owned by the pipeline
+	SpillBufferPool pool; /// The memory of every buffer
+
+	SpillQueue raw_free; /// Empty raw buffers (validator to reader)
+	SpillQueue raw_full; /// Raw buffers waiting to be validated (reader to validator)
+	SpillQueue spill_free; /// Empty spill buffers (sink to validator)
+	SpillQueue spill_full; /// Spills waiting for the sink (validator to sink)
+
+	validate_t validate;
+	sink_t sink;
+	idle_t idle;
+	thread_init_t thread_init;
+
+	std::thread validator;
+	std::thread sinker;
+	int cpus[3]; /// Cpu of the reader, validator and sink threads (-1 to let the kernel choose)
+
+	std::atomic<bool> running; /// Cleared to stop the validator once it has finished its buffers
+	std::atomic<bool> validating; /// Cleared by the validator when it exits, which stops the sink
+	bool stalled; /// Set while the reader has no free raw buffer
+
+	std::atomic<unsigned long long> num_pushed; /// Raw buffers passed to the validator
+	std::atomic<unsigned long long> num_finished; /// Raw buffers completely handled downstream
+	std::atomic<unsigned long long> num_stalls; /// Times the reader found no free raw buffer
+	std::atomic<unsigned long long> num_validator_waits; /// Times the validator found no free spill buffer
+	std::atomic<size_t> max_depth; /// Largest number of raw buffers in flight
+
+	void ValidateLoop();
+
+	void SinkLoop();
+
+	/// Set up the calling thread as the thread of stage_, pinning it to its cpu unless thread_init does.
+	void init_thread(size_t stage_);
+
+  public:
+	SpillPipeline();
+
+	~SpillPipeline();
+
+	/** Choose the cpus of the reader, validator and sink threads (-1 to let the kernel choose).
+	  * Must be called before Start. */
+	void SetAffinity(int reader_, int validator_, int sink_);
+
+	/** Parse a comma separated list of up to three cpus (reader, validator, sink) and set the
+	  * affinity. An empty list leaves the threads unpinned. Returns false if the list is invalid. */
+	bool SetAffinity(const std::string &list_);
+
+	int GetAffinity(size_t stage_){ return (stage_ < 3 ? cpus[stage_] : -1); }
+
+	/** Set up each stage's thread with init_ instead of pinning it to its cpu (e.g. to also change
+	  * its scheduling). Must be called before Start. */
+	void SetThreadInit(thread_init_t init_){ thread_init = init_; }
+
+	/** Allocate nBuffers_ raw and nBuffers_ spill buffers of nWords_ words for nMods_ modules, on huge
+	  * pages if possible, and start the validator and sink threads. The calling thread becomes the
+	  * reader and is pinned to its cpu. Returns false if the pipeline is already running or the
+	  * buffers cannot be allocated. */
+	bool Start(size_t nBuffers_, size_t nWords_, size_t nMods_, size_t nChan_, validate_t validate_, sink_t sink_, idle_t idle_);
+
+	/// Reader only. Return a free raw buffer, or NULL if every buffer is still downstream. Never blocks.
+	SpillBuffer *GetRaw();
+
+	/// Reader only. Pass the buffer returned by GetRaw to the validator.
+	void PushRaw();
+
+	/// Reader only. Wait until every buffer passed to the validator has been through the sink.
+	void Drain();
+
+	/// Stop the validator and sink threads once they have finished their buffers and free the buffers.
+	void Stop();
+
+	bool IsRunning(){ return running; }
+
+	/// Return the number of raw buffers passed to the validator which have not been through the sink yet.
+	size_t GetDepth(){ return (size_t)(num_pushed - num_finished); }
+
+	size_t GetMaxDepth(){ return max_depth; }
+
+	size_t GetNumBuffers(){ return buffers.size() / 2; }
+
+	/// Return the pool holding the words of every buffer.
+	SpillBufferPool *GetPool(){ return &pool; }
+
+	unsigned long long GetPushed(){ return num_pushed; }
+
+	unsigned long long GetStalls(){ return num_stalls; }
+
+	unsigned long long GetValidatorWaits(){ return num_validator_waits; }
+
+	/// Pin the calling thread to cpu_. Returns false if this is not possible.
+	static bool PinThread(int cpu_);
+};
+
+#endif
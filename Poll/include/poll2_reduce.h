@@ -0,0 +1,132 @@
+/** \file poll2_reduce.h
+  *
+  * \brief Shrinks the traces of list mode events before poll2 writes them
+  *
+  * \date Oct. 18th, 2026
+  *
+  * Traces are most of the data written by poll2 in a trace-heavy run. The
+  * TraceReducer works on the complete events of a validated spill, before
+  * it reaches the sink, and may do any of the following to the trace of an
+  * event, set separately for every channel:
+  *  cut      - drop the trace if the energy is outside [min, max]
+  *  roi      - keep only the samples from pre before to post after the
+  *             largest sample
+  *  decimate - replace every n samples by their average
+  * The event length in the first header word and the trace length in the
+  * fourth are rewritten to match, so the events may be read as usual.
+  * Events are moved down in the spill to close the gaps left behind, and
+  * the length word of every module block is updated.
+  *
+  * Events whose length does not match their header and trace lengths, and
+  * events of virtual channels, are left as they are.
+  *
+  * The settings may be changed while a run is going. Changes are made to a
+  * staged copy, which the thread reducing the spills swaps in between two
+  * spills, so every spill is reduced with one complete set of settings.
+*/
+
+#ifndef POLL2_REDUCE_H
+#define POLL2_REDUCE_H
+
+#include <vector>
+#include <atomic>
+#include <mutex>
+
+#define POLL2_REDUCE_VERSION "1.0.00"
+#define POLL2_REDUCE_DATE "Oct. 18th, 2026"
+
+// Longest trace an event may hold (in samples), two samples per word of the largest event
+#define REDUCE_MAX_TRACE 8190
+
+/// Reduction of the traces of one channel.
+struct ReduceSettings{
+	bool cut; /// Drop the trace if the energy is outside [emin, emax]
+	unsigned int emin;
+	unsigned int emax;
+
+	bool roi; /// Keep only the samples around the largest sample
+	unsigned int pre; /// Samples kept before the largest sample
+	unsigned int post; /// Samples kept after the largest sample
+
+	unsigned int decimate; /// Number of samples averaged into one (1 to keep every sample)
+
+	ReduceSettings();
+
+	/// Return true if the traces of the channel are changed at all.
+	bool IsActive(){ return (cut || roi || decimate > 1); }
+};
+
+class TraceReducer{
+  private:
+	size_t num_mods;
+	size_t num_chan;
+	std::vector<ReduceSettings> settings; /// Settings of every channel used by Reduce (only changed by Update)
+	bool active; /// Set if any channel in settings is reduced
+
+	std::vector<ReduceSettings> requested; /// Settings most recently configured, applied by the next Update
+	bool requested_active; /// Set if any channel in requested is reduced
+	std::mutex settings_lock; /// Guards requested and requested_active
+	std::atomic<bool> settings_changed; /// Set when requested has not been applied yet
+
+	std::vector<unsigned short> samples; /// Room for the reduced trace of one event
+
+	std::atomic<unsigned long long> bytes_in; /// Bytes of the spills passed to Reduce
+	std::atomic<unsigned long long> bytes_out; /// Bytes of the reduced spills
+	std::atomic<unsigned long long> traces_cut; /// Traces dropped by the energy cuts
+	std::atomic<unsigned long long> traces_reduced; /// Traces shortened by the roi or decimation
+
+	/// Update requested_active after a change to the requested settings.
+	void update_active();
+
+	/// Reduce the event at event_ of length eventWords_ and move it to dest_. Returns the new length.
+	size_t reduce_event(unsigned int *dest_, const unsigned int *event_, size_t eventWords_, unsigned int mod_);
+
+  public:
+	TraceReducer();
+
+	/// Set up nMods_ modules of nChan_ channels each, none of which is reduced.
+	void Init(size_t nMods_, size_t nChan_);
+
+	/// Return true if the traces of any channel are reduced by the settings most recently configured.
+	bool IsActive();
+
+	/** Change the settings of channel chan_ of module mod_ (either may be -1 for all of them) with setter_.
+	  * The change is applied by the next Update. Returns false if there is no such module or channel. */
+	template <typename T>
+	bool Configure(int mod_, int chan_, T setter_){
+		if(mod_ >= (int)num_mods || chan_ >= (int)num_chan){ return false; }
+		std::lock_guard<std::mutex> lock(settings_lock);
+		for(size_t mod = 0; mod < num_mods; mod++){
+			if(mod_ >= 0 && (int)mod != mod_){ continue; }
+			for(size_t chan = 0; chan < num_chan; chan++){
+				if(chan_ < 0 || (int)chan == chan_){ setter_(requested[mod * num_chan + chan]); }
+			}
+		}
+		update_active();
+		settings_changed = true;
+		return true;
+	}
+
+	/// Copy the settings most recently configured for channel chan_ of module mod_ to settings_. Returns false if there is no such channel.
+	bool GetSettings(size_t mod_, size_t chan_, ReduceSettings &settings_);
+
+	/// Apply any settings configured since the last call. Call between spills. Returns true if any channel is reduced.
+	bool Update();
+
+	/** Reduce the traces of the events in the spill of nWords_ words at data_, made of [length, module, events...]
+	  * blocks, in place. Returns the new length of the spill. */
+	size_t Reduce(unsigned int *data_, size_t nWords_);
+
+	/// Zero the byte and trace counts.
+	void ClearCounts();
+
+	unsigned long long GetBytesIn(){ return bytes_in.load(std::memory_order_relaxed); }
+
+	unsigned long long GetBytesOut(){ return bytes_out.load(std::memory_order_relaxed); }
+
+	unsigned long long GetTracesCut(){ return traces_cut.load(std::memory_order_relaxed); }
+
+	unsigned long long GetTracesReduced(){ return traces_reduced.load(std::memory_order_relaxed); }
+};
+
+#endif
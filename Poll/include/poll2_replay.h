@@ -0,0 +1,132 @@
+/** \file poll2_replay.h
+  *
+  * \brief Feeds the spills of a recorded run back through poll2
+  *
+  * \date Oct. 18th, 2026
+  *
+  * In replay mode poll2 does not touch the crate. Instead of reading the
+  * FIFOs it takes the spills of an .ldf or .pld file written by poll2 and
+  * hands them to the validator and sink stages, so the readout can be
+  * profiled (or an analysis fed) with real data at a known rate.
+  *
+  * Every spill is due at the time its last event was recorded, measured from
+  * the first spill and divided by the replay speed. At a speed of 1 the run
+  * is replayed at its original cadence, at a speed of 10 ten times faster,
+  * and at a speed of 0 ("max") every spill is sent as soon as the previous
+  * one has been handled. Spills without events, or whose clock has gone
+  * backwards, are due straight after the one before.
+  *
+  * The slot file must list the modules of the recording in the same order,
+  * since the validator checks the slot of every event.
+*/
+
+#ifndef POLL2_REPLAY_H
+#define POLL2_REPLAY_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+
+#include "hribf_buffers.h"
+
+#define POLL2_REPLAY_VERSION "1.0.00"
+#define POLL2_REPLAY_DATE "Oct. 18th, 2026"
+
+// File formats which may be replayed
+#define REPLAY_LDF 0
+#define REPLAY_PLD 1
+
+#define REPLAY_CLOCK_TICK 8E-9 /// Length of an event timestamp tick (in seconds)
+#define REPLAY_END_OF_SPILL 9999 /// Module number of the block which closes an ldf spill
+
+class SpillReplay{
+  private:
+	std::ifstream file;
+	std::string filename;
+	int format; /// REPLAY_LDF or REPLAY_PLD
+	std::streampos data_start; /// Position of the first spill in the file
+
+	DIR_buffer dirBuff;
+	HEAD_buffer headBuff;
+	DATA_buffer dataBuff;
+	PLD_header pldHead;
+	PLD_data pldData;
+
+	std::vector<unsigned int> spill; /// The next spill to be sent
+	size_t spill_words; /// Number of words in spill
+	double spill_time; /// Recorded time between the last event of the spill before and the last event of spill (in seconds)
+	bool have_spill; /// Set while spill holds a spill which has not been sent
+
+	double speed; /// Replay speed, 0 to send spills as fast as possible
+	double start_time; /// Time the replay was started (monotonic, in seconds)
+	double stop_time; /// Time the replay was stopped (monotonic, in seconds)
+	double due_time; /// Time the next spill is due (in seconds after start_time)
+	unsigned long long last_stamp; /// Latest event timestamp of the last spill with events
+	bool have_stamp; /// Set once a spill with events has been read
+
+	unsigned long long num_spills; /// Spills sent
+	unsigned long long num_words; /// Words sent
+	unsigned long long num_bad; /// Spills in the file flagged as corrupt
+	unsigned long long num_dropped; /// Module blocks which could not be sent
+	double file_time; /// Recorded time covered by the spills sent (in seconds)
+
+	/// Read the next good spill from the file. Returns false at the end of the file.
+	bool read_spill();
+
+	/// Return the latest event timestamp in spill, or false if it holds no events.
+	bool last_timestamp(unsigned long long &stamp_);
+
+  public:
+	SpillReplay();
+
+	/** Open fname_ and read its headers. maxWords_ is the length of the longest spill expected, a longer
+	  * spill ends the replay. Returns false if the file cannot be read or is not an .ldf or .pld file. */
+	bool Open(const std::string &fname_, size_t maxWords_);
+
+	bool IsOpen(){ return file.is_open(); }
+
+	std::string GetFilename(){ return filename; }
+
+	int GetFormat(){ return format; }
+
+	/// Set the replay speed to a multiple of the original cadence, or "max". Returns false if it is invalid.
+	bool SetSpeed(const std::string &speed_);
+
+	double GetSpeed(){ return speed; }
+
+	/// Go back to the first spill of the file and zero the counters. Returns false if the file holds no spills.
+	bool Start();
+
+	/// Record the end of the replay.
+	void Stop();
+
+	/// Return true once every spill has been sent.
+	bool AtEnd(){ return !have_spill; }
+
+	/// Return the time until the next spill is due (in seconds, zero or less if it is due now).
+	double GetTimeUntilDue();
+
+	/** Split the next spill into its module blocks, placing the words of module mod at data_[mod*stride_]
+	  * and their number in modWords_[mod], then read the spill after it. Blocks of modules beyond the end
+	  * of modWords_, or longer than stride_, are dropped. Returns the number of blocks dropped. */
+	size_t Unpack(unsigned int *data_, size_t stride_, std::vector<unsigned int> &modWords_);
+
+	unsigned long long GetSpills(){ return num_spills; }
+
+	unsigned long long GetWords(){ return num_words; }
+
+	unsigned long long GetBadSpills(){ return num_bad; }
+
+	unsigned long long GetDroppedBlocks(){ return num_dropped; }
+
+	/// Return the time since the replay was started, or the length of the last replay (in seconds).
+	double GetElapsed();
+
+	/// Return the rate at which words have been sent (in bytes per second).
+	double GetThroughput();
+
+	/// Return the recorded time covered by the spills sent per second of replay.
+	double GetAchievedSpeed();
+};
+
+#endif
@@ -0,0 +1,90 @@
+/** \file poll2_rt.h
+  *
+  * \brief Pins the poll2 readout threads to cpus, raises their priority and locks their memory
+  *
+  * \date Oct. 18th, 2026
+  *
+  * On a busy machine the readout thread shares its cpu with the terminal,
+  * the stats, the MCA and everything else, and the FIFOs may fill while it
+  * waits to be scheduled. The RealtimeConfig class lets the reader (and the
+  * validator and sink threads of the pipeline) be pinned to cpus and run
+  * under SCHED_FIFO, and lets the memory of poll2 be locked with mlockall
+  * once every spill buffer has been allocated, so no page of a buffer has to
+  * be faulted in during a run. MCL_FUTURE is not used, since any allocation
+  * past the locked memory limit would then fail.
+  *
+  * What is asked for is checked at startup, and each thread reports what it
+  * was actually granted as it starts, since an unprivileged user is usually
+  * allowed neither SCHED_FIFO nor much locked memory (see RLIMIT_RTPRIO and
+  * RLIMIT_MEMLOCK in /etc/security/limits.conf). A thread under SCHED_FIFO
+  * which spins on the FIFOs keeps its cpu to itself, so it should be pinned
+  * to a cpu of its own.
+*/
+
+#ifndef POLL2_RT_H
+#define POLL2_RT_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+
+#define POLL2_RT_VERSION "1.0.00"
+#define POLL2_RT_DATE "Oct. 18th, 2026"
+
+// SCHED_FIFO priority used if none is given
+#define RT_DEFAULT_PRIORITY 50
+
+/// What a readout thread asked for and was granted.
+struct RealtimeThread{
+	std::string name;
+	int cpu; /// Cpu the thread asked to be pinned to (-1 for any)
+	bool pinned; /// Set if the thread was pinned to cpu
+	int policy; /// Scheduling policy the thread runs under
+	int priority; /// Priority the thread runs at
+};
+
+class RealtimeConfig{
+  private:
+	int priority; /// SCHED_FIFO priority of the readout threads (0 to leave them alone)
+	bool lock_memory; /// Set if the memory of poll2 should be locked
+	bool memory_locked; /// Set once the memory has been locked
+
+	std::vector<RealtimeThread> threads; /// Every thread which has called Apply
+	std::mutex thread_lock; /// Apply may be called by several threads at once
+
+  public:
+	RealtimeConfig();
+
+	/// Run the readout threads under SCHED_FIFO at priority_, or "" for the default. Returns false if it is invalid.
+	bool SetPriority(const std::string &priority_);
+
+	void SetLockMemory(bool state_=true){ lock_memory = state_; }
+
+	int GetPriority(){ return priority; }
+
+	bool GetLockMemory(){ return lock_memory; }
+
+	bool IsMemoryLocked(){ return memory_locked; }
+
+	/** Check that what was asked for may be granted, printing a line for each request. cpus_ holds
+	  * nCpus_ cpus (-1 for any) the threads will be pinned to. Returns false if anything will be refused. */
+	bool Check(const int *cpus_, size_t nCpus_);
+
+	/** Pin the calling thread to cpu_ (unless it is -1) and raise it to SCHED_FIFO (if asked for),
+	  * printing what was granted and recording it under name_. */
+	void Apply(const std::string &name_, int cpu_);
+
+	/// Lock every page poll2 has mapped, if asked for. Returns false if the memory could not be locked.
+	bool LockMemory();
+
+	/// Fill threads_ with every thread which has called Apply.
+	void GetThreads(std::vector<RealtimeThread> &threads_);
+
+	/// Return the number of bytes of memory locked (VmLck), or 0 if it cannot be read.
+	static size_t GetLockedBytes();
+
+	/// Return the name of a scheduling policy.
+	static const char *PolicyName(int policy_);
+};
+
+#endif
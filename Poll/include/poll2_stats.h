@@ -1,84 +1,231 @@
 // Small class to handle the statistics information from pixies
+//
+// The event and data counters are atomics, each on a cache line of its own,
+// so they may be incremented without a lock. Everything else is owned by the
+// thread which sinks the spills. Each time the stats change that thread
+// publishes a snapshot of them under a seqlock, and any other thread (the
+// status bar, the monitor sender, an exporter) may copy the last snapshot
+// with GetSnapshot. Readers never take a lock and never hold up the writer;
+// a reader which overlaps a publish simply copies the snapshot again.
+//
+// The rates of the last STATS_HISTORY_LENGTH intervals are also kept, so
+// their spread over a sliding window may be queried with GetHistory.
+//
+// Each dump is sent to monitors as a StatsRecord (see poll2_statsproto.h),
+// tagged with the crate ID, over UDP and through the stats shm ring.
 
 #ifndef POLL2_STATS_H
 #define POLL2_STATS_H
 
+#include <vector>
+#include <string>
+#include <atomic>
+#include <mutex>
+
+#include "poll2_fifo.h"
+#include "poll2_history.h"
+#include "poll2_statsproto.h"
+
 #define NUM_CHAN_PER_MOD 16
 
+// Size of a cache line (in bytes)
+#define STATS_CACHE_LINE 64
+
+// Number of stats intervals kept in the rate history
+#define STATS_HISTORY_LENGTH 120
+
+// Rates kept in the rate history
+#define STATS_HISTORY_EVENTS 0 /// Event rate of each channel (in Hz)
+#define STATS_HISTORY_ICR 1 /// XIA input count rate of each channel (in Hz)
+#define STATS_HISTORY_OCR 2 /// XIA output count rate of each channel (in Hz)
+#define STATS_HISTORY_DATA 3 /// Data rate of each module (in B/s)
+#define STATS_HISTORY_TYPES 4
+
 class Client;
+class ShmWriter;
+
+/// Event counters of one channel, padded to a cache line.
+struct StatsChannel{
+	std::atomic<unsigned long long> eventsDelta; ///<Number of events this tick.
+	std::atomic<unsigned long long> eventsTotal; ///<Total number of events.
+	char padding[STATS_CACHE_LINE - 2*sizeof(std::atomic<unsigned long long>)];
+};
+
+/// Data counters of one module, padded to a cache line.
+struct StatsModule{
+	std::atomic<unsigned long long> dataDelta; ///<Data this tick (in bytes).
+	std::atomic<unsigned long long> dataTotal; ///<Total data (in bytes).
+	char padding[STATS_CACHE_LINE - 2*sizeof(std::atomic<unsigned long long>)];
+};
+
+/// A consistent copy of the stats as last published.
+struct StatsSnapshot{
+	unsigned int numCards;
+	unsigned int sequence; ///<Sequence number of the publish the snapshot was taken from.
+
+	double totalTime; ///<Total run time (in s).
+	double dataRate; ///<Total data rate over the last interval (in B/s).
+
+	std::vector<double> moduleDataRate; ///<Data rate of each module over the last interval (in B/s).
+	std::vector<unsigned long long> moduleDataTotal; ///<Total data of each module (in bytes).
+
+	std::vector<double> eventRate; ///<Event rate of each channel (mod*NUM_CHAN_PER_MOD+ch) over the last interval (in Hz).
+	std::vector<unsigned long long> eventsTotal; ///<Total events of each channel.
+	std::vector<double> inputCountRate; ///<The XIA input count rate of each channel.
+	std::vector<double> outputCountRate; ///<The XIA output count rate of each channel.
+
+	bool adaptiveReadout; ///<Set if the FIFO read threshold is adaptive.
+	double maxLatency; ///<Latency target of the adaptive readout (s).
+	double safetyMargin; ///<Fraction of the FIFO kept free by the adaptive readout.
+	unsigned int reads[FIFO_READ_TYPES]; ///<Number of FIFO reads for each reason over the last interval.
+	double latencyMean; ///<Mean time between FIFO reads over the last interval (s).
+	double latencyMax; ///<Longest time between FIFO reads over the last interval (s).
+
+	std::vector<double> fifoFillRate; ///<Estimated FIFO fill rate of each module (words/s).
+	std::vector<double> fifoReadLevel; ///<Number of FIFO words at which each module triggers a read.
+
+	///Return the event rate of a module (in Hz).
+	double GetEventRate(size_t mod) const;
+};
 
 class StatsHandler{
   public:
     StatsHandler(size_t nCards = 1);
-    
+
     ~StatsHandler();
 
+	///Count events of a channel. May be called from any thread without a lock.
     void AddEvent(unsigned int mod, unsigned int ch, size_t size, int delta_=1);
-    
+
     bool AddTime(double dtime);
 
 	///Set the amount of time between scalers dumps in seconds.
 	void SetDumpInterval(double interval) {dumpTime = interval;};
 
     double GetDataRate(size_t mod);
-    
+
     double GetTotalDataRate();
-    
+
     double GetEventRate(size_t mod);
-    
+
 	///Return the total run time.
 	double GetTotalTime();
 
+	///Copy the last published stats into snapshot. May be called from any thread and never blocks the writer.
+	void GetSnapshot(StatsSnapshot &snapshot);
+
+	///Summarize the last window intervals (0 for all) of a rate (STATS_HISTORY_*) of a channel (mod*NUM_CHAN_PER_MOD+ch),
+	///or of a module for STATS_HISTORY_DATA. Returns false if there is no history.
+	bool GetHistory(int type, size_t index, size_t window, HistorySummary &summary);
+
+	///Fill values with the last window intervals (0 for all) of a rate, oldest first. Returns the number of intervals.
+	size_t GetHistoryValues(int type, size_t index, size_t window, std::vector<double> &values);
+
+	///Return the number of intervals in the rate history.
+	size_t GetHistoryCount();
+
+	///Return the name of a rate of the history.
+	static const char *HistoryName(int type);
+
 	///Set the ICR and OCR from the XIA module.
-	void SetXiaRates(int mod, std::vector<std::pair<double,double>> *xiaRates); 
-	
+	void SetXiaRates(int mod, std::vector<std::pair<double,double>> *xiaRates);
+
+	///Count a read of the FIFOs for reason (FIFO_READ_*) which came latency seconds after the previous one.
+	void AddRead(int reason, double latency);
+
+	///Set the estimated FIFO fill rate (words/s) of a module and the number of words at which it triggers a read.
+	void SetFifoLevels(int mod, double fillRate, double readLevel);
+
+	///Set the FIFO readout mode published with the stats.
+	void SetReadoutMode(bool adaptive, double maxLatency, double margin);
+
 	bool CanSend(){ return is_able_to_send; }
-	
+
+	///Set the ID sent with the stats, which tells crates apart in a monitor.
+	void SetCrateID(unsigned short id){ encoder.SetCrateID(id); }
+
+	///Send the stats over UDP to host, or host:port (STATS_PROTO_PORT by default). Returns false if host is unknown.
+	bool SetDestination(const std::string &address);
+
+	unsigned short GetCrateID(){ return encoder.GetCrateID(); }
+
+	std::string GetDestination(){ return destination; }
+
+	///Return the bytes of key and delta stats packets sent so far.
+	unsigned long long GetKeyBytes(){ return encoder.GetKeyBytes(); }
+	unsigned long long GetDeltaBytes(){ return encoder.GetDeltaBytes(); }
+
 	///Clear the stats.
 	void Clear();
 	void ClearRates();
 	void ClearTotals();
 
     void Dump();
-	
+
   private:
     Client *client; // UDP client for network access
-    
-    /** number of events for each channel this tick */
-    unsigned int **nEventsDelta;
-    
-    /** total number of events for each channel */
-    unsigned int **nEventsTotal; 
-    
-    /** data in bytes this tick per module*/
-    size_t *dataDelta;
-    
-    /** total data in bytes per module*/
-    size_t *dataTotal;
-    
+    std::string destination; // Host and port the UDP stats are sent to
+    ShmWriter *shm_ring; // Shared memory ring for local monitors
+
+    /** event counters for each channel (mod*NUM_CHAN_PER_MOD+ch) */
+    StatsChannel *channels;
+
+    /** data counters for each module */
+    StatsModule *modules;
+
     /** calculated event rate in Hz for each channel */
     double **calcEventRate;
-    
+
     double **inputCountRate; ///<The XIA Module input count rate.
     double **outputCountRate; ///<The XIA Module output count rate.
-    
+
     /** calculated data rate in bytes per second for each module */
     size_t *calcDataRate;
 
     /** time elapsed in seconds */
     double timeElapsed;
-    
+
     /** total time in seconds */
     double totalTime;
-    
+
     /** time between data dumps in seconds */
     double dumpTime;
 
     /** number of cards in the system */
     unsigned int numCards;
 
+    unsigned int readsDelta[FIFO_READ_TYPES]; ///<Number of FIFO reads for each reason this tick.
+    double latencySum; ///<Sum of the times between FIFO reads this tick.
+    double latencyMax; ///<Longest time between FIFO reads this tick.
+
+    double *fifoFillRate; ///<Estimated FIFO fill rate of each module (words/s).
+    double *fifoReadLevel; ///<Number of FIFO words at which each module triggers a read.
+
+    bool adaptiveReadout; ///<Set if the FIFO read threshold is adaptive.
+    double maxLatency; ///<Latency target of the adaptive readout (s).
+    double safetyMargin; ///<Fraction of the FIFO kept free by the adaptive readout.
+
 	bool is_able_to_send; /// Is StatsHandler able to send on the network?
 
+	std::mutex write_lock; ///<Held by writers (never by readers) so a clear from another thread cannot tear a publish.
+
+	std::atomic<unsigned int> snapshotSeq; ///<Seqlock sequence, odd while a snapshot is being published.
+	std::atomic<unsigned long long> *snapshotWords; ///<The published snapshot, packed into words.
+	size_t numSnapshotWords;
+
+	StatsEncoder encoder; ///<Turns each dump into stats packets.
+	StatsRecord record; ///<The stats of the last dump, as sent.
+	std::vector<std::string> datagrams; ///<The packets of the last dump.
+	std::mutex send_lock; ///<Held while a dump is encoded and sent, as dumps may come from more than one thread.
+
+	RateHistory history[STATS_HISTORY_TYPES]; ///<The rates of the last intervals.
+	std::mutex history_lock; ///<Held while the history is added to or read.
+
+	///Publish a snapshot of the stats. write_lock must be held.
+	void publish();
+
+	///Send a stats packet to the monitors.
+	void send(const std::string &packet);
 };
 
 #endif
@@ -0,0 +1,131 @@
+/** \file poll2_trace.h
+  *
+  * \brief Records how long each spill spends in every stage of the poll2 readout
+  *
+  * \date Oct. 18th, 2026
+  *
+  * Every spill carries a timestamp for each point of the readout it has
+  * passed:
+  *  check - the FIFO check which decided to read the FIFOs
+  *  read  - the words have been read from the FIFOs
+  *  parse - the validator has built the spill
+  *  write - the spill has been written to disk
+  *  send  - the spill has been broadcast
+  * The sink hands the stamps of every spill to a SpillTracer once the spill
+  * has been sent. The tracer adds the time between successive stamps, and
+  * from check to send, to a histogram per stage, and keeps the stamps of the
+  * most recent spills in a ring which the command thread may copy without
+  * holding up the sink. The ring may be written out as a Chrome trace-event
+  * JSON file (chrome://tracing or ui.perfetto.dev) for offline inspection.
+  *
+  * The histograms have TRACE_BIN_STEPS bins per factor of two from 1 us to
+  * about 4 minutes, so the percentiles read from them are good to a few
+  * percent.
+*/
+
+#ifndef POLL2_TRACE_H
+#define POLL2_TRACE_H
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstddef>
+
+#define POLL2_TRACE_VERSION "1.0.00"
+#define POLL2_TRACE_DATE "Oct. 18th, 2026"
+
+// Points of the readout stamped for every spill
+#define TRACE_CHECK 0
+#define TRACE_READ 1
+#define TRACE_PARSE 2
+#define TRACE_WRITE 3
+#define TRACE_SEND 4
+#define TRACE_STAMPS 5
+
+// The stage histograms, one per pair of successive stamps and one from check to send
+#define TRACE_TOTAL (TRACE_STAMPS - 1)
+#define TRACE_STAGES TRACE_STAMPS
+
+// Number of spills kept in the trace ring
+#define TRACE_RING_SIZE 4096
+
+// Histogram bins per factor of two, and number of factors of two above 1 us
+#define TRACE_BIN_STEPS 8
+#define TRACE_BIN_OCTAVES 28
+#define TRACE_BINS (TRACE_BIN_STEPS * TRACE_BIN_OCTAVES + 1)
+
+/// The stamps of one spill.
+struct SpillTrace{
+	unsigned long long spill; /// Number of the spill since the tracer was cleared
+	unsigned int nWords; /// Length of the spill (in words)
+	int trigger; /// Why the FIFOs were read (one of the FIFO_READ_* reasons)
+	double stamps[TRACE_STAMPS]; /// Time of each stamp (monotonic, in seconds)
+};
+
+/// Histogram of the time spent in one stage, written by one thread and read by any.
+class LatencyHistogram{
+  private:
+	std::atomic<unsigned long long> bins[TRACE_BINS]; /// Bin 0 holds times below 1 us
+	std::atomic<unsigned long long> count;
+	std::atomic<double> sum;
+	std::atomic<double> max;
+
+  public:
+	LatencyHistogram();
+
+	/// Add a time of time_ seconds. Only one thread may add times.
+	void Add(double time_);
+
+	void Clear();
+
+	unsigned long long GetCount(){ return count.load(std::memory_order_relaxed); }
+
+	double GetMax(){ return max.load(std::memory_order_relaxed); }
+
+	/// Return the sum of every time added (in seconds).
+	double GetSum(){ return sum.load(std::memory_order_relaxed); }
+
+	/// Return the number of times in bin_.
+	unsigned long long GetBin(size_t bin_){ return (bin_ < TRACE_BINS ? bins[bin_].load(std::memory_order_relaxed) : 0); }
+
+	/// Return the upper edge of bin_ (in seconds). The last bin also holds every longer time.
+	static double GetEdge(size_t bin_);
+
+	/// Return the time below which fraction_ of the times fall (in seconds), or 0 if there are none.
+	double GetPercentile(double fraction_);
+};
+
+class SpillTracer{
+  private:
+	SpillTrace ring[TRACE_RING_SIZE]; /// The most recent spills
+	std::atomic<unsigned long long> head; /// Number of spills added since the tracer was cleared
+	std::atomic<bool> clear_due; /// Set by Clear, the next Add clears the tracer
+
+	LatencyHistogram stages[TRACE_STAGES];
+
+  public:
+	SpillTracer();
+
+	/** Add a spill of nWords_ words read for reason trigger_ with the stamps stamps_. Only one thread
+	  * (the sink) may add spills. A stage whose stamps are missing (zero) or out of order is skipped. */
+	void Add(const double *stamps_, unsigned int nWords_, int trigger_);
+
+	/// Clear the histograms and the ring before the next spill is added.
+	void Clear(){ clear_due = true; }
+
+	/// Return the number of spills added.
+	unsigned long long GetSpills(){ return head.load(std::memory_order_acquire); }
+
+	LatencyHistogram *GetStage(int stage_){ return (stage_ >= 0 && stage_ < TRACE_STAGES ? &stages[stage_] : NULL); }
+
+	/// Copy the spills in the ring, oldest first, to traces_. May be called while spills are being added.
+	void Snapshot(std::vector<SpillTrace> &traces_);
+
+	/// Write the spills in the ring to fname_ as Chrome trace-event JSON. Returns the number of spills written, or -1 on error.
+	int DumpChrome(const std::string &fname_);
+
+	/// Return the name of a stage, or of the stamp which ends it.
+	static const char *StageName(int stage_);
+};
+
+#endif
@@ -0,0 +1,261 @@
+/** \file aggregator.cpp
+  *
+  * \brief Merges the spill streams of several poll2 crates by event time
+  *
+  * \date Oct. 18th, 2026
+  *
+  * Subscribes to the stream server (--stream) of the poll2 of every crate,
+  * corrects the timestamps of each crate by its clock offset and merges the
+  * events of all of the crates into one stream ordered by time (see
+  * poll2_merge.h). The merged spills are served to subscribers on a stream
+  * server of their own, just like those of a single poll2, and/or written
+  * to a single .ldf or .pld file. Crates which go away are reconnected to
+  * every second, and do not hold up the others while they are gone.
+  *
+  * \version 1.0
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <chrono>
+
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/signalfd.h>
+
+#include "poll2_stream.h"
+#include "poll2_shm.h"
+#include "poll2_event.h"
+#include "poll2_merge.h"
+#include "hribf_buffers.h"
+
+// Time between merges, reconnection attempts and status lines (in ms)
+#define AGG_SERVICE_INTERVAL 50
+#define AGG_RECONNECT_INTERVAL 1000
+
+/// One crate to subscribe to.
+struct CrateStream{
+	std::string address;
+	long long offset; /// Clock offset (in clock ticks)
+	unsigned int num_modules; /// 0 to take it from the first spill
+	StreamReader reader;
+	size_t source; /// Index of the crate in the merger
+	int fd; /// Descriptor of the reader watched by the event loop (-1 while not watched)
+};
+
+double get_time(){
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void help(char *name_){
+	std::cout << " SYNTAX: " << name_ << " [options] --crate [addr] [crate options] [--crate [addr] [crate options] ...]\n";
+	std::cout << "  Available options:\n";
+	std::cout << "   --help               - Display this dialogue\n";
+	std::cout << "   --crate [addr]       - Subscribe to the poll2 stream server at host:port or a Unix socket path\n";
+	std::cout << "   --hold [ticks]       - Time events are held for stragglers from their own crate (default=" << MERGE_DEFAULT_HOLD << ")\n";
+	std::cout << "   --timeout [s]        - Time after which a crate with no events stops holding back the others (default=" << MERGE_DEFAULT_TIMEOUT << ")\n";
+	std::cout << "   --buffer [MB]        - Data held before the earliest events are released early (default=" << MERGE_DEFAULT_BUFFER * sizeof(unsigned int) / 1048576 << ")\n";
+	std::cout << "   --stream [addr]      - Serve the merged spills on a TCP port or Unix socket path\n";
+	std::cout << "   --output [prefix]    - Write the merged spills to a file\n";
+	std::cout << "   --format [ldf|pld]   - Format of the output file (default=ldf)\n";
+	std::cout << "   --dir [path]         - Directory of the output file (default=./)\n";
+	std::cout << "   --run [num]          - Run number of the output file (default=1)\n";
+	std::cout << "   --title [title]      - Run title of the output file\n";
+	std::cout << "   --status [s]         - Time between status lines, 0 for none (default=10)\n";
+	std::cout << "  Crate options (apply to the crate before them):\n";
+	std::cout << "   --offset [ticks]     - Clock offset added to every timestamp of the crate (default=0)\n";
+	std::cout << "   --modules [num]      - Number of modules in the crate (default=taken from the first spill)\n";
+}
+
+int main(int argc, char *argv[]){
+	std::vector<CrateStream*> crates;
+	unsigned long long hold = MERGE_DEFAULT_HOLD;
+	double timeout = MERGE_DEFAULT_TIMEOUT;
+	double buffer_size = MERGE_DEFAULT_BUFFER * sizeof(unsigned int) / 1048576.0; // MB
+	std::string stream_address = "";
+	std::string output_prefix = "";
+	std::string output_format = "ldf";
+	std::string output_dir = "./";
+	std::string output_title = "Merged run";
+	int run_num = 1;
+	double status_interval = 10.0;
+
+	for(int i = 1; i < argc; i++){
+		std::string arg = argv[i];
+		if(arg == "--help" || arg == "-h"){
+			help(argv[0]);
+			return 0;
+		}
+		else if(i+1 < argc && arg == "--crate"){
+			CrateStream *crate = new CrateStream();
+			crate->address = argv[++i];
+			crate->offset = 0;
+			crate->num_modules = 0;
+			crate->fd = -1;
+			crates.push_back(crate);
+		}
+		else if(i+1 < argc && !crates.empty() && arg == "--offset"){ crates.back()->offset = strtoll(argv[++i], NULL, 0); }
+		else if(i+1 < argc && !crates.empty() && arg == "--modules"){ crates.back()->num_modules = atoi(argv[++i]); }
+		else if(i+1 < argc && arg == "--hold"){ hold = strtoull(argv[++i], NULL, 0); }
+		else if(i+1 < argc && arg == "--timeout"){ timeout = atof(argv[++i]); }
+		else if(i+1 < argc && arg == "--buffer"){ buffer_size = atof(argv[++i]); }
+		else if(i+1 < argc && arg == "--stream"){ stream_address = argv[++i]; }
+		else if(i+1 < argc && arg == "--output"){ output_prefix = argv[++i]; }
+		else if(i+1 < argc && arg == "--format"){ output_format = argv[++i]; }
+		else if(i+1 < argc && arg == "--dir"){ output_dir = argv[++i]; }
+		else if(i+1 < argc && arg == "--run"){ run_num = atoi(argv[++i]); }
+		else if(i+1 < argc && arg == "--title"){ output_title = argv[++i]; }
+		else if(i+1 < argc && arg == "--status"){ status_interval = atof(argv[++i]); }
+		else{
+			std::cout << " Error: Invalid option '" << arg << "'!\n";
+			help(argv[0]);
+			return 1;
+		}
+	}
+
+	if(crates.empty()){
+		std::cout << " Error: No crates given!\n";
+		help(argv[0]);
+		return 1;
+	}
+	if(stream_address.empty() && output_prefix.empty()){
+		std::cout << " Error: The merged spills must be served (--stream) or written (--output)!\n";
+		return 1;
+	}
+	if(output_format != "ldf" && output_format != "pld"){
+		std::cout << " Error: Unknown output format '" << output_format << "'!\n";
+		return 1;
+	}
+	if(buffer_size <= 0.0 || timeout <= 0.0){
+		std::cout << " Error: The buffer size and timeout must be positive!\n";
+		return 1;
+	}
+	if(!output_dir.empty() && output_dir[output_dir.size()-1] != '/'){ output_dir += '/'; }
+
+	StreamServer stream_server;
+	if(!stream_address.empty() && !stream_server.Init(stream_address)){
+		std::cout << " Error: Failed to start stream server on " << stream_address << "!\n";
+		return 1;
+	}
+
+	PollOutputFile output_file;
+	if(!output_prefix.empty()){
+		output_file.SetFileFormat(output_format == "ldf" ? 0 : 1);
+		if(!output_file.OpenNewFile(output_title, run_num, output_prefix, output_dir)){
+			std::cout << " Error: Failed to open output file in " << output_dir << "!\n";
+			return 1;
+		}
+		std::cout << " Writing merged spills to " << output_file.GetCurrentFilename() << std::endl;
+	}
+
+	TimeMerger merger;
+	merger.SetHold(hold);
+	merger.SetTimeout(timeout);
+	merger.SetBufferSize((size_t)(buffer_size * 1048576 / sizeof(unsigned int)));
+	merger.SetCallback([&](unsigned int *data_, size_t nWords_){
+		if(stream_server.IsInit()){ stream_server.Publish(SHM_RECORD_SPILL, data_, nWords_ * sizeof(unsigned int)); }
+		if(output_file.IsOpen() && output_file.Write((char *)data_, nWords_) < 0){ std::cout << " Error: Failed to write merged spill of " << nWords_ << " words!\n"; }
+	});
+
+	for(std::vector<CrateStream*>::iterator iter = crates.begin(); iter != crates.end(); iter++){
+		(*iter)->source = merger.AddSource((*iter)->address, (*iter)->offset, (*iter)->num_modules);
+		std::cout << " Crate " << (*iter)->source << " - " << (*iter)->address << ", offset " << (*iter)->offset << " ticks\n";
+	}
+
+	EventLoop loop;
+	if(!loop.Init()){
+		std::cout << " Error: Failed to create event loop!\n";
+		return 1;
+	}
+
+	// Handle ctrl-c in the event loop, so that everything held is written before exiting
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	sigprocmask(SIG_BLOCK, &signals, NULL);
+	int signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+	if(signal_fd >= 0){ loop.Add(signal_fd, [&](int, unsigned int){ loop.Stop(); }); }
+
+	std::vector<unsigned int> buffer;
+	auto read_crate = [&](CrateStream *crate_){
+		unsigned int type;
+		size_t nBytes;
+		while(crate_->reader.Read(buffer, type, nBytes)){
+			if(type != SHM_RECORD_SPILL){ continue; }
+			if(!merger.AddSpill(crate_->source, buffer, nBytes / sizeof(unsigned int), get_time())){
+				std::cout << " Warning: Corrupt spill from " << crate_->address << ", kept the events before the error\n";
+			}
+		}
+
+		if(!crate_->reader.IsInit()){ // The crate went away
+			std::cout << " Lost connection to " << crate_->address << std::endl;
+			// The reader has already closed its descriptor, so remove the one it was watched by
+			if(!loop.Remove(crate_->fd)){ std::cout << " Warning: Failed to stop watching " << crate_->address << "!\n"; }
+			crate_->fd = -1;
+			merger.SetConnected(crate_->source, false);
+		}
+	};
+
+	auto connect_crates = [&](){
+		for(std::vector<CrateStream*>::iterator iter = crates.begin(); iter != crates.end(); iter++){
+			CrateStream *crate = *iter;
+			if(crate->fd >= 0 || !crate->reader.Init(crate->address)){ continue; }
+			if(!loop.Add(crate->reader.Get(), [&loop, &read_crate, crate](int, unsigned int){ read_crate(crate); })){
+				std::cout << " Warning: Failed to watch " << crate->address << ", trying again later\n";
+				crate->reader.Close();
+				continue;
+			}
+			std::cout << " Connected to " << crate->address << std::endl;
+			crate->fd = crate->reader.Get();
+			merger.SetConnected(crate->source, true);
+		}
+	};
+
+	connect_crates();
+	loop.AddTimer(AGG_RECONNECT_INTERVAL, connect_crates);
+
+	double last_status = get_time();
+	loop.AddTimer(AGG_SERVICE_INTERVAL, [&](){
+		double now = get_time();
+		merger.Service(now);
+		if(stream_server.IsInit()){ stream_server.Service(); }
+
+		if(status_interval <= 0.0 || now - last_status < status_interval){ return; }
+		last_status = now;
+
+		std::vector<MergeSourceInfo> sources;
+		merger.GetSources(sources);
+		std::cout << " Merged " << merger.GetSpillsOut() << " spills, " << merger.GetEventsOut() << " events, ";
+		std::cout << merger.GetWordsHeld() * sizeof(unsigned int) / 1024 << " kB held, " << merger.GetForcedReleases() << " forced releases\n";
+		for(std::vector<MergeSourceInfo>::iterator iter = sources.begin(); iter != sources.end(); iter++){
+			std::cout << "  " << std::setw(24) << std::left << iter->name << std::right;
+			if(!iter->connected){ std::cout << " disconnected"; }
+			else if(iter->idle){ std::cout << " idle        "; }
+			else{ std::cout << " live        "; }
+			std::cout << " modules " << iter->first_module << "-" << (int)(iter->first_module + iter->num_modules) - 1 << ", " << iter->spills_in << " spills, ";
+			std::cout << iter->events_in << " events, " << iter->events_held << " held, " << iter->events_late << " late, " << iter->events_dropped << " dropped\n";
+		}
+	});
+
+	loop.Run();
+
+	// Release everything still held
+	merger.Flush();
+	std::cout << " Merged " << merger.GetSpillsOut() << " spills, " << merger.GetEventsOut() << " events (" << merger.GetWordsOut() << " words)\n";
+	if(output_file.IsOpen()){ output_file.CloseFile(); }
+
+	loop.Close();
+	if(signal_fd >= 0){ close(signal_fd); }
+	stream_server.Close();
+	for(std::vector<CrateStream*>::iterator iter = crates.begin(); iter != crates.end(); iter++){
+		(*iter)->reader.Close();
+		delete *iter;
+	}
+
+	return 0;
+}
@@ -1,12 +1,17 @@
 /** \file monitor.cpp
-  * 
-  * \brief Receives and decodes rate packets from StatsHandler
-  * 
+  *
+  * \brief Receives and decodes stats packets from StatsHandler
+  *
   * \author Cory R. Thornsberry
-  * 
+  *
   * \date June 4th, 2015
-  * 
-  * \version 1.0
+  *
+  * \version 2.0
+  *
+  * The stats of any number of crates are shown at once, told apart by the
+  * crate ID each poll2 sends with its stats. With curses, only the cells whose
+  * values changed are drawn again, and the display may be scrolled with the
+  * arrow keys when it does not fit in the terminal.
 */
 
 #include <stdlib.h>
@@ -15,20 +20,50 @@
 #include <sstream>
 #include <iomanip>
 #include <cmath>
+#include <vector>
+#include <map>
+
+#include <unistd.h>
+#include <signal.h>
+#include <sys/signalfd.h>
+#include <sys/ioctl.h>
 
 #include "poll2_socket.h"
+#include "poll2_shm.h"
+#include "poll2_event.h"
+#include "poll2_history.h"
+#include "poll2_statsproto.h"
+
+#ifdef USE_NCURSES
+#include <curses.h>
+#endif
 
 #define KILOBYTE 1024 // bytes
 #define MEGABYTE 1048576 // bytes
 #define GIGABYTE 1073741824 // bytes
 
+// Time between checks of the poll2 stats ring (in ms)
+#define STATS_RING_POLL 100
+
+// Number of stats records shown in the trends
+#define TREND_DEFAULT_LENGTH 60
+
+// Width of the column of each module ("|" then the ICR, OCR, rate and total of a channel)
+#define MODULE_COLUMN_WIDTH 27
+
+// Width of the channel labels at the start of each row
+#define CHANNEL_LABEL_WIDTH 3
+
+// Largest packet read (in bytes, big enough for any UDP datagram)
+#define MAX_PACKET_SIZE 65536
+
 // Return the order of magnitude of a number
-double GetOrder(unsigned int input_, unsigned int &power){
+double GetOrder(unsigned long long input_, unsigned int &power){
 	double test = 1;
 	for(unsigned int i = 0; i < 100; i++){
-		if(input_/test <= 1){ 
+		if(input_/test <= 1){
 			power = i;
-			return test; 
+			return test;
 		}
 		test *= 10.0;
 	}
@@ -39,32 +74,32 @@ double GetOrder(unsigned int input_, unsigned int &power){
 std::string GetChanRateString(double input_){
 	if(input_ < 0.0){ input_ *= -1; }
 	int power = std::log10(input_);
-	
+
 	std::stringstream stream;
 	stream << std::setprecision(2) << std::fixed;
 	if(power >= 6){ stream << input_/1E6 << "M"; } // MHz
 	else if(power >= 3){ stream << input_/1E3 << "k"; } // kHz
-	else if (input_ == 0) { 
+	else if (input_ == 0) {
 		stream << "   0 ";
 	}
 	else {
-		stream << input_ << " "; 
+		stream << input_ << " ";
 	} // Hz
 
 	std::string output = stream.str();
 	output = output.substr(0,output.find_last_not_of(".",3)+1) + output.substr(output.length()-1,1);
-	
+
 	return output;
 }
 
-std::string GetChanTotalString(unsigned int input_){
+std::string GetChanTotalString(unsigned long long input_){
 	std::stringstream stream;
 	unsigned int power = 0;
 	double order = GetOrder(input_, power);
-	
+
 	if(power >= 4){ stream << 10*input_/order; }
 	else{ stream << input_; }
-	
+
 	// Limit to 2 decimal place due to space constraints
 	std::string output = stream.str();
 	size_t find_index = output.find('.');
@@ -75,9 +110,9 @@ std::string GetChanTotalString(unsigned int input_){
 		output = temp;
 	}
 
-	if(power >= 4){ 
+	if(power >= 4){
 		std::stringstream stream2;
-		stream2 << output << "E" << power-1; 
+		stream2 << output << "E" << power-1;
 		output = stream2.str();
 	}
 
@@ -87,27 +122,28 @@ std::string GetChanTotalString(unsigned int input_){
 // Expects input rate in B/s
 std::string GetRateString(double input_){
 	if(input_ < 0.0){ input_ *= -1; }
-	
+
 	std::stringstream stream;
-	if(input_/GIGABYTE > 1){ stream << input_/GIGABYTE << " GB/s\n"; } // GB/s
-	else if(input_/MEGABYTE > 1){ stream << input_/MEGABYTE << " MB/s\n"; } // MB/s
-	else if(input_/KILOBYTE > 1){ stream << input_/KILOBYTE << " kB/s\n"; } // kB/s
-	else{ stream << input_ << " B/s\n"; } // B/s
-	
+	stream << std::setprecision(3);
+	if(input_/GIGABYTE > 1){ stream << input_/GIGABYTE << " GB/s"; } // GB/s
+	else if(input_/MEGABYTE > 1){ stream << input_/MEGABYTE << " MB/s"; } // MB/s
+	else if(input_/KILOBYTE > 1){ stream << input_/KILOBYTE << " kB/s"; } // kB/s
+	else{ stream << input_ << " B/s"; } // B/s
+
 	return stream.str();
 }
 
 // Expects input time in seconds
 std::string GetTimeString(double input_){
 	if(input_ < 0.0){ input_ *= -1; }
-	
+
 	long long time = (long long)input_;
 	int hr = time/3600;
 	int min = (time%3600)/60;
 	int sec = (time%3600)%60;
 	int rem = (int)(100*(input_ - time));
-	
-	std::stringstream stream; 
+
+	std::stringstream stream;
 	if(hr < 10){ stream << "0" << hr; }
 	else{ stream << hr; }
 	stream << ":";
@@ -119,125 +155,568 @@ std::string GetTimeString(double input_){
 	stream << ".";
 	if(rem < 10){ stream << "0" << rem; }
 	else{ stream << rem; }
-	
+
 	return stream.str();
 }
 
-int main(){
-	const size_t msg_size = 5844;
-	const int modColumnWidth = 26;
-	char buffer[msg_size]; // 5.8 kB of stats data max
-	Server poll_server;
-	
-	int num_modules;
-	double time_in_sec;
-	double data_rate;
-	double **rates = NULL;
-	double **inputCountRate = NULL;
-	double **outputCountRate = NULL;
-	unsigned int **totals = NULL;
-	
-	bool first_packet = true;
-	if(poll_server.Init(5556)){
-		std::cout << " Waiting for first stats packet...\n";			
-
-		while(true){
-			std::cout << std::setprecision(2);
-
-			poll_server.RecvMessage(buffer, msg_size);
-			char *ptr = buffer;
-
-			if(strcmp(buffer, "$KILL_SOCKET") == 0){
-				std::cout << "  Received KILL_SOCKET flag...\n\n";
-				break;
-			}
+// Return text_ padded with spaces (or cut) to width_ columns
+std::string PadString(const std::string &text_, size_t width_){
+	if(text_.size() >= width_){ return text_.substr(0, width_); }
+	return text_ + std::string(width_ - text_.size(), ' ');
+}
 
-			system("clear");
-			
-			//std::cout << " Received:\t" << recv_bytes << " bytes\n";
-		
-			// Below is the stats packet structure (for N modules)
-			// ---------------------------------------------------
-			// 4 byte total number of pixie modules (N)
-			// 8 byte total time of run (in seconds)
-			// 8 byte total data rate (in B/s)
-			// channel 0, 0 rate
-			// channel 0, 0 total
-			// channel 0, 1 rate
-			// channel 0, 1 total
-			// ...
-			// channel 0, 15 rate
-			// channel 0, 15 total
-			// channel 1, 0 rate
-			// channel 1, 0 total
-			// ...
-			// channel N-1, 15 rate
-			// channel N-1, 15 total
-			memcpy(&num_modules, ptr, 4); ptr += 4;
-
-			if(first_packet){
-				rates = new double*[num_modules];
-				inputCountRate = new double*[num_modules];
-				outputCountRate = new double*[num_modules];
-				totals = new unsigned int*[num_modules];
-				for(int i = 0; i < num_modules; i++){
-					rates[i] = new double[16];
-					inputCountRate[i] = new double[16];
-					outputCountRate[i] = new double[16];
-					totals[i] = new unsigned int[16];
-				}
-				first_packet = false;
+// Read the next stats packet from the poll2 stats ring into buffer_
+bool ReadStatsRing(ShmReader &ring_, char *buffer_, size_t length_, size_t &nBytes_){
+	static std::vector<unsigned int> record;
+	unsigned int type;
+
+	if(!ring_.IsInit() || ring_.IsStale()){ // Attach to the ring (or re-attach if poll2 replaced it)
+		ring_.Close();
+		if(!ring_.Init(SHM_STATS_RING)){ return false; }
+	}
+
+	if(!ring_.Read(record, type, nBytes_)){ return false; }
+
+	if(nBytes_ > length_){ nBytes_ = length_; }
+	memcpy(buffer_, &record[0], nBytes_);
+
+	return true;
+}
+
+class StatsDisplay{
+  private:
+	StatsDecoder decoder;
+	size_t trend_length; /// Number of records shown in the trends (0 for none)
+	std::map<unsigned short, RateHistory> trends; /// The data rate, then the event rate of each module, of the last records of each crate
+	std::map<unsigned short, bool> updated; /// Crates with a record which has not been drawn yet
+
+	bool use_curses; /// Draw with curses, rather than printing the whole display for every record
+	bool is_open; /// Set while curses has the terminal
+	bool relayout; /// Set when the whole display must be laid out and drawn again
+	bool dirty; /// Set when something has changed since the display was last drawn
+	int width; /// Width of the terminal (0 if unknown)
+	int height; /// Height of the terminal (0 if unknown)
+	int num_rows; /// Rows of the display
+	int num_cols; /// Columns of the display
+	int top_row; /// First row shown, when the display is scrolled
+	int left_col; /// First column shown, when the display is scrolled
+	unsigned int mods_per_band; /// Modules shown side by side
+	std::map<unsigned short, int> crate_rows; /// First row of each crate
+	std::map<unsigned short, int> trend_rows; /// First row of the trends of each crate
+
+#ifdef USE_NCURSES
+	WINDOW *pad; /// Holds the whole display, of which the part which fits in the terminal is shown
+#endif
+	std::vector<std::string> lines; /// The whole display, when curses is not used
+
+	/// Write text_ to the display at row_ and col_.
+	void put(int row_, int col_, const std::string &text_);
+
+	/// Work out where everything goes and draw all of it.
+	void layout();
+
+	/// Draw the title line.
+	void draw_title();
+
+	/// Draw the status line of a crate.
+	void draw_status(StatsCrate &crate_);
+
+	/// Draw the module labels and channel labels of a band of modules of a crate.
+	void draw_band(StatsCrate &crate_, unsigned int band_);
+
+	/// Draw the rates and total of one channel.
+	void draw_cell(StatsCrate &crate_, unsigned int mod_, unsigned int ch_);
+
+	/// Draw the trends of a crate.
+	void draw_trends(StatsCrate &crate_);
+
+	/// Return a trend line for one series of the history of a crate.
+	std::string trend_line(const std::string &name_, RateHistory &trend_, size_t series_, bool isData_);
+
+	/// Get the size of the terminal.
+	void get_size();
+
+  public:
+	StatsDisplay(size_t trendLength_=TREND_DEFAULT_LENGTH, bool useCurses_=true);
+
+	~StatsDisplay(){ Close(); }
+
+	/// Set up the terminal.
+	void Open();
+
+	/// Give the terminal back.
+	void Close();
+
+	/// Decode a stats packet. Returns false once every crate has stopped sending stats.
+	bool Process(const char *buffer_, size_t length_);
+
+	/// Draw whatever has changed since the last call.
+	void Draw();
+
+	/// Handle any keys pressed. Returns false if the user asked to quit.
+	bool HandleKeys();
+
+	/// Lay the display out again for the new size of the terminal.
+	void Resize();
+
+	bool UsesCurses(){ return use_curses; }
+};
+
+StatsDisplay::StatsDisplay(size_t trendLength_/*=TREND_DEFAULT_LENGTH*/, bool useCurses_/*=true*/) : trend_length(trendLength_), use_curses(useCurses_), is_open(false), relayout(true), dirty(true),
+                                                                                                   width(0), height(0), num_rows(0), num_cols(0), top_row(0), left_col(0), mods_per_band(0) {
+#ifdef USE_NCURSES
+	pad = NULL;
+#else
+	use_curses = false;
+#endif
+}
+
+void StatsDisplay::Open(){
+#ifdef USE_NCURSES
+	if(use_curses){
+		initscr();
+		cbreak();
+		noecho();
+		curs_set(0);
+		refresh();
+		is_open = true;
+	}
+#endif
+	get_size();
+	layout();
+}
+
+void StatsDisplay::Close(){
+#ifdef USE_NCURSES
+	if(is_open){
+		if(pad){ delwin(pad); }
+		pad = NULL;
+		endwin();
+		is_open = false;
+	}
+#endif
+}
+
+void StatsDisplay::get_size(){
+#ifdef USE_NCURSES
+	if(use_curses){
+		getmaxyx(stdscr, height, width);
+		return;
+	}
+#endif
+	struct winsize size;
+	if(isatty(STDOUT_FILENO) && ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0){
+		width = size.ws_col;
+		height = size.ws_row;
+	}
+	else{ width = height = 0; } // Not a terminal, so nothing is wrapped
+}
+
+void StatsDisplay::put(int row_, int col_, const std::string &text_){
+	if(row_ < 0 || row_ >= num_rows){ return; }
+#ifdef USE_NCURSES
+	if(use_curses){
+		if(pad){ mvwaddstr(pad, row_, col_, text_.c_str()); }
+		return;
+	}
+#endif
+	std::string &line = lines[row_];
+	if(line.size() < col_ + text_.size()){ line.resize(col_ + text_.size(), ' '); }
+	line.replace(col_, text_.size(), text_);
+}
+
+bool StatsDisplay::Process(const char *buffer_, size_t length_){
+	unsigned short id;
+	if(!decoder.Decode(buffer_, length_, id)){
+		if(decoder.GetRejected() == 1){ dirty = true; } // Show that packets are being ignored
+		return true;
+	}
+
+	StatsCrate *crate = decoder.GetCrate(id);
+
+	// Keep the rates in the trends
+	if(!crate->closed){
+		unsigned int nModules = crate->record.GetNumModules();
+		RateHistory &trend = trends[id];
+		if(trend.GetNumSeries() != nModules + 1){ trend.Init(nModules + 1, trend_length); }
+		double *sample = trend.Next();
+		if(sample){
+			sample[0] = crate->record.GetDouble(STATS_FIELD_DATA_RATE);
+			for(unsigned int i = 0; i < nModules; i++){
+				sample[i+1] = 0.0;
+				for(unsigned int j = 0; j < crate->record.GetNumChannels(); j++){ sample[i+1] += crate->record.GetDouble(crate->record.ChannelField(i, j, STATS_CHANNEL_EVENT_RATE)); }
 			}
-			
-			memcpy(&time_in_sec, ptr, 8); ptr += 8;
-			memcpy(&data_rate, ptr, 8); ptr += 8;
-			for(int i = 0; i < num_modules; i++){
-				for(int j = 0; j < 16; j++){
-					memcpy(&inputCountRate[i][j], ptr, 8); ptr += 8;
-					memcpy(&outputCountRate[i][j], ptr, 8); ptr += 8;
-					memcpy(&rates[i][j], ptr, 8); ptr += 8;
-					memcpy(&totals[i][j], ptr, 4); ptr += 4;
+			trend.Commit();
+		}
+	}
+
+	updated[id] = true;
+	dirty = true;
+
+	return !decoder.AllClosed();
+}
+
+void StatsDisplay::layout(){
+	std::map<unsigned short, StatsCrate> &crates = decoder.GetCrates();
+
+	// Fit as many modules side by side as the terminal is wide (or all of them if its width is unknown)
+	mods_per_band = 1;
+	if(width > 0){ mods_per_band = (width - CHANNEL_LABEL_WIDTH - 1) / MODULE_COLUMN_WIDTH; }
+	else{
+		for(std::map<unsigned short, StatsCrate>::iterator iter = crates.begin(); iter != crates.end(); iter++){
+			if(iter->second.record.GetNumModules() > mods_per_band){ mods_per_band = iter->second.record.GetNumModules(); }
+		}
+	}
+	if(mods_per_band == 0){ mods_per_band = 1; }
+
+	int row = 2;
+	num_cols = width;
+	crate_rows.clear();
+	trend_rows.clear();
+	for(std::map<unsigned short, StatsCrate>::iterator iter = crates.begin(); iter != crates.end(); iter++){
+		unsigned int nModules = iter->second.record.GetNumModules();
+		unsigned int nBands = (nModules + mods_per_band - 1) / mods_per_band;
+		unsigned int nColumns = (nModules < mods_per_band ? nModules : mods_per_band);
+		crate_rows[iter->first] = row;
+		row += 1 + nBands * (iter->second.record.GetNumChannels() + 1) + 1;
+		if(CHANNEL_LABEL_WIDTH + (int)nColumns * MODULE_COLUMN_WIDTH + 1 > num_cols){ num_cols = CHANNEL_LABEL_WIDTH + nColumns * MODULE_COLUMN_WIDTH + 1; }
+	}
+	if(trend_length > 0){
+		for(std::map<unsigned short, StatsCrate>::iterator iter = crates.begin(); iter != crates.end(); iter++){
+			trend_rows[iter->first] = row;
+			row += 3 + iter->second.record.GetNumModules() + 1;
+		}
+		if(5 + (int)trend_length + 1 + 4*11 + 5 > num_cols){ num_cols = 5 + trend_length + 1 + 4*11 + 5; }
+	}
+	num_rows = row;
+	if(num_cols < 80){ num_cols = 80; }
+
+	// Start again with an empty display
+#ifdef USE_NCURSES
+	if(use_curses){
+		if(pad){ delwin(pad); }
+		pad = newpad(num_rows, num_cols);
+		keypad(pad, TRUE);
+		nodelay(pad, TRUE);
+	}
+#endif
+	lines.assign(num_rows, "");
+
+	for(std::map<unsigned short, StatsCrate>::iterator iter = crates.begin(); iter != crates.end(); iter++){
+		StatsCrate &crate = iter->second;
+		unsigned int nModules = crate.record.GetNumModules();
+		for(unsigned int band = 0; band * mods_per_band < nModules; band++){ draw_band(crate, band); }
+		for(unsigned int mod = 0; mod < nModules; mod++){
+			for(unsigned int ch = 0; ch < crate.record.GetNumChannels(); ch++){ draw_cell(crate, mod, ch); }
+		}
+		updated[iter->first] = true;
+	}
+
+	relayout = false;
+}
+
+void StatsDisplay::draw_title(){
+	std::map<unsigned short, StatsCrate> &crates = decoder.GetCrates();
+	std::stringstream stream;
+	if(crates.empty()){ stream << "Waiting for the first stats packet..."; }
+	else{ stream << "poll2 stats of " << crates.size() << (crates.size() == 1 ? " crate" : " crates"); }
+	if(decoder.GetRejected() > 0){ stream << ", " << decoder.GetRejected() << " packets of another version ignored"; }
+	if(use_curses){ stream << "   (arrow keys scroll, q quits)"; }
+	put(0, 0, PadString(stream.str(), num_cols));
+}
+
+void StatsDisplay::draw_status(StatsCrate &crate_){
+	std::stringstream stream;
+	stream << "Crate " << crate_.id << " - Run Time: " << GetTimeString(crate_.record.GetDouble(STATS_FIELD_TIME));
+	stream << "  Data Rate: " << GetRateString(crate_.record.GetDouble(STATS_FIELD_DATA_RATE));
+	if(crate_.closed){ stream << "  [stopped]"; }
+	else if(!crate_.synced){ stream << "  [syncing]"; }
+	if(crate_.lost > 0){ stream << "  [" << crate_.lost << " of " << crate_.records + crate_.lost << " records lost]"; }
+	put(crate_rows[crate_.id], 0, PadString(stream.str(), num_cols));
+}
+
+void StatsDisplay::draw_band(StatsCrate &crate_, unsigned int band_){
+	unsigned int nModules = crate_.record.GetNumModules();
+	unsigned int nChannels = crate_.record.GetNumChannels();
+	unsigned int first = band_ * mods_per_band;
+	unsigned int last = (first + mods_per_band < nModules ? first + mods_per_band : nModules);
+	int row = crate_rows[crate_.id] + 1 + band_ * (nChannels + 1);
+
+	std::stringstream header;
+	header << "   ";
+	for(unsigned int mod = first; mod < last; mod++){
+		header << "|" << std::setw((MODULE_COLUMN_WIDTH-3) / 2) << std::setfill('-') << "M" << std::setw(2) << std::setfill('0') << mod;
+		header << std::setw((MODULE_COLUMN_WIDTH-3) / 2) << std::setfill('-') << "";
+	}
+	header << "|";
+	put(row, 0, header.str());
+
+	for(unsigned int ch = 0; ch < nChannels; ch++){
+		std::stringstream label;
+		label << "C" << std::setw(2) << std::setfill('0') << ch;
+		put(row + 1 + ch, 0, label.str());
+		put(row + 1 + ch, CHANNEL_LABEL_WIDTH + (last - first) * MODULE_COLUMN_WIDTH, "|");
+	}
+}
+
+void StatsDisplay::draw_cell(StatsCrate &crate_, unsigned int mod_, unsigned int ch_){
+	StatsRecord &record = crate_.record;
+	int row = crate_rows[crate_.id] + 1 + (mod_ / mods_per_band) * (record.GetNumChannels() + 1) + 1 + ch_;
+	int col = CHANNEL_LABEL_WIDTH + (mod_ % mods_per_band) * MODULE_COLUMN_WIDTH;
+
+	std::stringstream cell;
+	cell << "|" << std::setfill(' ');
+	cell << std::setw(5) << GetChanRateString(record.GetDouble(record.ChannelField(mod_, ch_, STATS_CHANNEL_ICR))) << " ";
+	cell << std::setw(5) << GetChanRateString(record.GetDouble(record.ChannelField(mod_, ch_, STATS_CHANNEL_OCR))) << " ";
+	cell << std::setw(5) << GetChanRateString(record.GetDouble(record.ChannelField(mod_, ch_, STATS_CHANNEL_EVENT_RATE))) << " ";
+	cell << " " << std::setw(6) << GetChanTotalString(record.GetWord(record.ChannelField(mod_, ch_, STATS_CHANNEL_EVENTS_TOTAL))) << " ";
+	put(row, col, PadString(cell.str(), MODULE_COLUMN_WIDTH));
+}
+
+std::string StatsDisplay::trend_line(const std::string &name_, RateHistory &trend_, size_t series_, bool isData_){
+	std::vector<double> values;
+	trend_.GetValues(series_, 0, values);
+	HistorySummary summary = RateHistory::Summarize(values);
+
+	std::stringstream stream;
+	stream << std::setfill(' ') << std::left << std::setw(5) << name_ << std::right;
+	stream << RateHistory::Sparkline(values, use_curses);
+	for(size_t i = values.size(); i < trend_length; i++){ stream << " "; } // Keep the columns lined up while the trend fills
+	stream << " ";
+	if(isData_){
+		stream << std::fixed << std::setprecision(2) << std::setw(11) << summary.min / MEGABYTE << std::setw(11) << summary.mean / MEGABYTE;
+		stream << std::setw(11) << summary.max / MEGABYTE << std::setw(11) << summary.p95 / MEGABYTE << " MB/s";
+	}
+	else{
+		stream << std::setw(11) << GetChanRateString(summary.min) << std::setw(11) << GetChanRateString(summary.mean);
+		stream << std::setw(11) << GetChanRateString(summary.max) << std::setw(11) << GetChanRateString(summary.p95) << " Hz";
+	}
+
+	return stream.str();
+}
+
+void StatsDisplay::draw_trends(StatsCrate &crate_){
+	RateHistory &trend = trends[crate_.id];
+	if(trend_length == 0 || trend.GetCount() == 0){ return; }
+
+	int row = trend_rows[crate_.id];
+	std::stringstream title;
+	title << "Crate " << crate_.id << " trend of the last " << trend.GetCount() << " records";
+	put(row, 0, PadString(title.str(), num_cols));
+	std::stringstream header;
+	header << std::string(5 + trend_length + 1, ' ') << std::setw(11) << "min" << std::setw(11) << "mean" << std::setw(11) << "max" << std::setw(11) << "p95";
+	put(row + 1, 0, header.str());
+	put(row + 2, 0, trend_line("Data", trend, 0, true));
+	for(unsigned int i = 0; i < crate_.record.GetNumModules() && i + 1 < trend.GetNumSeries(); i++){
+		std::stringstream name;
+		name << "M" << std::setw(2) << std::setfill('0') << i;
+		put(row + 3 + i, 0, trend_line(name.str(), trend, i+1, false));
+	}
+}
+
+void StatsDisplay::Draw(){
+	std::map<unsigned short, StatsCrate> &crates = decoder.GetCrates();
+	for(std::map<unsigned short, StatsCrate>::iterator iter = crates.begin(); iter != crates.end(); iter++){
+		if(iter->second.layout_changed || crate_rows.find(iter->first) == crate_rows.end()){ relayout = true; }
+	}
+	if(!dirty && !relayout){ return; }
+	if(relayout){ layout(); }
+
+	// Only the cells which changed are drawn again
+	draw_title();
+	for(std::map<unsigned short, StatsCrate>::iterator iter = crates.begin(); iter != crates.end(); iter++){
+		if(!updated[iter->first]){ continue; }
+		StatsCrate &crate = iter->second;
+		draw_status(crate);
+		for(unsigned int mod = 0; mod < crate.record.GetNumModules(); mod++){
+			for(unsigned int ch = 0; ch < crate.record.GetNumChannels(); ch++){
+				size_t field = crate.record.ChannelField(mod, ch, 0);
+				for(int i = 0; i < STATS_CHANNEL_FIELDS; i++){
+					if(crate.changed[field + i]){
+						draw_cell(crate, mod, ch);
+						break;
+					}
 				}
 			}
-			
-			// Display the rate information
-			std::cout << "Run Time: " << GetTimeString(time_in_sec);
-			if (num_modules > 1) std::cout << "\t";
-			else std::cout << "\n";
-			std::cout << "Data Rate: " << GetRateString(data_rate) << std::endl;
-			std::cout << "   ";
-			for(unsigned int i = 0; i < (unsigned int)num_modules; i++){
-			    std::cout << "|" << std::setw((modColumnWidth-2) / 2) 
-				      << std::setfill('-') << "M" << std::setw(2) 
-				      << std::setfill('0') << i 
-				      << std::setw((modColumnWidth-2) / 2) 
-				      << std::setfill('-') << "";
+		}
+		draw_trends(crate);
+		updated[iter->first] = false;
+	}
+	decoder.ClearChanged();
+	dirty = false;
+
+#ifdef USE_NCURSES
+	if(use_curses){
+		if(top_row > num_rows - height){ top_row = (num_rows > height ? num_rows - height : 0); }
+		if(left_col > num_cols - width){ left_col = (num_cols > width ? num_cols - width : 0); }
+		prefresh(pad, top_row, left_col, 0, 0, height - 1, width - 1);
+		return;
+	}
+#endif
+
+	// Without curses the whole display is printed again
+	std::stringstream screen;
+	screen << "\033[H\033[2J";
+	for(std::vector<std::string>::iterator iter = lines.begin(); iter != lines.end(); iter++){ screen << *iter << "\n"; }
+	std::cout << screen.str() << std::flush;
+}
+
+bool StatsDisplay::HandleKeys(){
+#ifdef USE_NCURSES
+	if(!use_curses){ return true; }
+	int key;
+	while((key = wgetch(pad)) != ERR){
+		switch(key){
+			case 'q': case 'Q': return false;
+			case KEY_UP: top_row--; break;
+			case KEY_DOWN: top_row++; break;
+			case KEY_PPAGE: top_row -= height; break;
+			case KEY_NPAGE: top_row += height; break;
+			case KEY_HOME: top_row = 0; break;
+			case KEY_END: top_row = num_rows; break;
+			case KEY_LEFT: left_col -= MODULE_COLUMN_WIDTH; break;
+			case KEY_RIGHT: left_col += MODULE_COLUMN_WIDTH; break;
+			default: continue;
+		}
+		if(top_row < 0){ top_row = 0; }
+		if(left_col < 0){ left_col = 0; }
+		dirty = true;
+	}
+	Draw();
+#endif
+	return true;
+}
+
+void StatsDisplay::Resize(){
+#ifdef USE_NCURSES
+	if(use_curses){
+		struct winsize size;
+		if(ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0){ resizeterm(size.ws_row, size.ws_col); }
+	}
+#endif
+	get_size();
+	relayout = true;
+	Draw();
+}
+
+void help(char *name_){
+	std::cout << " SYNTAX: " << name_ << " [options]\n";
+	std::cout << "  Available options:\n";
+	std::cout << "   --help - Display this dialogue\n";
+	std::cout << "   --udp  - Read stats packets from UDP instead of the poll2 shm ring, from every crate sending to this host\n";
+	std::cout << "   --port <num> - UDP port the stats packets are read from (default=" << STATS_PROTO_PORT << ")\n";
+	std::cout << "   --trend [num] - Number of stats records shown in the trend of each module, 0 for none (default=" << TREND_DEFAULT_LENGTH << ")\n";
+	std::cout << "   --plain - Print the whole display for every record instead of using curses\n";
+}
+
+int main(int argc, char *argv[]){
+	bool use_udp = false;
+	bool use_curses = true;
+	int port = STATS_PROTO_PORT;
+	int trend_length = TREND_DEFAULT_LENGTH;
+	for(int i = 1; i < argc; i++){
+		if(strcmp(argv[i], "--udp") == 0){ use_udp = true; }
+		else if(strcmp(argv[i], "--plain") == 0){ use_curses = false; }
+		else if(i+1 < argc && strcmp(argv[i], "--trend") == 0){
+			trend_length = atoi(argv[++i]);
+			if(trend_length < 0){
+				std::cout << " Error: Invalid trend length '" << argv[i] << "'!\n";
+				return 1;
 			}
-			std::cout << "|\n";
-				
-			for(unsigned int i = 0; i < 16; i++){
-			    std::cout << "C" << std::setw(2) << std:: setfill('0') << i << "|";
-			    for(unsigned int j = 0; j < (unsigned int)num_modules; j++){
-				std::cout << std::setw(5) << std::setfill(' ') << GetChanRateString(inputCountRate[j][i]) << " ";
-				std::cout << std::setw(5) << std::setfill(' ') << GetChanRateString(outputCountRate[j][i]) << " ";
-				std::cout << std::setw(5) << std::setfill(' ') << GetChanRateString(rates[j][i]) << " ";
-				std:: cout << " " << std::setw(6) << GetChanTotalString(totals[j][i]) << " ";
-				std::cout << "|";
-			    }
-			    std::cout << "\n";
+		}
+		else if(i+1 < argc && strcmp(argv[i], "--port") == 0){
+			port = atoi(argv[++i]);
+			if(port <= 0 || port > 65535){
+				std::cout << " Error: Invalid port '" << argv[i] << "'!\n";
+				return 1;
 			}
 		}
+		else if(strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0){
+			help(argv[0]);
+			return 0;
+		}
+		else{
+			std::cout << " Error: Unknown option '" << argv[i] << "'!\n";
+			help(argv[0]);
+			return 1;
+		}
 	}
-	else{ 
-		std::cout << " Error: Failed to open poll socket 5556!\n";
-		return 1; 
+	if(!isatty(STDOUT_FILENO)){ use_curses = false; }
+
+	std::vector<char> buffer(MAX_PACKET_SIZE);
+	Server poll_server;
+	ShmReader stats_ring;
+	StatsDisplay display(trend_length, use_curses);
+	EventLoop loop;
+	bool all_stopped = false;
+
+	if(use_udp && !poll_server.Init(port)){
+		std::cout << " Error: Failed to open poll socket " << port << "!\n";
+		return 1;
+	}
+
+	if(!loop.Init()){
+		std::cout << " Error: Failed to create event loop!\n";
+		return 1;
+	}
+
+	// Handle ctrl-c and resizes in the event loop, so that the stats ring is detached and the terminal restored cleanly
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	sigaddset(&signals, SIGWINCH);
+	sigprocmask(SIG_BLOCK, &signals, NULL);
+	int signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+	if(signal_fd >= 0){
+		loop.Add(signal_fd, [&](int fd_, unsigned int){
+			struct signalfd_siginfo info;
+			while(read(fd_, &info, sizeof(info)) == sizeof(info)){
+				if(info.ssi_signo == SIGWINCH){ display.Resize(); }
+				else{ loop.Stop(); }
+			}
+		});
+	}
+
+	display.Open();
+	if(display.UsesCurses() && isatty(STDIN_FILENO)){
+		loop.Add(STDIN_FILENO, [&](int, unsigned int){ if(!display.HandleKeys()){ loop.Stop(); } });
 	}
+
+	if(use_udp){
+		loop.Add(poll_server.Get(), [&](int, unsigned int){
+			int nBytes = poll_server.RecvMessage(&buffer[0], buffer.size());
+			if(nBytes > 0 && !display.Process(&buffer[0], nBytes)){
+				all_stopped = true;
+				loop.Stop();
+			}
+			display.Draw();
+		});
+	}
+	else{ // The stats ring cannot be watched by epoll, so check it regularly
+		loop.AddTimer(STATS_RING_POLL, [&](){
+			size_t nBytes;
+			while(ReadStatsRing(stats_ring, &buffer[0], buffer.size(), nBytes)){
+				if(!display.Process(&buffer[0], nBytes)){
+					all_stopped = true;
+					loop.Stop();
+					break;
+				}
+			}
+			display.Draw();
+		});
+	}
+
+	display.Draw();
+	loop.Run();
+
+	display.Close();
+	if(all_stopped){ std::cout << "  Every crate has stopped sending stats...\n\n"; }
+
+	loop.Close();
+	if(signal_fd >= 0){ close(signal_fd); }
 	poll_server.Close();
-	
-	if(rates){ delete[] rates; }
-	if(inputCountRate){ delete[] inputCountRate; }
-	if(outputCountRate){ delete[] outputCountRate; }
-	if(totals){ delete[] totals; }
+	stats_ring.Close();
 
 	return 0;
 }
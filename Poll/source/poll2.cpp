@@ -16,6 +16,12 @@
 #include <map>
 
 #include "poll2_core.h"
+#include "poll2_shm.h"
+#include "poll2_stream.h"
+#include "poll2_socket.h"
+#include "poll2_fifo.h"
+#include "poll2_rt.h"
+#include "poll2_statsproto.h"
 #include "Display.h"
 #include "CTerminal.h"
 
@@ -27,10 +33,29 @@ void help(){
 	std::cout << "  -q, --quiet          Run quietly (false by default)\n";
 	std::cout << "  -n, --no-wall-clock  Do not insert the wall clock in the data stream\n";
 	std::cout << "  -r, --rates          Display module rates in quiet mode (false by defualt)\n";
-	std::cout << "  -t, --thresh <num>   Sets FIFO read threshold to num% full (50% by default)\n";
+	std::cout << "  -t, --thresh <num>   Sets FIFO read threshold to num% full (50% by default), or 'auto' to adapt it to the rates\n";
 	std::cout << "  -z, --zero           Zero clocks on each START_ACQ (false by default)\n";
 	std::cout << "  -d, --debug          Set debug mode to true (false by default)\n";
 	std::cout << "  -p, --pacman         Use classic poll operation for use with Pacman.\n";
+	std::cout << "  -u, --udp-shm        Send shm spills over UDP port 5555 instead of the shared memory ring\n";
+	std::cout << "      --ring-size <MB> Size of the shared memory ring (" << SHM_SPILL_RING_SIZE << " MB by default)\n";
+	std::cout << "  -o, --overrun <mode> What to do when a shm reader falls behind, lap or drop (lap by default)\n";
+	std::cout << "  -s, --stream <addr>  Serve spills to TCP subscribers on port <addr>, or Unix socket subscribers if <addr> is a path\n";
+	std::cout << "      --metrics <addr> Serve Prometheus metrics over HTTP on port <addr> of localhost, host:port, or a Unix socket if <addr> is a path\n";
+	std::cout << "      --crate <id>     Crate ID sent with the stats, which tells crates apart in the monitor (0 by default)\n";
+	std::cout << "      --stats-to <host[:port]> Send the stats packets to a monitor on another host (127.0.0.1:" << STATS_PROTO_PORT << " by default)\n";
+	std::cout << "      --slow-client <mode> What to do when a stream subscriber falls behind, sample or drop (sample by default)\n";
+	std::cout << "  -m, --mcast <group>  Send shm spills over UDP to a multicast group (e.g. 239.255.0.1) instead of the shared memory ring\n";
+	std::cout << "      --mcast-ttl <num> Time-to-live of multicast datagrams (" << MULTICAST_TTL << " by default, stays on the local subnet)\n";
+	std::cout << "      --mcast-if <iface> Interface name or address to send multicast datagrams on\n";
+	std::cout << "      --pace <MB/s>    Limit the rate of spills sent over UDP, or 'auto' to spread each spill over the time between spills\n";
+	std::cout << "      --pipeline [cpus] Validate and write spills on their own threads, optionally pinning the reader, validator and sink to cpus (e.g. 2,3,4)\n";
+	std::cout << "      --affinity <cpus> Pin the readout thread, and the validator and sink with --pipeline, to cpus (e.g. 2 or 2,3,4)\n";
+	std::cout << "      --rt-priority [prio] Run the readout threads under SCHED_FIFO at prio (" << RT_DEFAULT_PRIORITY << " by default)\n";
+	std::cout << "      --mlock          Lock the memory of poll2 once the spill buffers are allocated\n";
+	std::cout << "      --backoff <spins,yields,us> Poll the FIFOs spinning, then yielding, then sleeping up to us between checks (" << BACKOFF_DEFAULT_SPINS << "," << BACKOFF_DEFAULT_YIELDS << "," << BACKOFF_MAX_SLEEP*1E6 << " by default)\n";
+	std::cout << "      --replay <file>  Send the spills of an .ldf or .pld file through the readout instead of reading the crate\n";
+	std::cout << "      --replay-speed <num> Replay at num times the recorded rate, or 'max' to replay as fast as possible (1 by default)\n";
 	std::cout << "  -h, --help           Display this help dialogue.\n\n";
 }	
 	
@@ -45,11 +70,12 @@ void start_cmd_control(Poll *poll_){
 int main(int argc, char *argv[]){
 	// Read the FIFO when it is this full
 	unsigned int threshPercent = 50;
+	bool adaptiveThresh = false;
 	std::string alarmArgument = "";
 
 	// Define all valid command line options
 	// This is done to keep legacy options available while removing dependency on HRIBF libraries
-	CLoption valid_opt[11];
+	CLoption valid_opt[30];
 	valid_opt[0].Set("alarm", false, true);
 	valid_opt[1].Set("fast", false, false);
 	valid_opt[2].Set("quiet", false, false);
@@ -59,12 +85,46 @@ int main(int argc, char *argv[]){
 	valid_opt[6].Set("zero", false, false);
 	valid_opt[7].Set("debug", false, false);
 	valid_opt[8].Set("pacman", false, false);
-	valid_opt[9].Set("help", false, false);
-	valid_opt[10].Set("?", false, false);
-	if(!get_opt(argc, argv, valid_opt, 11, help)){ return 1; }
+	valid_opt[9].Set("udp-shm", false, false);
+	valid_opt[10].Set("ring-size", true, false);
+	valid_opt[10].opt = 0x0;
+	valid_opt[11].Set("overrun", true, false);
+	valid_opt[12].Set("stream", true, false);
+	valid_opt[13].Set("slow-client", true, false);
+	valid_opt[13].opt = 0x0;
+	valid_opt[14].Set("mcast", true, false);
+	valid_opt[15].Set("mcast-ttl", true, false);
+	valid_opt[15].opt = 0x0;
+	valid_opt[16].Set("mcast-if", true, false);
+	valid_opt[16].opt = 0x0;
+	valid_opt[17].Set("pace", true, false);
+	valid_opt[17].opt = 0x0;
+	valid_opt[18].Set("pipeline", false, true);
+	valid_opt[18].opt = 0x0;
+	valid_opt[19].Set("backoff", true, false);
+	valid_opt[19].opt = 0x0;
+	valid_opt[20].Set("replay", true, false);
+	valid_opt[20].opt = 0x0;
+	valid_opt[21].Set("replay-speed", true, false);
+	valid_opt[21].opt = 0x0;
+	valid_opt[22].Set("affinity", true, false);
+	valid_opt[22].opt = 0x0;
+	valid_opt[23].Set("rt-priority", false, true);
+	valid_opt[23].opt = 0x0;
+	valid_opt[24].Set("mlock", false, false);
+	valid_opt[24].opt = 0x0;
+	valid_opt[25].Set("metrics", true, false);
+	valid_opt[25].opt = 0x0;
+	valid_opt[26].Set("crate", true, false);
+	valid_opt[26].opt = 0x0;
+	valid_opt[27].Set("stats-to", true, false);
+	valid_opt[27].opt = 0x0;
+	valid_opt[28].Set("help", false, false);
+	valid_opt[29].Set("?", false, false);
+	if(!get_opt(argc, argv, valid_opt, 30, help)){ return 1; }
 
 	// Help
-	if(valid_opt[9].is_active){
+	if(valid_opt[28].is_active){
 		help();
 		return 0;
 	}	
@@ -88,7 +148,11 @@ int main(int argc, char *argv[]){
 	if(valid_opt[2].is_active){ poll.SetQuietMode(); }
 	if(valid_opt[3].is_active){ poll.SetWallClock(); }
 	if(valid_opt[4].is_active){ poll.SetShowRates(); }
-	if(valid_opt[5].is_active){ 
+	if(valid_opt[5].is_active && valid_opt[5].value == "auto"){ 
+		poll.SetAdaptiveThresh(true); 
+		adaptiveThresh = true;
+	}
+	else if(valid_opt[5].is_active){ 
 		threshPercent = atoi(valid_opt[5].value.c_str()); 
 		if(threshPercent <= 0){ 
 			std::cout << Display::WarningStr("Warning!") << " failed to set threshold level. Using default of 50%\n";
@@ -98,7 +162,60 @@ int main(int argc, char *argv[]){
 	if(valid_opt[6].is_active){ poll.SetZeroClocks(); }
 	if(valid_opt[7].is_active){ poll.SetDebugMode(); }
 	if(valid_opt[8].is_active){ poll.SetPacmanMode(); }
-	if(valid_opt[10].is_active){ return 0; }
+	if(valid_opt[9].is_active){ poll.SetShmUdpMode(); }
+	if(valid_opt[10].is_active){
+		int ringSize = atoi(valid_opt[10].value.c_str());
+		if(ringSize <= 0){ std::cout << Display::WarningStr("Warning!") << " failed to set shm ring size. Using default of " << SHM_SPILL_RING_SIZE << " MB\n"; }
+		else{ poll.SetShmRingSize(ringSize); }
+	}
+	if(valid_opt[11].is_active){
+		if(valid_opt[11].value == "drop"){ poll.SetShmOverrun(SHM_OVERRUN_DROP); }
+		else if(valid_opt[11].value == "lap"){ poll.SetShmOverrun(SHM_OVERRUN_LAP); }
+		else{ std::cout << Display::WarningStr("Warning!") << " unknown overrun mode '" << valid_opt[11].value << "'. Using lap\n"; }
+	}
+	if(valid_opt[12].is_active){ poll.SetStreamAddress(valid_opt[12].value); }
+	if(valid_opt[13].is_active){
+		if(valid_opt[13].value == "drop"){ poll.SetStreamPolicy(STREAM_SLOW_DROP); }
+		else if(valid_opt[13].value == "sample"){ poll.SetStreamPolicy(STREAM_SLOW_SAMPLE); }
+		else{ std::cout << Display::WarningStr("Warning!") << " unknown slow client mode '" << valid_opt[13].value << "'. Using sample\n"; }
+	}
+	if(valid_opt[14].is_active){ poll.SetMulticastGroup(valid_opt[14].value); }
+	if(valid_opt[15].is_active){
+		int ttl = atoi(valid_opt[15].value.c_str());
+		if(ttl < 0 || ttl > 255){ std::cout << Display::WarningStr("Warning!") << " invalid multicast ttl. Using default of " << MULTICAST_TTL << std::endl; }
+		else{ poll.SetMulticastTTL(ttl); }
+	}
+	if(valid_opt[16].is_active){ poll.SetMulticastIface(valid_opt[16].value); }
+	if(valid_opt[17].is_active && !poll.SetPacing(valid_opt[17].value)){
+		std::cout << Display::WarningStr("Warning!") << " invalid pacing rate '" << valid_opt[17].value << "'. Pacing is off\n";
+	}
+	if(valid_opt[18].is_active && !poll.SetPipeline(valid_opt[18].value)){
+		std::cout << Display::WarningStr("Warning!") << " invalid pipeline cpu list '" << valid_opt[18].value << "'. Threads are not pinned\n";
+		poll.SetPipeline();
+	}
+	if(valid_opt[19].is_active && !poll.SetBackoff(valid_opt[19].value)){
+		std::cout << Display::WarningStr("Warning!") << " invalid polling backoff '" << valid_opt[19].value << "'. Using the default\n";
+	}
+	if(valid_opt[20].is_active){ poll.SetReplayFile(valid_opt[20].value); }
+	if(valid_opt[21].is_active && !poll.SetReplaySpeed(valid_opt[21].value)){
+		std::cout << Display::WarningStr("Warning!") << " invalid replay speed '" << valid_opt[21].value << "'. Replaying at the recorded rate\n";
+	}
+	if(valid_opt[22].is_active && !poll.SetAffinity(valid_opt[22].value)){
+		std::cout << Display::WarningStr("Warning!") << " invalid cpu list '" << valid_opt[22].value << "'. Threads are not pinned\n";
+		poll.SetAffinity("");
+	}
+	if(valid_opt[23].is_active && !poll.SetRealtimePriority(valid_opt[23].value)){
+		std::cout << Display::WarningStr("Warning!") << " invalid SCHED_FIFO priority '" << valid_opt[23].value << "'. Using the standard scheduler\n";
+	}
+	if(valid_opt[24].is_active){ poll.SetLockMemory(); }
+	if(valid_opt[25].is_active){ poll.SetMetricsAddress(valid_opt[25].value); }
+	if(valid_opt[26].is_active){
+		int crate = atoi(valid_opt[26].value.c_str());
+		if(crate < 0 || crate > 65535){ std::cout << Display::WarningStr("Warning!") << " invalid crate ID '" << valid_opt[26].value << "'. Using crate 0\n"; }
+		else{ poll.SetStatsCrate(crate); }
+	}
+	if(valid_opt[27].is_active){ poll.SetStatsDestination(valid_opt[27].value); }
+	if(valid_opt[29].is_active){ return 0; }
 
 	if(!poll.Initialize()){ return 1; }
 
@@ -125,7 +242,8 @@ int main(int argc, char *argv[]){
 	std::cout << " ==  ==  ==  ==  == \n\n"; 
 	
 	poll.SetThreshWords(EXTERNAL_FIFO_LENGTH * threshPercent / 100.0);
-	std::cout << "Using FIFO threshold of " << threshPercent << "% (" << poll.GetThreshWords() << "/" << EXTERNAL_FIFO_LENGTH << " words).\n";
+	if(adaptiveThresh){ std::cout << "Using adaptive FIFO threshold (type 'thresh' for details).\n"; }
+	else{ std::cout << "Using FIFO threshold of " << threshPercent << "% (" << poll.GetThreshWords() << "/" << EXTERNAL_FIFO_LENGTH << " words).\n"; }
 	
 #ifdef PIF_REVA
 	std::cout << "Using Pixie16 revision A\n";
@@ -33,7 +33,21 @@
 
 #include "poll2_core.h"
 #include "poll2_socket.h"
+#include "poll2_spill.h"
+#include "poll2_pac.h"
+#include "poll2_shm.h"
+#include "poll2_stream.h"
+#include "poll2_pacer.h"
+#include "poll2_pipeline.h"
+#include "poll2_staging.h"
+#include "poll2_fifo.h"
 #include "poll2_stats.h"
+#include "poll2_replay.h"
+#include "poll2_trace.h"
+#include "poll2_reduce.h"
+#include "poll2_rt.h"
+#include "poll2_metrics.h"
+#include "poll2_statsproto.h"
 
 #include "CTerminal.h"
 
@@ -45,19 +59,12 @@
 #include "MCA_ROOT.h"
 #include "MCA_DAMM.h"
 
-// Values associated with the minimum timing between pixie calls (in us)
-// Adjusted to help alleviate the issue with data corruption
-#define POLL_TRIES 100
+// Longest time run control sleeps while idle (in seconds)
+#define POLL_IDLE_SLEEP 0.1
 
 // 4 GB. Maximum allowable .ldf file size in bytes
 #define MAX_FILE_SIZE 4294967296ll
 
-// Length of shm packet header (in bytes)
-#define PKT_HEAD_LEN 8
-
-// Maximum shm packet size (in bytes)
-#define MAX_PKT_DATA (MAX_ORPH_DATA - PKT_HEAD_LEN)
-
 std::vector<std::string> chan_params = {"TRIGGER_RISETIME", "TRIGGER_FLATTOP", "TRIGGER_THRESHOLD", "ENERGY_RISETIME", "ENERGY_FLATTOP", "TAU", "TRACE_LENGTH",
 									 "TRACE_DELAY", "VOFFSET", "XDT", "BASELINE_PERCENT", "EMIN", "BINFACTOR", "CHANNEL_CSRA", "CHANNEL_CSRB", "BLCUT",
 									 "ExternDelayLen", "ExtTrigStretch", "ChanTrigStretch", "FtrigoutDelay", "FASTTRIGBACKLEN"};
@@ -68,12 +75,12 @@ std::vector<std::string> mod_params = {"MODULE_CSRA", "MODULE_CSRB", "MODULE_FOR
 const std::vector<std::string> Poll::runControlCommands_ ({"run", "stop", 
 	"startacq", "startvme", "stopacq", "stopvme", "acq", "shm", "spill", "hup", 
 	"prefix", "fdir", "title", "runnum", "oform", "close", "reboot", "stats", 
-	"mca"});
+	"mca", "replay", "reliable"});
 const std::vector<std::string> Poll::paramControlCommands_ ({"dump", "pread", 
 	"pmread", "pwrite", "pmwrite", "adjust_offsets", "find_tau", "toggle", 
 	"toggle_bit", "csr_test", "bit_test"});
 const std::vector<std::string> Poll::pollStatusCommands_ ({"status", "thresh", 
-	"debug", "quiet",	"quit", "help", "version"});
+	"pace", "trace", "reduce", "history", "debug", "quiet",	"quit", "help", "version"});
 
 MCA_args::MCA_args(){ 
 	mca = NULL;
@@ -176,7 +183,22 @@ Poll::Poll(){
 	zero_clocks = false;
 	debug_mode = false;
 	shm_mode = false;
+	shm_udp_mode = false;
+	shm_ring_size = SHM_SPILL_RING_SIZE;
+	shm_overrun = SHM_OVERRUN_LAP;
+	stream_policy = STREAM_SLOW_SAMPLE;
+	stats_crate = 0;
+	mcast_ttl = MULTICAST_TTL;
+	pace_auto = false;
+	last_bcast_time = 0.0;
 	pac_mode = false;
+	use_pipeline = false;
+	scalers_due = false;
+	bytes_written = 0;
+	spills_written = 0;
+	file_rollovers = 0;
+	file_size = 0;
+	file_run = 0;
 	init = false;
 
 	// Options relating to output data file
@@ -189,10 +211,30 @@ Poll::Poll(){
 	current_file_num = 0;
 	filename_prefix = "run";
 	
-	udp_sequence = 0; 
-	total_spill_chunks = 0; 
-	
+	pacer = new TokenBucket();
 	client = new Client();
+	client->SetPacer(pacer);
+	spill_sender = new SpillSender(client);
+	pac_sender = new PacSender(client);
+	shm_ring = new ShmWriter();
+	stream_server = new StreamServer();
+	metrics_server = new MetricsServer();
+	pipeline = new SpillPipeline();
+	fifo_ctrl = new FifoController();
+	backoff = new PollBackoff();
+	replay = new SpillReplay();
+	tracer = new SpillTracer();
+	reducer = new TraceReducer();
+	rt_config = new RealtimeConfig();
+	pipeline->SetThreadInit([this](size_t stage, int cpu){
+		const char *names[3] = {"reader", "validator", "sink"};
+		rt_config->Apply(names[stage], cpu);
+	});
+	raw_buffer = NULL;
+	spill_buffer = NULL;
+	buffer_pool = new SpillBufferPool();
+	buffer_words = 0;
+	raw_stride = EXTERNAL_FIFO_LENGTH;
 }
 
 Poll::~Poll(){
@@ -208,17 +250,21 @@ bool Poll::Initialize(){
 	if(debug_mode){ 
 		std::cout << sys_message_head << "Setting debug mode\n";
 		output_file.SetDebugMode(); 
+		spill_sender->SetDebugMode();
+		pac_sender->SetDebugMode();
 	}
 
-	// Initialize the pixie interface and boot
+	// Initialize the pixie interface and boot. A replay only needs the slots, which the data is checked against.
 	pif->GetSlots();
-	if(!pif->Init()){ return false; }
+	if(replay_file.empty()){
+		if(!pif->Init()){ return false; }
 
-	if(boot_fast){
-		if(!pif->Boot(PixieInterface::DownloadParameters | PixieInterface::SetDAC | PixieInterface::ProgramFPGA)){ return false; } 
-	}
-	else{
-		if(!pif->Boot(PixieInterface::BootAll)){ return false; }
+		if(boot_fast){
+			if(!pif->Boot(PixieInterface::DownloadParameters | PixieInterface::SetDAC | PixieInterface::ProgramFPGA)){ return false; } 
+		}
+		else{
+			if(!pif->Boot(PixieInterface::BootAll)){ return false; }
+		}
 	}
 
 	// Check the scheduler
@@ -228,13 +274,35 @@ bool Poll::Initialize(){
 	else if(startScheduler == SCHED_OTHER){ std::cout << Display::InfoStr("STANDARD") << std::endl; }
 	else{ std::cout << Display::WarningStr("UNEXPECTED") << std::endl; }
 
-	if(!synch_mods()){ return false; }
+	// Check the cpus, priority and memory locking asked for. Without the pipeline only the reader is pinned.
+	int rtCpus[3] = {pipeline->GetAffinity(0), pipeline->GetAffinity(1), pipeline->GetAffinity(2)};
+	rt_config->Check(rtCpus, (use_pipeline ? 3 : 1));
+
+	if(replay_file.empty() && !synch_mods()){ return false; }
 
 	// Allocate memory buffers for FIFO
 	n_cards = pif->GetNumberCards();
 	
-	// Two extra words to store size of data block and module number
-	std::cout << "\nAllocating memory to store FIFO data (" << sizeof(word_t) * (EXTERNAL_FIFO_LENGTH + 2) * n_cards / 1024 << " kB)" << std::endl;
+	// Two extra words to store size of data block and module number, plus room for a partial event
+	buffer_words = (EXTERNAL_FIFO_LENGTH + 2 + maxEventSize) * n_cards;
+	// A replayed block may hold a carried over partial event as well as a full FIFO read
+	raw_stride = (replay_file.empty() ? EXTERNAL_FIFO_LENGTH : buffer_words / n_cards);
+	if(use_pipeline){
+		std::cout << "\nAllocating memory to store FIFO data (" << PIPELINE_DEFAULT_BUFFERS << " x 2 x " << sizeof(word_t) * buffer_words / 1024 << " kB)" << std::endl;
+	}
+	else{
+		std::cout << "\nAllocating memory to store FIFO data (2 x " << sizeof(word_t) * buffer_words / 1024 << " kB)" << std::endl;
+		if(!alloc_serial_buffers()){ return false; }
+	}
+
+	if(!replay_file.empty()){
+		Display::LeaderPrint(std::string("Opening replay file ") + replay_file);
+		if(replay->Open(replay_file, buffer_words)){ std::cout << Display::OkayStr() << std::endl; }
+		else{
+			std::cout << Display::ErrorStr("[FAILED]") << std::endl;
+			return false;
+		}
+	}
 	
 	if(pac_mode){ 
 		client->Init("127.0.0.1", 45080);
@@ -243,21 +311,71 @@ bool Poll::Initialize(){
 		server->Init(45086, 1); // Set the timeout to 1 second. 
 	}
 	else{ 
-		// This is done to avoid tying up udptoipc's port
-		client->Init("127.0.0.1", 5555);
+		if(!mcast_group.empty()){ // Send each shm spill once to every receiver in the group
+			Display::LeaderPrint(std::string("Sending shm spills to multicast group ") + mcast_group);
+			if(client->Init(mcast_group.c_str(), 5555) && client->IsMulticast() && client->SetMulticast(mcast_ttl, (mcast_iface.empty() ? NULL : mcast_iface.c_str()))){
+				std::cout << Display::OkayStr() << std::endl;
+				shm_udp_mode = true;
+			}
+			else{
+				std::cout << Display::WarningStr("[FAILED]") << std::endl;
+				return false;
+			}
+		}
+		else{
+			// This is done to avoid tying up udptoipc's port
+			client->Init("127.0.0.1", 5555);
+		}
+
+		if(!shm_udp_mode){
+			Display::LeaderPrint(std::string("Creating shm ring ") + SHM_SPILL_RING);
+			if(shm_ring->Init(SHM_SPILL_RING, shm_ring_size * 1048576, shm_overrun)){ 
+				std::cout << Display::OkayStr("[" + humanReadable(shm_ring->GetCapacity()) + "]") << std::endl; 
+			}
+			else{ // Fall back on the old UDP transport
+				std::cout << Display::WarningStr("[FAILED]") << std::endl;
+				std::cout << Display::WarningStr("Warning!") << " Sending shm spills over UDP port 5555 instead.\n";
+				shm_udp_mode = true;
+			}
+		}
+
+		if(!stream_address.empty()){
+			Display::LeaderPrint(std::string("Starting stream server on ") + stream_address);
+			stream_server->SetPolicy(stream_policy);
+			if(stream_server->Init(stream_address)){ std::cout << Display::OkayStr() << std::endl; }
+			else{ std::cout << Display::WarningStr("[FAILED]") << std::endl; }
+		}
 	}
 
-	partialEvent = new std::vector<word_t>[n_cards];
+	// A partial event is never longer than the largest event, so the rings never grow during a run
+	partialEvent = new StagingRing[n_cards];
+	for(unsigned short mod = 0; mod < n_cards; mod++){ partialEvent[mod].Init(maxEventSize); }
+
+	fifo_ctrl->Init(n_cards, EXTERNAL_FIFO_LENGTH, MIN_FIFO_READ);
+	reducer->Init(n_cards, NUM_CHAN_PER_MOD);
 
 	//Build the list of commands
 	commands_.insert(commands_.begin(), pollStatusCommands_.begin(), pollStatusCommands_.end());
-	commands_.insert(commands_.begin(), paramControlCommands_.begin(), paramControlCommands_.end());
+	if(!replay->IsOpen()){ commands_.insert(commands_.begin(), paramControlCommands_.begin(), paramControlCommands_.end()); }
 	if (!pac_mode) {
 		commands_.insert(commands_.begin(), runControlCommands_.begin(), runControlCommands_.end());
 	}
 
 	statsHandler = new StatsHandler(n_cards);
 	statsHandler->SetDumpInterval(statsInterval_);
+	statsHandler->SetCrateID(stats_crate);
+	if(!stats_destination.empty()){
+		Display::LeaderPrint(std::string("Sending stats to ") + stats_destination);
+		if(statsHandler->SetDestination(stats_destination)){ std::cout << Display::OkayStr() << std::endl; }
+		else{ std::cout << Display::WarningStr("[FAILED]") << std::endl; }
+	}
+
+	// The metrics server reads the stats, so it is started last
+	if(!metrics_address.empty()){
+		Display::LeaderPrint(std::string("Starting metrics server on ") + metrics_address);
+		if(metrics_server->Init(metrics_address, [this](MetricsPage &page){ write_metrics(page); })){ std::cout << Display::OkayStr() << std::endl; }
+		else{ std::cout << Display::WarningStr("[FAILED]") << std::endl; }
+	}
 	
 	return init = true;
 }
@@ -265,14 +383,23 @@ bool Poll::Initialize(){
 bool Poll::Close(){
 	if(!init){ return false; }
 	
-	if(!pac_mode){ client->SendMessage((char *)"$KILL_SOCKET", 13); }
+	if(!pac_mode){ broadcast_flag("$KILL_SOCKET"); }
 	else{ server->Close(); }
 	client->Close();
+	shm_ring->Close();
+	pipeline->Stop();
+	stream_server->Close();
+	metrics_server->Close();
 	
 	// Just to be safe
 	if(output_file.IsOpen()){ close_output_file(); }
 
+	// Tells the monitors that this crate has stopped
+	delete statsHandler;
+	statsHandler = NULL;
+
 	delete pif;
+	delete[] partialEvent;
 	
 	init = false;
 	
@@ -291,11 +418,12 @@ bool Poll::close_output_file(bool continueRun /*=false*/){
 		}
 
 		std::cout << sys_message_head << "Closing output file.\n";
-		if(!pac_mode){ client->SendMessage((char *)"$CLOSE_FILE", 12); }
+		if(!pac_mode){ broadcast_flag("$CLOSE_FILE"); }
 		output_file.CloseFile();
 
 		//We call get next file name to update the run number.
 		if (!continueRun) output_file.GetNextFileName(next_run_num,filename_prefix,output_directory);
+		publish_file_info();
 
 		return true;
 	}
@@ -324,7 +452,7 @@ bool Poll::open_output_file(bool continueRun){
 		statsHandler->Dump();
 
 		std::cout << sys_message_head << "Opening output file '" << output_file.GetCurrentFilename() << "'.\n";
-		if(!pac_mode){ client->SendMessage((char *)"$OPEN_FILE", 12); }
+		if(!pac_mode){ broadcast_flag("$OPEN_FILE"); }
 	}
 	else{ 
 		std::cout << sys_message_head << "Warning! A file is already open. Close the current file before opening a new one.\n"; 
@@ -332,10 +460,28 @@ bool Poll::open_output_file(bool continueRun){
 	}
 
 	file_open = true;
+	publish_file_info();
 	
 	return true;
 }
 
+/** The sink thread writes and rolls over the output file while the RunControl
+  * thread draws the status bar, so the status bar never touches output_file
+  * itself and reads this copy instead.
+  */
+void Poll::publish_file_info(){
+	std::lock_guard<std::mutex> lock(file_info_lock);
+	if(output_file.IsOpen()){
+		file_name = output_file.GetCurrentFilename();
+		file_run = output_file.GetRunNumber();
+		file_size = output_file.GetFilesize();
+	}
+	else{
+		file_name = "";
+		file_size = 0;
+	}
+}
+
 bool Poll::synch_mods(){
 	static bool firstTime = true;
 	static char synchString[] = "IN_SYNCH";
@@ -360,6 +506,17 @@ bool Poll::synch_mods(){
 	return !hadError;
 }
 
+bool Poll::alloc_serial_buffers(){
+	if(raw_buffer){ return true; }
+	if(!buffer_pool->Init(2, buffer_words)){
+		std::cout << Display::ErrorStr() << " Failed to allocate the FIFO buffers!\n";
+		return false;
+	}
+	raw_buffer = new SpillBuffer(buffer_pool->Get(), buffer_words, n_cards, NUM_CHAN_PER_MOD);
+	spill_buffer = new SpillBuffer(buffer_pool->Get(), buffer_words, n_cards, NUM_CHAN_PER_MOD);
+	return true;
+}
+
 int Poll::write_data(word_t *data, unsigned int nWords){
 	// Open an output file if needed
 	if(!output_file.IsOpen()){
@@ -376,150 +533,121 @@ int Poll::write_data(word_t *data, unsigned int nWords){
 		std::cout << sys_message_head << "Opening new file.\n";
 		close_output_file(true);
 		open_output_file(true);
+		file_rollovers++;
 	}
 
 	if (!is_quiet) std::cout << "Writing " << nWords << " words.\n";
 
-	return output_file.Write((char*)data, nWords);
+	int retval = output_file.Write((char*)data, nWords);
+	if (retval >= 0) {
+		bytes_written += nWords * sizeof(word_t);
+		spills_written++;
+	}
+	file_size = output_file.GetFilesize();
+	return retval;
 }
 
 void Poll::broadcast_data(word_t *data, unsigned int nWords) {
-	if(pac_mode){ // Broadcast the spill onto the network using the classic pacman shm style
-		// Maximum size of the shared memory buffer
-		const int maxShmSizeL = 4050; // in pixie words
-		const int maxShmSize  = maxShmSizeL * sizeof(word_t); // in bytes
-	
-		unsigned int nBufs = nWords / maxShmSizeL;
-		unsigned int wordsLeft = nWords % maxShmSizeL;
-
-		unsigned int totalBufs = nBufs + 1 + ((wordsLeft != 0) ? 1 : 0);
+	// Queue the spill for any stream subscribers. Slow subscribers never hold up readout.
+	if(stream_server->IsInit() && !stream_server->Publish(SHM_RECORD_SPILL, data, nWords*sizeof(word_t)) && debug_mode){
+		std::cout << " debug: Stream server skipped spill of " << nWords << " words for slow subscribers\n";
+	}
 
-		word_t *pWrite = (word_t *)AcqBuf.Data;
-		
-		// Chop the data and send it through the network
-		for(size_t buf=0; buf < nBufs; buf++){
-			// Get a long sized pointer to the data block for writing
-			// put a header on each shared memory buffer
-			AcqBuf.BufLen = (maxShmSizeL + 3) * sizeof(word_t);
-			pWrite[0] = AcqBuf.BufLen; // size
-			pWrite[1] = totalBufs; // number of buffers we expect
-			pWrite[2] = buf;
-			memcpy(&pWrite[3], &data[buf * maxShmSizeL], maxShmSize);
-
-			broadcast_pac_data();
-			usleep(1);
-		}
-
-		// Send the last fragment (if there is any)
-		if (wordsLeft != 0) {
-			AcqBuf.BufLen = (wordsLeft + 3) * sizeof(word_t);
-			pWrite[0] = AcqBuf.BufLen;
-			pWrite[1] = totalBufs;
-			pWrite[2] = nBufs;
-			memcpy(&pWrite[3], &data[nBufs * maxShmSizeL], 
-			wordsLeft * sizeof(word_t) );
-
-			broadcast_pac_data();
-			usleep(1);
-		}
-
-		// Send a buffer to say that we are done
-		AcqBuf.BufLen = 5 * sizeof(word_t);
-		pWrite[0] = AcqBuf.BufLen;
-		pWrite[1] = totalBufs;
-		pWrite[2] = totalBufs - 1;
-		
-		// Pacman looks for the following data
-		pWrite[3] = 0x2; 
-		pWrite[4] = 0x270f; // vsn 9999
+	// Spread spills sent over UDP across the time between spills
+	if(pace_auto && (pac_mode || (shm_mode && shm_udp_mode))){ auto_pace(nWords*sizeof(word_t)); }
 
-		broadcast_pac_data();  
+	if(pac_mode){ // Broadcast the spill onto the network using the classic pacman shm style
+		if(!pac_sender->Send(data, nWords) && debug_mode){ std::cout << " debug: Failed to broadcast spill of " << nWords << " words\n"; }
 	}
-	else if(shm_mode){ // Broadcast the spill onto the network using the new shm style
-		char shm_data[40008]; // 40 kB packets of data
-		char *data_l = (char *)data; // Local pointer to the data array
-		unsigned int num_net_chunks = nWords / 10000;
-		unsigned int num_net_remain = nWords % 10000;
-		if(num_net_remain != 0){ num_net_chunks++; }
-		
-		unsigned int net_chunk = 1;
-		unsigned int words_bcast = 0;
-		if(debug_mode){ std::cout << " debug: Splitting " << nWords << " words into network spill of " << num_net_chunks << " chunks (fragment = " << num_net_remain << " words)\n"; }
-		
-		while(words_bcast < nWords){
-			if(nWords - words_bcast > 10000){ // Broadcast the spill chunks
-				memcpy(&shm_data[0], (char *)&net_chunk, 4);
-				memcpy(&shm_data[4], (char *)&num_net_chunks, 4);
-				memcpy(&shm_data[8], &data_l[words_bcast*4], 40000);
-				client->SendMessage(shm_data, 40008);
-				words_bcast += 10000;
-			}
-			else{ // Broadcast the spill remainder
-				memcpy(&shm_data[0], (char *)&net_chunk, 4);
-				memcpy(&shm_data[4], (char *)&num_net_chunks, 4);
-				memcpy(&shm_data[8], &data_l[words_bcast*4], (nWords-words_bcast)*4);
-				client->SendMessage(shm_data, (nWords - words_bcast + 2)*4);
-				words_bcast += nWords-words_bcast;
-			}
-			net_chunk++;
+	else if(shm_mode && !shm_udp_mode){ // Publish the spill to the shared memory ring
+		if(!shm_ring->Publish(SHM_RECORD_SPILL, data, nWords*sizeof(word_t)) && debug_mode){ 
+			std::cout << " debug: Dropped spill of " << nWords << " words from shm ring (" << shm_ring->GetDropped() << " dropped)\n"; 
 		}
 	}
+	else if(shm_mode){ // Broadcast the spill onto the network using the new shm style
+		spill_sender->ServiceNacks();
+		if(!spill_sender->Send(data, nWords) && debug_mode){ std::cout << " debug: Failed to broadcast spill of " << nWords << " words\n"; }
+	}
 	else{ // Broadcast a spill notification to the network
 		output_file.SendPacket(client);
 	}
 }
 
-void Poll::broadcast_pac_data(){
-	const int BufEnd=0xFFFFFFFF;
-	short int status, cont_pkt;
-	char *bufptr;
-	int size,bytes;
+void Poll::auto_pace(size_t nBytes){
+	double now = TokenBucket::Now();
+	if(last_bcast_time > 0.0 && now > last_bcast_time){
+		// Leave some of the interval free in case the next spill comes early
+		pacer->SetRate(nBytes / ((now - last_bcast_time) * PACE_AUTO_FILL), pacer->GetBurst());
+	}
+	last_bcast_time = now;
+}
 
-	size = AcqBuf.BufLen;
-	memcpy(AcqBuf.Data+size, &BufEnd, 4);
-	size += 4;
-	if(size % 2 != 0){ 
-		memcpy(AcqBuf.Data+size,&BufEnd,2);
-		size+=2;
+bool Poll::SetPacing(const std::string &rate_, const std::string &burst_/*=""*/){
+	double burst = pacer->GetBurst();
+	if(!burst_.empty()){
+		burst = atof(burst_.c_str()) * 1024;
+		if(burst <= 0.0){ return false; }
 	}
 
-	if(size <= MAX_PKT_DATA){ 
-		AcqBuf.Sequence = udp_sequence++;
-		AcqBuf.DataSize = size + 8;    
-		AcqBuf.TotalEvents = ++total_spill_chunks;
-		AcqBuf.Events = 1;
-		AcqBuf.Cont=0; 
+	if(rate_ == "off"){
+		pace_auto = false;
+		pacer->SetRate(0.0, burst);
+	}
+	else if(rate_ == "auto"){
+		// No limit until the time between two spills is known
+		pace_auto = true;
+		last_bcast_time = 0.0;
+		pacer->SetRate(0.0, burst);
+	}
+	else{
+		double rate = atof(rate_.c_str()) * 1E6;
+		if(rate <= 0.0){ return false; }
+		pace_auto = false;
+		pacer->SetRate(rate, burst);
+	}
 
-		status = client->SendMessage((char *)&AcqBuf, size + PKT_HEAD_LEN + 8);
-		if(status < 0 && debug_mode){ perror(" debug: broadcast_data - error at SendMessage"); }
+	return true;
+}
 
-		return;
-	}
+void Poll::SetThreshWords(const size_t &thresh_){
+	threshWords = thresh_;
+	fifo_ctrl->SetThreshold(thresh_);
+}
 
-	cont_pkt = 1;
-	bufptr =(char *)&AcqBuf;
-	total_spill_chunks++;
-	do{
-		if(size > MAX_PKT_DATA){ 
-			bytes = MAX_PKT_DATA;
-			*((unsigned short *)(bufptr+PKT_HEAD_LEN+4)) = 0;
-		} 
-		else{
-			bytes = size;
-			*((unsigned short *)(bufptr+PKT_HEAD_LEN+4)) = 1;
-		}
-		*((int *)(bufptr+PKT_HEAD_LEN)) = total_spill_chunks;
-		*((unsigned short *)(bufptr+PKT_HEAD_LEN+6)) = cont_pkt;
-		*((unsigned int *)(bufptr)) = udp_sequence++;
-		*((int *)(bufptr+4)) = bytes+8;
+void Poll::SetAdaptiveThresh(bool state_, double maxLatency_/*=-1.0*/, double margin_/*=-1.0*/){
+	fifo_ctrl->SetAdaptive(state_, maxLatency_, margin_);
+}
 
-		status = client->SendMessage((char *)bufptr, bytes + PKT_HEAD_LEN + 8);
-		if(status < 0 && debug_mode){ perror(" debug: broadcast_data - error at SendMessage"); }
+bool Poll::SetBackoff(const std::string &config_){
+	return backoff->Configure(config_);
+}
+
+bool Poll::SetPipeline(const std::string &cpus_/*=""*/){
+	if(!pipeline->SetAffinity(cpus_)){ return false; }
+	use_pipeline = true;
+	return true;
+}
+
+bool Poll::SetAffinity(const std::string &cpus_){
+	return pipeline->SetAffinity(cpus_);
+}
+
+bool Poll::SetRealtimePriority(const std::string &priority_){
+	return rt_config->SetPriority(priority_);
+}
+
+void Poll::SetLockMemory(bool state_/*=true*/){
+	rt_config->SetLockMemory(state_);
+}
 
-		cont_pkt++;
-		bufptr += bytes;
-		size = size - bytes;
-	}while(size > 0);
+bool Poll::SetReplaySpeed(const std::string &speed_){
+	return replay->SetSpeed(speed_);
+}
+
+void Poll::broadcast_flag(const char *flag){
+	client->SendMessage((char *)flag, strlen(flag) + 1);
+	if(shm_ring->IsInit()){ shm_ring->Publish(SHM_RECORD_FLAG, flag, strlen(flag) + 1); }
+	if(stream_server->IsInit()){ stream_server->Publish(SHM_RECORD_FLAG, flag, strlen(flag) + 1); }
 }
 
 /* Print help dialogue for POLL options. */
@@ -531,6 +659,7 @@ void Poll::help(){
 		std::cout << "   startacq (startvme) - Start data acquisition\n";
 		std::cout << "   stopacq (stopvme)   - Stop data acquisition\n";
 		std::cout << "   acq (shm)           - Run in \"shared-memory\" mode\n";
+		std::cout << "   reliable [spills]   - Toggle retransmission of lost shm chunks over UDP (default window=" << SHM_SEND_WINDOW << " spills)\n";
 		std::cout << "   spill (hup)         - Force dump of current spill\n";
 		std::cout << "   prefix [name]       - Set the output filename prefix (default='run_#.ldf')\n";
 		std::cout << "   fdir [path]         - Set the output file directory (default='./')\n";
@@ -541,6 +670,7 @@ void Poll::help(){
 		std::cout << "   reboot              - Reboot PIXIE crate\n";
 		std::cout << "   stats [time]        - Set the time delay between statistics dumps (default=-1)\n";
 		std::cout << "   mca [root|damm] [time] [filename] - Use MCA to record data for debugging purposes\n";
+		std::cout << "   replay [speed|max]  - Display replay progress or set the replay speed (replay mode only)\n";
 	}
 	std::cout << "   dump [filename]                   - Dump pixie settings to file (default='Fallback.set')\n";
 	std::cout << "   pread [mod] [chan] [param]        - Read parameters from individual PIXIE channels\n";
@@ -554,7 +684,11 @@ void Poll::help(){
 	std::cout << "   csr_test [number]                 - Output the CSRA parameters for a given integer\n";
 	std::cout << "   bit_test [num_bits] [number]      - Display active bits in a given integer up to 32 bits long\n";
 	std::cout << "   status              - Display system status information\n";
-	std::cout << "   thresh              - Display current polling threshold\n";
+	std::cout << "   thresh [percent|auto] [ms] [margin%] - Display or set the polling threshold, auto reads within ms (default=" << FIFO_DEFAULT_LATENCY*1000 << ") keeping margin% of the FIFO free (default=" << FIFO_DEFAULT_MARGIN*100 << ")\n";
+	std::cout << "   pace [MB/s|auto|off] [burst kB] - Limit the rate of spills sent over UDP (default=off, burst=" << PACE_DEFAULT_BURST/1024 << " kB)\n";
+	std::cout << "   reduce [mod] [chan] [cut|roi|decimate|off] [values] - Display or set the reduction of traces before they are written, mod and chan may be * (see 'reduce help')\n";
+	std::cout << "   trace [dump [file]|clear] - Display the time spills spend in each readout stage, or dump the last " << TRACE_RING_SIZE << " as Chrome trace JSON (default='poll2_trace.json')\n";
+	std::cout << "   history [events|icr|ocr|data] [mod] [intervals] - Display the min, mean, max and p95 of a rate over the last stats intervals (default=data of every module)\n";
 	std::cout << "   debug               - Toggle debug mode flag (default=false)\n";
 	std::cout << "   quiet               - Toggle quiet mode flag (default=false)\n";
 	std::cout << "   quit                - Close the program\n";
@@ -711,6 +845,34 @@ void Poll::show_status(){
 	std::cout << "   Acq running     - " << yesno(acq_running) << std::endl;
 	if(!pac_mode){
 		std::cout << "   Shared memory   - " << yesno(shm_mode) << std::endl;
+		if(client->IsMulticast()){ std::cout << "   Multicast       - " << mcast_group << " (ttl " << mcast_ttl << ", interface " << (mcast_iface.empty() ? "default" : mcast_iface) << ")\n"; }
+		if(shm_ring->IsInit()){
+			std::cout << "   Shm ring        - " << shm_ring->GetNumReaders() << " readers, " << shm_ring->GetPublished() << " published, " << shm_ring->GetDropped() << " dropped (";
+			std::cout << (shm_ring->GetPolicy() == SHM_OVERRUN_DROP ? "drop" : "lap") << " on overrun)\n";
+		}
+		std::cout << "   Reliable shm    - " << yesno(spill_sender->GetReliable());
+		if(spill_sender->GetReliable()){ std::cout << " (" << spill_sender->GetChunksResent() << " of " << spill_sender->GetChunksSent() << " chunks resent)"; }
+		std::cout << std::endl;
+		if(stream_server->IsInit()){
+			std::vector<StreamClientInfo> subscribers;
+			stream_server->GetClients(subscribers);
+			std::cout << "   Stream server   - " << stream_server->GetAddress() << ", " << subscribers.size() << " subscribers, " << stream_server->GetSkipped() << " spills skipped, ";
+			std::cout << stream_server->GetDropped() << " dropped (" << (stream_server->GetPolicy() == STREAM_SLOW_DROP ? "drop" : "sample") << " slow clients)\n";
+			for(std::vector<StreamClientInfo>::iterator iter = subscribers.begin(); iter != subscribers.end(); iter++){
+				std::cout << "    " << iter->address << " - lag " << humanReadable(iter->queued_bytes) << " (" << iter->queued_records << " records, max " << humanReadable(iter->max_queued_bytes);
+				std::cout << "), " << iter->records_sent << " sent, " << iter->records_skipped << " skipped";
+				if(iter->filtered){ std::cout << ", modules 0x" << std::hex << iter->module_mask << std::dec << " (" << humanReadable(iter->bytes_filtered) << " filtered)"; }
+				std::cout << std::endl;
+			}
+		}
+		std::cout << "   Stats packets   - crate " << statsHandler->GetCrateID() << " to " << statsHandler->GetDestination() << " and shm, ";
+		std::cout << humanReadable(statsHandler->GetKeyBytes()) << " key, " << humanReadable(statsHandler->GetDeltaBytes()) << " delta sent\n";
+		std::cout << "   Metrics         - ";
+		if(metrics_server->IsInit()){
+			std::cout << metrics_server->GetAddress() << ", " << metrics_server->GetRequests() << " requests, " << metrics_server->GetRenders() << " pages built, ";
+			std::cout << metrics_server->GetRejected() << " rejected\n";
+		}
+		else{ std::cout << "off\n"; }
 		std::cout << "   Write to disk   - " << yesno(record_data) << std::endl;
 		std::cout << "   File open       - " << yesno(output_file.IsOpen()) << std::endl;
 		std::cout << "   Rebooting       - " << yesno(do_reboot) << std::endl;
@@ -718,6 +880,49 @@ void Poll::show_status(){
 		std::cout << "   Do MCA run      - " << yesno(do_MCA_run) << std::endl;	
 	}
 	else{ std::cout << "   Pacman mode     - " << yesno(pac_mode) << std::endl; }
+	std::cout << "   UDP pacing      - ";
+	if(pacer->IsActive()){
+		std::cout << pacer->GetRate()/1E6 << " MB/s" << (pace_auto ? " (auto)" : "") << ", burst " << pacer->GetBurst()/1024 << " kB, ";
+		std::cout << pacer->GetWaits() << " waits (" << pacer->GetWaitTime() << " s)\n";
+	}
+	else{ std::cout << (pace_auto ? "auto (waiting for spills)" : "off") << std::endl; }
+	std::cout << "   Pipeline        - ";
+	if(pipeline->IsRunning()){
+		std::cout << pipeline->GetNumBuffers() << " buffers, depth " << pipeline->GetDepth() << " (max " << pipeline->GetMaxDepth() << "), " << pipeline->GetStalls() << " reader stalls, ";
+		std::cout << pipeline->GetValidatorWaits() << " validator waits, cpus";
+		for(size_t stage = 0; stage < 3; stage++){
+			std::cout << (stage == 0 ? " " : "/");
+			if(pipeline->GetAffinity(stage) >= 0){ std::cout << pipeline->GetAffinity(stage); }
+			else{ std::cout << "any"; }
+		}
+		std::cout << std::endl;
+	}
+	else{ std::cout << (use_pipeline ? "starting" : "off") << std::endl; }
+	SpillBufferPool *pool = (use_pipeline ? pipeline->GetPool() : buffer_pool);
+	std::cout << "   Spill buffers   - ";
+	if(pool->GetNumBlocks() > 0){
+		std::cout << pool->GetNumBlocks() << " x " << humanReadable(pool->GetBlockWords() * sizeof(word_t)) << " on " << HugePageRegion::BackingName(pool->GetBacking());
+		std::cout << " pages, aligned to " << pool->GetAlignment() << " bytes\n";
+	}
+	else{ std::cout << "not allocated\n"; }
+	std::vector<RealtimeThread> rtThreads;
+	rt_config->GetThreads(rtThreads);
+	std::cout << "   Scheduling      - ";
+	for(std::vector<RealtimeThread>::iterator iter = rtThreads.begin(); iter != rtThreads.end(); iter++){
+		std::cout << (iter == rtThreads.begin() ? "" : ", ") << iter->name << " " << RealtimeConfig::PolicyName(iter->policy);
+		if(iter->policy == SCHED_FIFO || iter->policy == SCHED_RR){ std::cout << " " << iter->priority; }
+		if(iter->pinned){ std::cout << " on cpu " << iter->cpu; }
+		else if(iter->cpu >= 0){ std::cout << " (not pinned to cpu " << iter->cpu << ")"; }
+	}
+	std::cout << (rtThreads.empty() ? "" : ", ") << "memory " << (rt_config->IsMemoryLocked() ? "locked" : "not locked");
+	if(rt_config->IsMemoryLocked()){ std::cout << " (" << humanReadable(RealtimeConfig::GetLockedBytes()) << ")"; }
+	std::cout << std::endl;
+	std::cout << "   Polling         - " << PollBackoff::PhaseName(backoff->GetPhase()) << " now";
+	for(int phase = BACKOFF_SPIN; phase < BACKOFF_PHASES; phase++){
+		std::cout << ", " << PollBackoff::PhaseName(phase) << " " << backoff->GetPhaseTime(phase) << " s (" << backoff->GetPhaseWaits(phase) << " waits)";
+	}
+	std::cout << std::endl;
+	if(replay->IsOpen()){ std::cout << "   Replaying       - " << replay->GetFilename() << " (" << replay->GetSpills() << " spills sent)\n"; }
 	std::cout << "   Run ctrl Exited - " << yesno(run_ctrl_exit) << std::endl;
 				
 	std::cout << "\n  Poll Options:\n";
@@ -732,8 +937,192 @@ void Poll::show_status(){
 }
 
 void Poll::show_thresh() {
-	float threshPercent = (float) threshWords / EXTERNAL_FIFO_LENGTH * 100;
-	std::cout << "Polling Threshold:	" << threshPercent << "% (" << threshWords << "/" << EXTERNAL_FIFO_LENGTH << ")\n";
+	FifoSettings fifoSettings = fifo_ctrl->GetSettings();
+	if(fifoSettings.adaptive){
+		std::cout << "Polling Threshold:	adaptive, latency target " << fifoSettings.max_latency*1000 << " ms, safety margin " << fifoSettings.margin*100 << "%\n";
+		for(size_t mod = 0; mod < n_cards; mod++){
+			std::cout << "  Module " << mod << ": filling at " << humanReadable(fifo_ctrl->GetFillRate(mod)*sizeof(word_t)) << "/s, read at ";
+			std::cout << (size_t)fifo_ctrl->GetReadLevel(mod) << "/" << EXTERNAL_FIFO_LENGTH << " words\n";
+		}
+	}
+	else{
+		float threshPercent = (float) threshWords / EXTERNAL_FIFO_LENGTH * 100;
+		std::cout << "Polling Threshold:	" << threshPercent << "% (" << threshWords << "/" << EXTERNAL_FIFO_LENGTH << ")\n";
+	}
+	std::cout << "FIFO reads:	";
+	for(int reason = FIFO_READ_THRESH; reason < FIFO_READ_TYPES; reason++){
+		std::cout << (reason == FIFO_READ_THRESH ? "" : ", ") << fifo_ctrl->GetReads(reason) << " " << FifoController::ReasonName(reason);
+	}
+	std::cout << " (last " << fifo_ctrl->GetLastLatency()*1000 << " ms after the one before)\n";
+}
+
+void Poll::show_trace(){
+	std::cout << "Spill latency (" << tracer->GetSpills() << " spills, times in ms):\n";
+	std::cout << "  stage        p50        p99        max\n";
+	for(int stage = 0; stage < TRACE_STAGES; stage++){
+		LatencyHistogram *histogram = tracer->GetStage(stage);
+		std::cout << "  " << std::left << std::setw(6) << SpillTracer::StageName(stage) << std::right << std::fixed << std::setprecision(3);
+		std::cout << std::setw(11) << histogram->GetPercentile(0.5)*1E3 << std::setw(11) << histogram->GetPercentile(0.99)*1E3;
+		std::cout << std::setw(11) << histogram->GetMax()*1E3 << std::endl;
+	}
+	std::cout.unsetf(std::ios::floatfield);
+	std::cout << std::setprecision(6);
+}
+
+void Poll::show_reduce(){
+	if(!reducer->IsActive()){ std::cout << "Trace reduction:	off\n"; }
+	else{
+		std::cout << "Trace reduction:\n";
+		for(size_t mod = 0; mod < n_cards; mod++){
+			for(size_t chan = 0; chan < NUM_CHAN_PER_MOD; chan++){
+				ReduceSettings settings;
+				if(!reducer->GetSettings(mod, chan, settings) || !settings.IsActive()){ continue; }
+				std::cout << "  Module " << mod << " channel " << chan << ":";
+				if(settings.cut){ std::cout << " energy " << settings.emin << " to " << settings.emax; }
+				if(settings.roi){ std::cout << " roi -" << settings.pre << "/+" << settings.post; }
+				if(settings.decimate > 1){ std::cout << " decimate " << settings.decimate; }
+				std::cout << std::endl;
+			}
+		}
+	}
+	if(reducer->GetBytesIn() > 0){
+		double saved = reducer->GetBytesIn() - reducer->GetBytesOut();
+		std::cout << "Reduced " << humanReadable(reducer->GetBytesIn()) << " to " << humanReadable(reducer->GetBytesOut()) << " (" << 100.0 * saved / reducer->GetBytesIn() << "% saved), ";
+		std::cout << reducer->GetTracesCut() << " traces cut, " << reducer->GetTracesReduced() << " shortened\n";
+	}
+}
+
+void Poll::show_history(int type, int mod, size_t window){
+	size_t nIntervals = statsHandler->GetHistoryCount();
+	if(nIntervals == 0){
+		std::cout << "No stats intervals recorded yet\n";
+		return;
+	}
+	if(window == 0 || window > nIntervals){ window = nIntervals; }
+
+	bool isData = (type == STATS_HISTORY_DATA);
+	std::cout << "Rate history of " << StatsHandler::HistoryName(type) << " over the last " << window << " stats intervals";
+	if(!isData){ std::cout << " of module " << mod; }
+	std::cout << (isData ? " (per s):\n" : " (Hz):\n");
+	std::cout << "         min       mean        max        p95  trend\n";
+
+	size_t first = (isData ? 0 : mod * NUM_CHAN_PER_MOD);
+	size_t count = (isData ? n_cards : NUM_CHAN_PER_MOD);
+	std::vector<double> values;
+	for(size_t index = first; index < first + count; index++){
+		HistorySummary summary;
+		if(!statsHandler->GetHistory(type, index, window, summary)){ continue; }
+		statsHandler->GetHistoryValues(type, index, window, values);
+		std::cout << (isData ? "  M" : "  C") << std::setfill('0') << std::setw(2) << index - first << std::setfill(' ');
+		if(isData){
+			std::cout << std::setw(10) << humanReadable(summary.min) << std::setw(11) << humanReadable(summary.mean);
+			std::cout << std::setw(11) << humanReadable(summary.max) << std::setw(11) << humanReadable(summary.p95);
+		}
+		else{
+			std::cout << std::fixed << std::setprecision(1) << std::setw(10) << summary.min << std::setw(11) << summary.mean;
+			std::cout << std::setw(11) << summary.max << std::setw(11) << summary.p95;
+		}
+		std::cout << "  " << RateHistory::Sparkline(values) << std::endl;
+	}
+	std::cout.unsetf(std::ios::floatfield);
+	std::cout << std::setprecision(6);
+}
+
+void Poll::write_metrics(MetricsPage &page){
+	StatsSnapshot stats;
+	statsHandler->GetSnapshot(stats);
+
+	page.Family("poll2_up", "gauge", "Set while poll2 is serving metrics.");
+	page.Sample("poll2_up", "", 1);
+	page.Family("poll2_acquisition_running", "gauge", "Set while data is being acquired.");
+	page.Sample("poll2_acquisition_running", "", acq_running ? 1 : 0);
+	page.Family("poll2_run_time_seconds", "counter", "Run time counted by the stats.");
+	page.Sample("poll2_run_time_seconds", "", stats.totalTime);
+
+	// Per channel rates and totals
+	const char *chanNames[4] = {"poll2_channel_event_rate_hz", "poll2_channel_events_total", "poll2_channel_input_count_rate_hz", "poll2_channel_output_count_rate_hz"};
+	const char *chanTypes[4] = {"gauge", "counter", "gauge", "gauge"};
+	const char *chanHelp[4] = {"Event rate of a channel over the last stats interval.", "Events of a channel since the stats were cleared.",
+	                           "XIA input count rate of a channel.", "XIA output count rate of a channel."};
+	for(int metric = 0; metric < 4; metric++){
+		page.Family(chanNames[metric], chanTypes[metric], chanHelp[metric]);
+		for(size_t index = 0; index < stats.eventRate.size(); index++){
+			std::string labels = MetricsPage::Label("module", index / NUM_CHAN_PER_MOD) + "," + MetricsPage::Label("channel", index % NUM_CHAN_PER_MOD);
+			double value = 0.0;
+			if(metric == 0){ value = stats.eventRate[index]; }
+			else if(metric == 1){ value = stats.eventsTotal[index]; }
+			else if(metric == 2){ value = stats.inputCountRate[index]; }
+			else{ value = stats.outputCountRate[index]; }
+			page.Sample(chanNames[metric], labels, value);
+		}
+	}
+
+	// Per module data rates and FIFO levels
+	const char *modNames[5] = {"poll2_module_data_rate_bytes_per_second", "poll2_module_data_bytes_total", "poll2_fifo_fill_rate_words_per_second", "poll2_fifo_read_level_words",
+	                           "poll2_fifo_words"};
+	const char *modTypes[5] = {"gauge", "counter", "gauge", "gauge", "gauge"};
+	const char *modHelp[5] = {"Data rate of a module over the last stats interval.", "Data read from a module since the stats were cleared.",
+	                          "Estimated rate at which the external FIFO of a module fills.", "Number of FIFO words at which a module is read.",
+	                          "Words in the external FIFO of a module when it was last checked."};
+	for(int metric = 0; metric < 5; metric++){
+		page.Family(modNames[metric], modTypes[metric], modHelp[metric]);
+		for(size_t mod = 0; mod < stats.numCards; mod++){
+			double value = 0.0;
+			if(metric == 0){ value = stats.moduleDataRate[mod]; }
+			else if(metric == 1){ value = stats.moduleDataTotal[mod]; }
+			else if(metric == 2){ value = stats.fifoFillRate[mod]; }
+			else if(metric == 3){ value = stats.fifoReadLevel[mod]; }
+			else{ value = fifo_ctrl->GetWords(mod); }
+			page.Sample(modNames[metric], MetricsPage::Label("module", mod), value);
+		}
+	}
+
+	page.Family("poll2_fifo_reads_total", "counter", "FIFO reads by the reason they were made.");
+	for(int reason = FIFO_READ_THRESH; reason < FIFO_READ_TYPES; reason++){
+		page.Sample("poll2_fifo_reads_total", MetricsPage::Label("reason", FifoController::ReasonName(reason)), fifo_ctrl->GetReads(reason));
+	}
+
+	// Spill latency, with a bucket at the end of each octave of the trace histograms. The last
+	// bin also holds every longer time, so only the +Inf bucket covers it.
+	page.Family("poll2_spill_latency_seconds", "histogram", "Time spent by spills in each stage of the readout.");
+	for(int stage = 0; stage < TRACE_STAGES; stage++){
+		LatencyHistogram *histogram = tracer->GetStage(stage);
+		std::string stageLabel = MetricsPage::Label("stage", SpillTracer::StageName(stage));
+		unsigned long long cumulative = 0;
+		for(size_t bin = 0; bin < TRACE_BINS; bin++){
+			cumulative += histogram->GetBin(bin);
+			if(bin + 1 < TRACE_BINS && (bin == 0 || (bin - 1) % TRACE_BIN_STEPS == TRACE_BIN_STEPS - 1)){
+				std::stringstream edge;
+				edge << std::setprecision(12) << LatencyHistogram::GetEdge(bin);
+				page.Sample("poll2_spill_latency_seconds_bucket", stageLabel + "," + MetricsPage::Label("le", edge.str()), cumulative);
+			}
+		}
+		page.Sample("poll2_spill_latency_seconds_bucket", stageLabel + "," + MetricsPage::Label("le", "+Inf"), cumulative);
+		page.Sample("poll2_spill_latency_seconds_sum", stageLabel, histogram->GetSum());
+		page.Sample("poll2_spill_latency_seconds_count", stageLabel, cumulative);
+	}
+
+	// Output
+	page.Family("poll2_written_bytes_total", "counter", "Spill data written to disk.");
+	page.Sample("poll2_written_bytes_total", "", bytes_written.load());
+	page.Family("poll2_written_spills_total", "counter", "Spills written to disk.");
+	page.Sample("poll2_written_spills_total", "", spills_written.load());
+	page.Family("poll2_file_rollovers_total", "counter", "Output files continued in a new file for being too large.");
+	page.Sample("poll2_file_rollovers_total", "", file_rollovers.load());
+	page.Family("poll2_dropped_spills_total", "counter", "Spills not delivered to a reader or subscriber which fell behind.");
+	page.Sample("poll2_dropped_spills_total", MetricsPage::Label("transport", "shm"), shm_ring->GetDropped());
+	page.Sample("poll2_dropped_spills_total", MetricsPage::Label("transport", "stream"), stream_server->GetSkipped());
+}
+
+void Poll::show_replay(){
+	std::cout << "Replaying " << replay->GetFilename() << " at ";
+	if (replay->GetSpeed() > 0.0) std::cout << replay->GetSpeed() << "x the recorded rate\n";
+	else std::cout << "full speed\n";
+	std::cout << "  " << replay->GetSpills() << " spills (" << humanReadable(replay->GetWords() * sizeof(word_t)) << ") sent in " << replay->GetElapsed() << " s, ";
+	std::cout << humanReadable(replay->GetThroughput()) << "/s, " << replay->GetAchievedSpeed() << "x the recorded rate\n";
+	if (replay->GetBadSpills() > 0 || replay->GetDroppedBlocks() > 0) {
+		std::cout << "  " << replay->GetBadSpills() << " corrupt spills skipped, " << replay->GetDroppedBlocks() << " module blocks dropped\n";
+	}
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -853,6 +1242,13 @@ void Poll::CommandControl(){
 		
 		//We clear the error flag when a command is entered.
 		had_error = false;
+
+		//A replay does not use the crate, so commands which talk to the modules are refused.
+		if(replay->IsOpen() && cmd != "csr_test" && cmd != "bit_test" && (cmd == "reboot" || cmd == "mca" || cmd == "MCA" ||
+		   std::find(paramControlCommands_.begin(), paramControlCommands_.end(), cmd) != paramControlCommands_.end())){
+			std::cout << sys_message_head << "Command '" << cmd << "' is not available while replaying " << replay->GetFilename() << "\n";
+			continue;
+		}
 		// check for defined commands
 		if(cmd == "quit" || cmd == "exit"){
 			if(do_MCA_run){ std::cout << sys_message_head << "Warning! Cannot quit while MCA program is running\n"; }
@@ -876,6 +1272,22 @@ void Poll::CommandControl(){
 		else if(cmd == "version" || cmd == "v"){ 
 			std::cout << "  Poll2 Core    v" << POLL2_CORE_VERSION << " (" << POLL2_CORE_DATE << ")\n"; 
 			std::cout << "  Poll2 Socket  v" << POLL2_SOCKET_VERSION << " (" << POLL2_SOCKET_DATE << ")\n"; 
+			std::cout << "  Poll2 Spill   v" << POLL2_SPILL_VERSION << " (" << POLL2_SPILL_DATE << ")\n";
+			std::cout << "  Poll2 Pac     v" << POLL2_PAC_VERSION << " (" << POLL2_PAC_DATE << ")\n";
+			std::cout << "  Poll2 Shm     v" << POLL2_SHM_VERSION << " (" << POLL2_SHM_DATE << ")\n";
+			std::cout << "  Poll2 Stream  v" << POLL2_STREAM_VERSION << " (" << POLL2_STREAM_DATE << ")\n";
+			std::cout << "  Poll2 Pacer   v" << POLL2_PACER_VERSION << " (" << POLL2_PACER_DATE << ")\n";
+			std::cout << "  Poll2 Pipeline v" << POLL2_PIPELINE_VERSION << " (" << POLL2_PIPELINE_DATE << ")\n";
+			std::cout << "  Poll2 Fifo    v" << POLL2_FIFO_VERSION << " (" << POLL2_FIFO_DATE << ")\n";
+			std::cout << "  Poll2 Staging v" << POLL2_STAGING_VERSION << " (" << POLL2_STAGING_DATE << ")\n";
+			std::cout << "  Poll2 Replay  v" << POLL2_REPLAY_VERSION << " (" << POLL2_REPLAY_DATE << ")\n";
+			std::cout << "  Poll2 Trace   v" << POLL2_TRACE_VERSION << " (" << POLL2_TRACE_DATE << ")\n";
+			std::cout << "  Poll2 Reduce  v" << POLL2_REDUCE_VERSION << " (" << POLL2_REDUCE_DATE << ")\n";
+			std::cout << "  Poll2 RT      v" << POLL2_RT_VERSION << " (" << POLL2_RT_DATE << ")\n";
+			std::cout << "  Poll2 HugePage v" << POLL2_HUGEPAGE_VERSION << " (" << POLL2_HUGEPAGE_DATE << ")\n";
+			std::cout << "  Poll2 History v" << POLL2_HISTORY_VERSION << " (" << POLL2_HISTORY_DATE << ")\n";
+			std::cout << "  Poll2 Metrics v" << POLL2_METRICS_VERSION << " (" << POLL2_METRICS_DATE << ")\n";
+			std::cout << "  Poll2 StatsProto v" << POLL2_STATSPROTO_VERSION << " (" << POLL2_STATSPROTO_DATE << ")\n";
 			std::cout << "  HRIBF Buffers v" << HRIBF_BUFFERS_VERSION << " (" << HRIBF_BUFFERS_DATE << ")\n"; 
 			std::cout << "  CTerminal     v" << CTERMINAL_VERSION << " (" << CTERMINAL_DATE << ")\n";
 		}
@@ -883,8 +1295,112 @@ void Poll::CommandControl(){
 			show_status();
 		}
 		else if(cmd == "thresh"){
+			if(p_args >= 1 && arguments.at(0) == "auto"){
+				double latency = (p_args >= 2 ? atof(arguments.at(1).c_str()) / 1000.0 : -1.0);
+				double margin = (p_args >= 3 ? atof(arguments.at(2).c_str()) / 100.0 : -1.0);
+				if((p_args >= 2 && latency <= 0.0) || (p_args >= 3 && (margin < 0.0 || margin >= 1.0))){
+					std::cout << sys_message_head << "Invalid latency target or safety margin\n";
+				}
+				else{ SetAdaptiveThresh(true, latency, margin); }
+			}
+			else if(p_args >= 1){
+				int threshPercent = atoi(arguments.at(0).c_str());
+				if(threshPercent <= 0 || threshPercent > 100){ std::cout << sys_message_head << "Invalid threshold '" << arguments.at(0) << "'\n"; }
+				else{
+					SetThreshWords(EXTERNAL_FIFO_LENGTH * threshPercent / 100.0);
+					SetAdaptiveThresh(false);
+				}
+			}
 			show_thresh();
 		}
+		else if(cmd == "trace"){ // Show or dump the time spent by spills in each readout stage
+			if(p_args >= 1 && arguments.at(0) == "dump"){
+				std::string fname = (p_args >= 2 ? arguments.at(1) : "poll2_trace.json");
+				int nSpills = tracer->DumpChrome(fname);
+				if(nSpills < 0){ std::cout << sys_message_head << "Failed to write trace file '" << fname << "'\n"; }
+				else{ std::cout << sys_message_head << "Wrote " << nSpills << " spills to '" << fname << "'\n"; }
+			}
+			else if(p_args >= 1 && arguments.at(0) == "clear"){
+				tracer->Clear();
+				std::cout << sys_message_head << "Clearing spill latencies\n";
+			}
+			else if(p_args >= 1){ std::cout << sys_message_head << "Unknown trace option '" << arguments.at(0) << "'\n"; }
+			else{ show_trace(); }
+		}
+		else if(cmd == "history"){ // Show how the rates moved about over the last stats intervals
+			int type = STATS_HISTORY_DATA;
+			if(p_args >= 1){
+				for(type = 0; type < STATS_HISTORY_TYPES; type++){
+					if(arguments.at(0) == StatsHandler::HistoryName(type)){ break; }
+				}
+			}
+			int mod = (p_args >= 2 ? atoi(arguments.at(1).c_str()) : 0);
+			int window = (p_args >= 3 ? atoi(arguments.at(2).c_str()) : 0);
+			if(type >= STATS_HISTORY_TYPES){ std::cout << sys_message_head << "Unknown rate '" << arguments.at(0) << "' (events, icr, ocr or data)\n"; }
+			else if(mod < 0 || mod >= (int)n_cards){ std::cout << sys_message_head << "Invalid module " << mod << "\n"; }
+			else if(window < 0){ std::cout << sys_message_head << "Invalid number of intervals " << window << "\n"; }
+			else{ show_history(type, mod, window); }
+		}
+		else if(cmd == "reduce"){ // Set how the traces of a channel are reduced before they are written, even mid-run
+			if(p_args == 0){ show_reduce(); }
+			else if(p_args < 3){
+				std::cout << sys_message_head << " -SYNTAX- reduce [mod] [chan] cut [min] [max]  - Drop traces with an energy outside [min, max]\n";
+				std::cout << sys_message_head << " -SYNTAX- reduce [mod] [chan] roi [pre] [post] - Keep pre samples before and post after the largest sample\n";
+				std::cout << sys_message_head << " -SYNTAX- reduce [mod] [chan] decimate [n]     - Average every n samples into one\n";
+				std::cout << sys_message_head << " -SYNTAX- reduce [mod] [chan] [cut|roi] off    - Stop cutting or trimming traces\n";
+				std::cout << sys_message_head << " -SYNTAX- reduce [mod] [chan] off              - Write the traces as they are read\n";
+			}
+			else{
+				int mod = (arguments.at(0) == "*" ? -1 : atoi(arguments.at(0).c_str()));
+				int chan = (arguments.at(1) == "*" ? -1 : atoi(arguments.at(1).c_str()));
+				std::string option = arguments.at(2);
+				int first = (p_args >= 4 ? atoi(arguments.at(3).c_str()) : -1);
+				int second = (p_args >= 5 ? atoi(arguments.at(4).c_str()) : -1);
+				bool turnOff = (p_args == 4 && arguments.at(3) == "off");
+
+				bool valid = true;
+				if(option == "off"){ valid = reducer->Configure(mod, chan, [](ReduceSettings &settings){ settings = ReduceSettings(); }); }
+				else if((option == "cut" || option == "roi") && turnOff){
+					valid = reducer->Configure(mod, chan, [&option](ReduceSettings &settings){
+						if(option == "cut"){ settings.cut = false; }
+						else{ settings.roi = false; }
+					});
+				}
+				else if(option == "cut" && first >= 0 && second >= first){
+					valid = reducer->Configure(mod, chan, [first, second](ReduceSettings &settings){
+						settings.cut = true;
+						settings.emin = first;
+						settings.emax = second;
+					});
+				}
+				else if(option == "roi" && first >= 0 && second >= 0){
+					valid = reducer->Configure(mod, chan, [first, second](ReduceSettings &settings){
+						settings.roi = true;
+						settings.pre = first;
+						settings.post = second;
+					});
+				}
+				else if(option == "decimate" && first >= 1){
+					valid = reducer->Configure(mod, chan, [first](ReduceSettings &settings){ settings.decimate = first; });
+				}
+				else{ std::cout << sys_message_head << "Invalid trace reduction '" << arg << "' (type 'reduce help' for the syntax)\n"; }
+
+				if(!valid){ std::cout << sys_message_head << "No module " << arguments.at(0) << " channel " << arguments.at(1) << std::endl; }
+			}
+		}
+		else if(cmd == "pace"){ // Change the rate limit for spills sent over UDP, even mid-run
+			if(p_args == 0){
+				if(pace_auto){ std::cout << sys_message_head << "Pacing UDP spills automatically (currently " << pacer->GetRate()/1E6 << " MB/s)\n"; }
+				else if(pacer->IsActive()){ std::cout << sys_message_head << "Pacing UDP spills at " << pacer->GetRate()/1E6 << " MB/s with bursts of " << pacer->GetBurst()/1024 << " kB\n"; }
+				else{ std::cout << sys_message_head << "UDP pacing is off\n"; }
+			}
+			else if(!SetPacing(arguments.at(0), (p_args > 1 ? arguments.at(1) : ""))){
+				std::cout << sys_message_head << "Invalid pacing rate or burst size\n";
+			}
+			else if(arguments.at(0) == "off"){ std::cout << sys_message_head << "UDP pacing is off\n"; }
+			else if(pace_auto){ std::cout << sys_message_head << "Pacing UDP spills automatically with bursts of " << pacer->GetBurst()/1024 << " kB\n"; }
+			else{ std::cout << sys_message_head << "Pacing UDP spills at " << pacer->GetRate()/1E6 << " MB/s with bursts of " << pacer->GetBurst()/1024 << " kB\n"; }
+		}
 		else if(cmd == "dump"){ // Dump pixie parameters to file
 			std::ofstream ofile;
 			
@@ -1115,6 +1631,23 @@ void Poll::CommandControl(){
 					shm_mode = true;
 				}
 			}
+			else if(cmd == "reliable"){ // Toggle retransmission of lost shm chunks
+				if(acq_running){ std::cout << sys_message_head << "Warning! Cannot change reliable mode while acquisition is running\n"; }
+				else if(spill_sender->GetReliable() && p_args == 0){
+					std::cout << sys_message_head << "Toggling reliable shm mode OFF\n";
+					spill_sender->SetReliable(false);
+				}
+				else{
+					int window = SHM_SEND_WINDOW;
+					if(p_args > 0){ window = atoi(arguments.at(0).c_str()); }
+					if(window <= 0){ std::cout << sys_message_head << "Invalid window size '" << arguments.at(0) << "'\n"; }
+					else{
+						std::cout << sys_message_head << "Toggling reliable shm mode ON (window of " << window << " spills)\n";
+						if(!shm_udp_mode){ std::cout << sys_message_head << "Note: reliable mode only applies to shm spills sent over UDP (--udp-shm)\n"; }
+						spill_sender->SetReliable(true, window);
+					}
+				}
+			}
 			else if(cmd == "reboot"){ // Tell POLL to attempt a PIXIE crate reboot
 				if(do_MCA_run){ std::cout << sys_message_head << "Warning! Cannot reboot while MCA is running\n"; }
 				else if(acq_running || do_MCA_run){ std::cout << sys_message_head << "Warning! Cannot reboot while acquisition running\n"; }
@@ -1241,6 +1774,11 @@ void Poll::CommandControl(){
 				else{ std::cout << sys_message_head << "Using output file format '" << output_format << "'\n"; }
 				if(output_file.IsOpen()){ std::cout << sys_message_head << "New output format used for new files only! Current file is unchanged.\n"; }
 			}
+			else if(cmd == "replay"){ // Show the progress of the replay or change its speed
+				if(!replay->IsOpen()){ std::cout << sys_message_head << "Not in replay mode (start poll2 with --replay <file>)\n"; }
+				else if(p_args >= 1 && !replay->SetSpeed(arguments.at(0))){ std::cout << sys_message_head << "Invalid replay speed '" << arguments.at(0) << "'\n"; }
+				else{ show_replay(); }
+			}
 			else if(cmd == "mca" || cmd == "MCA"){ // Run MCA program using either root or damm
 				if(do_MCA_run){
 					std::cout << sys_message_head << "MCA program is already running\n\n";
@@ -1283,6 +1821,25 @@ void Poll::CommandControl(){
 
 /// Function to control the gathering and recording of PIXIE data
 void Poll::RunControl(){
+	// This thread becomes the FIFO reader stage of the pipeline
+	if(use_pipeline){
+		if(!pipeline->Start(PIPELINE_DEFAULT_BUFFERS, buffer_words, n_cards, NUM_CHAN_PER_MOD,
+		                    [this](SpillBuffer *raw, SpillBuffer *spill){ return validate_spill(raw, spill); },
+		                    [this](SpillBuffer *spill){ sink_spill(spill); },
+		                    [this](){ sink_idle(); })){
+			// Run every stage on this thread instead, as without --pipeline
+			std::cout << Display::WarningStr("Warning!") << " Failed to start the readout pipeline, running the whole readout on one thread\n";
+			use_pipeline = false;
+		}
+	}
+	if(!use_pipeline){
+		rt_config->Apply("reader", pipeline->GetAffinity(0));
+		if(!alloc_serial_buffers()){ std::cout << Display::ErrorStr() << " Acquisition cannot be started without FIFO buffers\n"; }
+	}
+
+	// Every spill buffer has been allocated by now
+	rt_config->LockMemory();
+
 	while(true){
 		if(kill_all){ // Supersedes all other commands
 			if(acq_running || mca_args.IsRunning()){ do_stop_acq = true; } // Safety catch
@@ -1335,9 +1892,14 @@ void Poll::RunControl(){
 		}
 
 		//Start acquistion
-		if (do_start_acq && !acq_running) {
-			//Start list mode
-			if(pif->StartListModeRun(LIST_MODE_RUN, NEW_RUN)) {
+		if (do_start_acq && !acq_running && !pipeline->IsRunning() && !raw_buffer) {
+			std::cout << sys_message_head << "Cannot start acquisition, the FIFO buffers could not be allocated\n";
+			had_error = true;
+			do_start_acq = false;
+		}
+		else if (do_start_acq && !acq_running) {
+			//Start list mode, or go back to the first spill of the replay file
+			if(replay->IsOpen() ? replay->Start() : pif->StartListModeRun(LIST_MODE_RUN, NEW_RUN)) {
 				time_t currTime;
 				time(&currTime);
 				if (record_data) std::cout << "Run " << output_file.GetRunNumber();
@@ -1346,7 +1908,16 @@ void Poll::RunControl(){
 
 				acq_running = true;
 				startTime = usGetTime(0);
+				tracer->Clear();
+				reducer->ClearCounts();
 				lastSpillTime = 0;
+				fifo_ctrl->Reset(0.0);
+				backoff->ClearTimes();
+				backoff->Reset();
+			}
+			else if(replay->IsOpen()){
+				std::cout << sys_message_head << "Failed to find any spills in " << replay->GetFilename() << "\n";
+				had_error = true;
 			}
 			else{ 
 				std::cout << sys_message_head << "Failed to start list mode run. Try rebooting PIXIE\n"; 
@@ -1365,13 +1936,22 @@ void Poll::RunControl(){
 
 			//Handle a stop signal
 			if(do_stop_acq){ 
-				pif->EndRun();
+				if(!replay->IsOpen()){ pif->EndRun(); }
 
 				time_t currTime;
 				time(&currTime);
+
+				// Free up the pipeline buffers so the remaining words can be read
+				pipeline->Drain();
+
+				// Every spill replayed has now been through the sink
+				if(replay->IsOpen()){
+					replay->Stop();
+					show_replay();
+				}
 				
-				// Check if each module has ended its run properly.
-				for(size_t mod = 0; mod < n_cards; mod++){
+				// Check if each module has ended its run properly. A replay has no modules to check.
+				for(size_t mod = 0; mod < n_cards && !replay->IsOpen(); mod++){
 					//If the run status is 1 then the run has not finished in the module.
 					// We need to read it out.
 					if(pif->CheckRunStatus(mod) == 1) {
@@ -1382,15 +1962,16 @@ void Poll::RunControl(){
 						sleep(1);
 						//We read the FIFO out.
 						ReadFIFO();
+						pipeline->Drain();
 					}
 
 					//Print the module status.
 					std::stringstream leader;
 					leader << "Run end status in module " << mod;
-					if (!partialEvent[mod].empty()) {
+					if (!partialEvent[mod].Empty()) {
 						///\bug Warning Str colors oversets the number of characters.
 						leader << Display::WarningStr(" (partial evt)");
-						partialEvent[mod].clear();
+						partialEvent[mod].Clear();
 					}
 					
 					Display::LeaderPrint(leader.str());
@@ -1425,237 +2006,455 @@ void Poll::RunControl(){
 		else if (do_MCA_run) status << Display::OkayStr("[MCA]");
 		else status << Display::InfoStr("[IDLE]");
 
-		if (file_open) status << " Run " << output_file.GetRunNumber();
+		//The sink may be rolling the output file over, so only its published copy is read
+		std::string fileName;
+		int fileRun;
+		{
+			std::lock_guard<std::mutex> lock(file_info_lock);
+			fileName = file_name;
+			fileRun = file_run;
+		}
+
+		if (file_open) status << " Run " << fileRun;
 
 		if(do_MCA_run){
 			status << " " << (int)mca_args.GetMCA()->GetRunTime() << "s";
 			status << " of " << mca_args.GetTotalTime() << "s";
 		}
 		else{
-			//Add run time to status
-			status << " " << (long long) statsHandler->GetTotalTime() << "s";
-			//Add data rate to status
-			status << " " << humanReadable(statsHandler->GetTotalDataRate()) << "/s";
+			//Add run time and data rate to status, from one snapshot of the stats
+			StatsSnapshot stats;
+			statsHandler->GetSnapshot(stats);
+			status << " " << (long long) stats.totalTime << "s";
+			status << " " << humanReadable(stats.dataRate) << "/s";
 		}
 
 		if (file_open) {
 			if (acq_running && !record_data) status << TermColors::DkYellow;
 			//Add file size to status
-			status << " " << humanReadable(output_file.GetFilesize());
-			status << " " << output_file.GetCurrentFilename();
+			status << " " << humanReadable(file_size.load());
+			status << " " << fileName;
 			if (acq_running && !record_data) status << TermColors::Reset;
 		}
 
 		//Update the status bar
 		poll_term_->SetStatus(status.str());
 
-		//Sleep the run control if idle to reduce CPU utilization.
-		if (!acq_running && !do_MCA_run) sleep(1);
+		//The sink thread looks after the network while the pipeline is running.
+		if(!pipeline->IsRunning()){ sink_idle(); }
+
+		//Back off the run control if idle to reduce CPU utilization.
+		if (!acq_running && !do_MCA_run) backoff->Wait(POLL_IDLE_SLEEP);
 	}
 
+	pipeline->Stop();
+
 	run_ctrl_exit = true;
 	std::cout << "Run Control exited\n";
 }
 
-void Poll::ReadScalers() {
-	static std::vector< std::pair<double, double> > xiaRates(16, std::make_pair<double, double>(0,0));
+void Poll::ReadScalers(std::vector<double> &rates) {
+	//There are no modules to read in a replay
+	if (replay->IsOpen()) {
+		std::fill(rates.begin(), rates.end(), 0.0);
+		return;
+	}
+
 	static int numChPerMod = pif->GetNumberChannels();
 
 	for (unsigned short mod=0;mod < n_cards; mod++) {
 		//Tell interface to get stats data from the modules.
 		pif->GetStatistics(mod);
-		
-		for (int ch=0;ch< numChPerMod; ch++) 
-			xiaRates[ch] = std::make_pair<double, double>(pif->GetInputCountRate(mod, ch),pif->GetOutputCountRate(mod,ch));
 
-		//Populate Stats Handler with ICR and OCR.
-		statsHandler->SetXiaRates(mod, &xiaRates);
+		for (int ch=0;ch < numChPerMod && ch < NUM_CHAN_PER_MOD; ch++) {
+			rates[2*(mod*NUM_CHAN_PER_MOD + ch)] = pif->GetInputCountRate(mod, ch);
+			rates[2*(mod*NUM_CHAN_PER_MOD + ch) + 1] = pif->GetOutputCountRate(mod, ch);
+		}
 	}
 }
-bool Poll::ReadFIFO() {
- 	static word_t *fifoData = new word_t[(EXTERNAL_FIFO_LENGTH + 2) * n_cards];
 
+/** Poll the FIFOs until the FIFO controller decides they need reading and read them out. The words are
+  * validated and sent on the RunControl thread, or handed to the pipeline if it is running.
+  * The pipeline never makes this wait, if all of its buffers are in use the words are left
+  * in the FIFOs until the next call.
+  */
+bool Poll::ReadFIFO() {
 	if (!acq_running) return false;
+	if (replay->IsOpen()) return read_replay();
 
 	//Number of words in the FIFO of each module.
 	std::vector<word_t> nWords(n_cards);
-	//Iterator to determine which card has the most words.
-	std::vector<word_t>::iterator maxWords;
 
-	//We loop until the FIFO has reached the threshold for any module unless we are stopping and then we skip the loop.
-	for (unsigned int timeout = 0; timeout < POLL_TRIES; timeout++){ 
+	//Why the FIFOs are being read
+	int trigger = FIFO_READ_NONE;
+
+	//Time of the last FIFO check, the start of the spill's trace
+	double checkStamp = 0.0;
+
+	//We loop until the FIFO controller decides to read the FIFOs, backing off between checks. We go back to
+	// the run control loop after every sleep, or straight away if we are stopping, so commands are handled.
+	while (true){
 		//Check the FIFO size for every module
+		checkStamp = PollBackoff::Now();
+		double sampleTime = usGetTime(startTime) * 1e-6;
 		for (unsigned short mod=0; mod < n_cards; mod++) {
 			nWords[mod] = pif->CheckFIFOWords(mod);
+			fifo_ctrl->Sample(mod, nWords[mod], sampleTime);
 		}
-		//Find the maximum module
-		maxWords = std::max_element(nWords.begin(), nWords.end());
-		if(*maxWords > threshWords){ break; }
+		trigger = fifo_ctrl->Check(sampleTime);
+		if(trigger != FIFO_READ_NONE || force_spill || do_stop_acq){ break; }
+		if(backoff->Wait()){ break; }
 	}
 
 	//We need to read the data out of the FIFO
-	if (*maxWords > threshWords || force_spill) {
+	if (trigger != FIFO_READ_NONE || force_spill) {
+		if (trigger == FIFO_READ_NONE) trigger = FIFO_READ_FORCED;
+
+		//Data is flowing, so check again quickly
+		backoff->Reset();
+
+		SpillBuffer *raw = raw_buffer;
+		if(pipeline->IsRunning()){
+			raw = pipeline->GetRaw();
+			if(!raw){ return true; }
+		}
+		else{ raw->Reset(); }
+
 		force_spill = false;
-		//Number of data words read from the FIFO
-		size_t dataWords = 0;
+		double readStart = usGetTime(startTime) * 1e-6;
+		if(!read_modules(raw, nWords)){ return false; }
+		raw->stamps[TRACE_CHECK] = checkStamp;
+		raw->stamps[TRACE_READ] = PollBackoff::Now();
+
+		//Tell the FIFO controller what was read, the sink publishes its decision with the stats
+		raw->trigger = trigger;
+		raw->latency = fifo_ctrl->Read(trigger, nWords, readStart, raw->time * 1e-6);
+		for (unsigned short mod=0; mod < n_cards; mod++) {
+			raw->fillRates[mod] = fifo_ctrl->GetFillRate(mod);
+			raw->readLevels[mod] = fifo_ctrl->GetReadLevel(mod);
+		}
 
-		//Loop over each module's FIFO
-		for (unsigned short mod=0;mod < n_cards; mod++) {
+		if(pipeline->IsRunning()){ pipeline->PushRaw(); }
+		else{
+			spill_buffer->Reset();
+			if(!validate_spill(raw, spill_buffer)){ return false; }
+			sink_spill(spill_buffer);
+		}
+	} //If we had exceeded the threshold or forced a flush
 
-			//if the module has no words in the FIFO we continue to the next module
-			if (nWords[mod] < MIN_FIFO_READ) {
-				// write an empty buffer if there is no data
-				fifoData[dataWords++] = 2;
-				fifoData[dataWords++] = mod;	    
-				continue;
+	return true;
+}
+
+bool Poll::read_modules(SpillBuffer *raw, const std::vector<word_t> &nWords){
+	//Loop over each module's FIFO. Each module has its own EXTERNAL_FIFO_LENGTH words of the raw buffer.
+	for (unsigned short mod=0;mod < n_cards; mod++) {
+
+		//if the module has no words in the FIFO we continue to the next module
+		if (nWords[mod] < MIN_FIFO_READ) {
+			continue;
+		}
+		else if (nWords[mod] < 0) {
+			std::cout << Display::WarningStr("Number of FIFO words less than 0") << " in module " << mod << std::endl;
+			continue;
+		}
+
+		//Check if the FIFO is overfilled
+		bool fullFIFO = (nWords[mod] >= EXTERNAL_FIFO_LENGTH);
+		if (fullFIFO) {
+			std::cout << Display::ErrorStr() << " Full FIFO in module " << mod
+				<< " size: " << nWords[mod] << "/"
+				<< EXTERNAL_FIFO_LENGTH << Display::ErrorStr(" ABORTING!") << std::endl;
+			had_error = true;
+			do_stop_acq = true;
+			return false;
+		}
+
+		//Try to read FIFO and catch errors.
+		if(!pif->ReadFIFOWords(&raw->data[mod * raw_stride], nWords[mod], mod, debug_mode)){
+			std::cout << Display::ErrorStr() << " Unable to read " << nWords[mod] << " from module " << mod << "\n";
+			had_error = true;
+			do_stop_acq = true;
+			return false;
+		}
+
+		raw->modWords[mod] = nWords[mod];
+	} //End loop over modules for reading FIFO
+
+	//Get the time of the spill
+	raw->time = usGetTime(startTime);
+
+	//The sink has asked for the scalers. They are read here as only this thread talks to the modules.
+	if(scalers_due){
+		ReadScalers(raw->scalers);
+		raw->has_scalers = true;
+		scalers_due = false;
+	}
+
+	return true;
+}
+
+/** Wait for the next spill of the replay file to be due, backing off like the FIFO checks, and pass it on
+  * as a forced read. The spill is split into the module blocks of a raw buffer, so it goes through the
+  * same validator and sink as words read from the FIFOs. The acquisition stops after the last spill.
+  */
+bool Poll::read_replay(){
+	if (replay->AtEnd()) {
+		if (!do_stop_acq) std::cout << sys_message_head << "Reached the end of " << replay->GetFilename() << "\n";
+		do_stop_acq = true;
+		return true;
+	}
+
+	//We go back to the run control loop after every sleep, or straight away if we are stopping, so commands are handled.
+	double wait = replay->GetTimeUntilDue();
+	while (wait > 0.0 && !do_stop_acq) {
+		if (backoff->Wait(wait)) return true;
+		wait = replay->GetTimeUntilDue();
+	}
+	if (do_stop_acq) return true;
+
+	//The next spill is due now
+	double checkStamp = PollBackoff::Now();
+	backoff->Reset();
+
+	SpillBuffer *raw = raw_buffer;
+	if (pipeline->IsRunning()) {
+		raw = pipeline->GetRaw();
+		if (!raw) return true;
+	}
+	else raw->Reset();
+
+	force_spill = false;
+	double readStart = usGetTime(startTime) * 1e-6;
+	size_t dropped = replay->Unpack(&raw->data[0], raw_stride, raw->modWords);
+	if (dropped > 0) {
+		std::cout << Display::WarningStr("Warning!") << " Dropped " << dropped << " module blocks of replayed spill " << replay->GetSpills();
+		std::cout << " which do not fit the modules in the slot file\n";
+	}
+	raw->time = usGetTime(startTime);
+	raw->stamps[TRACE_CHECK] = checkStamp;
+	raw->stamps[TRACE_READ] = PollBackoff::Now();
+
+	if (scalers_due) {
+		ReadScalers(raw->scalers);
+		raw->has_scalers = true;
+		scalers_due = false;
+	}
+
+	//Count the spill as a forced read, so the stats show the time between spills
+	raw->trigger = FIFO_READ_FORCED;
+	raw->latency = fifo_ctrl->Read(FIFO_READ_FORCED, raw->modWords, readStart, raw->time * 1e-6);
+	for (unsigned short mod=0; mod < n_cards; mod++) {
+		raw->fillRates[mod] = fifo_ctrl->GetFillRate(mod);
+		raw->readLevels[mod] = fifo_ctrl->GetReadLevel(mod);
+	}
+
+	if (pipeline->IsRunning()) pipeline->PushRaw();
+	else {
+		spill_buffer->Reset();
+		if (!validate_spill(raw, spill_buffer)) return false;
+		sink_spill(spill_buffer);
+	}
+
+	return true;
+}
+
+bool Poll::validate_spill(SpillBuffer *raw, SpillBuffer *spill){
+	word_t *fifoData = &spill->data[0];
+	//Number of data words in the spill
+	size_t dataWords = 0;
+
+	for (unsigned short mod=0;mod < n_cards; mod++) {
+		if (raw->modWords[mod] == 0) {
+			// write an empty buffer if there is no data
+			fifoData[dataWords++] = 2;
+			fifoData[dataWords++] = mod;
+			continue;
+		}
+		word_t nWords = raw->modWords[mod];
+
+		//We inject two words describing the size of the FIFO spill and the module.
+		//We inject the size after it has been computedos we skip it for now and only add the module number.
+		dataWords++;
+		fifoData[dataWords++] = mod;
+
+		//We store the partial event if we had one, which empties its ring, followed by the words read from the FIFO
+		size_t partialWords = partialEvent[mod].Pop(&fifoData[dataWords], partialEvent[mod].Size());
+		memcpy(&fifoData[dataWords + partialWords], &raw->data[mod * raw_stride], nWords * sizeof(word_t));
+
+		//Print a message about what we did
+		if(!is_quiet) {
+			std::cout << "Read " << nWords << " words from module " << mod;
+			if (partialWords > 0)
+				std::cout << " and stored " << partialWords << " partial event words";
+			std::cout << " to buffer position " << dataWords << std::endl;
+		}
+
+		//After reading the FIFO and printing a sttus message we can update the number of words to include the partial event.
+		nWords += partialWords;
+
+		//We now ned to parse the event to determine if there is a hanging event. Also, allows a check for corrupted data.
+		size_t parseWords = dataWords;
+		//We declare the eventSize outside the loop in case there is a partial event.
+		word_t eventSize = 0;
+		while (parseWords < dataWords + nWords) {
+			//Check first word to see if data makes sense.
+			// We check the slot, channel and event size.
+			word_t slotRead = ((fifoData[parseWords] & 0xF0) >> 4);
+			word_t slotExpected = pif->GetSlotNumber(mod);
+			word_t chanRead = (fifoData[parseWords] & 0xF);
+			eventSize = ((fifoData[parseWords] & 0x7FFE2000) >> 17);
+			bool virtualChannel = ((fifoData[parseWords] & 0x20000000) != 0);
+
+			if( slotRead != slotExpected ){
+				std::cout << Display::ErrorStr() << " Slot read (" << slotRead
+					<< ") not the same as" << " slot expected ("
+					<< slotExpected << ")" << std::endl;
+				break;
 			}
-			else if (nWords[mod] < 0) {
-				std::cout << Display::WarningStr("Number of FIFO words less than 0") << " in module " << mod << std::endl;
-				// write an empty buffer if there is no data
-				fifoData[dataWords++] = 2;
-				fifoData[dataWords++] = mod;	    
-				continue;
+			else if (chanRead < 0 || chanRead > 15) {
+				std::cout << Display::ErrorStr() << " Channel read (" << chanRead << ") not valid!\n";
+				break;
+			}
+			else if(eventSize == 0){
+				std::cout << Display::ErrorStr() << "ZERO EVENT SIZE in mod " << mod << "!\n";
+				break;
 			}
 
-			//Check if the FIFO is overfilled
-			bool fullFIFO = (nWords[mod] >= EXTERNAL_FIFO_LENGTH);
-			if (fullFIFO) {
-				std::cout << Display::ErrorStr() << " Full FIFO in module " << mod 
-					<< " size: " << nWords[mod] << "/" 
-					<< EXTERNAL_FIFO_LENGTH << Display::ErrorStr(" ABORTING!") << std::endl;
-				had_error = true;
-				do_stop_acq = true;
-				return false;
+			// Count the event for the statsHandler (for monitor.bash), the sink passes the counts on
+			if(!virtualChannel){
+				spill->chanEvents[mod*NUM_CHAN_PER_MOD + chanRead]++;
+				spill->chanBytes[mod*NUM_CHAN_PER_MOD + chanRead] += sizeof(word_t) * eventSize;
 			}
 
-			//We inject two words describing the size of the FIFO spill and the module.
-			//We inject the size after it has been computedos we skip it for now and only add the module number.
-			dataWords++;
-			fifoData[dataWords++] = mod;
+			//Iterate to the next event and continue parsing
+			parseWords += eventSize;
+		}
 
-			//We store the partial event if we had one
-			for (size_t i=0;i<partialEvent[mod].size();i++)
-				fifoData[dataWords + i] = partialEvent[mod].at(i);
+		//We now check the outcome of the data parsing.
+		//If we have too many words as an event was not completely pulled form the FIFO
+		if (parseWords > dataWords + nWords) {
+			word_t missingWords = parseWords - dataWords - nWords;
+			word_t partialSize = eventSize - missingWords;
+			if (debug_mode) std::cout << "Partial event " << partialSize << "/" << eventSize << " words!\n";
 
-			//Try to read FIFO and catch errors.
-			if(!pif->ReadFIFOWords(&fifoData[dataWords + partialEvent[mod].size()], nWords[mod], mod, debug_mode)){
-				std::cout << Display::ErrorStr() << " Unable to read " << nWords[mod] << " from module " << mod << "\n";
-				had_error = true;
+			//We could get the words now from the FIFO, but me may have to wait. Instead we store the partial event for the next FIFO read.
+			if (!partialEvent[mod].Push(&fifoData[parseWords - eventSize], partialSize)) {
+				std::cout << Display::ErrorStr() << " Partial event of " << partialSize << " words in module " << mod << " is longer than the largest event (" << maxEventSize << ")!\n";
 				do_stop_acq = true;
+				had_error = true;
 				return false;
 			}
 
-			//Print a message about what we did	
-			if(!is_quiet) {
-				std::cout << "Read " << nWords[mod] << " words from module " << mod;
-				if (!partialEvent[mod].empty())
-					std::cout << " and stored " << partialEvent[mod].size() << " partial event words";
-				std::cout << " to buffer position " << dataWords << std::endl;
-			}
-
-			//After reading the FIFO and printing a sttus message we can update the number of words to include the partial event.
-			nWords[mod] += partialEvent[mod].size();
-			//Clear the partial event
-			partialEvent[mod].clear();
-
-			//We now ned to parse the event to determine if there is a hanging event. Also, allows a check for corrupted data.
-			size_t parseWords = dataWords;
-			//We declare the eventSize outside the loop in case there is a partial event.
-			word_t eventSize = 0;
-			while (parseWords < dataWords + nWords[mod]) {
-				//Check first word to see if data makes sense.
-				// We check the slot, channel and event size.
-				word_t slotRead = ((fifoData[parseWords] & 0xF0) >> 4);
-				word_t slotExpected = pif->GetSlotNumber(mod);
-				word_t chanRead = (fifoData[parseWords] & 0xF);
-				eventSize = ((fifoData[parseWords] & 0x7FFE2000) >> 17);
-				bool virtualChannel = ((fifoData[parseWords] & 0x20000000) != 0);
-
-				if( slotRead != slotExpected ){ 
-					std::cout << Display::ErrorStr() << " Slot read (" << slotRead 
-						<< ") not the same as" << " slot expected (" 
-						<< slotExpected << ")" << std::endl; 
-					break;
-				}
-				else if (chanRead < 0 || chanRead > 15) {
-					std::cout << Display::ErrorStr() << " Channel read (" << chanRead << ") not valid!\n";
-					break;
-				}
-				else if(eventSize == 0){ 
-					std::cout << Display::ErrorStr() << "ZERO EVENT SIZE in mod " << mod << "!\n"; 
-					break;
-				}
+			//Update the number of words to indicate removal or partial event.
+			nWords -= partialSize;
 
-				// Update the statsHandler with the event (for monitor.bash)
-				if(!virtualChannel && statsHandler){ 
-					statsHandler->AddEvent(mod, chanRead, sizeof(word_t) * eventSize); 
+		}
+		//If parseWords is small then the parse failed for some reason
+		else if (parseWords < dataWords + nWords) {
+			std::cout << Display::ErrorStr() << " Parsing indicated corrupted data at " << parseWords - dataWords << " words into FIFO.\n";
+
+			if (!is_quiet) {
+				//Print the first 100 words
+				std::cout << std::hex;
+				for(int i=0;i< 100;i++) {
+					if (i%10 == 0) std::cout << std::endl << "\t";
+					std::cout << fifoData[dataWords + i] << " ";
 				}
-
-				//Iterate to the next event and continue parsing
-				parseWords += eventSize;
+				std::cout << std::dec << std::endl;
 			}
 
-			//We now check the outcome of the data parsing.
-			//If we have too many words as an event was not completely pulled form the FIFO
-			if (parseWords > dataWords + nWords[mod]) {
-				word_t missingWords = parseWords - dataWords - nWords[mod];
-				word_t partialSize = eventSize - missingWords;
-				if (debug_mode) std::cout << "Partial event " << partialSize << "/" << eventSize << " words!\n";
+			do_stop_acq = true;
+			had_error = true;
+			return false;
+		}
 
-				//We could get the words now from the FIFO, but me may have to wait. Instead we store the partial event for the next FIFO read.
-				for(unsigned short i=0;i< partialSize;i++) 
-					partialEvent[mod].push_back(fifoData[parseWords - eventSize + i]);
+		//Assign the first injected word of spill to final spill length
+		fifoData[dataWords - 2] = nWords + 2;
+		//The data should be good so we iterate the position in the storage array.
+		dataWords += nWords;
+	} //End loop over modules for building the spill
+
+	//Shrink the traces before the spill is written and sent, with any new settings swapped in between spills
+	if (reducer->Update()) dataWords = reducer->Reduce(fifoData, dataWords);
+
+	spill->nWords = dataWords;
+	spill->time = raw->time;
+	spill->trigger = raw->trigger;
+	spill->latency = raw->latency;
+	spill->fillRates.swap(raw->fillRates);
+	spill->readLevels.swap(raw->readLevels);
+	memcpy(spill->stamps, raw->stamps, sizeof(spill->stamps));
+	spill->stamps[TRACE_PARSE] = PollBackoff::Now();
+
+	//Pass on the scalers read with the FIFO. Both vectors are the same size, so nothing is allocated.
+	if (raw->has_scalers) {
+		spill->scalers.swap(raw->scalers);
+		spill->has_scalers = true;
+	}
 
-				//Update the number of words to indicate removal or partial event.
-				nWords[mod] -= partialSize;
+	return true;
+}
 
-			}
-			//If parseWords is small then the parse failed for some reason
-			else if (parseWords < dataWords + nWords[mod]) {
-				std::cout << Display::ErrorStr() << " Parsing indicated corrupted data at " << parseWords - dataWords << " words into FIFO.\n";
+void Poll::sink_spill(SpillBuffer *spill){
+	//Get the length of the spill
+	double durSpill = spill->time - lastSpillTime;
+	lastSpillTime = spill->time;
 
-				if (!is_quiet) {
-					//Print the first 100 words
-					std::cout << std::hex;
-					for(int i=0;i< 100;i++) {
-						if (i%10 == 0) std::cout << std::endl << "\t";
-						std::cout << fifoData[dataWords + i] << " ";
-					}
-					std::cout << std::dec << std::endl;
-				}
+	// Update the statsHandler with the events found by the validator
+	if (statsHandler) {
+		for (size_t i=0;i < spill->chanEvents.size();i++) {
+			if (spill->chanEvents[i] > 0)
+				statsHandler->AddEvent(i / NUM_CHAN_PER_MOD, i % NUM_CHAN_PER_MOD, spill->chanBytes[i], spill->chanEvents[i]);
+		}
 
-				do_stop_acq = true;
-				had_error = true;
-				return false;
-			}
+		// Publish why the FIFOs were read and the FIFO levels with the stats
+		FifoSettings fifoSettings = fifo_ctrl->GetSettings();
+		statsHandler->SetReadoutMode(fifoSettings.adaptive, fifoSettings.max_latency, fifoSettings.margin);
+		statsHandler->AddRead(spill->trigger, spill->latency);
+		for (unsigned short mod=0;mod < n_cards; mod++)
+			statsHandler->SetFifoLevels(mod, spill->fillRates[mod], spill->readLevels[mod]);
+	}
 
-			//Assign the first injected word of spill to final spill length
-			fifoData[dataWords - 2] = nWords[mod] + 2;
-			//The data should be good so we iterate the position in the storage array.
-			dataWords += nWords[mod];
-		} //End loop over modules for reading FIFO
+	// Add time to the statsHandler and check if interval has been exceeded.
+	//If exceed interval we need the scalers from the modules to dump the stats. The pipeline
+	// reader reads them with the next spill, otherwise we read them now.
+	if (statsHandler->AddTime(durSpill * 1e-6) && !spill->has_scalers) {
+		if (pipeline->IsRunning()) scalers_due = true;
+		else {
+			ReadScalers(spill->scalers);
+			spill->has_scalers = true;
+		}
+	}
 
-		//Get the length of the spill
-		double spillTime = usGetTime(startTime);
-		double durSpill = spillTime - lastSpillTime;
-		lastSpillTime = spillTime;
+	if (spill->has_scalers) {
+		static std::vector< std::pair<double, double> > xiaRates(NUM_CHAN_PER_MOD, std::make_pair<double, double>(0,0));
+		for (unsigned short mod=0;mod < n_cards; mod++) {
+			for (int ch=0;ch < NUM_CHAN_PER_MOD; ch++)
+				xiaRates[ch] = std::make_pair(spill->scalers[2*(mod*NUM_CHAN_PER_MOD + ch)], spill->scalers[2*(mod*NUM_CHAN_PER_MOD + ch) + 1]);
 
-		// Add time to the statsHandler and check if interval has been exceeded.
-		//If exceed interval we read the scalers from the modules and dump the stats.
-		if (statsHandler->AddTime(durSpill * 1e-6)) {
-			ReadScalers();
-			statsHandler->Dump();
-			statsHandler->ClearRates();
+			//Populate Stats Handler with ICR and OCR.
+			statsHandler->SetXiaRates(mod, &xiaRates);
 		}
+		statsHandler->Dump();
+		statsHandler->ClearRates();
+	}
 
-		if (!is_quiet) std::cout << "Writing/Broadcasting " << dataWords << " words.\n";
-		//We have read the FIFO now we write the data	
-		if (record_data && !pac_mode) write_data(fifoData, dataWords); 
-		broadcast_data(fifoData, dataWords);
+	if (!is_quiet) std::cout << "Writing/Broadcasting " << spill->nWords << " words.\n";
+	//We have read the FIFO now we write the data
+	if (record_data && !pac_mode) write_data(&spill->data[0], spill->nWords);
+	spill->stamps[TRACE_WRITE] = PollBackoff::Now();
+	broadcast_data(&spill->data[0], spill->nWords);
+	spill->stamps[TRACE_SEND] = PollBackoff::Now();
 
-	} //If we had exceeded the threshold or forced a flush
+	tracer->Add(spill->stamps, spill->nWords, spill->trigger);
+}
 
-	return true;
+void Poll::sink_idle(){
+	//Resend any shm chunks which a receiver has asked for.
+	if(shm_mode && shm_udp_mode){ spill_sender->ServiceNacks(); }
+
+	//Accept new stream subscribers and keep sending to slow ones.
+	stream_server->Service();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
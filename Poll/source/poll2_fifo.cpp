@@ -0,0 +1,310 @@
+/** \file poll2_fifo.cpp
+  *
+  * \brief Decides when poll2 reads out the module FIFOs
+  *
+  * \date Oct. 18th, 2026
+  *
+  * The FIFOs are sampled far more often than their size changes by a
+  * meaningful amount, so each fill rate is measured over a window of at least
+  * FIFO_RATE_WINDOW and then averaged. A read empties a FIFO of the words seen
+  * at the last sample, so the window of every module which was read restarts
+  * from zero words at the time of that sample.
+*/
+
+#include <cstdlib>
+
+#include <time.h>
+#include <errno.h>
+#include <sched.h>
+
+#include "poll2_fifo.h"
+
+FifoController::FifoController(){
+	num_mods = 0;
+	words = NULL;
+	fifo_length = 0;
+	min_read = 0;
+	active.adaptive = false;
+	active.thresh = 0;
+	active.max_latency = FIFO_DEFAULT_LATENCY;
+	active.margin = FIFO_DEFAULT_MARGIN;
+	requested = active;
+	settings_changed = false;
+	Reset(0.0);
+}
+
+FifoController::~FifoController(){
+	delete[] words;
+}
+
+void FifoController::Init(size_t nMods_, size_t fifoLength_, size_t minRead_){
+	num_mods = nMods_;
+	fifo_length = fifoLength_;
+	min_read = minRead_;
+
+	delete[] words;
+	words = new std::atomic<unsigned int>[num_mods];
+	rate.assign(num_mods, 0.0);
+	window_words.assign(num_mods, 0);
+	window_time.assign(num_mods, 0.0);
+
+	Reset(0.0);
+}
+
+void FifoController::SetThreshold(size_t words_){
+	std::lock_guard<std::mutex> lock(settings_lock);
+	requested.thresh = words_;
+	settings_changed = true;
+}
+
+void FifoController::SetAdaptive(bool state_, double maxLatency_/*=FIFO_DEFAULT_LATENCY*/, double margin_/*=FIFO_DEFAULT_MARGIN*/){
+	std::lock_guard<std::mutex> lock(settings_lock);
+	requested.adaptive = state_;
+	if(maxLatency_ > 0.0){ requested.max_latency = maxLatency_; }
+	if(margin_ >= 0.0 && margin_ < 1.0){ requested.margin = margin_; }
+	settings_changed = true;
+}
+
+FifoSettings FifoController::GetSettings(){
+	std::lock_guard<std::mutex> lock(settings_lock);
+	return requested;
+}
+
+void FifoController::Reset(double time_){
+	for(size_t mod = 0; mod < num_mods; mod++){
+		words[mod].store(0, std::memory_order_relaxed);
+		rate[mod] = 0.0;
+		window_words[mod] = 0;
+		window_time[mod] = time_;
+	}
+	sample_time = time_;
+
+	last_check = time_;
+	check_interval = 0.0;
+	read_time = 0.0;
+	last_read = time_;
+
+	for(int i = 0; i < FIFO_READ_TYPES; i++){ num_reads[i].store(0, std::memory_order_relaxed); }
+	last_latency = 0.0;
+}
+
+void FifoController::Sample(size_t mod_, unsigned int words_, double time_){
+	if(mod_ >= num_mods){ return; }
+
+	words[mod_].store(words_, std::memory_order_relaxed);
+	sample_time = time_;
+
+	// The FIFO was read without telling us, start a new window
+	if(words_ < window_words[mod_]){
+		window_words[mod_] = words_;
+		window_time[mod_] = time_;
+		return;
+	}
+
+	double dtime = time_ - window_time[mod_];
+	if(dtime >= FIFO_RATE_WINDOW){
+		double measured = (words_ - window_words[mod_]) / dtime;
+		rate[mod_] += FIFO_RATE_WEIGHT * (measured - rate[mod_]);
+		window_words[mod_] = words_;
+		window_time[mod_] = time_;
+	}
+}
+
+int FifoController::Check(double time_){
+	// Apply new settings between checks, never part way through one
+	if(settings_changed.exchange(false)){
+		std::lock_guard<std::mutex> lock(settings_lock);
+		active = requested;
+	}
+
+	if(time_ > last_check){
+		if(check_interval <= 0.0){ check_interval = time_ - last_check; }
+		else{ check_interval += FIFO_RATE_WEIGHT * ((time_ - last_check) - check_interval); }
+	}
+	last_check = time_;
+
+	if(!active.adaptive){
+		for(size_t mod = 0; mod < num_mods; mod++){
+			if(words[mod].load(std::memory_order_relaxed) > active.thresh){ return FIFO_READ_THRESH; }
+		}
+		return FIFO_READ_NONE;
+	}
+
+	// Words may keep arriving until the FIFOs are next checked and read
+	double lookahead = check_interval + read_time;
+	double limit = (1.0 - active.margin) * fifo_length;
+
+	bool have_data = false;
+	for(size_t mod = 0; mod < num_mods; mod++){
+		unsigned int nWords = words[mod].load(std::memory_order_relaxed);
+		if(nWords >= min_read){ have_data = true; }
+		if(nWords + rate[mod] * lookahead >= limit){ return FIFO_READ_SAFETY; }
+	}
+
+	if(have_data && time_ - last_read >= active.max_latency){ return FIFO_READ_LATENCY; }
+
+	return FIFO_READ_NONE;
+}
+
+double FifoController::Read(int reason_, const std::vector<unsigned int> &nWords_, double start_, double stop_){
+	if(reason_ >= 0 && reason_ < FIFO_READ_TYPES){ num_reads[reason_].fetch_add(1, std::memory_order_relaxed); }
+	read_time = (stop_ > start_ ? stop_ - start_ : 0.0);
+
+	// Only the words arriving since the last sample are left in the FIFOs which were read
+	for(size_t mod = 0; mod < num_mods && mod < nWords_.size(); mod++){
+		if(nWords_[mod] < min_read){ continue; }
+		words[mod].store(0, std::memory_order_relaxed);
+		window_words[mod] = 0;
+		window_time[mod] = sample_time;
+	}
+
+	last_latency = start_ - last_read;
+	last_read = start_;
+
+	return last_latency;
+}
+
+double FifoController::GetReadLevel(size_t mod_){
+	if(mod_ >= num_mods){ return 0.0; }
+
+	// Also called to show the thresholds, so read the settings in use under the lock
+	FifoSettings settings;
+	{
+		std::lock_guard<std::mutex> lock(settings_lock);
+		settings = active;
+	}
+	if(!settings.adaptive){ return settings.thresh; }
+
+	// The lower of the level which fills the latency target and the level the safety margin allows
+	double level = (1.0 - settings.margin) * fifo_length - rate[mod_] * (check_interval + read_time);
+	if(rate[mod_] * settings.max_latency < level){ level = rate[mod_] * settings.max_latency; }
+	if(level < min_read){ level = min_read; }
+
+	return level;
+}
+
+const char *FifoController::ReasonName(int reason_){
+	switch(reason_){
+		case FIFO_READ_THRESH: return "threshold";
+		case FIFO_READ_SAFETY: return "safety";
+		case FIFO_READ_LATENCY: return "latency";
+		case FIFO_READ_FORCED: return "forced";
+		default: return "none";
+	}
+}
+
+PollBackoff::PollBackoff(){
+	max_spins = BACKOFF_DEFAULT_SPINS;
+	max_yields = BACKOFF_DEFAULT_YIELDS;
+	min_sleep = BACKOFF_MIN_SLEEP;
+	max_sleep = BACKOFF_MAX_SLEEP;
+	phase = BACKOFF_SPIN;
+	ClearTimes();
+	Reset();
+}
+
+bool PollBackoff::Configure(unsigned int spins_, unsigned int yields_, double minSleep_, double maxSleep_){
+	if(minSleep_ <= 0.0 || maxSleep_ < minSleep_){ return false; }
+	max_spins = spins_;
+	max_yields = yields_;
+	min_sleep = minSleep_;
+	max_sleep = maxSleep_;
+	return true;
+}
+
+bool PollBackoff::Configure(const std::string &list_){
+	double values[3] = {(double)max_spins, (double)max_yields, max_sleep * 1E6};
+	size_t count = 0;
+	size_t start = 0;
+	while(start <= list_.size()){
+		if(count >= 3){ return false; }
+		size_t stop = list_.find(',', start);
+		if(stop == std::string::npos){ stop = list_.size(); }
+		std::string item = list_.substr(start, stop - start);
+		if(!item.empty()){ // Leave missing values as they are
+			char *end = NULL;
+			double value = strtod(item.c_str(), &end);
+			if(*end != '\0' || value < 0.0){ return false; }
+			values[count] = value;
+		}
+		count++;
+		start = stop + 1;
+	}
+
+	// The first sleep is never longer than the longest one
+	double longest = values[2] * 1E-6;
+	return Configure((unsigned int)values[0], (unsigned int)values[1], (min_sleep < longest ? min_sleep : longest), longest);
+}
+
+double PollBackoff::Account(){
+	double now = Now();
+	if(now > last_time){ phase_time[phase] += now - last_time; }
+	last_time = now;
+	return now;
+}
+
+void PollBackoff::Reset(){
+	Account();
+	phase = BACKOFF_SPIN;
+	count = 0;
+	sleep_time = min_sleep;
+}
+
+bool PollBackoff::Wait(double maxSleep_/*=-1.0*/){
+	Account();
+
+	// Move on once a phase has used up its checks (either may have none)
+	if(phase == BACKOFF_SPIN && count >= max_spins){
+		phase = BACKOFF_YIELD;
+		count = 0;
+	}
+	if(phase == BACKOFF_YIELD && count >= max_yields){
+		phase = BACKOFF_SLEEP;
+		count = 0;
+		sleep_time = min_sleep;
+	}
+
+	phase_waits[phase]++;
+	count++;
+
+	if(phase == BACKOFF_SPIN){ return false; }
+	else if(phase == BACKOFF_YIELD){
+		sched_yield();
+		return false;
+	}
+
+	double longest = (maxSleep_ > 0.0 ? maxSleep_ : max_sleep);
+	double length = (sleep_time < longest ? sleep_time : longest);
+
+	struct timespec wait;
+	wait.tv_sec = (time_t)length;
+	wait.tv_nsec = (long)((length - wait.tv_sec) * 1E9);
+	while(nanosleep(&wait, &wait) == -1 && errno == EINTR){ }
+
+	sleep_time = (2 * sleep_time < longest ? 2 * sleep_time : longest);
+
+	return true;
+}
+
+void PollBackoff::ClearTimes(){
+	for(int i = 0; i < BACKOFF_PHASES; i++){
+		phase_time[i] = 0.0;
+		phase_waits[i] = 0;
+	}
+	last_time = Now();
+}
+
+const char *PollBackoff::PhaseName(int phase_){
+	switch(phase_){
+		case BACKOFF_SPIN: return "spin";
+		case BACKOFF_YIELD: return "yield";
+		case BACKOFF_SLEEP: return "sleep";
+		default: return "unknown";
+	}
+}
+
+double PollBackoff::Now(){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1E-9;
+}
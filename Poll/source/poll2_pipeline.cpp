@@ -0,0 +1,291 @@
+/** \file poll2_pipeline.cpp
+  *
+  * \brief Three stage readout pipeline used by poll2
+  *
+  * \date Oct. 18th, 2026
+  *
+  * Each ring has exactly one thread pushing and one thread popping. The
+  * producer publishes a slot by storing the tail with release ordering and
+  * the consumer frees it by storing the head with release ordering, so
+  * neither side ever waits on the other. Every ring is as large as the pool
+  * feeding it, so a push can never fail.
+*/
+
+#include "poll2_pipeline.h"
+
+#include <iostream>
+#include <cstdlib>
+
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+
+SpillBuffer::SpillBuffer(unsigned int *data_, size_t words_, size_t nMods_, size_t nChan_){
+	data = data_;
+	capacity = words_;
+	modWords.assign(nMods_, 0);
+	fillRates.assign(nMods_, 0.0);
+	readLevels.assign(nMods_, 0.0);
+	scalers.assign(2 * nMods_ * nChan_, 0.0);
+	chanEvents.assign(nMods_ * nChan_, 0);
+	chanBytes.assign(nMods_ * nChan_, 0);
+	Reset();
+}
+
+void SpillBuffer::Reset(){
+	nWords = 0;
+	time = 0.0;
+	trigger = 0;
+	latency = 0.0;
+	for(int i = 0; i < TRACE_STAMPS; i++){ stamps[i] = 0.0; }
+	has_scalers = false;
+	for(size_t i = 0; i < modWords.size(); i++){ modWords[i] = 0; }
+	for(size_t i = 0; i < chanEvents.size(); i++){
+		chanEvents[i] = 0;
+		chanBytes[i] = 0;
+	}
+}
+
+SpillQueue::SpillQueue() : head(0), tail(0) { }
+
+void SpillQueue::Init(size_t capacity_){
+	// One slot is always left empty to tell a full ring from an empty one
+	slots.assign(capacity_ + 1, NULL);
+	head = 0;
+	tail = 0;
+}
+
+bool SpillQueue::Push(SpillBuffer *buffer_){
+	size_t current = tail.load(std::memory_order_relaxed);
+	size_t next = (current + 1) % slots.size();
+	if(next == head.load(std::memory_order_acquire)){ return false; }
+	slots[current] = buffer_;
+	tail.store(next, std::memory_order_release);
+	return true;
+}
+
+SpillBuffer *SpillQueue::Front(){
+	size_t current = head.load(std::memory_order_relaxed);
+	if(current == tail.load(std::memory_order_acquire)){ return NULL; }
+	return slots[current];
+}
+
+void SpillQueue::Pop(){
+	size_t current = head.load(std::memory_order_relaxed);
+	head.store((current + 1) % slots.size(), std::memory_order_release);
+}
+
+size_t SpillQueue::Size(){
+	if(slots.empty()){ return 0; }
+	size_t first = head.load(std::memory_order_acquire);
+	size_t last = tail.load(std::memory_order_acquire);
+	return (last + slots.size() - first) % slots.size();
+}
+
+SpillPipeline::SpillPipeline() : running(false), validating(false), num_pushed(0), num_finished(0), num_stalls(0), num_validator_waits(0), max_depth(0) {
+	cpus[0] = -1;
+	cpus[1] = -1;
+	cpus[2] = -1;
+	stalled = false;
+}
+
+SpillPipeline::~SpillPipeline(){
+	Stop();
+}
+
+void SpillPipeline::SetAffinity(int reader_, int validator_, int sink_){
+	cpus[0] = reader_;
+	cpus[1] = validator_;
+	cpus[2] = sink_;
+}
+
+bool SpillPipeline::SetAffinity(const std::string &list_){
+	int values[3] = {-1, -1, -1};
+	size_t count = 0;
+	size_t start = 0;
+	while(start < list_.size()){
+		if(count >= 3){ return false; }
+		size_t stop = list_.find(',', start);
+		if(stop == std::string::npos){ stop = list_.size(); }
+		std::string item = list_.substr(start, stop - start);
+		char *end = NULL;
+		long cpu = strtol(item.c_str(), &end, 10);
+		if(item.empty() || *end != '\0' || cpu < 0 || cpu >= CPU_SETSIZE){ return false; }
+		values[count++] = (int)cpu;
+		start = stop + 1;
+	}
+	SetAffinity(values[0], values[1], values[2]);
+	return true;
+}
+
+bool SpillPipeline::Start(size_t nBuffers_, size_t nWords_, size_t nMods_, size_t nChan_, validate_t validate_, sink_t sink_, idle_t idle_){
+	if(running || nBuffers_ == 0){ return false; }
+
+	validate = validate_;
+	sink = sink_;
+	idle = idle_;
+
+	raw_free.Init(nBuffers_);
+	raw_full.Init(nBuffers_);
+	spill_free.Init(nBuffers_);
+	spill_full.Init(nBuffers_);
+
+	// Everything is allocated here so nothing is allocated during a run
+	if(!pool.Init(2 * nBuffers_, nWords_)){
+		std::cout << " Error! Failed to allocate " << 2 * nBuffers_ << " pipeline buffers of " << nWords_ << " words\n";
+		return false;
+	}
+	for(size_t i = 0; i < nBuffers_; i++){
+		SpillBuffer *raw = new SpillBuffer(pool.Get(), nWords_, nMods_, nChan_);
+		SpillBuffer *spill = new SpillBuffer(pool.Get(), nWords_, nMods_, nChan_);
+		buffers.push_back(raw);
+		buffers.push_back(spill);
+		raw_free.Push(raw);
+		spill_free.Push(spill);
+	}
+
+	num_pushed = 0;
+	num_finished = 0;
+	num_stalls = 0;
+	num_validator_waits = 0;
+	max_depth = 0;
+	stalled = false;
+
+	init_thread(0);
+
+	running = true;
+	validating = true;
+	validator = std::thread(&SpillPipeline::ValidateLoop, this);
+	sinker = std::thread(&SpillPipeline::SinkLoop, this);
+
+	return true;
+}
+
+SpillBuffer *SpillPipeline::GetRaw(){
+	SpillBuffer *raw = raw_free.Front();
+	if(!raw){
+		// Only count the start of each stall, the reader will be back here very soon
+		if(!stalled){ num_stalls++; }
+		stalled = true;
+		return NULL;
+	}
+	stalled = false;
+	raw->Reset();
+	return raw;
+}
+
+void SpillPipeline::PushRaw(){
+	SpillBuffer *raw = raw_free.Front();
+	if(!raw){ return; }
+	raw_free.Pop();
+	raw_full.Push(raw);
+
+	num_pushed++;
+	size_t depth = GetDepth();
+	if(depth > max_depth){ max_depth = depth; }
+}
+
+void SpillPipeline::Drain(){
+	while(running && num_finished < num_pushed){ usleep(PIPELINE_IDLE_SLEEP); }
+}
+
+void SpillPipeline::Stop(){
+	if(!running){ return; }
+
+	running = false;
+	if(validator.joinable()){ validator.join(); }
+	if(sinker.joinable()){ sinker.join(); }
+
+	for(std::vector<SpillBuffer*>::iterator iter = buffers.begin(); iter != buffers.end(); iter++){
+		pool.Put((*iter)->data);
+		delete (*iter);
+	}
+	buffers.clear();
+	pool.Free();
+}
+
+void SpillPipeline::ValidateLoop(){
+	init_thread(1);
+
+	SpillBuffer *spill = NULL;
+	bool waiting = false;
+	while(true){
+		SpillBuffer *raw = raw_full.Front();
+		if(!raw){
+			// The reader has stopped pushing once running is cleared, so the ring stays empty
+			if(!running && raw_full.Size() == 0){ break; }
+			usleep(PIPELINE_IDLE_SLEEP);
+			continue;
+		}
+
+		if(!spill){
+			spill = spill_free.Front();
+			if(!spill){
+				if(!waiting){ num_validator_waits++; }
+				waiting = true;
+				usleep(PIPELINE_IDLE_SLEEP);
+				continue;
+			}
+			waiting = false;
+			spill_free.Pop();
+			spill->Reset();
+		}
+
+		bool passed = validate(raw, spill);
+
+		raw_full.Pop();
+		raw_free.Push(raw);
+
+		if(passed){
+			spill_full.Push(spill);
+			spill = NULL;
+		}
+		else{
+			// Keep the spill buffer for the next raw buffer
+			spill->Reset();
+			num_finished++;
+		}
+	}
+
+	validating = false;
+}
+
+void SpillPipeline::SinkLoop(){
+	init_thread(2);
+
+	while(true){
+		SpillBuffer *spill = spill_full.Front();
+		if(!spill){
+			if(!validating && spill_full.Size() == 0){ break; }
+			if(idle){ idle(); }
+			usleep(PIPELINE_IDLE_SLEEP);
+			continue;
+		}
+
+		sink(spill);
+
+		spill_full.Pop();
+		spill_free.Push(spill);
+		num_finished++;
+	}
+}
+
+void SpillPipeline::init_thread(size_t stage_){
+	if(thread_init){
+		thread_init(stage_, cpus[stage_]);
+		return;
+	}
+
+	const char *names[3] = {"reader", "validator", "sink"};
+	if(cpus[stage_] >= 0 && !PinThread(cpus[stage_])){ std::cout << " Warning! Failed to pin the " << names[stage_] << " thread to cpu " << cpus[stage_] << std::endl; }
+}
+
+bool SpillPipeline::PinThread(int cpu_){
+	if(cpu_ < 0 || cpu_ >= CPU_SETSIZE){ return false; }
+
+	cpu_set_t cpuset;
+	CPU_ZERO(&cpuset);
+	CPU_SET(cpu_, &cpuset);
+
+	return (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset) == 0);
+}
@@ -0,0 +1,175 @@
+/** \file poll2_reduce.cpp
+  *
+  * \brief Shrinks the traces of list mode events before poll2 writes them
+  *
+  * \date Oct. 18th, 2026
+  *
+  * An event never grows, so the events are reduced in place from the front
+  * of the spill to the back without overwriting any word still to be read.
+*/
+
+#include <cstring>
+
+#include "poll2_reduce.h"
+
+ReduceSettings::ReduceSettings(){
+	cut = false;
+	emin = 0;
+	emax = 0;
+	roi = false;
+	pre = 0;
+	post = 0;
+	decimate = 1;
+}
+
+TraceReducer::TraceReducer() : settings_changed(false), bytes_in(0), bytes_out(0), traces_cut(0), traces_reduced(0) {
+	num_mods = 0;
+	num_chan = 0;
+	active = false;
+	requested_active = false;
+}
+
+void TraceReducer::Init(size_t nMods_, size_t nChan_){
+	std::lock_guard<std::mutex> lock(settings_lock);
+	num_mods = nMods_;
+	num_chan = nChan_;
+	settings.assign(num_mods * num_chan, ReduceSettings());
+	requested = settings;
+	samples.assign(REDUCE_MAX_TRACE, 0);
+	active = false;
+	requested_active = false;
+	settings_changed = false;
+	ClearCounts();
+}
+
+void TraceReducer::update_active(){
+	bool any = false;
+	for(size_t i = 0; i < requested.size(); i++){
+		if(requested[i].IsActive()){ any = true; }
+	}
+	requested_active = any;
+}
+
+bool TraceReducer::IsActive(){
+	std::lock_guard<std::mutex> lock(settings_lock);
+	return requested_active;
+}
+
+bool TraceReducer::GetSettings(size_t mod_, size_t chan_, ReduceSettings &settings_){
+	if(mod_ >= num_mods || chan_ >= num_chan){ return false; }
+	std::lock_guard<std::mutex> lock(settings_lock);
+	settings_ = requested[mod_ * num_chan + chan_];
+	return true;
+}
+
+bool TraceReducer::Update(){
+	if(settings_changed.exchange(false)){
+		std::lock_guard<std::mutex> lock(settings_lock);
+		settings = requested;
+		active = requested_active;
+	}
+	return active;
+}
+
+size_t TraceReducer::reduce_event(unsigned int *dest_, const unsigned int *event_, size_t eventWords_, unsigned int mod_){
+	unsigned int chan = event_[0] & 0xF;
+	size_t headerWords = (event_[0] & 0x0001F000) >> 12;
+	size_t traceLength = (eventWords_ >= 4 ? (event_[3] & 0x7FFF0000) >> 16 : 0);
+	bool virtualChannel = ((event_[0] & 0x20000000) != 0);
+
+	// Leave the event alone unless we are sure where its trace is
+	ReduceSettings *chanSettings = (mod_ < num_mods && chan < num_chan ? &settings[mod_ * num_chan + chan] : NULL);
+	if(!chanSettings || !chanSettings->IsActive() || virtualChannel || headerWords < 4 || traceLength == 0 ||
+	   traceLength > REDUCE_MAX_TRACE || headerWords + traceLength / 2 != eventWords_){
+		if(dest_ != event_){ memmove(dest_, event_, eventWords_ * sizeof(unsigned int)); }
+		return eventWords_;
+	}
+
+	// Pick the samples to keep
+	const unsigned short *trace = (const unsigned short *)(event_ + headerWords);
+	size_t first = 0;
+	size_t last = traceLength;
+	unsigned int energy = event_[3] & 0xFFFF;
+	if(chanSettings->cut && (energy < chanSettings->emin || energy > chanSettings->emax)){
+		last = 0;
+		traces_cut.fetch_add(1, std::memory_order_relaxed);
+	}
+	else if(chanSettings->roi){
+		size_t peak = 0;
+		for(size_t sample = 1; sample < traceLength; sample++){
+			if(trace[sample] > trace[peak]){ peak = sample; }
+		}
+		first = (peak > chanSettings->pre ? peak - chanSettings->pre : 0);
+		last = (peak + chanSettings->post + 1 < traceLength ? peak + chanSettings->post + 1 : traceLength);
+	}
+
+	// Average every group of samples, dropping a group which is not complete
+	size_t step = (chanSettings->decimate > 1 ? chanSettings->decimate : 1);
+	size_t nSamples = 0;
+	for(size_t sample = first; sample + step <= last; sample += step){
+		unsigned int sum = 0;
+		for(size_t i = 0; i < step; i++){ sum += trace[sample + i]; }
+		samples[nSamples++] = sum / step;
+	}
+
+	// Traces are stored two samples to a word
+	if(nSamples % 2 != 0){ nSamples--; }
+	if(last > 0 && nSamples < traceLength){ traces_reduced.fetch_add(1, std::memory_order_relaxed); }
+
+	// The samples are safely copied, so the event may be moved over its old trace
+	size_t newWords = headerWords + nSamples / 2;
+	if(dest_ != event_){ memmove(dest_, event_, headerWords * sizeof(unsigned int)); }
+	dest_[0] = (dest_[0] & ~0x1FFE0000) | (newWords << 17);
+	dest_[3] = (dest_[3] & 0x8000FFFF) | (nSamples << 16);
+	memcpy(dest_ + headerWords, &samples[0], nSamples * sizeof(unsigned short));
+
+	return newWords;
+}
+
+size_t TraceReducer::Reduce(unsigned int *data_, size_t nWords_){
+	size_t out = 0;
+	size_t block = 0;
+	while(block + 2 <= nWords_){
+		size_t blockWords = data_[block];
+		unsigned int mod = data_[block+1];
+		if(blockWords < 2 || block + blockWords > nWords_){ break; } // Keep the rest of the spill as it is
+
+		// The header words are written before the events, which are all further on
+		size_t blockStart = out;
+		data_[out+1] = mod;
+		out += 2;
+
+		size_t event = block + 2;
+		size_t blockEnd = block + blockWords;
+		while(event < blockEnd){
+			size_t eventWords = (data_[event] & 0x1FFE0000) >> 17;
+			if(eventWords == 0 || event + eventWords > blockEnd){ // Keep the rest of the block as it is
+				memmove(&data_[out], &data_[event], (blockEnd - event) * sizeof(unsigned int));
+				out += blockEnd - event;
+				break;
+			}
+			out += reduce_event(&data_[out], &data_[event], eventWords, mod);
+			event += eventWords;
+		}
+
+		data_[blockStart] = out - blockStart;
+		block = blockEnd;
+	}
+
+	if(block < nWords_){
+		memmove(&data_[out], &data_[block], (nWords_ - block) * sizeof(unsigned int));
+		out += nWords_ - block;
+	}
+
+	bytes_in.fetch_add(nWords_ * sizeof(unsigned int), std::memory_order_relaxed);
+	bytes_out.fetch_add(out * sizeof(unsigned int), std::memory_order_relaxed);
+
+	return out;
+}
+
+void TraceReducer::ClearCounts(){
+	bytes_in = 0;
+	bytes_out = 0;
+	traces_cut = 0;
+	traces_reduced = 0;
+}
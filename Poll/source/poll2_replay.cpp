@@ -0,0 +1,231 @@
+/** \file poll2_replay.cpp
+  *
+  * \brief Feeds the spills of a recorded run back through poll2
+  *
+  * \date Oct. 18th, 2026
+  *
+  * A spill is read from the file as soon as the one before it has been sent,
+  * so the time it takes to read the file is hidden in the wait for the next
+  * spill to become due.
+*/
+
+#include <cstdlib>
+#include <cstring>
+
+#include "poll2_replay.h"
+#include "poll2_fifo.h"
+
+SpillReplay::SpillReplay(){
+	format = REPLAY_LDF;
+	spill_words = 0;
+	spill_time = 0.0;
+	have_spill = false;
+	speed = 1.0;
+	start_time = 0.0;
+	stop_time = 0.0;
+	due_time = 0.0;
+	last_stamp = 0;
+	have_stamp = false;
+	num_spills = 0;
+	num_words = 0;
+	num_bad = 0;
+	num_dropped = 0;
+	file_time = 0.0;
+}
+
+bool SpillReplay::read_spill(){
+	spill_words = 0;
+	if(format == REPLAY_PLD){
+		int nBytes = 0;
+		if(!pldData.Read(&file, (char*)&spill[0], nBytes, spill.size() * sizeof(unsigned int))){ return false; }
+		spill_words = nBytes / sizeof(unsigned int);
+	}
+	else{
+		// An ldf spill may be split over several buffers, keep reading until we have all of it
+		bool full_spill = false;
+		bool bad_spill = false;
+		unsigned int nBytes = 0;
+		while(true){
+			if(!dataBuff.Read(&file, (char*)&spill[0], nBytes, spill.size() * sizeof(unsigned int), full_spill, bad_spill)){ return false; }
+			if(full_spill && !bad_spill){ break; }
+			if(bad_spill){ num_bad++; }
+		}
+		spill_words = nBytes / sizeof(unsigned int);
+	}
+
+	// Work out when the spill is due from the time of its last event
+	spill_time = 0.0;
+	unsigned long long stamp;
+	if(last_timestamp(stamp)){
+		if(have_stamp && stamp > last_stamp){
+			spill_time = (stamp - last_stamp) * REPLAY_CLOCK_TICK;
+			if(speed > 0.0){ due_time += spill_time / speed; }
+		}
+		last_stamp = stamp;
+		have_stamp = true;
+	}
+
+	return true;
+}
+
+bool SpillReplay::last_timestamp(unsigned long long &stamp_){
+	bool found = false;
+	stamp_ = 0;
+
+	// Walk the events of every module block ([length, module, events...])
+	size_t block = 0;
+	while(block + 2 <= spill_words){
+		size_t blockWords = spill[block];
+		if(blockWords < 2 || block + blockWords > spill_words){ break; }
+		if(spill[block+1] != REPLAY_END_OF_SPILL){
+			size_t event = block + 2;
+			while(event + 2 < block + blockWords){
+				size_t eventSize = (spill[event] & 0x1FFE0000) >> 17;
+				if(eventSize == 0){ break; }
+				unsigned long long stamp = spill[event+1] | ((unsigned long long)(spill[event+2] & 0xFFFF) << 32);
+				if(!found || stamp > stamp_){ stamp_ = stamp; }
+				found = true;
+				event += eventSize;
+			}
+		}
+		block += blockWords;
+	}
+
+	return found;
+}
+
+bool SpillReplay::Open(const std::string &fname_, size_t maxWords_){
+	if(file.is_open()){ file.close(); }
+
+	size_t dot = fname_.find_last_of('.');
+	std::string extension = (dot != std::string::npos ? fname_.substr(dot) : "");
+	if(extension == ".pld"){ format = REPLAY_PLD; }
+	else if(extension == ".ldf"){ format = REPLAY_LDF; }
+	else{ return false; }
+
+	file.open(fname_.c_str(), std::ios::binary);
+	if(!file.is_open() || !file.good()){
+		file.close();
+		return false;
+	}
+
+	// Every poll2 ldf file starts with a DIR buffer followed by a HEAD buffer, a pld file with its own header
+	bool goodHead;
+	if(format == REPLAY_PLD){
+		goodHead = pldHead.Read(&file);
+		if((size_t)pldHead.GetMaxSpillSize() > maxWords_){ maxWords_ = pldHead.GetMaxSpillSize(); }
+	}
+	else{
+		int numBuffers;
+		goodHead = dirBuff.Read(&file, numBuffers) && headBuff.Read(&file);
+	}
+	if(!goodHead){
+		file.close();
+		return false;
+	}
+
+	filename = fname_;
+	data_start = file.tellg();
+
+	// Room for the two words which close an ldf spill
+	spill.assign(maxWords_ + 2, 0);
+	have_spill = false;
+
+	return true;
+}
+
+bool SpillReplay::SetSpeed(const std::string &speed_){
+	double value = 0.0;
+	if(speed_ != "max"){
+		char *end = NULL;
+		value = strtod(speed_.c_str(), &end);
+		if(speed_.empty() || *end != '\0' || value <= 0.0){ return false; }
+	}
+
+	// Carry on from now at the new speed, rather than catching up with the old schedule
+	if(have_spill){ due_time = PollBackoff::Now() - start_time; }
+	speed = value;
+
+	return true;
+}
+
+bool SpillReplay::Start(){
+	if(!file.is_open()){ return false; }
+
+	file.clear();
+	file.seekg(data_start);
+
+	due_time = 0.0;
+	last_stamp = 0;
+	have_stamp = false;
+	num_spills = 0;
+	num_words = 0;
+	num_bad = 0;
+	num_dropped = 0;
+	file_time = 0.0;
+
+	have_spill = read_spill();
+	start_time = PollBackoff::Now();
+	stop_time = 0.0;
+
+	return have_spill;
+}
+
+void SpillReplay::Stop(){
+	stop_time = PollBackoff::Now();
+	have_spill = false;
+}
+
+double SpillReplay::GetTimeUntilDue(){
+	if(speed <= 0.0){ return 0.0; }
+	return due_time - (PollBackoff::Now() - start_time);
+}
+
+size_t SpillReplay::Unpack(unsigned int *data_, size_t stride_, std::vector<unsigned int> &modWords_){
+	if(!have_spill){ return 0; }
+
+	for(size_t mod = 0; mod < modWords_.size(); mod++){ modWords_[mod] = 0; }
+
+	size_t dropped = 0;
+	size_t block = 0;
+	while(block + 2 <= spill_words){
+		size_t blockWords = spill[block];
+		unsigned int mod = spill[block+1];
+		if(blockWords < 2 || block + blockWords > spill_words){ // Lost our place in the spill
+			dropped++;
+			break;
+		}
+		if(mod != REPLAY_END_OF_SPILL && blockWords > 2){
+			if(mod >= modWords_.size() || blockWords - 2 > stride_ || modWords_[mod] != 0){ dropped++; }
+			else{
+				memcpy(&data_[mod * stride_], &spill[block+2], (blockWords - 2) * sizeof(unsigned int));
+				modWords_[mod] = blockWords - 2;
+			}
+		}
+		block += blockWords;
+	}
+
+	num_spills++;
+	num_words += spill_words;
+	num_dropped += dropped;
+	file_time += spill_time;
+
+	have_spill = read_spill();
+
+	return dropped;
+}
+
+double SpillReplay::GetElapsed(){
+	if(start_time <= 0.0){ return 0.0; }
+	return (stop_time > 0.0 ? stop_time : PollBackoff::Now()) - start_time;
+}
+
+double SpillReplay::GetThroughput(){
+	double elapsed = GetElapsed();
+	return (elapsed > 0.0 ? num_words * sizeof(unsigned int) / elapsed : 0.0);
+}
+
+double SpillReplay::GetAchievedSpeed(){
+	double elapsed = GetElapsed();
+	return (elapsed > 0.0 ? file_time / elapsed : 0.0);
+}
@@ -0,0 +1,199 @@
+/** \file poll2_rt.cpp
+  *
+  * \brief Pins the poll2 readout threads to cpus, raises their priority and locks their memory
+  *
+  * \date Oct. 18th, 2026
+  *
+  * Whether SCHED_FIFO will be granted is checked on a short lived thread, so
+  * the check never changes the scheduling of the thread which makes it.
+*/
+
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <thread>
+
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#include "poll2_rt.h"
+#include "Display.h"
+
+/// Return a resource limit as text.
+static std::string limit_string(int resource_){
+	struct rlimit limit;
+	if(getrlimit(resource_, &limit) != 0){ return "unknown"; }
+	if(limit.rlim_cur == RLIM_INFINITY){ return "unlimited"; }
+	std::stringstream stream;
+	stream << limit.rlim_cur;
+	return stream.str();
+}
+
+RealtimeConfig::RealtimeConfig(){
+	priority = 0;
+	lock_memory = false;
+	memory_locked = false;
+}
+
+bool RealtimeConfig::SetPriority(const std::string &priority_){
+	if(priority_.empty()){
+		priority = RT_DEFAULT_PRIORITY;
+		return true;
+	}
+
+	char *end = NULL;
+	long value = strtol(priority_.c_str(), &end, 10);
+	if(*end != '\0' || value < sched_get_priority_min(SCHED_FIFO) || value > sched_get_priority_max(SCHED_FIFO)){ return false; }
+	priority = (int)value;
+	return true;
+}
+
+bool RealtimeConfig::Check(const int *cpus_, size_t nCpus_){
+	bool retval = true;
+
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	bool haveAllowed = (sched_getaffinity(0, sizeof(cpu_set_t), &allowed) == 0);
+	for(size_t i = 0; i < nCpus_; i++){
+		if(cpus_[i] < 0){ continue; }
+		std::stringstream stream;
+		stream << "Checking cpu " << cpus_[i];
+		Display::LeaderPrint(stream.str());
+		if(haveAllowed && !CPU_ISSET(cpus_[i], &allowed)){
+			std::cout << Display::WarningStr("[NOT ALLOWED]") << std::endl;
+			retval = false;
+		}
+		else{ std::cout << Display::OkayStr() << std::endl; }
+	}
+
+	if(priority > 0){
+		std::stringstream stream;
+		stream << "Checking SCHED_FIFO priority " << priority;
+		Display::LeaderPrint(stream.str());
+
+		// Try it on a thread of its own
+		int error = 0;
+		std::thread test([this, &error](){
+			struct sched_param param;
+			param.sched_priority = priority;
+			error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+		});
+		test.join();
+
+		if(error == 0){ std::cout << Display::OkayStr() << std::endl; }
+		else{
+			std::cout << Display::WarningStr("[DENIED]") << std::endl;
+			std::cout << "  " << strerror(error) << ", RLIMIT_RTPRIO is " << limit_string(RLIMIT_RTPRIO) << ". The readout threads will use the standard scheduler\n";
+			retval = false;
+		}
+	}
+
+	if(lock_memory){
+		Display::LeaderPrint("Checking memory locking");
+		struct rlimit limit;
+		if(geteuid() == 0 || (getrlimit(RLIMIT_MEMLOCK, &limit) == 0 && limit.rlim_cur == RLIM_INFINITY)){ std::cout << Display::OkayStr() << std::endl; }
+		else{
+			// The memory is only locked once the buffers are allocated, so we cannot tell yet if the limit is big enough
+			std::cout << Display::WarningStr("[LIMITED]") << std::endl;
+			std::cout << "  RLIMIT_MEMLOCK is " << limit_string(RLIMIT_MEMLOCK) << " bytes, locking may fail\n";
+		}
+	}
+
+	return retval;
+}
+
+void RealtimeConfig::Apply(const std::string &name_, int cpu_){
+	std::lock_guard<std::mutex> guard(thread_lock);
+
+	RealtimeThread thread;
+	thread.name = name_;
+	thread.cpu = cpu_;
+	thread.pinned = false;
+
+	if(cpu_ >= 0 && cpu_ < CPU_SETSIZE){
+		cpu_set_t cpuset;
+		CPU_ZERO(&cpuset);
+		CPU_SET(cpu_, &cpuset);
+		thread.pinned = (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset) == 0);
+
+		std::stringstream stream;
+		stream << "Pinning " << name_ << " thread to cpu " << cpu_;
+		Display::LeaderPrint(stream.str());
+		if(thread.pinned){ std::cout << Display::OkayStr() << std::endl; }
+		else{ std::cout << Display::WarningStr("[FAILED]") << std::endl; }
+	}
+
+	if(priority > 0){
+		struct sched_param param;
+		param.sched_priority = priority;
+		int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+
+		std::stringstream stream;
+		stream << "Raising " << name_ << " thread to SCHED_FIFO " << priority;
+		Display::LeaderPrint(stream.str());
+		if(error == 0){ std::cout << Display::OkayStr() << std::endl; }
+		else{ std::cout << Display::WarningStr("[DENIED]") << std::endl; }
+	}
+
+	// Record what the thread really runs under
+	struct sched_param param;
+	if(pthread_getschedparam(pthread_self(), &thread.policy, &param) == 0){ thread.priority = param.sched_priority; }
+	else{
+		thread.policy = -1;
+		thread.priority = 0;
+	}
+
+	threads.push_back(thread);
+}
+
+bool RealtimeConfig::LockMemory(){
+	if(!lock_memory || memory_locked){ return true; }
+
+	Display::LeaderPrint("Locking memory");
+	if(mlockall(MCL_CURRENT) != 0){
+		int error = errno;
+		std::cout << Display::WarningStr("[FAILED]") << std::endl;
+		std::cout << "  " << strerror(error) << ", RLIMIT_MEMLOCK is " << limit_string(RLIMIT_MEMLOCK) << " bytes\n";
+		return false;
+	}
+
+	memory_locked = true;
+	std::stringstream stream;
+	stream << "[" << GetLockedBytes() / 1048576 << " MB]";
+	std::cout << Display::OkayStr(stream.str()) << std::endl;
+
+	return true;
+}
+
+void RealtimeConfig::GetThreads(std::vector<RealtimeThread> &threads_){
+	std::lock_guard<std::mutex> guard(thread_lock);
+	threads_ = threads;
+}
+
+size_t RealtimeConfig::GetLockedBytes(){
+	std::ifstream status("/proc/self/status");
+	std::string line;
+	while(std::getline(status, line)){
+		if(line.compare(0, 6, "VmLck:") != 0){ continue; }
+		return strtoul(line.c_str() + 6, NULL, 10) * 1024; // Given in kB
+	}
+	return 0;
+}
+
+const char *RealtimeConfig::PolicyName(int policy_){
+	switch(policy_){
+		case SCHED_OTHER: return "standard";
+		case SCHED_BATCH: return "batch";
+		case SCHED_IDLE: return "idle";
+		case SCHED_FIFO: return "fifo";
+		case SCHED_RR: return "round robin";
+		default: return "unknown";
+	}
+}
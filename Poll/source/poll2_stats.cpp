@@ -1,24 +1,72 @@
 #include <iostream>
+#include <sstream>
 #include <vector>
+#include <new>
 #include <string.h>
+#include <stdlib.h>
 #include <unistd.h>
 
 #include "poll2_stats.h"
 #include "poll2_socket.h"
+#include "poll2_shm.h"
+
+// Words of the published snapshot ahead of the module and channel words, and the words of each module and channel
+#define STATS_HEADER_WORDS (7 + FIFO_READ_TYPES)
+#define STATS_MODULE_WORDS 4
+#define STATS_CHANNEL_WORDS 4
+
+static_assert(FIFO_READ_TYPES - FIFO_READ_THRESH == STATS_READ_TYPES, "The stats packets carry a count of FIFO reads for each reason");
+
+/// Allocate count_ objects, each starting on a cache line.
+template <typename T>
+static T *new_padded(size_t count_){
+	void *mem = NULL;
+	if(posix_memalign(&mem, STATS_CACHE_LINE, count_ * sizeof(T)) != 0){ throw std::bad_alloc(); }
+	T *objects = (T *)mem;
+	for(size_t i = 0; i < count_; i++){ new (&objects[i]) T(); }
+	return objects;
+}
+
+template <typename T>
+static void delete_padded(T *objects_, size_t count_){
+	for(size_t i = 0; i < count_; i++){ objects_[i].~T(); }
+	free(objects_);
+}
+
+static unsigned long long pack_double(double value_){
+	unsigned long long word;
+	memcpy(&word, &value_, sizeof(word));
+	return word;
+}
+
+static double unpack_double(unsigned long long word_){
+	double value;
+	memcpy(&value, &word_, sizeof(value));
+	return value;
+}
+
+double StatsSnapshot::GetEventRate(size_t mod) const {
+	double output = 0.0;
+	if(mod >= numCards){ return output; }
+	for(unsigned int ch = 0; ch < NUM_CHAN_PER_MOD; ch++){
+		output += eventRate[mod*NUM_CHAN_PER_MOD + ch];
+	}
+	return output;
+}
 
 StatsHandler::StatsHandler(const size_t nCards){
 
 	numCards = nCards;
 
+	// The counters, each on a cache line of its own
+	channels = new_padded<StatsChannel>(numCards * NUM_CHAN_PER_MOD);
+	modules = new_padded<StatsModule>(numCards);
+
 	// Define all the 2d arrays
-	nEventsDelta = new unsigned int*[numCards];
-	nEventsTotal = new unsigned int*[numCards]; 
 	calcEventRate = new double*[numCards];
 	inputCountRate = new double*[numCards];
 	outputCountRate = new double*[numCards];
 	for(unsigned int i = 0; i < numCards; i++){
-		nEventsDelta[i] = new unsigned int[NUM_CHAN_PER_MOD];
-		nEventsTotal[i] = new unsigned int[NUM_CHAN_PER_MOD];
 		calcEventRate[i] = new double[NUM_CHAN_PER_MOD];
 		inputCountRate[i] = new double[NUM_CHAN_PER_MOD];
 		outputCountRate[i] = new double[NUM_CHAN_PER_MOD];
@@ -26,8 +74,6 @@ StatsHandler::StatsHandler(const size_t nCards){
 
 	for(unsigned int i = 0; i < numCards; i++){
 		for(unsigned int j = 0; j < NUM_CHAN_PER_MOD; j++){
-			nEventsDelta[i][j] = 0;
-			nEventsTotal[i][j] = 0;
 			calcEventRate[i][j] = 0.0;
 			inputCountRate[i][j] = 0.0;
 			outputCountRate[i][j] = 0.0;
@@ -35,46 +81,72 @@ StatsHandler::StatsHandler(const size_t nCards){
 	}
 
 	// Define all the 1d arrays
-	dataDelta = new size_t[numCards];
-	dataTotal = new size_t[numCards];
 	calcDataRate = new size_t[numCards];
+	fifoFillRate = new double[numCards];
+	fifoReadLevel = new double[numCards];
+	for(unsigned int i = 0; i < numCards; i++){
+		calcDataRate[i] = 0;
+		fifoFillRate[i] = 0.0;
+		fifoReadLevel[i] = 0.0;
+	}
+
+	adaptiveReadout = false;
+	maxLatency = FIFO_DEFAULT_LATENCY;
+	safetyMargin = FIFO_DEFAULT_MARGIN;
 
 	timeElapsed = 0.0;
 	totalTime = 0.0;
 	dumpTime = 3.0; // Minimum of 2 seconds between updates
+
+	// The published snapshot
+	numSnapshotWords = STATS_HEADER_WORDS + numCards * (STATS_MODULE_WORDS + NUM_CHAN_PER_MOD * STATS_CHANNEL_WORDS);
+	snapshotWords = new std::atomic<unsigned long long>[numSnapshotWords];
+	for(size_t i = 0; i < numSnapshotWords; i++){ snapshotWords[i].store(0, std::memory_order_relaxed); }
+	snapshotSeq.store(0, std::memory_order_relaxed);
+
+	// The rate history
+	for(int i = 0; i < STATS_HISTORY_TYPES; i++){
+		history[i].Init(i == STATS_HISTORY_DATA ? numCards : numCards * NUM_CHAN_PER_MOD, STATS_HISTORY_LENGTH);
+	}
 	
 	is_able_to_send = true;
 
 	client = new Client();
-	if(!client->Init("127.0.0.1", 5556)){
+	if(!SetDestination("127.0.0.1")){
 		is_able_to_send = false;
 	}
 
+	// Local monitors may also read the stats straight from shared memory
+	shm_ring = new ShmWriter();
+	if(shm_ring->Init(SHM_STATS_RING, SHM_STATS_RING_SIZE)){ is_able_to_send = true; }
+
 	Clear();
 }
 
 StatsHandler::~StatsHandler(){
-	client->SendMessage((char *)"$KILL_SOCKET", 13);
+	send(encoder.EncodeClose());
 	client->Close();
+	delete shm_ring;
 	
+	// De-allocate the counters
+	delete_padded(channels, numCards * NUM_CHAN_PER_MOD);
+	delete_padded(modules, numCards);
+
 	// De-allocate the 2d arrays
 	for(unsigned int i = 0; i < numCards; i++){
-		delete[] nEventsDelta[i];
-		delete[] nEventsTotal[i];
 		delete[] calcEventRate[i];
 		delete[] inputCountRate[i];
 		delete[] outputCountRate[i];
 	}
-	delete[] nEventsDelta;
-	delete[] nEventsTotal;
 	delete[] calcEventRate;
 	delete[] inputCountRate;
 	delete[] outputCountRate;
 	
 	// De-allocate the 1d arrays
-	delete[] dataDelta;
-	delete[] dataTotal;
 	delete[] calcDataRate;
+	delete[] fifoFillRate;
+	delete[] fifoReadLevel;
+	delete[] snapshotWords;
 }
 
 void StatsHandler::AddEvent(unsigned int mod, unsigned int ch, size_t size, int delta_/*=1*/){
@@ -86,129 +158,331 @@ void StatsHandler::AddEvent(unsigned int mod, unsigned int ch, size_t size, int
 		std::cout << "Bad channel " << ch << std::endl;
 		return;
 	}
-	nEventsDelta[mod][ch] += delta_;
-	nEventsTotal[mod][ch] += delta_;
-	dataDelta[mod] += size;
-	dataTotal[mod] += size;
+	StatsChannel &channel = channels[mod*NUM_CHAN_PER_MOD + ch];
+	channel.eventsDelta.fetch_add(delta_, std::memory_order_relaxed);
+	channel.eventsTotal.fetch_add(delta_, std::memory_order_relaxed);
+	modules[mod].dataDelta.fetch_add(size, std::memory_order_relaxed);
+	modules[mod].dataTotal.fetch_add(size, std::memory_order_relaxed);
 }
 
 /**
  *	\return Returns true if the dump interval is exceeded.
  */
 bool StatsHandler::AddTime(double dtime) {
+	std::lock_guard<std::mutex> guard(write_lock);
 	timeElapsed += dtime;
 	totalTime   += dtime;
 
+	// Keep the run time and totals seen by other threads current
+	publish();
+
 	return (timeElapsed >= dumpTime);
    
 }
 
-void StatsHandler::Dump(void){
-	if(!is_able_to_send){ return; }
+void StatsHandler::publish(){
+	unsigned int numReads = 0;
+	for(int i = FIFO_READ_THRESH; i < FIFO_READ_TYPES; i++){ numReads += readsDelta[i]; }
 
 	double dataRate = 0.0;
+	for(unsigned int i = 0; i < numCards; i++){ dataRate += calcDataRate[i]; }
+
+	// Mark the snapshot as being written. The fence keeps the stores below from being seen before it.
+	unsigned int seq = snapshotSeq.load(std::memory_order_relaxed);
+	snapshotSeq.store(seq + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	std::atomic<unsigned long long> *word = snapshotWords;
+	(word++)->store(pack_double(totalTime), std::memory_order_relaxed);
+	(word++)->store(pack_double(dataRate), std::memory_order_relaxed);
+	(word++)->store(adaptiveReadout ? 1 : 0, std::memory_order_relaxed);
+	(word++)->store(pack_double(maxLatency), std::memory_order_relaxed);
+	(word++)->store(pack_double(safetyMargin), std::memory_order_relaxed);
+	for(int i = 0; i < FIFO_READ_TYPES; i++){ (word++)->store(readsDelta[i], std::memory_order_relaxed); }
+	(word++)->store(pack_double(numReads > 0 ? latencySum / numReads : 0.0), std::memory_order_relaxed);
+	(word++)->store(pack_double(latencyMax), std::memory_order_relaxed);
+
 	for(unsigned int i = 0; i < numCards; i++){
-		dataRate += dataDelta[i];
-	}
-	dataRate /= timeElapsed;
-	if(timeElapsed<=0) dataRate = 0;
-
-	// Below is the stats packet structure (for N modules)
-	// ---------------------------------------------------
-	// 4 byte total number of pixie modules (N)
-	// 8 byte total time of run (in seconds)
-	// 8 byte total data rate (in B/s)
-	// channel 0, 0 rate
-	// channel 0, 0 total
-	// channel 0, 1 rate
-	// channel 0, 1 total
-	// ...
-	// channel 0, 15 rate
-	// channel 0, 15 total
-	// channel 1, 0 rate
-	// channel 1, 0 total
-	// ...
-	// channel N-1, 15 rate
-	// channel N-1, 15 total
-	//msg_size = 20 fixed bytes + 4 words/card/ch * numCards * 16 ch * 8 bytes/ word
-	size_t msg_size = sizeof(numCards) + sizeof(totalTime) + sizeof(dataRate) + numCards*16*(sizeof(inputCountRate[0][0])+sizeof(outputCountRate[0][0])+sizeof(calcEventRate[0][0])+sizeof(nEventsTotal[0][0]));
-	char *message = new char[msg_size];
-	char *ptr = message;
-	
-	// Construct the rate message
-	memcpy(ptr, &numCards, 4); ptr += 4;
-	memcpy(ptr, &totalTime, 8); ptr += 8;
-	memcpy(ptr, &dataRate, 8); ptr += 8;
-	for (unsigned int i=0; i < numCards; i++) {
-		calcDataRate[i] = (size_t)(dataDelta[i] / timeElapsed);
-		if (timeElapsed<=0) 
-			calcDataRate[i] = 0;
-		for (unsigned int j=0; j < NUM_CHAN_PER_MOD; j++) {	 
-			calcEventRate[i][j] = nEventsDelta[i][j] / timeElapsed;
+		(word++)->store(pack_double(calcDataRate[i]), std::memory_order_relaxed);
+		(word++)->store(modules[i].dataTotal.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		(word++)->store(pack_double(fifoFillRate[i]), std::memory_order_relaxed);
+		(word++)->store(pack_double(fifoReadLevel[i]), std::memory_order_relaxed);
+	}
+
+	for(unsigned int i = 0; i < numCards; i++){
+		for(unsigned int j = 0; j < NUM_CHAN_PER_MOD; j++){
+			(word++)->store(pack_double(calcEventRate[i][j]), std::memory_order_relaxed);
+			(word++)->store(channels[i*NUM_CHAN_PER_MOD + j].eventsTotal.load(std::memory_order_relaxed), std::memory_order_relaxed);
+			(word++)->store(pack_double(inputCountRate[i][j]), std::memory_order_relaxed);
+			(word++)->store(pack_double(outputCountRate[i][j]), std::memory_order_relaxed);
+		}
+	}
+
+	snapshotSeq.store(seq + 2, std::memory_order_release);
+}
+
+void StatsHandler::GetSnapshot(StatsSnapshot &snapshot){
+	std::vector<unsigned long long> words(numSnapshotWords);
+
+	// Copy the words until no publish overlapped the copy
+	unsigned int seq;
+	while(true){
+		seq = snapshotSeq.load(std::memory_order_acquire);
+		if(seq & 1){ continue; }
+		for(size_t i = 0; i < numSnapshotWords; i++){ words[i] = snapshotWords[i].load(std::memory_order_relaxed); }
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if(snapshotSeq.load(std::memory_order_relaxed) == seq){ break; }
+	}
+
+	snapshot.numCards = numCards;
+	snapshot.sequence = seq / 2;
+	snapshot.moduleDataRate.resize(numCards);
+	snapshot.moduleDataTotal.resize(numCards);
+	snapshot.fifoFillRate.resize(numCards);
+	snapshot.fifoReadLevel.resize(numCards);
+	snapshot.eventRate.resize(numCards * NUM_CHAN_PER_MOD);
+	snapshot.eventsTotal.resize(numCards * NUM_CHAN_PER_MOD);
+	snapshot.inputCountRate.resize(numCards * NUM_CHAN_PER_MOD);
+	snapshot.outputCountRate.resize(numCards * NUM_CHAN_PER_MOD);
+
+	const unsigned long long *word = &words[0];
+	snapshot.totalTime = unpack_double(*word++);
+	snapshot.dataRate = unpack_double(*word++);
+	snapshot.adaptiveReadout = (*word++ != 0);
+	snapshot.maxLatency = unpack_double(*word++);
+	snapshot.safetyMargin = unpack_double(*word++);
+	for(int i = 0; i < FIFO_READ_TYPES; i++){ snapshot.reads[i] = (unsigned int)*word++; }
+	snapshot.latencyMean = unpack_double(*word++);
+	snapshot.latencyMax = unpack_double(*word++);
+
+	for(unsigned int i = 0; i < numCards; i++){
+		snapshot.moduleDataRate[i] = unpack_double(*word++);
+		snapshot.moduleDataTotal[i] = *word++;
+		snapshot.fifoFillRate[i] = unpack_double(*word++);
+		snapshot.fifoReadLevel[i] = unpack_double(*word++);
+	}
+
+	for(unsigned int i = 0; i < numCards * NUM_CHAN_PER_MOD; i++){
+		snapshot.eventRate[i] = unpack_double(*word++);
+		snapshot.eventsTotal[i] = *word++;
+		snapshot.inputCountRate[i] = unpack_double(*word++);
+		snapshot.outputCountRate[i] = unpack_double(*word++);
+	}
+}
+
+void StatsHandler::Dump(void){
+	// Work out the rates of this tick and publish them
+	{
+		std::lock_guard<std::mutex> guard(write_lock);
+		for (unsigned int i=0; i < numCards; i++) {
+			calcDataRate[i] = (size_t)(modules[i].dataDelta.load(std::memory_order_relaxed) / timeElapsed);
 			if (timeElapsed<=0) 
-				calcEventRate[i][j] = 0;
-			memcpy(ptr, &inputCountRate[i][j], sizeof(inputCountRate[i][j])); ptr += sizeof(inputCountRate[i][j]);
-			memcpy(ptr, &outputCountRate[i][j], sizeof(outputCountRate[i][j])); ptr += sizeof(outputCountRate[i][j]);
-			memcpy(ptr, &calcEventRate[i][j], sizeof(calcEventRate[i][j])); ptr += sizeof(calcEventRate[i][j]);
-			memcpy(ptr, &nEventsTotal[i][j], sizeof(nEventsTotal[i][j])); ptr += sizeof(nEventsTotal[i][j]);
-		} //Update the status bar
+				calcDataRate[i] = 0;
+			for (unsigned int j=0; j < NUM_CHAN_PER_MOD; j++) {	 
+				calcEventRate[i][j] = channels[i*NUM_CHAN_PER_MOD + j].eventsDelta.load(std::memory_order_relaxed) / timeElapsed;
+				if (timeElapsed<=0) 
+					calcEventRate[i][j] = 0;
+			}
+		}
+		publish();
+
+		// Keep the rates of the tick in the history
+		if (timeElapsed > 0) {
+			std::lock_guard<std::mutex> historyGuard(history_lock);
+			double *events = history[STATS_HISTORY_EVENTS].Next();
+			double *icr = history[STATS_HISTORY_ICR].Next();
+			double *ocr = history[STATS_HISTORY_OCR].Next();
+			double *data = history[STATS_HISTORY_DATA].Next();
+			for (unsigned int i=0; i < numCards; i++) {
+				data[i] = calcDataRate[i];
+				for (unsigned int j=0; j < NUM_CHAN_PER_MOD; j++) {
+					events[i*NUM_CHAN_PER_MOD + j] = calcEventRate[i][j];
+					icr[i*NUM_CHAN_PER_MOD + j] = inputCountRate[i][j];
+					ocr[i*NUM_CHAN_PER_MOD + j] = outputCountRate[i][j];
+				}
+			}
+			for (int i=0; i < STATS_HISTORY_TYPES; i++) history[i].Commit();
+		}
 	}
-	
-	client->SendMessage(message, msg_size);
-	
-	delete[] message;
+
+	if(!is_able_to_send){ return; }
+
+	// The packet is built from the snapshot alone
+	StatsSnapshot stats;
+	GetSnapshot(stats);
+
+	// Fill the record sent to the monitors
+	std::lock_guard<std::mutex> guard(send_lock);
+	if(record.GetNumModules() != numCards){ record.Init(numCards, NUM_CHAN_PER_MOD); }
+	record.SetDouble(STATS_FIELD_TIME, stats.totalTime);
+	record.SetDouble(STATS_FIELD_DATA_RATE, stats.dataRate);
+	record.SetWord(STATS_FIELD_READOUT_MODE, stats.adaptiveReadout ? 1 : 0);
+	record.SetDouble(STATS_FIELD_MAX_LATENCY, stats.maxLatency);
+	record.SetDouble(STATS_FIELD_MARGIN, stats.safetyMargin);
+	record.SetDouble(STATS_FIELD_LATENCY_MEAN, stats.latencyMean);
+	record.SetDouble(STATS_FIELD_LATENCY_MAX, stats.latencyMax);
+	for(int i = FIFO_READ_THRESH; i < FIFO_READ_TYPES; i++){ record.SetWord(STATS_FIELD_READS + i - FIFO_READ_THRESH, stats.reads[i]); }
+	for(unsigned int i = 0; i < numCards; i++){
+		record.SetDouble(StatsRecord::ModuleField(i, STATS_MODULE_DATA_RATE), stats.moduleDataRate[i]);
+		record.SetWord(StatsRecord::ModuleField(i, STATS_MODULE_DATA_TOTAL), stats.moduleDataTotal[i]);
+		record.SetDouble(StatsRecord::ModuleField(i, STATS_MODULE_FIFO_FILL), stats.fifoFillRate[i]);
+		record.SetDouble(StatsRecord::ModuleField(i, STATS_MODULE_FIFO_LEVEL), stats.fifoReadLevel[i]);
+		for(unsigned int j = 0; j < NUM_CHAN_PER_MOD; j++){
+			record.SetDouble(record.ChannelField(i, j, STATS_CHANNEL_EVENT_RATE), stats.eventRate[i*NUM_CHAN_PER_MOD + j]);
+			record.SetWord(record.ChannelField(i, j, STATS_CHANNEL_EVENTS_TOTAL), stats.eventsTotal[i*NUM_CHAN_PER_MOD + j]);
+			record.SetDouble(record.ChannelField(i, j, STATS_CHANNEL_ICR), stats.inputCountRate[i*NUM_CHAN_PER_MOD + j]);
+			record.SetDouble(record.ChannelField(i, j, STATS_CHANNEL_OCR), stats.outputCountRate[i*NUM_CHAN_PER_MOD + j]);
+		}
+	}
+
+	// Only the fields which changed are sent, split into datagrams which fit in a frame
+	encoder.Encode(record, datagrams);
+	for(std::vector<std::string>::iterator iter = datagrams.begin(); iter != datagrams.end(); iter++){ send(*iter); }
+}
+
+void StatsHandler::send(const std::string &packet){
+	client->SendMessage((char *)packet.data(), packet.size());
+	shm_ring->Publish(SHM_RECORD_STATS, packet.data(), packet.size());
+}
+
+bool StatsHandler::SetDestination(const std::string &address){
+	std::string host = address;
+	int port = STATS_PROTO_PORT;
+	size_t colon = address.find_last_of(':');
+	if(colon != std::string::npos){
+		host = address.substr(0, colon);
+		port = atoi(address.substr(colon+1).c_str());
+	}
+	if(host.empty() || port <= 0 || port > 65535){ return false; }
+
+	client->Close();
+	if(!client->Init(host.c_str(), port)){
+		client->Close();
+		return false;
+	}
+
+	std::stringstream stream;
+	stream << host << ":" << port;
+	destination = stream.str();
+	is_able_to_send = true;
+	return true;
 }
 
 double StatsHandler::GetDataRate(size_t mod){
-	return calcDataRate[mod];
+	StatsSnapshot stats;
+	GetSnapshot(stats);
+	return (mod < numCards ? stats.moduleDataRate[mod] : 0.0);
 }
 
 double StatsHandler::GetTotalDataRate(){
-	double rate = 0;
-	for (unsigned int i=0; i < numCards; i++) rate += calcDataRate[i];
-	return rate;
+	StatsSnapshot stats;
+	GetSnapshot(stats);
+	return stats.dataRate;
 }
 
 double StatsHandler::GetEventRate(size_t mod){
-	double output = 0.0;
-	for(unsigned int i = 0; i < numCards; i++){
-		output += calcEventRate[mod][i];
-	}
-	return output;
+	StatsSnapshot stats;
+	GetSnapshot(stats);
+	return stats.GetEventRate(mod);
 }
 
 double StatsHandler::GetTotalTime() {
-	return totalTime;
+	StatsSnapshot stats;
+	GetSnapshot(stats);
+	return stats.totalTime;
+}
+
+bool StatsHandler::GetHistory(int type, size_t index, size_t window, HistorySummary &summary){
+	if(type < 0 || type >= STATS_HISTORY_TYPES){ return false; }
+	std::lock_guard<std::mutex> guard(history_lock);
+	return history[type].GetSummary(index, window, summary);
+}
+
+size_t StatsHandler::GetHistoryValues(int type, size_t index, size_t window, std::vector<double> &values){
+	values.clear();
+	if(type < 0 || type >= STATS_HISTORY_TYPES){ return 0; }
+	std::lock_guard<std::mutex> guard(history_lock);
+	return history[type].GetValues(index, window, values);
+}
+
+size_t StatsHandler::GetHistoryCount(){
+	std::lock_guard<std::mutex> guard(history_lock);
+	return history[STATS_HISTORY_EVENTS].GetCount();
 }
 
+const char *StatsHandler::HistoryName(int type){
+	switch(type){
+		case STATS_HISTORY_EVENTS: return "events";
+		case STATS_HISTORY_ICR: return "icr";
+		case STATS_HISTORY_OCR: return "ocr";
+		case STATS_HISTORY_DATA: return "data";
+		default: return "unknown";
+	}
+}
+
+/// The rates of the last tick stay published until the next Dump.
 void StatsHandler::ClearRates(){
+	std::lock_guard<std::mutex> guard(write_lock);
 	timeElapsed = 0;
 
+	for(int i = 0; i < FIFO_READ_TYPES; i++){ readsDelta[i] = 0; }
+	latencySum = 0.0;
+	latencyMax = 0.0;
+
 	for(size_t i=0; i < numCards; i++){
 		for(size_t j = 0; j < NUM_CHAN_PER_MOD; j++){
-			nEventsDelta[i][j] = 0;
+			channels[i*NUM_CHAN_PER_MOD + j].eventsDelta.store(0, std::memory_order_relaxed);
 		}
-		dataDelta[i] = 0;
-		calcDataRate[i] = 0;
+		modules[i].dataDelta.store(0, std::memory_order_relaxed);
 	}
 }
 
 void StatsHandler::SetXiaRates(int mod, std::vector<std::pair<double, double> > *xiaRates) {
+	std::lock_guard<std::mutex> guard(write_lock);
 	for (int ch = 0; ch < NUM_CHAN_PER_MOD; ch++) {
 		inputCountRate[mod][ch] = xiaRates->at(ch).first;
 		outputCountRate[mod][ch] = xiaRates->at(ch).second;
 	}
 }
+void StatsHandler::AddRead(int reason, double latency){
+	if(reason < 0 || reason >= FIFO_READ_TYPES){ return; }
+	std::lock_guard<std::mutex> guard(write_lock);
+	readsDelta[reason]++;
+	latencySum += latency;
+	if(latency > latencyMax){ latencyMax = latency; }
+}
+
+void StatsHandler::SetFifoLevels(int mod, double fillRate, double readLevel){
+	if(mod < 0 || (unsigned int)mod >= numCards){ return; }
+	std::lock_guard<std::mutex> guard(write_lock);
+	fifoFillRate[mod] = fillRate;
+	fifoReadLevel[mod] = readLevel;
+}
+
+void StatsHandler::SetReadoutMode(bool adaptive, double maxLatency_, double margin){
+	std::lock_guard<std::mutex> guard(write_lock);
+	adaptiveReadout = adaptive;
+	maxLatency = maxLatency_;
+	safetyMargin = margin;
+}
+
 void StatsHandler::ClearTotals(){
+	std::lock_guard<std::mutex> guard(write_lock);
 	totalTime = 0;
 	for(size_t i=0; i < numCards; i++){
 		for(size_t j = 0; j < NUM_CHAN_PER_MOD; j++){
-			nEventsTotal[i][j] = 0;
+			channels[i*NUM_CHAN_PER_MOD + j].eventsTotal.store(0, std::memory_order_relaxed);
 		}
+		modules[i].dataTotal.store(0, std::memory_order_relaxed);
 	}
+	publish();
 }
 
 void StatsHandler::Clear(){
 	ClearRates();
 	ClearTotals();
+
+	// Monitors are sent every field of the next dump
+	std::lock_guard<std::mutex> guard(send_lock);
+	encoder.Reset();
 }
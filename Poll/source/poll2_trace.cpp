@@ -0,0 +1,163 @@
+/** \file poll2_trace.cpp
+  *
+  * \brief Records how long each spill spends in every stage of the poll2 readout
+  *
+  * \date Oct. 18th, 2026
+  *
+  * The trace ring is written by the sink alone. A slot is filled before the
+  * head is moved past it, so a reader which copies the ring and then checks
+  * the head again knows which of the slots it copied may have been reused
+  * while it was copying, and leaves them out.
+*/
+
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+
+#include "poll2_trace.h"
+#include "poll2_fifo.h"
+
+LatencyHistogram::LatencyHistogram(){
+	Clear();
+}
+
+void LatencyHistogram::Add(double time_){
+	size_t bin = 0;
+	double micro = time_ * 1E6;
+	if(micro >= 1.0){
+		int exponent;
+		double mantissa = frexp(micro, &exponent); // micro = mantissa * 2^exponent, 0.5 <= mantissa < 1
+		size_t octave = exponent - 1;
+		size_t step = (size_t)((2.0 * mantissa - 1.0) * TRACE_BIN_STEPS);
+		bin = (octave < TRACE_BIN_OCTAVES ? 1 + octave * TRACE_BIN_STEPS + step : TRACE_BINS - 1);
+	}
+
+	bins[bin].fetch_add(1, std::memory_order_relaxed);
+	count.fetch_add(1, std::memory_order_relaxed);
+	sum.store(sum.load(std::memory_order_relaxed) + time_, std::memory_order_relaxed); // Only one thread adds times
+	if(time_ > max.load(std::memory_order_relaxed)){ max.store(time_, std::memory_order_relaxed); }
+}
+
+void LatencyHistogram::Clear(){
+	for(size_t bin = 0; bin < TRACE_BINS; bin++){ bins[bin] = 0; }
+	count = 0;
+	sum = 0.0;
+	max = 0.0;
+}
+
+double LatencyHistogram::GetPercentile(double fraction_){
+	unsigned long long total = GetCount();
+	if(total == 0){ return 0.0; }
+
+	unsigned long long wanted = (unsigned long long)ceil(fraction_ * total);
+	if(wanted < 1){ wanted = 1; }
+
+	unsigned long long seen = 0;
+	for(size_t bin = 0; bin < TRACE_BINS; bin++){
+		seen += bins[bin].load(std::memory_order_relaxed);
+		if(seen < wanted){ continue; }
+
+		// Take the upper edge of the bin, but never more than the longest time seen
+		double edge = GetEdge(bin);
+		return (edge < GetMax() ? edge : GetMax());
+	}
+
+	return GetMax();
+}
+
+double LatencyHistogram::GetEdge(size_t bin_){
+	if(bin_ == 0){ return 1E-6; }
+	size_t octave = (bin_ - 1) / TRACE_BIN_STEPS;
+	size_t step = (bin_ - 1) % TRACE_BIN_STEPS;
+	return ldexp(1.0 + (step + 1.0) / TRACE_BIN_STEPS, octave) * 1E-6;
+}
+
+SpillTracer::SpillTracer() : head(0), clear_due(false) { }
+
+void SpillTracer::Add(const double *stamps_, unsigned int nWords_, int trigger_){
+	if(clear_due.exchange(false)){
+		for(int stage = 0; stage < TRACE_STAGES; stage++){ stages[stage].Clear(); }
+		head.store(0, std::memory_order_release);
+	}
+
+	for(int stage = 0; stage < TRACE_STAGES; stage++){
+		double start = stamps_[stage == TRACE_TOTAL ? TRACE_CHECK : stage];
+		double stop = stamps_[stage == TRACE_TOTAL ? TRACE_SEND : stage + 1];
+		if(start > 0.0 && stop >= start){ stages[stage].Add(stop - start); }
+	}
+
+	unsigned long long current = head.load(std::memory_order_relaxed);
+	SpillTrace &trace = ring[current % TRACE_RING_SIZE];
+	trace.spill = current;
+	trace.nWords = nWords_;
+	trace.trigger = trigger_;
+	for(int stamp = 0; stamp < TRACE_STAMPS; stamp++){ trace.stamps[stamp] = stamps_[stamp]; }
+
+	head.store(current + 1, std::memory_order_release);
+}
+
+void SpillTracer::Snapshot(std::vector<SpillTrace> &traces_){
+	traces_.clear();
+
+	unsigned long long stop = head.load(std::memory_order_acquire);
+	unsigned long long start = (stop > TRACE_RING_SIZE ? stop - TRACE_RING_SIZE : 0);
+	traces_.reserve(stop - start);
+	for(unsigned long long index = start; index < stop; index++){ traces_.push_back(ring[index % TRACE_RING_SIZE]); }
+
+	// Leave out the slots the sink may have moved on to while they were copied
+	std::atomic_thread_fence(std::memory_order_acquire);
+	unsigned long long now = head.load(std::memory_order_relaxed);
+	if(now < stop){ // Cleared while copying
+		traces_.clear();
+		return;
+	}
+	unsigned long long valid = (now + 1 > TRACE_RING_SIZE ? now + 1 - TRACE_RING_SIZE : 0);
+	size_t stale = (valid > start ? valid - start : 0);
+	if(stale > traces_.size()){ stale = traces_.size(); }
+	traces_.erase(traces_.begin(), traces_.begin() + stale);
+}
+
+int SpillTracer::DumpChrome(const std::string &fname_){
+	std::ofstream file(fname_.c_str());
+	if(!file.good()){ return -1; }
+
+	std::vector<SpillTrace> traces;
+	Snapshot(traces);
+
+	// The reader, validator and sink are shown as threads 1, 2 and 3
+	const int threads[TRACE_TOTAL] = {1, 2, 3, 3};
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"reader\"}},\n";
+	file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"validator\"}},\n";
+	file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":3,\"args\":{\"name\":\"sink\"}}";
+
+	// Times are given in us from the first stamp in the file
+	double origin = (traces.empty() ? 0.0 : traces.front().stamps[TRACE_CHECK]);
+	file << std::fixed << std::setprecision(3);
+	for(std::vector<SpillTrace>::iterator iter = traces.begin(); iter != traces.end(); iter++){
+		for(int stage = 0; stage < TRACE_TOTAL; stage++){
+			double start = iter->stamps[stage];
+			double stop = iter->stamps[stage + 1];
+			if(start <= 0.0 || stop < start){ continue; }
+			file << ",\n{\"name\":\"" << StageName(stage) << "\",\"cat\":\"spill\",\"ph\":\"X\",\"pid\":1,\"tid\":" << threads[stage];
+			file << ",\"ts\":" << (start - origin) * 1E6 << ",\"dur\":" << (stop - start) * 1E6;
+			file << ",\"args\":{\"spill\":" << iter->spill << ",\"words\":" << iter->nWords << ",\"trigger\":\"" << FifoController::ReasonName(iter->trigger) << "\"}}";
+		}
+	}
+	file << "\n]}\n";
+
+	if(!file.good()){ return -1; }
+	return (int)traces.size();
+}
+
+const char *SpillTracer::StageName(int stage_){
+	// Every stage but the total ends at the stamp after the one it is numbered by
+	switch(stage_){
+		case TRACE_CHECK: return "read";
+		case TRACE_READ: return "parse";
+		case TRACE_PARSE: return "write";
+		case TRACE_WRITE: return "send";
+		case TRACE_TOTAL: return "total";
+		default: return "unknown";
+	}
+}
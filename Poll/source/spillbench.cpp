@@ -0,0 +1,530 @@
+/** \file spillbench.cpp
+  *
+  * \brief Benchmarks the poll2 spill transports over the loopback interface
+  *
+  * \date Oct. 18th, 2026
+  *
+  * Synthetic spills of a given size are sent at a given rate (or as fast as
+  * possible) through one of the transports poll2 uses to pass spills to
+  * ScanMain and pacman, and are received by one or more receiver threads in
+  * the same way the real readers do. Every spill carries its send time and a
+  * known pattern, so the throughput, loss and latency percentiles of each
+  * transport can be measured and compared. Results are printed as text or,
+  * with --json, as a single JSON object.
+  *
+  * Transports:
+  *  udp    - shm spills split into chunks by a SpillSender (--mcast to send to a
+  *           multicast group). A fraction of the outgoing chunks (and of the
+  *           NACKs) may be thrown away to test reliable mode.
+  *  pacman - classic pacman datagrams from a PacSender.
+  *  ring   - the shared memory ring (ShmWriter and ShmReader).
+  *  stream - the TCP or Unix domain socket StreamServer.
+  * With --pace, the sender is rate limited by a TokenBucket like poll2 with
+  * the pace command.
+  *
+  * \version 2.0
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "poll2_socket.h"
+#include "poll2_spill.h"
+#include "poll2_pac.h"
+#include "poll2_shm.h"
+#include "poll2_stream.h"
+#include "poll2_pacer.h"
+
+typedef std::chrono::steady_clock bench_clock;
+
+// Pattern word used to check the contents of each spill
+#define PATTERN_MULT 2654435761u
+
+// Name of the shared memory ring used by the benchmark (not the one used by poll2)
+#define BENCH_RING "/spillbench_ring"
+
+// Time the receivers keep going after the last spill is sent (in seconds)
+#define BENCH_LINGER 0.5
+
+std::string transport = "udp";
+unsigned int num_spills = 1000;
+unsigned int num_words = 100000;
+double spill_rate = 100.0;
+double loss_rate = 0.0;
+double nack_loss_rate = 0.0;
+unsigned int window = SHM_SEND_WINDOW;
+bool reliable = true;
+int port = 5557;
+bool json_output = false;
+
+std::atomic<bool> sender_done(false);
+
+std::string mcast_group = "";
+std::string mcast_iface = "127.0.0.1";
+unsigned int num_receivers = 1;
+
+size_t ring_size = SHM_SPILL_RING_SIZE; // MB
+std::string stream_address = ""; // Uses the port by default
+
+double pace_rate = 0.0; // MB/s
+double pace_burst = PACE_DEFAULT_BURST/1024; // kB
+
+/// Results gathered by a single receiver thread.
+struct RecvResults{
+	unsigned long long num_received;
+	unsigned long long num_corrupt;
+	unsigned long long num_recovered; /// Spills which needed retransmitted chunks (udp)
+	unsigned long long nacks; /// NACKs sent (udp)
+	unsigned long long dropped; /// Spills the receiver knows it lost
+	unsigned long long dgrams_dropped; /// Datagrams lost or unused, or ring overruns
+	double first_time, last_time; /// Arrival time of the first and last good spill
+	std::vector<double> latency; /// Latency of every good spill (in seconds)
+
+	RecvResults() : num_received(0), num_corrupt(0), num_recovered(0), nacks(0), dropped(0), dgrams_dropped(0), first_time(0.0), last_time(0.0) {}
+};
+
+double get_time(){
+	return std::chrono::duration<double>(bench_clock::now().time_since_epoch()).count();
+}
+
+/// Check the pattern of a received spill and record its latency.
+void check_spill(const unsigned int *data_, unsigned int nWords_, bool recovered_, RecvResults *results_){
+	double now = get_time();
+
+	bool good = (nWords_ == num_words);
+	for(unsigned int i = 3; good && i < nWords_; i++){
+		if(data_[i] != data_[0]*PATTERN_MULT + i){ good = false; }
+	}
+	if(!good){
+		results_->num_corrupt++;
+		return;
+	}
+
+	double sent;
+	memcpy(&sent, &data_[1], sizeof(double));
+
+	if(results_->num_received == 0){ results_->first_time = now; }
+	results_->last_time = now;
+	results_->num_received++;
+	if(recovered_){ results_->num_recovered++; }
+	results_->latency.push_back(now - sent);
+}
+
+/// Return true while the receiver should keep going.
+bool keep_receiving(double &stop_time_){
+	if(sender_done && stop_time_ < 0.0){ stop_time_ = get_time() + BENCH_LINGER; }
+	return (stop_time_ < 0.0 || get_time() < stop_time_);
+}
+
+void start_udp_receiver(Server *server_, RecvResults *results_){
+	SpillReceiver receiver(server_);
+	receiver.SetNackLoss(nack_loss_rate);
+	int dummy;
+
+	// Keep going for a little while after the sender finishes, so late retransmissions arrive
+	double stop_time = -1.0;
+	while(keep_receiving(stop_time)){
+		server_->Select(dummy);
+		while(receiver.Receive()){
+			check_spill(receiver.GetSpill(), receiver.GetSpillWords(), receiver.GetSpillRecovered(), results_);
+		}
+	}
+
+	results_->nacks = receiver.GetNacksSent();
+	results_->dropped = receiver.GetSpillsDropped();
+	results_->dgrams_dropped = receiver.GetDatagramsDropped();
+}
+
+void start_pac_receiver(Server *server_, RecvResults *results_){
+	PacReceiver receiver(server_);
+	int dummy;
+
+	double stop_time = -1.0;
+	while(keep_receiving(stop_time)){
+		server_->Select(dummy);
+		while(receiver.Receive()){
+			check_spill(receiver.GetSpill(), receiver.GetSpillWords(), false, results_);
+		}
+	}
+
+	results_->dropped = receiver.GetSpillsDropped();
+	results_->dgrams_dropped = receiver.GetDatagramsLost();
+}
+
+void start_ring_receiver(ShmReader *reader_, RecvResults *results_){
+	std::vector<unsigned int> buffer;
+	unsigned int type;
+	size_t nBytes;
+
+	double stop_time = -1.0;
+	while(keep_receiving(stop_time)){
+		reader_->Wait(10);
+		while(reader_->Read(buffer, type, nBytes)){
+			if(type == SHM_RECORD_SPILL){ check_spill(&buffer[0], nBytes/sizeof(unsigned int), false, results_); }
+		}
+	}
+
+	results_->dropped = reader_->GetRecordsMissed();
+	results_->dgrams_dropped = reader_->GetOverruns();
+}
+
+void start_stream_receiver(StreamReader *reader_, RecvResults *results_){
+	std::vector<unsigned int> buffer;
+	unsigned int type;
+	size_t nBytes;
+
+	double stop_time = -1.0;
+	while(keep_receiving(stop_time)){
+		reader_->Wait(10);
+		while(reader_->Read(buffer, type, nBytes)){
+			if(type == SHM_RECORD_SPILL){ check_spill(&buffer[0], nBytes/sizeof(unsigned int), false, results_); }
+		}
+		if(!reader_->IsInit()){ break; } // The server went away
+	}
+
+	results_->dropped = reader_->GetRecordsMissed();
+}
+
+/// Return the given percentile of a sorted list of values.
+double percentile(const std::vector<double> &sorted_, double percent_){
+	if(sorted_.empty()){ return 0.0; }
+	size_t index = (size_t)(percent_ / 100.0 * (sorted_.size() - 1) + 0.5);
+	return sorted_[index];
+}
+
+/// Summary of a receiver's results, computed once the run is over.
+struct RecvSummary{
+	unsigned long long lost;
+	double throughput; /// MB/s of good spills received
+	double mean, p50, p90, p99, p999, max; /// Latency (in ms)
+};
+
+RecvSummary summarize(RecvResults &results_, double start_time_){
+	RecvSummary summary;
+	summary.lost = num_spills - results_.num_received - results_.num_corrupt;
+
+	double elapsed = results_.last_time - start_time_;
+	summary.throughput = (elapsed > 0.0 ? results_.num_received * num_words * sizeof(unsigned int) / elapsed / 1E6 : 0.0);
+
+	std::vector<double> &latency = results_.latency;
+	std::sort(latency.begin(), latency.end());
+	double sum = 0.0;
+	for(std::vector<double>::iterator iter = latency.begin(); iter != latency.end(); iter++){ sum += *iter; }
+	summary.mean = (latency.empty() ? 0.0 : 1E3*sum/latency.size());
+	summary.p50 = 1E3*percentile(latency, 50.0);
+	summary.p90 = 1E3*percentile(latency, 90.0);
+	summary.p99 = 1E3*percentile(latency, 99.0);
+	summary.p999 = 1E3*percentile(latency, 99.9);
+	summary.max = (latency.empty() ? 0.0 : 1E3*latency.back());
+
+	return summary;
+}
+
+void print_results(const RecvResults &results_, const RecvSummary &summary_){
+	std::cout << " Spills received:    " << results_.num_received << " (" << 100.0*results_.num_received/num_spills << "%)";
+	if(transport == "udp"){ std::cout << ", " << results_.num_recovered << " recovered"; }
+	std::cout << std::endl;
+	std::cout << " Spills lost:        " << summary_.lost << " (" << results_.dropped << " known to the receiver)\n";
+	std::cout << " Spills corrupt:     " << results_.num_corrupt << std::endl;
+	std::cout << " Throughput:         " << summary_.throughput << " MB/s\n";
+	std::cout << " Latency (ms):       mean " << summary_.mean << ", p50 " << summary_.p50 << ", p90 " << summary_.p90 << ", p99 " << summary_.p99;
+	std::cout << ", p99.9 " << summary_.p999 << ", max " << summary_.max << std::endl;
+	if(transport == "udp"){
+		std::cout << " NACKs sent:         " << results_.nacks << std::endl;
+		std::cout << " Datagrams unused:   " << results_.dgrams_dropped << std::endl;
+	}
+	else if(transport == "pacman"){ std::cout << " Datagrams lost:     " << results_.dgrams_dropped << std::endl; }
+	else if(transport == "ring"){ std::cout << " Overruns:           " << results_.dgrams_dropped << std::endl; }
+}
+
+void print_json(const RecvResults &results_, const RecvSummary &summary_, bool last_){
+	std::cout << "    {\"received\": " << results_.num_received << ", \"lost\": " << summary_.lost << ", \"corrupt\": " << results_.num_corrupt;
+	std::cout << ", \"known_lost\": " << results_.dropped << ", \"recovered\": " << results_.num_recovered;
+	std::cout << ", \"nacks\": " << results_.nacks << ", \"dgrams_dropped\": " << results_.dgrams_dropped;
+	std::cout << ", \"throughput_MBps\": " << summary_.throughput;
+	std::cout << ", \"latency_ms\": {\"mean\": " << summary_.mean << ", \"p50\": " << summary_.p50 << ", \"p90\": " << summary_.p90;
+	std::cout << ", \"p99\": " << summary_.p99 << ", \"p99.9\": " << summary_.p999 << ", \"max\": " << summary_.max << "}}" << (last_ ? "\n" : ",\n");
+}
+
+void help(char *name_){
+	std::cout << " SYNTAX: " << name_ << " [options]\n";
+	std::cout << "  Available options:\n";
+	std::cout << "   --help               - Display this dialogue\n";
+	std::cout << "   --transport [name]   - Transport to benchmark, udp, pacman, ring or stream (default=" << transport << ")\n";
+	std::cout << "   --spills [num]       - Number of spills to send (default=" << num_spills << ")\n";
+	std::cout << "   --words [num]        - Number of words in each spill (default=" << num_words << ")\n";
+	std::cout << "   --rate [num]         - Number of spills sent per second, 0 to send as fast as possible (default=" << spill_rate << ")\n";
+	std::cout << "   --receivers [num]    - Number of receivers (multicast, ring and stream only, default=" << num_receivers << ")\n";
+	std::cout << "   --json               - Print the results as JSON\n";
+	std::cout << "   --pace [MB/s]        - Limit the rate the sender sends at (udp and pacman only, default=no limit)\n";
+	std::cout << "   --burst [kB]         - Largest burst allowed by the pacer (default=" << pace_burst << ")\n";
+	std::cout << "   --port [port]        - Loopback port to use (default=" << port << ")\n";
+	std::cout << "  udp options:\n";
+	std::cout << "   --loss [fraction]    - Fraction of chunks thrown away by the sender (default=" << loss_rate << ")\n";
+	std::cout << "   --nack-loss [frac]   - Fraction of NACKs thrown away by the receiver (default=" << nack_loss_rate << ")\n";
+	std::cout << "   --window [spills]    - Number of spills kept for retransmission (default=" << window << ")\n";
+	std::cout << "   --unreliable         - Do not retransmit lost chunks\n";
+	std::cout << "   --mcast [group]      - Send to a multicast group on the loopback interface instead\n";
+	std::cout << "  ring and stream options:\n";
+	std::cout << "   --ring-size [MB]     - Size of the shared memory ring (default=" << ring_size << ")\n";
+	std::cout << "   --stream [addr]      - Stream server port or Unix socket path (default=the loopback port)\n";
+}
+
+int main(int argc, char *argv[]){
+	for(int i = 1; i < argc; i++){
+		std::string arg = argv[i];
+		if(arg == "--help" || arg == "-h"){
+			help(argv[0]);
+			return 0;
+		}
+		else if(arg == "--unreliable"){ reliable = false; }
+		else if(arg == "--json"){ json_output = true; }
+		else if(i+1 < argc && arg == "--transport"){ transport = argv[++i]; }
+		else if(i+1 < argc && arg == "--spills"){ num_spills = atoi(argv[++i]); }
+		else if(i+1 < argc && arg == "--words"){ num_words = atoi(argv[++i]); }
+		else if(i+1 < argc && arg == "--rate"){ spill_rate = atof(argv[++i]); }
+		else if(i+1 < argc && arg == "--loss"){ loss_rate = atof(argv[++i]); }
+		else if(i+1 < argc && arg == "--nack-loss"){ nack_loss_rate = atof(argv[++i]); }
+		else if(i+1 < argc && arg == "--window"){ window = atoi(argv[++i]); }
+		else if(i+1 < argc && arg == "--port"){ port = atoi(argv[++i]); }
+		else if(i+1 < argc && arg == "--mcast"){ mcast_group = argv[++i]; }
+		else if(i+1 < argc && arg == "--receivers"){ num_receivers = atoi(argv[++i]); }
+		else if(i+1 < argc && arg == "--pace"){ pace_rate = atof(argv[++i]); }
+		else if(i+1 < argc && arg == "--burst"){ pace_burst = atof(argv[++i]); }
+		else if(i+1 < argc && arg == "--ring-size"){ ring_size = atoi(argv[++i]); }
+		else if(i+1 < argc && arg == "--stream"){ stream_address = argv[++i]; }
+		else{
+			std::cout << " Error: Invalid option '" << arg << "'!\n";
+			help(argv[0]);
+			return 1;
+		}
+	}
+
+	if(transport != "udp" && transport != "pacman" && transport != "ring" && transport != "stream"){
+		std::cout << " Error: Unknown transport '" << transport << "'!\n";
+		return 1;
+	}
+	if(num_spills == 0 || num_words < 3 || spill_rate < 0.0){
+		std::cout << " Error: Spills must have at least 3 words and the rate must not be negative!\n";
+		return 1;
+	}
+
+	bool is_udp = (transport == "udp" || transport == "pacman");
+	bool fan_out = (transport == "ring" || transport == "stream" || !mcast_group.empty());
+	if(!fan_out || num_receivers == 0){ num_receivers = 1; }
+	if(transport != "udp"){ mcast_group = ""; }
+
+	// Open the sending side and the receivers' sockets
+	std::vector<Server> servers(is_udp ? num_receivers : 0);
+	Client client;
+	TokenBucket pacer;
+	ShmWriter ring;
+	StreamServer stream_server;
+	std::vector<ShmReader> ring_readers(transport == "ring" ? num_receivers : 0);
+	std::vector<StreamReader> stream_readers(transport == "stream" ? num_receivers : 0);
+
+	if(is_udp){
+		for(unsigned int i = 0; i < num_receivers; i++){
+			bool retval;
+			if(mcast_group.empty()){ retval = servers[i].Init(port, 0, 10000); }
+			else{ retval = servers[i].InitMulticast(mcast_group.c_str(), port, mcast_iface.c_str(), 0, 10000); }
+			if(!retval){
+				std::cout << " Error: Failed to open port " << port << " for receiver " << i << "!\n";
+				return 1;
+			}
+		}
+
+		if(!client.Init((mcast_group.empty() ? "127.0.0.1" : mcast_group.c_str()), port)){
+			std::cout << " Error: Failed to open client socket!\n";
+			return 1;
+		}
+		if(!mcast_group.empty() && !client.SetMulticast(MULTICAST_TTL, mcast_iface.c_str())){
+			std::cout << " Error: Failed to set multicast options!\n";
+			return 1;
+		}
+
+		pacer.SetRate(pace_rate*1E6, pace_burst*1024);
+		client.SetPacer(&pacer);
+	}
+	else if(transport == "ring"){
+		if(!ring.Init(BENCH_RING, ring_size*1048576, SHM_OVERRUN_LAP)){
+			std::cout << " Error: Failed to create shared memory ring " << BENCH_RING << "!\n";
+			return 1;
+		}
+		for(unsigned int i = 0; i < num_receivers; i++){
+			if(!ring_readers[i].Init(BENCH_RING)){
+				std::cout << " Error: Failed to attach receiver " << i << " to the shared memory ring!\n";
+				return 1;
+			}
+		}
+	}
+	else{
+		std::stringstream stream;
+		stream << port;
+		std::string address = (stream_address.empty() ? stream.str() : stream_address);
+		if(!stream_server.Init(address)){
+			std::cout << " Error: Failed to start stream server on " << address << "!\n";
+			return 1;
+		}
+		if(address.find('/') == std::string::npos){ address = "127.0.0.1:" + address; }
+		for(unsigned int i = 0; i < num_receivers; i++){
+			if(!stream_readers[i].Init(address)){
+				std::cout << " Error: Failed to connect receiver " << i << " to the stream server!\n";
+				return 1;
+			}
+		}
+
+		// Wait for the server to accept every receiver
+		double timeout = get_time() + 2.0;
+		while(stream_server.GetNumClients() < num_receivers && get_time() < timeout){
+			stream_server.Service();
+			usleep(1000);
+		}
+	}
+
+	SpillSender sender(&client);
+	sender.SetReliable(reliable, window);
+	sender.SetLossRate(loss_rate);
+
+	PacSender pac_sender(&client);
+
+	if(!json_output){
+		std::cout << " Sending " << num_spills << " spills of " << num_words << " words over " << transport << " at ";
+		if(spill_rate > 0.0){ std::cout << spill_rate << " spills/s\n"; }
+		else{ std::cout << "full speed\n"; }
+		if(transport == "udp"){
+			std::cout << " Chunk loss " << loss_rate << ", NACK loss " << nack_loss_rate << ", ";
+			if(reliable){ std::cout << "reliable mode (window of " << window << " spills)\n"; }
+			else{ std::cout << "unreliable mode\n"; }
+		}
+		if(!mcast_group.empty()){ std::cout << " Multicast to " << mcast_group << " on " << mcast_iface << " with " << num_receivers << " receivers\n"; }
+		else if(num_receivers > 1){ std::cout << " Fanning out to " << num_receivers << " receivers\n"; }
+		if(pacer.IsActive()){ std::cout << " Paced at " << pace_rate << " MB/s with bursts of " << pace_burst << " kB\n"; }
+	}
+
+	std::vector<RecvResults> results(num_receivers);
+	std::vector<std::thread> recvthreads;
+	for(unsigned int i = 0; i < num_receivers; i++){
+		if(transport == "udp"){ recvthreads.push_back(std::thread(start_udp_receiver, &servers[i], &results[i])); }
+		else if(transport == "pacman"){ recvthreads.push_back(std::thread(start_pac_receiver, &servers[i], &results[i])); }
+		else if(transport == "ring"){ recvthreads.push_back(std::thread(start_ring_receiver, &ring_readers[i], &results[i])); }
+		else{ recvthreads.push_back(std::thread(start_stream_receiver, &stream_readers[i], &results[i])); }
+	}
+
+	// Answer NACKs and continue sending queued stream records
+	auto service = [&](){
+		if(transport == "udp"){ sender.ServiceNacks(); }
+		else if(transport == "stream"){ stream_server.Service(); }
+	};
+
+	std::vector<unsigned int> data(num_words);
+	double start_time = get_time();
+	double send_time = 0.0, send_max = 0.0;
+	for(unsigned int spill = 0; spill < num_spills; spill++){
+		data[0] = spill;
+		for(unsigned int i = 3; i < num_words; i++){ data[i] = spill*PATTERN_MULT + i; }
+
+		double now = get_time();
+		memcpy(&data[1], &now, sizeof(double));
+		if(transport == "udp"){ sender.Send(&data[0], num_words); }
+		else if(transport == "pacman"){ pac_sender.Send(&data[0], num_words); }
+		else if(transport == "ring"){ ring.Publish(SHM_RECORD_SPILL, &data[0], num_words*sizeof(unsigned int)); }
+		else{ stream_server.Publish(SHM_RECORD_SPILL, &data[0], num_words*sizeof(unsigned int)); }
+
+		double sent = get_time() - now;
+		send_time += sent;
+		if(sent > send_max){ send_max = sent; }
+
+		if(spill_rate <= 0.0){
+			service();
+			continue;
+		}
+
+		// Service the transport until it is time for the next spill
+		double next_time = start_time + (spill + 1) / spill_rate;
+		do{
+			service();
+			usleep(200);
+		} while(get_time() < next_time);
+	}
+	double end_time = get_time();
+
+	// Answer any last NACKs and drain the stream queues
+	double linger_time = get_time() + 0.25;
+	while(get_time() < linger_time){
+		service();
+		usleep(200);
+		if(transport == "stream"){
+			std::vector<StreamClientInfo> clients;
+			stream_server.GetClients(clients);
+			bool drained = true;
+			for(size_t i = 0; i < clients.size(); i++){
+				if(clients[i].queued_bytes > 0){ drained = false; }
+			}
+			if(!drained){ linger_time = get_time() + 0.25; }
+		}
+	}
+	sender_done = true;
+
+	for(unsigned int i = 0; i < num_receivers; i++){ recvthreads[i].join(); }
+
+	double offered = num_spills * num_words * sizeof(unsigned int) / (end_time - start_time) / 1E6;
+
+	std::vector<RecvSummary> summaries;
+	for(unsigned int i = 0; i < num_receivers; i++){ summaries.push_back(summarize(results[i], start_time)); }
+
+	if(json_output){
+		std::cout << std::fixed << std::setprecision(3);
+		std::cout << "{\n  \"transport\": \"" << transport << "\",\n";
+		std::cout << "  \"spills\": " << num_spills << ", \"words\": " << num_words << ", \"rate\": " << spill_rate;
+		std::cout << ", \"pace_MBps\": " << pace_rate << ", \"reliable\": " << (reliable ? "true" : "false") << ", \"loss\": " << loss_rate << ",\n";
+		std::cout << "  \"send_duration_s\": " << end_time - start_time << ", \"offered_MBps\": " << offered;
+		std::cout << ", \"send_time_ms\": {\"mean\": " << 1E3*send_time/num_spills << ", \"max\": " << 1E3*send_max << "},\n";
+		if(transport == "udp"){
+			std::cout << "  \"chunks_sent\": " << sender.GetChunksSent() << ", \"chunks_resent\": " << sender.GetChunksResent();
+			std::cout << ", \"nacks_received\": " << sender.GetNacksReceived() << ",\n";
+		}
+		else if(transport == "pacman"){ std::cout << "  \"datagrams_sent\": " << pac_sender.GetDatagramsSent() << ",\n"; }
+		else if(transport == "stream"){ std::cout << "  \"spills_skipped\": " << stream_server.GetSkipped() << ",\n"; }
+		std::cout << "  \"receivers\": [\n";
+		for(unsigned int i = 0; i < num_receivers; i++){ print_json(results[i], summaries[i], i == num_receivers - 1); }
+		std::cout << "  ]\n}\n";
+	}
+	else{
+		std::cout << std::fixed << std::setprecision(3);
+		std::cout << "\n Spills sent:        " << num_spills << " in " << end_time - start_time << " s (" << offered << " MB/s offered)\n";
+		std::cout << " Send time:          mean " << 1E3*send_time/num_spills << " ms, max " << 1E3*send_max << " ms\n";
+		if(transport == "udp"){
+			std::cout << " Chunks sent:        " << sender.GetChunksSent() << " (" << sender.GetChunksLost() << " thrown away)\n";
+			std::cout << " Chunks resent:      " << sender.GetChunksResent() << " (" << sender.GetChunksExpired() << " requested after leaving the window)\n";
+			std::cout << " NACKs received:     " << sender.GetNacksReceived() << std::endl;
+		}
+		else if(transport == "pacman"){ std::cout << " Datagrams sent:     " << pac_sender.GetDatagramsSent() << std::endl; }
+		else if(transport == "stream"){ std::cout << " Spills skipped:     " << stream_server.GetSkipped() << " (slow receivers)\n"; }
+		if(pacer.IsActive()){ std::cout << " Pacer waits:        " << pacer.GetWaits() << " (" << pacer.GetWaitTime() << " s)\n"; }
+		for(unsigned int i = 0; i < num_receivers; i++){
+			if(num_receivers > 1){ std::cout << "\n Receiver " << i << ":\n"; }
+			else{ std::cout << std::endl; }
+			print_results(results[i], summaries[i]);
+		}
+	}
+
+	for(unsigned int i = 0; i < servers.size(); i++){ servers[i].Close(); }
+	for(unsigned int i = 0; i < ring_readers.size(); i++){ ring_readers[i].Close(); }
+	for(unsigned int i = 0; i < stream_readers.size(); i++){ stream_readers[i].Close(); }
+	client.Close();
+	ring.Close();
+	stream_server.Close();
+
+	return 0;
+}